@@ -0,0 +1,283 @@
+// BMP decode and encode throughput, for each of the common bit depths.
+//
+//   node bench/bmp.js [--iterations N] [--json] [--baseline FILE]
+//
+// Files are synthetic (no display needed) and written to the temp directory
+// first. --baseline takes the --json output of an earlier run (say, of an
+// older build) and prints the speedup against it; depths that build could
+// not read show up there as unsupported.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var robot = require('..');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var iterations = 10;
+var baseline = null;
+if (args.indexOf('--iterations') !== -1)
+{
+    iterations = parseInt(args[args.indexOf('--iterations') + 1], 10);
+}
+if (args.indexOf('--baseline') !== -1)
+{
+    baseline = JSON.parse(fs.readFileSync(args[args.indexOf('--baseline') + 1], 'utf8'));
+}
+
+var width = 1920;
+var height = 1080;
+
+// A desktop-ish picture as palette indices: a title bar, a flat side panel
+// and lines of "text".
+function makeIndices()
+{
+    var indices = new Uint8Array(width * height);
+    var seed = 1;
+
+    for (var y = 0; y < height; y++)
+    {
+        for (var x = 0; x < width; x++)
+        {
+            var index;
+            if (y < height / 10)
+            {
+                index = 16 + (x * 60 / width) | 0;
+            }
+            else if (x < width / 5)
+            {
+                index = 1;
+            }
+            else if ((y >> 4) % 2 === 0 && (x >> 3) % 3 !== 0)
+            {
+                seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+                index = (seed >> 16) & 1 ? 2 : 3;
+            }
+            else
+            {
+                index = 3;
+            }
+            indices[y * width + x] = index;
+        }
+    }
+
+    return indices;
+}
+
+function makePalette()
+{
+    var palette = [[0, 0, 0], [240, 240, 240], [30, 30, 30], [255, 255, 255]];
+    for (var i = 4; i < 256; i++)
+    {
+        palette.push([200, 120 + (i - 16) % 60, 40]);
+    }
+    return palette;
+}
+
+// Writes a BMP with a Windows v3 header (plus |masks|, if any) and returns
+// its path.
+function writeBMP(name, bitsPerPixel, compression, rows, options)
+{
+    options = options || {};
+    var masks = options.masks ? Buffer.alloc(4 * options.masks.length) : Buffer.alloc(0);
+    var palette = options.palette ? Buffer.alloc(4 * options.palette.length) : Buffer.alloc(0);
+    var pixels = Buffer.concat(options.topDown ? rows : rows.slice().reverse());
+    var header = Buffer.alloc(54);
+    var offset = header.length + masks.length + palette.length;
+
+    (options.masks || []).forEach(function(mask, i)
+    {
+        masks.writeUInt32LE(mask >>> 0, i * 4);
+    });
+    (options.palette || []).forEach(function(color, i)
+    {
+        palette[i * 4] = color[2];
+        palette[i * 4 + 1] = color[1];
+        palette[i * 4 + 2] = color[0];
+    });
+
+    header.write('BM', 0);
+    header.writeUInt32LE(offset + pixels.length, 2);
+    header.writeUInt32LE(offset, 10);
+    header.writeUInt32LE(40, 14);
+    header.writeInt32LE(width, 18);
+    header.writeInt32LE(options.topDown ? -height : height, 22);
+    header.writeUInt16LE(1, 26);
+    header.writeUInt16LE(bitsPerPixel, 28);
+    header.writeUInt32LE(compression, 30);
+    header.writeUInt32LE(pixels.length, 34);
+    header.writeUInt32LE(options.palette ? options.palette.length : 0, 46);
+
+    var file = path.join(os.tmpdir(), 'robotjs-bench-' + name + '.bmp');
+    fs.writeFileSync(file, Buffer.concat([header, masks, palette, pixels]));
+    return file;
+}
+
+// Packs each row of pixels with |write(buffer, offset, color, index)|, padded
+// to 4 bytes.
+function packRows(indices, palette, bytesPerPixel, write)
+{
+    var stride = (width * bytesPerPixel + 3) & ~3;
+    var rows = [];
+
+    for (var y = 0; y < height; y++)
+    {
+        var row = Buffer.alloc(stride);
+        for (var x = 0; x < width; x++)
+        {
+            var index = indices[y * width + x];
+            write(row, x * bytesPerPixel, palette[index], index);
+        }
+        rows.push(row);
+    }
+
+    return rows;
+}
+
+// Each row as runs of one index, then an end of line; the top row, which is
+// stored last, ends the bitmap instead.
+function encodeRLE8(indices)
+{
+    var rows = [];
+
+    for (var y = 0; y < height; y++)
+    {
+        var bytes = [];
+        var x = 0;
+        while (x < width)
+        {
+            var index = indices[y * width + x];
+            var count = 1;
+            while (x + count < width && count < 255 && indices[y * width + x + count] === index)
+            {
+                count++;
+            }
+            bytes.push(count, index);
+            x += count;
+        }
+        bytes.push(0, y === 0 ? 1 : 0);
+        rows.push(Buffer.from(bytes));
+    }
+
+    return rows;
+}
+
+function makeFiles()
+{
+    var indices = makeIndices();
+    var palette = makePalette();
+
+    function bgr(row, offset, color)
+    {
+        row[offset] = color[2];
+        row[offset + 1] = color[1];
+        row[offset + 2] = color[0];
+    }
+
+    var rows24 = packRows(indices, palette, 3, bgr);
+    var rows32 = packRows(indices, palette, 4, function(row, offset, color)
+    {
+        bgr(row, offset, color);
+        row[offset + 3] = 255;
+    });
+    var rowsRGBA = packRows(indices, palette, 4, function(row, offset, color)
+    {
+        row[offset] = color[0];
+        row[offset + 1] = color[1];
+        row[offset + 2] = color[2];
+        row[offset + 3] = 255;
+    });
+    var rows565 = packRows(indices, palette, 2, function(row, offset, color)
+    {
+        row.writeUInt16LE(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3), offset);
+    });
+    var rows8 = packRows(indices, palette, 1, function(row, offset, color, index)
+    {
+        row[offset] = index;
+    });
+
+    return [
+        { name: '24-bit', file: writeBMP('24', 24, 0, rows24) },
+        { name: '24-bit top-down', file: writeBMP('24-top-down', 24, 0, rows24, { topDown: true }) },
+        { name: '32-bit', file: writeBMP('32', 32, 0, rows32) },
+        { name: '32-bit RGBA masks', file: writeBMP('32-rgba', 32, 3, rowsRGBA, { masks: [0xff, 0xff00, 0xff0000] }) },
+        { name: '16-bit 565', file: writeBMP('565', 16, 3, rows565, { masks: [0xf800, 0x07e0, 0x001f] }) },
+        { name: '8-bit', file: writeBMP('8', 8, 0, rows8, { palette: palette }) },
+        { name: '8-bit RLE', file: writeBMP('rle8', 8, 1, encodeRLE8(indices), { palette: palette }) }
+    ];
+}
+
+function median(times)
+{
+    times.sort(function(a, b) { return a - b; });
+    return times[times.length >> 1];
+}
+
+function time(fn)
+{
+    var times = [];
+    for (var i = 0; i < iterations; i++)
+    {
+        var start = process.hrtime.bigint();
+        fn();
+        times.push(Number(process.hrtime.bigint() - start) / 1e6);
+    }
+    return median(times);
+}
+
+function run(entry)
+{
+    var result = { name: entry.name, bytes: fs.statSync(entry.file).size, decodeMs: null, encodeMs: null };
+    var bitmap;
+
+    try
+    {
+        bitmap = robot.readBitmap(entry.file);
+    }
+    catch (error)
+    {
+        return result;
+    }
+
+    var out = path.join(os.tmpdir(), 'robotjs-bench-out.bmp');
+    result.decodeMs = time(function() { robot.readBitmap(entry.file); });
+    result.encodeMs = time(function() { robot.saveBitmapFile(bitmap, out); });
+    result.mpixelsPerSecond = width * height / 1e6 / (result.decodeMs / 1000);
+    return result;
+}
+
+function format(ms, before)
+{
+    if (ms === null)
+    {
+        return 'unsupported';
+    }
+
+    var text = ms.toFixed(2) + ' ms';
+    if (before !== undefined)
+    {
+        text += before === null ? ' (was unsupported)' : ' (' + (before / ms).toFixed(2) + 'x)';
+    }
+    return text;
+}
+
+var results = makeFiles().map(run);
+
+if (json)
+{
+    console.log(JSON.stringify({ iterations: iterations, width: width, height: height, results: results }, null, 2));
+}
+else
+{
+    results.forEach(function(result)
+    {
+        var before = baseline && baseline.results.filter(function(entry)
+        {
+            return entry.name === result.name;
+        })[0];
+
+        console.log(result.name + '\tdecode ' + format(result.decodeMs, before ? before.decodeMs : undefined) +
+            '\tencode ' + format(result.encodeMs, before ? before.encodeMs : undefined) +
+            (result.decodeMs !== null ? '\t' + result.mpixelsPerSecond.toFixed(0) + ' Mpixel/s' : ''));
+    });
+}
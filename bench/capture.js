@@ -0,0 +1,261 @@
+// Screen capture latency and pixel-query call rates.
+//
+//   node bench/capture.js [--xvfb [WxHxD]] [--iterations N] [--json] [--baseline FILE]
+//
+// Times captureScreen() for 1x1, 3x3, 256x256 and full-screen rects, and how
+// many getPixelColor()/getPixelColors()/getMouseColor() calls go through per
+// second. If the native harness has been built (node-gyp rebuild
+// --build_benchmarks=true), it is run as well, and the difference between the
+// two is reported as the binding's overhead: N-API calls, the Buffer copy and
+// building the object.
+//
+// --xvfb runs everything on a private Xvfb server (1920x1080x24 by default),
+// so it works headless. --baseline takes the --json output of an earlier run
+// and prints how each median has changed.
+
+var fs = require('fs');
+var path = require('path');
+var childProcess = require('child_process');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var iterations = 200;
+var fullIterations = 20;
+var baseline = null;
+var xvfb = null;
+
+if (args.indexOf('--iterations') !== -1)
+{
+    iterations = parseInt(args[args.indexOf('--iterations') + 1], 10);
+    fullIterations = Math.max(1, Math.round(iterations / 10));
+}
+if (args.indexOf('--baseline') !== -1)
+{
+    baseline = JSON.parse(fs.readFileSync(args[args.indexOf('--baseline') + 1], 'utf8'));
+}
+if (args.indexOf('--xvfb') !== -1)
+{
+    var screen = args[args.indexOf('--xvfb') + 1];
+    xvfb = screen && /^\d+x\d+x\d+$/.test(screen) ? screen : '1920x1080x24';
+}
+
+var harness = path.join(__dirname, '..', 'build', 'Release', 'capture_bench');
+
+function sleep(ms)
+{
+    return new Promise(function(resolve) { setTimeout(resolve, ms); });
+}
+
+// Starts Xvfb on the first free display number and points DISPLAY at it.
+function startXvfb(screen)
+{
+    var number = 99;
+    while (fs.existsSync('/tmp/.X11-unix/X' + number) || fs.existsSync('/tmp/.X' + number + '-lock'))
+    {
+        number++;
+    }
+
+    var server = childProcess.spawn('Xvfb', [':' + number, '-screen', '0', screen, '-nolisten', 'tcp'], { stdio: 'ignore' });
+    var failed = null;
+    server.on('error', function(error) { failed = error; });
+    process.on('exit', function() { server.kill(); });
+
+    function wait(tries)
+    {
+        if (failed)
+        {
+            return Promise.reject(new Error('Could not start Xvfb: ' + failed.message));
+        }
+        if (fs.existsSync('/tmp/.X11-unix/X' + number))
+        {
+            process.env.DISPLAY = ':' + number;
+            return Promise.resolve();
+        }
+        if (tries === 0)
+        {
+            return Promise.reject(new Error('Xvfb did not start'));
+        }
+        return sleep(50).then(function() { return wait(tries - 1); });
+    }
+
+    return wait(100);
+}
+
+function summarize(times)
+{
+    times.sort(function(a, b) { return a - b; });
+    function percentile(p)
+    {
+        return times[Math.min(times.length - 1, Math.round(p / 100 * (times.length - 1)))];
+    }
+    var total = times.reduce(function(sum, time) { return sum + time; }, 0);
+    return {
+        min: percentile(0),
+        p50: percentile(50),
+        p99: percentile(99),
+        max: percentile(100),
+        mean: total / times.length
+    };
+}
+
+// Microseconds per call of |fn|, |count| times.
+function time(fn, count)
+{
+    var times = [];
+    for (var i = 0; i < count; i++)
+    {
+        var start = process.hrtime.bigint();
+        fn(i);
+        times.push(Number(process.hrtime.bigint() - start) / 1e3);
+    }
+    return summarize(times);
+}
+
+function runHarness()
+{
+    if (!fs.existsSync(harness))
+    {
+        return null;
+    }
+
+    var output = childProcess.execFileSync(harness, [
+        '--iterations', String(iterations),
+        '--full-iterations', String(fullIterations)
+    ], { encoding: 'utf8' });
+    return JSON.parse(output);
+}
+
+function run()
+{
+    var robot = require('..');
+    var size = robot.getScreenSize();
+    var native = runHarness();
+
+    var rects = [
+        { name: '1x1', width: 1, height: 1 },
+        { name: '3x3', width: 3, height: 3 },
+        { name: '256x256', width: Math.min(256, size.width), height: Math.min(256, size.height) },
+        { name: 'full', width: size.width, height: size.height }
+    ];
+
+    var captures = rects.map(function(rect)
+    {
+        var count = rect.name === 'full' ? fullIterations : iterations;
+        var result = {
+            name: rect.name,
+            width: rect.width,
+            height: rect.height,
+            iterations: count,
+            captureScreenUs: time(function() { robot.captureScreen(0, 0, rect.width, rect.height); }, count),
+            screenCaptureUs: time(function() { robot.screen.capture(0, 0, rect.width, rect.height); }, count)
+        };
+
+        var match = native && native.captures.filter(function(entry) { return entry.name === rect.name; })[0];
+        if (match)
+        {
+            result.nativeUs = match.captureUs;
+            result.bufferCopyUs = match.bufferCopyUs;
+            result.overheadUs = result.captureScreenUs.p50 - match.captureUs.p50;
+        }
+        return result;
+    });
+
+    // Walk the pixel queries over the screen so nothing is cached by accident.
+    var probes = new Int32Array(200);
+    for (var i = 0; i < 100; i++)
+    {
+        probes[i * 2] = (i * 37) % size.width;
+        probes[i * 2 + 1] = (i * 17) % size.height;
+    }
+
+    var calls = [
+        {
+            name: 'getPixelColor',
+            fn: function(i) { robot.getPixelColor((i * 37) % size.width, (i * 17) % size.height); }
+        },
+        {
+            // The same 100 pixels getPixelColor() walks, in one call.
+            name: 'getPixelColors x100',
+            fn: function() { robot.getPixelColors(probes); }
+        },
+        {
+            name: 'getMouseColor',
+            fn: function() { robot.getMouseColor(); }
+        },
+        {
+            // getPixelColor() again, answered from one cached frame.
+            name: 'getPixelColor cached',
+            cache: 60000,
+            fn: function(i) { robot.getPixelColor((i * 37) % size.width, (i * 17) % size.height); }
+        }
+    ].map(function(call)
+    {
+        robot.setScreenCache(call.cache || false);
+        var start = process.hrtime.bigint();
+        var us = time(call.fn, iterations);
+        var seconds = Number(process.hrtime.bigint() - start) / 1e9;
+        robot.setScreenCache(false);
+        return { name: call.name, iterations: iterations, perSecond: iterations / seconds, us: us };
+    });
+
+    return {
+        display: { width: size.width, height: size.height, xvfb: xvfb !== null },
+        native: native !== null,
+        captures: captures,
+        calls: calls
+    };
+}
+
+function change(now, before)
+{
+    if (before === undefined)
+    {
+        return '';
+    }
+    return ' (' + (now > before ? '+' : '') + ((now / before - 1) * 100).toFixed(1) + '%)';
+}
+
+function report(results)
+{
+    if (json)
+    {
+        console.log(JSON.stringify(results, null, 2));
+        return;
+    }
+
+    function find(list, name)
+    {
+        return baseline ? baseline[list].filter(function(entry) { return entry.name === name; })[0] : undefined;
+    }
+
+    console.log('Display ' + results.display.width + 'x' + results.display.height +
+        (results.display.xvfb ? ' (Xvfb)' : '') + (results.native ? '' : ', native harness not built'));
+
+    results.captures.forEach(function(capture)
+    {
+        var before = find('captures', capture.name);
+        console.log('capture ' + capture.name + '\tp50 ' + capture.captureScreenUs.p50.toFixed(1) + ' us' +
+            change(capture.captureScreenUs.p50, before && before.captureScreenUs.p50) +
+            '\tp99 ' + capture.captureScreenUs.p99.toFixed(1) + ' us' +
+            (capture.nativeUs ? '\tnative p50 ' + capture.nativeUs.p50.toFixed(1) + ' us, overhead ' +
+                capture.overheadUs.toFixed(1) + ' us' : ''));
+    });
+
+    results.calls.forEach(function(call)
+    {
+        var before = find('calls', call.name);
+        console.log(call.name + '\t' + call.perSecond.toFixed(0) + ' calls/s' +
+            change(call.perSecond, before && before.perSecond) +
+            '\tp50 ' + call.us.p50.toFixed(1) + ' us\tp99 ' + call.us.p99.toFixed(1) + ' us');
+    });
+}
+
+(xvfb ? startXvfb(xvfb) : Promise.resolve()).then(function()
+{
+    report(run());
+    process.exit(0);
+}).catch(function(error)
+{
+    console.error(error.message);
+    process.exit(1);
+});
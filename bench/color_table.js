@@ -0,0 +1,63 @@
+// Needle color table throughput, MMColorTable against UTHashTable, from the
+// native harness.
+//
+//   node bench/color_table.js [--json] [harness options]
+//
+// Runs build/Release/color_table_bench (node-gyp rebuild
+// --build_benchmarks=true) and prints, for each needle, pixels inserted and
+// colors looked up per second by each table, with MMColorTable's speedup and
+// heap allocations per call. Any other options (--sizes, --lookups,
+// --iterations, --seed) are passed through; see
+// bench/native/color_table.cc.
+
+var fs = require('fs');
+var path = require('path');
+var childProcess = require('child_process');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var harnessArgs = args.filter(function(arg)
+{
+    return arg !== '--json';
+});
+
+var harness = path.join(__dirname, '..', 'build', 'Release', 'color_table_bench');
+if (process.platform === 'win32')
+{
+    harness += '.exe';
+}
+
+if (!fs.existsSync(harness))
+{
+    console.error('color_table_bench is not built; run node-gyp rebuild --build_benchmarks=true');
+    process.exit(1);
+}
+
+var results = JSON.parse(childProcess.execFileSync(harness, harnessArgs, { encoding: 'utf8' }));
+
+if (json)
+{
+    console.log(JSON.stringify(results, null, 2));
+    process.exit(0);
+}
+
+console.log(results.lookups + ' lookups per call' +
+    (results.allocationCounting ? '' : ', allocations not counted'));
+
+results.results.forEach(function(result)
+{
+    var table = result.kernel.split(' ')[0];
+    var operation = result.kernel.split(' ')[1];
+    var uthash = table === 'MMColorTable' && results.results.filter(function(entry)
+    {
+        return entry.kernel === 'UTHashTable ' + operation &&
+            entry.needle === result.needle && entry.size === result.size;
+    })[0];
+
+    console.log(result.kernel + '\t' + result.needle + ' ' + result.size + 'x' + result.size +
+        '\t' + (result.itemsPerSecond / 1e6).toFixed(0) + ' M/s' +
+        (uthash ? ' (' + (result.itemsPerSecond / uthash.itemsPerSecond).toFixed(2) + 'x)' : '') +
+        '\tp50 ' + result.us.p50.toFixed(1) + ' us' +
+        (result.allocationsPerCall !== null ? '\t' + result.allocationsPerCall + ' allocs' : '') +
+        '\t' + result.counted + (operation === 'build' ? ' colors' : ' found'));
+});
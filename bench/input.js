@@ -0,0 +1,370 @@
+// Input injection rate and end-to-end latency.
+//
+//   node bench/input.js [--xvfb [WxHxD]] [--iterations N] [--json] [--baseline FILE]
+//
+// Injects bursts of moveMouse(), mouseClick(), keyTap() and typeString() and
+// watches them arrive at a separate X client, build/Release/input_observer
+// (node-gyp rebuild --build_benchmarks=true), which covers the screen with a
+// window holding the input focus. For each call it reports how long the call
+// blocked, how long until the first of its events landed (latencyUs) and
+// until the last one did (completeUs), so changes to the waits in mouse.c and
+// keypress.c show up directly. The mouse and keyboard delays are set to 0.
+//
+// --xvfb runs everything on a private Xvfb server (1280x720x24 by default);
+// without it the observer takes over the current display until it is done.
+// --baseline takes the --json output of an earlier run and prints how each
+// median has changed.
+
+var fs = require('fs');
+var path = require('path');
+var childProcess = require('child_process');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var iterations = 100;
+var baseline = null;
+var xvfb = null;
+
+if (args.indexOf('--iterations') !== -1)
+{
+    iterations = parseInt(args[args.indexOf('--iterations') + 1], 10);
+}
+if (args.indexOf('--baseline') !== -1)
+{
+    baseline = JSON.parse(fs.readFileSync(args[args.indexOf('--baseline') + 1], 'utf8'));
+}
+if (args.indexOf('--xvfb') !== -1)
+{
+    var screen = args[args.indexOf('--xvfb') + 1];
+    xvfb = screen && /^\d+x\d+x\d+$/.test(screen) ? screen : '1280x720x24';
+}
+
+var observerPath = path.join(__dirname, '..', 'build', 'Release', 'input_observer');
+var text = 'robotjs';
+
+function sleep(ms)
+{
+    return new Promise(function(resolve) { setTimeout(resolve, ms); });
+}
+
+// Starts Xvfb on the first free display number and points DISPLAY at it.
+function startXvfb(screen)
+{
+    var number = 99;
+    while (fs.existsSync('/tmp/.X11-unix/X' + number) || fs.existsSync('/tmp/.X' + number + '-lock'))
+    {
+        number++;
+    }
+
+    var server = childProcess.spawn('Xvfb', [':' + number, '-screen', '0', screen, '-nolisten', 'tcp'], { stdio: 'ignore' });
+    var failed = null;
+    server.on('error', function(error) { failed = error; });
+    process.on('exit', function() { server.kill(); });
+
+    function wait(tries)
+    {
+        if (failed)
+        {
+            return Promise.reject(new Error('Could not start Xvfb: ' + failed.message));
+        }
+        if (fs.existsSync('/tmp/.X11-unix/X' + number))
+        {
+            process.env.DISPLAY = ':' + number;
+            return Promise.resolve();
+        }
+        if (tries === 0)
+        {
+            return Promise.reject(new Error('Xvfb did not start'));
+        }
+        return sleep(50).then(function() { return wait(tries - 1); });
+    }
+
+    return wait(100);
+}
+
+// Starts the observer and resolves, once its window has the focus, to an
+// object collecting the events it reports.
+function startObserver()
+{
+    if (!fs.existsSync(observerPath))
+    {
+        return Promise.reject(new Error('input_observer is not built; run node-gyp rebuild --build_benchmarks=true'));
+    }
+
+    var child = childProcess.spawn(observerPath, [], { stdio: ['ignore', 'pipe', 'inherit'] });
+    var observer = { events: [], size: null, waiting: null };
+    var pending = '';
+    process.on('exit', function() { child.kill(); });
+
+    return new Promise(function(resolve, reject)
+    {
+        child.on('error', reject);
+        child.on('exit', function(code)
+        {
+            reject(new Error('input_observer exited with ' + code));
+        });
+
+        child.stdout.setEncoding('utf8');
+        child.stdout.on('data', function(data)
+        {
+            var lines = (pending + data).split('\n');
+            pending = lines.pop();
+
+            lines.forEach(function(line)
+            {
+                var fields = line.split(' ');
+                if (fields[0] === 'ready')
+                {
+                    observer.size = { width: Number(fields[1]), height: Number(fields[2]) };
+                    resolve(observer);
+                    return;
+                }
+                observer.events.push({ kind: fields[0], us: Number(fields[fields.length - 1]) });
+            });
+
+            if (observer.waiting)
+            {
+                observer.waiting();
+            }
+        });
+    });
+}
+
+// Resolves once |observer| has seen |count| events of |kind| at or after
+// |since|, or after |timeout| ms, whichever is first.
+function waitForEvents(observer, kind, since, count, timeout)
+{
+    return new Promise(function(resolve)
+    {
+        function check()
+        {
+            var seen = observer.events.filter(function(event)
+            {
+                return event.kind === kind && event.us >= since;
+            }).length;
+            if (seen >= count)
+            {
+                done();
+            }
+        }
+
+        function done()
+        {
+            observer.waiting = null;
+            clearTimeout(timer);
+            resolve();
+        }
+
+        var timer = setTimeout(done, timeout);
+        observer.waiting = check;
+        check();
+    });
+}
+
+function summarize(times)
+{
+    if (times.length === 0)
+    {
+        return null;
+    }
+
+    times.sort(function(a, b) { return a - b; });
+    function percentile(p)
+    {
+        return times[Math.min(times.length - 1, Math.round(p / 100 * (times.length - 1)))];
+    }
+    var total = times.reduce(function(sum, time) { return sum + time; }, 0);
+    return {
+        min: percentile(0),
+        p50: percentile(50),
+        p99: percentile(99),
+        max: percentile(100),
+        mean: total / times.length
+    };
+}
+
+function nowMicros()
+{
+    return Number(process.hrtime.bigint()) / 1e3;
+}
+
+// Makes |count| calls of |test.call| back to back, then matches each to the
+// |test.perCall| events of |test.first| and |test.last| it caused. Anything
+// stamped before the burst began is left over from the one before.
+function burst(observer, test, count)
+{
+    var starts = [];
+    var calls = [];
+
+    observer.events = [];
+    var burstStart = nowMicros();
+    for (var i = 0; i < count; i++)
+    {
+        var start = nowMicros();
+        test.call(i);
+        starts.push(start);
+        calls.push(nowMicros() - start);
+    }
+    var burstSeconds = (nowMicros() - burstStart) / 1e6;
+
+    return waitForEvents(observer, test.last, burstStart, count * test.perCall, 5000).then(function()
+    {
+        function ofKind(kind)
+        {
+            return observer.events.filter(function(event)
+            {
+                return event.kind === kind && event.us >= burstStart;
+            });
+        }
+
+        var firsts = ofKind(test.first);
+        var lasts = ofKind(test.last);
+        var latencies = [];
+        var completions = [];
+
+        for (var i = 0; i < count; i++)
+        {
+            var first = firsts[i * test.perCall];
+            var last = lasts[(i + 1) * test.perCall - 1];
+            if (first)
+            {
+                latencies.push(first.us - starts[i]);
+            }
+            if (last)
+            {
+                completions.push(last.us - starts[i]);
+            }
+        }
+
+        return {
+            name: test.name,
+            iterations: count,
+            eventsPerCall: test.perCall,
+            lost: count * test.perCall - lasts.length,
+            callsPerSecond: count / burstSeconds,
+            callUs: summarize(calls),
+            latencyUs: summarize(latencies),
+            completeUs: summarize(completions)
+        };
+    });
+}
+
+function run(observer)
+{
+    var robot = require('..');
+    var size = observer.size;
+    robot.setMouseDelay(0);
+    robot.setKeyboardDelay(0);
+    robot.moveMouse(size.width >> 1, size.height >> 1);
+
+    // Key taps sleep between each press and release, so they get fewer
+    // rounds than the mouse does.
+    var keyIterations = Math.max(1, Math.round(iterations / 5));
+    var typeIterations = Math.max(1, Math.round(iterations / 20));
+
+    var tests = [
+        {
+            name: 'moveMouse',
+            count: iterations,
+            first: 'motion',
+            last: 'motion',
+            perCall: 1,
+            // A different spot each time; a move to where the pointer is
+            // already sends nothing.
+            call: function(i) { robot.moveMouse(10 + i % 97, 10 + i % 89); }
+        },
+        {
+            name: 'mouseClick',
+            count: iterations,
+            first: 'press',
+            last: 'release',
+            perCall: 1,
+            call: function() { robot.mouseClick(); }
+        },
+        {
+            name: 'keyTap',
+            count: keyIterations,
+            first: 'keydown',
+            last: 'keyup',
+            perCall: 1,
+            call: function() { robot.keyTap('a'); }
+        },
+        {
+            name: 'typeString',
+            count: typeIterations,
+            first: 'keydown',
+            last: 'keyup',
+            perCall: text.length,
+            call: function() { robot.typeString(text); }
+        }
+    ];
+
+    var results = [];
+    return tests.reduce(function(previous, test)
+    {
+        return previous.then(function()
+        {
+            return burst(observer, test, test.count);
+        }).then(function(result)
+        {
+            results.push(result);
+        });
+    }, Promise.resolve()).then(function()
+    {
+        return {
+            display: { width: size.width, height: size.height, xvfb: xvfb !== null },
+            tests: results
+        };
+    });
+}
+
+function change(now, before)
+{
+    if (before === undefined || before === null)
+    {
+        return '';
+    }
+    return ' (' + (now > before ? '+' : '') + ((now / before - 1) * 100).toFixed(1) + '%)';
+}
+
+function format(name, summary, before)
+{
+    if (summary === null)
+    {
+        return '\t' + name + ' -';
+    }
+    return '\t' + name + ' p50 ' + summary.p50.toFixed(1) + ' us' +
+        change(summary.p50, before && before.p50) + ' p99 ' + summary.p99.toFixed(1) + ' us';
+}
+
+function report(results)
+{
+    if (json)
+    {
+        console.log(JSON.stringify(results, null, 2));
+        return;
+    }
+
+    console.log('Display ' + results.display.width + 'x' + results.display.height +
+        (results.display.xvfb ? ' (Xvfb)' : ''));
+
+    results.tests.forEach(function(test)
+    {
+        var before = baseline && baseline.tests.filter(function(entry) { return entry.name === test.name; })[0];
+        console.log(test.name + '\t' + test.callsPerSecond.toFixed(0) + ' calls/s' +
+            change(test.callsPerSecond, before && before.callsPerSecond) +
+            format('latency', test.latencyUs, before && before.latencyUs) +
+            format('complete', test.completeUs, before && before.completeUs) +
+            (test.lost > 0 ? '\t' + test.lost + ' events lost' : ''));
+    });
+}
+
+(xvfb ? startXvfb(xvfb) : Promise.resolve()).then(startObserver).then(run).then(function(results)
+{
+    report(results);
+    process.exit(0);
+}).catch(function(error)
+{
+    console.error(error.message);
+    process.exit(1);
+});
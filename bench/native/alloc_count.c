@@ -0,0 +1,50 @@
+/* bench/native/alloc_count.c
+ *
+ * Counts heap allocations for the native benchmarks by standing in for
+ * glibc's malloc(), calloc() and realloc(). Elsewhere nothing is counted and
+ * benchAllocations() returns -1. */
+#include <stddef.h>
+
+#if defined(__GLIBC__) || (defined(__linux__) && !defined(__ANDROID__))
+#include <features.h>
+#endif
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long allocations = 0;
+
+void *malloc(size_t size)
+{
+	++allocations;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	++allocations;
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	++allocations;
+	return __libc_realloc(ptr, size);
+}
+
+long benchAllocations(void)
+{
+	return allocations;
+}
+
+#else
+
+long benchAllocations(void)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,98 @@
+// bench/native/bench.h
+//
+// Timing and reporting shared by the native benchmark executables. Each one
+// prints a single JSON object, for bench/*.js to run and compare.
+#pragma once
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Heap allocations made so far, or -1 if they aren't being counted
+// (alloc_count.c counts them under glibc).
+extern "C" long benchAllocations(void);
+
+namespace bench {
+
+inline double nowMicros()
+{
+	using namespace std::chrono;
+	return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Per-call timings of one operation, in microseconds.
+class Samples
+{
+public:
+	void reserve(size_t count) { times.reserve(count); }
+	void add(double micros) { times.push_back(micros); sorted = false; }
+	size_t count() const { return times.size(); }
+
+	double percentile(double p)
+	{
+		if (times.empty()) return 0;
+		sort();
+		size_t index = (size_t)(p / 100 * (times.size() - 1) + 0.5);
+		return times[std::min(index, times.size() - 1)];
+	}
+
+	double mean() const
+	{
+		double total = 0;
+		for (double time : times) total += time;
+		return times.empty() ? 0 : total / times.size();
+	}
+
+	// {"min":..,"p50":..,"p99":..,"max":..,"mean":..}
+	std::string json()
+	{
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer),
+		         "{\"min\":%.3f,\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f,\"mean\":%.3f}",
+		         percentile(0), percentile(50), percentile(99), percentile(100), mean());
+		return buffer;
+	}
+
+private:
+	void sort()
+	{
+		if (!sorted) std::sort(times.begin(), times.end());
+		sorted = true;
+	}
+
+	std::vector<double> times;
+	bool sorted = false;
+};
+
+// Returns the value of --|name| VALUE on the command line, or |fallback|.
+inline const char* stringOption(int argc, char** argv, const char* name, const char* fallback)
+{
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strncmp(argv[i], "--", 2) == 0 && strcmp(argv[i] + 2, name) == 0) {
+			return argv[i + 1];
+		}
+	}
+	return fallback;
+}
+
+inline long intOption(int argc, char** argv, const char* name, long fallback)
+{
+	const char* value = stringOption(argc, argv, name, NULL);
+	return value != NULL ? strtol(value, NULL, 10) : fallback;
+}
+
+inline double doubleOption(int argc, char** argv, const char* name, double fallback)
+{
+	const char* value = stringOption(argc, argv, name, NULL);
+	return value != NULL ? strtod(value, NULL) : fallback;
+}
+
+} // namespace bench
+
+#endif /* BENCH_H */
@@ -0,0 +1,90 @@
+// bench/native/capture.cc
+//
+// Latency of copyMMBitmapFromDisplayInRect() for a few rect sizes, measured
+// below N-API, plus the cost of copying each result the way captureScreen
+// copies it into a Buffer. bench/capture.js runs this next to the JS side
+// and works out the binding's overhead from the two.
+//
+//   capture_bench [--iterations N] [--full-iterations N]
+//
+// Needs a display (bench/capture.js --xvfb starts one). Prints JSON.
+#include "../../src/screengrab.h"
+#include "../../src/screen.h"
+#include "bench.h"
+
+#if defined(USE_X11)
+	#include "../../src/xdisplay.h"
+#endif
+
+struct CaptureCase
+{
+	const char* name;
+	int32_t width;  // 0 for the whole screen.
+	int32_t height;
+};
+
+static const CaptureCase cases[] = {
+	{ "1x1", 1, 1 },
+	{ "3x3", 3, 3 },
+	{ "256x256", 256, 256 },
+	{ "full", 0, 0 }
+};
+
+int main(int argc, char** argv)
+{
+	const long iterations = bench::intOption(argc, argv, "iterations", 500);
+	const long fullIterations = bench::intOption(argc, argv, "full-iterations", 30);
+#if defined(USE_X11)
+	if (XGetMainDisplay() == NULL) {
+		fprintf(stderr, "No display to capture; is DISPLAY set?\n");
+		return 1;
+	}
+#endif
+
+	const MMSignedSize screen = getMainDisplaySize();
+
+	printf("{\"display\":{\"width\":%d,\"height\":%d},\"captures\":[",
+	       (int)screen.width, (int)screen.height);
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const CaptureCase& test = cases[i];
+		const int32_t width = test.width > 0 ? test.width : screen.width;
+		const int32_t height = test.height > 0 ? test.height : screen.height;
+		const long count = test.width > 0 ? iterations : fullIterations;
+		bench::Samples capture, copy;
+		size_t bytes = 0;
+		long failures = 0;
+
+		capture.reserve(count);
+		copy.reserve(count);
+
+		for (long n = 0; n < count; n++) {
+			double start = bench::nowMicros();
+			MMBitmapRef bitmap = copyMMBitmapFromDisplayInRect(MMSignedRectMake(0, 0, width, height));
+			capture.add(bench::nowMicros() - start);
+
+			if (bitmap == NULL) {
+				failures++;
+				continue;
+			}
+
+			// What napi_create_buffer_copy() does with it.
+			bytes = (size_t)bitmap->bytewidth * bitmap->height;
+			start = bench::nowMicros();
+			void* buffer = malloc(bytes);
+			memcpy(buffer, bitmap->imageBuffer, bytes);
+			copy.add(bench::nowMicros() - start);
+
+			free(buffer);
+			destroyMMBitmap(bitmap);
+		}
+
+		printf("%s{\"name\":\"%s\",\"width\":%d,\"height\":%d,\"iterations\":%ld,"
+		       "\"failures\":%ld,\"bytes\":%zu,\"captureUs\":%s,\"bufferCopyUs\":%s}",
+		       i > 0 ? "," : "", test.name, (int)width, (int)height, count,
+		       failures, bytes, capture.json().c_str(), copy.json().c_str());
+	}
+
+	printf("]}\n");
+	return 0;
+}
@@ -0,0 +1,206 @@
+// bench/native/color_table.cc
+//
+// The needle analysis behind the bitmap search on its own: building a table
+// of a needle's colors (insert if absent, every pixel from the last) and
+// looking colors up in it, with MMColorTable against the uthash-based
+// UTHashTable it replaced.
+//
+//   color_table_bench [--sizes A,B,..] [--lookups N] [--iterations N] [--seed N]
+//
+// Each needle size is tried with two kinds of needle: "distinct", every pixel
+// a different color (the worst case for a table), and "screen", a handful of
+// colors in runs the way icons and text are. Lookups are half colors in the
+// needle and half not. Both tables live in the arena, as in the search, and
+// are rewound after every call. Prints JSON: time per call, pixels inserted
+// or colors looked up per second and heap allocations per call (glibc only;
+// null elsewhere).
+#include "../../src/color_table.h"
+#include "../../src/arena.h"
+#include "bench.h"
+
+extern "C" {
+#include "../../src/UTHashTable.h"
+}
+
+#include <functional>
+
+// xorshift32, so runs with the same --seed see the same needles everywhere.
+class Random
+{
+public:
+	explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// In [0, limit).
+	uint32_t below(uint32_t limit) { return limit ? next() % limit : 0; }
+
+private:
+	uint32_t state;
+};
+
+// In uthash_table.c.
+extern "C" long benchBuildUTHashTable(UTHashTable* table, const MMRGBHex* pixels, size_t count);
+extern "C" int benchUTHashTableGet(const UTHashTable* table, MMRGBHex color, uint32_t* value);
+
+// |size| squared colors, listed from the last pixel back as the search
+// analyses them.
+static std::vector<MMRGBHex> createNeedle(const char* kind, size_t size, Random& random)
+{
+	std::vector<MMRGBHex> pixels(size * size);
+
+	if (strcmp(kind, "distinct") == 0) {
+		for (size_t i = 0; i < pixels.size(); i++) pixels[i] = (MMRGBHex)(i * 0x9E3B + 0x10101) & 0xFFFFFF;
+	} else {
+		static const MMRGBHex palette[] = {
+			0xFAFAFA, 0x202020, 0x7A1F9C, 0x3C9F5A, 0xE8E8E8, 0x3060C0, 0xC0C0C0, 0x000000
+		};
+		MMRGBHex color = palette[0];
+		for (size_t i = 0; i < pixels.size(); i++) {
+			if (random.below(6) == 0) color = palette[random.below(8)];
+			pixels[i] = color;
+		}
+	}
+
+	return pixels;
+}
+
+static std::vector<MMRGBHex> parseList(const char* list, std::vector<MMRGBHex> values = {})
+{
+	const char* cursor = list;
+	while (*cursor != '\0') {
+		char* end;
+		const long value = strtol(cursor, &end, 10);
+		if (end == cursor) break;
+		values.push_back((MMRGBHex)value);
+		cursor = *end == ',' ? end + 1 : end;
+	}
+	return values;
+}
+
+static long buildColorTable(const std::vector<MMRGBHex>& pixels, MMColorTable* table)
+{
+	initMMColorTable(table, pixels.size());
+	for (size_t i = 0; i < pixels.size(); i++) {
+		MMColorTableAdd(table, pixels[i], (uint32_t)(pixels.size() - 1 - i));
+	}
+	return (long)table->count;
+}
+
+// Times |iterations| calls of |kernel|, which returns what it counted, and
+// prints one result object; |items| is how many pixels or colors a call
+// goes through.
+static void run(const char* name, const char* kind, size_t size, long iterations,
+                size_t items, const std::function<long()>& kernel, bool& first)
+{
+	bench::Samples samples;
+	samples.reserve(iterations);
+
+	const MMArenaMark mark = MMArenaGetMark();
+	long counted = kernel(); // Warm up, and the answer to report.
+	MMArenaRewind(mark);
+	const long allocationsBefore = benchAllocations();
+	for (long n = 0; n < iterations; n++) {
+		const double start = bench::nowMicros();
+		kernel();
+		MMArenaRewind(mark);
+		samples.add(bench::nowMicros() - start);
+	}
+	const long allocationsAfter = benchAllocations();
+
+	char allocations[32] = "null";
+	if (allocationsBefore >= 0) {
+		snprintf(allocations, sizeof(allocations), "%.1f",
+		         (double)(allocationsAfter - allocationsBefore) / iterations);
+	}
+
+	printf("%s{\"kernel\":\"%s\",\"needle\":\"%s\",\"size\":%zu,\"iterations\":%ld,"
+	       "\"counted\":%ld,\"us\":%s,\"itemsPerSecond\":%.0f,\"allocationsPerCall\":%s}",
+	       first ? "" : ",", name, kind, size, iterations, counted,
+	       samples.json().c_str(), items / (samples.percentile(50) / 1e6), allocations);
+	first = false;
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	const std::vector<MMRGBHex> sizes = parseList(bench::stringOption(argc, argv, "sizes", "8,32,64"));
+	const long lookups = bench::intOption(argc, argv, "lookups", 100000);
+	const long iterations = bench::intOption(argc, argv, "iterations", 200);
+	const long seed = bench::intOption(argc, argv, "seed", 1);
+	static const char* const kinds[] = { "distinct", "screen" };
+
+	if (sizes.empty() || lookups < 1 || iterations < 1) {
+		fprintf(stderr, "Invalid options\n");
+		return 1;
+	}
+	for (MMRGBHex size : sizes) {
+		if (size < 1 || size > 2048) {
+			fprintf(stderr, "Invalid options\n");
+			return 1;
+		}
+	}
+
+	printf("{\"lookups\":%ld,\"seed\":%ld,\"allocationCounting\":%s,\"results\":[",
+	       lookups, seed, benchAllocations() >= 0 ? "true" : "false");
+
+	bool first = true;
+	for (MMRGBHex size : sizes) {
+		for (const char* kind : kinds) {
+			Random random((uint32_t)seed);
+			const std::vector<MMRGBHex> pixels = createNeedle(kind, size, random);
+
+			// Half hits, half colors with the top bit set that no needle has.
+			std::vector<MMRGBHex> probes((size_t)lookups);
+			for (size_t i = 0; i < probes.size(); i++) {
+				probes[i] = i % 2 ? pixels[random.below((uint32_t)pixels.size())]
+				                  : 0x800000 | (random.next() & 0x7FFFFF);
+			}
+
+			run("MMColorTable build", kind, size, iterations, pixels.size(), [&]() -> long {
+				MMColorTable table;
+				return buildColorTable(pixels, &table);
+			}, first);
+			run("UTHashTable build", kind, size, iterations, pixels.size(), [&]() -> long {
+				UTHashTable table;
+				const long count = benchBuildUTHashTable(&table, pixels.data(), pixels.size());
+				destroyHashTable(&table);
+				return count;
+			}, first);
+
+			// Lookups time a table built once, outside the timed calls.
+			const MMArenaMark mark = MMArenaGetMark();
+			MMColorTable colorTable;
+			UTHashTable hashTable;
+			buildColorTable(pixels, &colorTable);
+			benchBuildUTHashTable(&hashTable, pixels.data(), pixels.size());
+
+			run("MMColorTable lookup", kind, size, iterations, probes.size(), [&]() -> long {
+				long found = 0;
+				uint32_t index;
+				for (MMRGBHex color : probes) found += MMColorTableGet(&colorTable, color, &index);
+				return found;
+			}, first);
+			run("UTHashTable lookup", kind, size, iterations, probes.size(), [&]() -> long {
+				long found = 0;
+				uint32_t index;
+				for (MMRGBHex color : probes) found += benchUTHashTableGet(&hashTable, color, &index);
+				return found;
+			}, first);
+
+			destroyHashTable(&hashTable);
+			MMArenaRewind(mark);
+		}
+	}
+
+	printf("]}\n");
+
+	MMArenaRelease();
+	return 0;
+}
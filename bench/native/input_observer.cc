@@ -0,0 +1,83 @@
+// bench/native/input_observer.cc
+//
+// The far end of bench/input.js: a separate X client that covers the screen
+// with a window, takes the input focus and prints every pointer and key
+// event it is sent, stamped with the time it arrived,
+//
+//   ready WIDTH HEIGHT
+//   motion X Y MICROS
+//   press BUTTON MICROS / release BUTTON MICROS
+//   keydown KEYCODE MICROS / keyup KEYCODE MICROS
+//
+// MICROS is CLOCK_MONOTONIC, the clock process.hrtime() reads, so the runner
+// can subtract the time it injected each event from the time it landed.
+// Runs until killed. Meant for a private Xvfb server, where no window
+// manager or other client gets in the way.
+#include "bench.h"
+
+#include <X11/Xlib.h>
+
+int main()
+{
+	Display* display = XOpenDisplay(NULL);
+	if (display == NULL) {
+		fprintf(stderr, "No display to observe; is DISPLAY set?\n");
+		return 1;
+	}
+
+	const int screen = DefaultScreen(display);
+	const int width = DisplayWidth(display, screen);
+	const int height = DisplayHeight(display, screen);
+
+	// Override-redirect, so it is placed and mapped as asked even if there
+	// is a window manager after all.
+	XSetWindowAttributes attributes;
+	attributes.override_redirect = True;
+	attributes.background_pixel = BlackPixel(display, screen);
+	attributes.event_mask = PointerMotionMask | ButtonPressMask | ButtonReleaseMask |
+	                        KeyPressMask | KeyReleaseMask | StructureNotifyMask;
+
+	Window window = XCreateWindow(display, RootWindow(display, screen), 0, 0,
+	                              width, height, 0, CopyFromParent, InputOutput,
+	                              CopyFromParent,
+	                              CWOverrideRedirect | CWBackPixel | CWEventMask,
+	                              &attributes);
+	XMapRaised(display, window);
+
+	XEvent event;
+	do {
+		XNextEvent(display, &event);
+	} while (event.type != MapNotify);
+
+	XSetInputFocus(display, window, RevertToParent, CurrentTime);
+	XSync(display, False);
+
+	printf("ready %d %d\n", width, height);
+	fflush(stdout);
+
+	for (;;) {
+		XNextEvent(display, &event);
+		const double now = bench::nowMicros();
+
+		switch (event.type) {
+		case MotionNotify:
+			printf("motion %d %d %.1f\n", event.xmotion.x_root, event.xmotion.y_root, now);
+			break;
+		case ButtonPress:
+		case ButtonRelease:
+			printf("%s %u %.1f\n", event.type == ButtonPress ? "press" : "release",
+			       event.xbutton.button, now);
+			break;
+		case KeyPress:
+		case KeyRelease:
+			printf("%s %u %.1f\n", event.type == KeyPress ? "keydown" : "keyup",
+			       event.xkey.keycode, now);
+			break;
+		default:
+			continue;
+		}
+
+		// One write per batch of queued events, not per event.
+		if (XPending(display) == 0) fflush(stdout);
+	}
+}
@@ -0,0 +1,275 @@
+// bench/native/search.cc
+//
+// Throughput of the image search kernels on their own: findBitmapInRect(),
+// countOfBitmapInRect(), findAllBitmapInRect(), findColorInRect(),
+// countOfColorsInRect(), findAllColorInRect() and the MMRGBHexSimilarToColor()
+// comparison they are built on, at each tolerance.
+//
+//   search_bench [--width N] [--height N] [--needle N] [--noise F]
+//                [--matches N] [--tolerances A,B,..] [--iterations N] [--seed N]
+//
+// The haystack is a synthetic desktop (no display needed) with |matches|
+// copies of a |needle|-sized patch and |matches| pixels of the searched-for
+// color planted in it. --noise then nudges that fraction of all pixels off
+// their color, the way scaling and anti-aliasing do, so exact searches start
+// missing the planted copies. Prints JSON: time per call, haystack pixels
+// scanned per second and heap allocations per call (glibc only; null
+// elsewhere).
+#include "../../src/arena.h"
+#include "../../src/bitmap_find.h"
+#include "../../src/color_find.h"
+#include "../../src/MMBitmap.h"
+#include "../../src/MMPointArray.h"
+#include "bench.h"
+
+#include <functional>
+
+// xorshift32, so runs with the same --seed see the same images everywhere.
+class Random
+{
+public:
+	explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// In [0, limit).
+	uint32_t below(uint32_t limit) { return limit ? next() % limit : 0; }
+	double unit() { return next() / 4294967296.0; }
+
+private:
+	uint32_t state;
+};
+
+// Not used by the background, the needle or the noise around either.
+static const MMRGBHex kTargetColor = 0x3C9F5A;
+
+static MMBitmapRef createBlankBitmap(int32_t width, int32_t height)
+{
+	const int32_t bytewidth = width * 4;
+	uint8_t* buffer = (uint8_t*)calloc((size_t)bytewidth * height, 1);
+	return createMMBitmap(buffer, width, height, bytewidth, 32, 4);
+}
+
+static void setPixel(MMBitmapRef bitmap, int32_t x, int32_t y, MMRGBHex color)
+{
+	uint8_t* pixel = bitmap->imageBuffer + (size_t)y * bitmap->bytewidth + x * 4;
+	pixel[0] = color & 0xFF;
+	pixel[1] = (color >> 8) & 0xFF;
+	pixel[2] = (color >> 16) & 0xFF;
+	pixel[3] = 0xFF;
+}
+
+// A title bar gradient, a flat side panel and blocks of two-tone "text" on a
+// light page: long runs of few colors, which is what the jump table sees on
+// a real screen.
+static MMBitmapRef createHaystack(int32_t width, int32_t height, Random& random)
+{
+	MMBitmapRef haystack = createBlankBitmap(width, height);
+
+	for (int32_t y = 0; y < height; y++) {
+		for (int32_t x = 0; x < width; x++) {
+			MMRGBHex color;
+			if (y < height / 20) {
+				const uint32_t shade = 0x30 + (uint32_t)x * 0x40 / width;
+				color = (shade << 16) | (shade << 8) | 0xC0;
+			} else if (x < width / 6) {
+				color = 0xE8E8E8;
+			} else if ((y >> 4) % 2 == 0 && (x >> 3) % 3 != 0) {
+				color = random.below(2) ? 0x202020 : 0xFAFAFA;
+			} else {
+				color = 0xFAFAFA;
+			}
+			setPixel(haystack, x, y, color);
+		}
+	}
+
+	return haystack;
+}
+
+// An icon-like patch: a border around random mid-range colors, distinct from
+// the haystack so the copies planted in it are the only true matches.
+static MMBitmapRef createNeedle(int32_t size, Random& random)
+{
+	MMBitmapRef needle = createBlankBitmap(size, size);
+
+	for (int32_t y = 0; y < size; y++) {
+		for (int32_t x = 0; x < size; x++) {
+			const bool border = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+			const MMRGBHex color = border ? 0x7A1F9C :
+				((0x40 + random.below(0x80)) << 16) |
+				((0x40 + random.below(0x80)) << 8) |
+				(0x40 + random.below(0x80));
+			setPixel(needle, x, y, color);
+		}
+	}
+
+	return needle;
+}
+
+static void plant(MMBitmapRef haystack, MMBitmapRef needle, int32_t left, int32_t top)
+{
+	for (int32_t y = 0; y < (int32_t)needle->height; y++) {
+		memcpy(haystack->imageBuffer + (size_t)(top + y) * haystack->bytewidth + left * 4,
+		       needle->imageBuffer + (size_t)y * needle->bytewidth,
+		       needle->width * 4);
+	}
+}
+
+// Moves each channel of |fraction| of the pixels by up to 12 either way.
+static void addNoise(MMBitmapRef bitmap, double fraction, Random& random)
+{
+	if (fraction <= 0) return;
+
+	for (int32_t y = 0; y < (int32_t)bitmap->height; y++) {
+		uint8_t* row = bitmap->imageBuffer + (size_t)y * bitmap->bytewidth;
+		for (int32_t x = 0; x < (int32_t)bitmap->width; x++) {
+			if (random.unit() >= fraction) continue;
+			for (int channel = 0; channel < 3; channel++) {
+				const int value = row[x * 4 + channel] + (int)random.below(25) - 12;
+				row[x * 4 + channel] = (uint8_t)std::max(0, std::min(255, value));
+			}
+		}
+	}
+}
+
+static std::vector<float> parseTolerances(const char* list)
+{
+	std::vector<float> tolerances;
+	const char* cursor = list;
+	while (*cursor != '\0') {
+		char* end;
+		const float tolerance = strtof(cursor, &end);
+		if (end == cursor) break;
+		tolerances.push_back(tolerance);
+		cursor = *end == ',' ? end + 1 : end;
+	}
+	return tolerances;
+}
+
+// Times |iterations| calls of |kernel|, which returns what it found, and
+// prints one result object.
+static void run(const char* name, float tolerance, long iterations, size_t pixels,
+                const std::function<long()>& kernel, bool& first)
+{
+	bench::Samples samples;
+	samples.reserve(iterations);
+
+	long found = kernel(); // Warm up, and the answer to report.
+	const long allocationsBefore = benchAllocations();
+	for (long n = 0; n < iterations; n++) {
+		const double start = bench::nowMicros();
+		kernel();
+		samples.add(bench::nowMicros() - start);
+	}
+	const long allocationsAfter = benchAllocations();
+
+	char allocations[32] = "null";
+	if (allocationsBefore >= 0) {
+		snprintf(allocations, sizeof(allocations), "%.1f",
+		         (double)(allocationsAfter - allocationsBefore) / iterations);
+	}
+
+	printf("%s{\"kernel\":\"%s\",\"tolerance\":%g,\"iterations\":%ld,\"found\":%ld,"
+	       "\"us\":%s,\"pixelsPerSecond\":%.0f,\"allocationsPerCall\":%s}",
+	       first ? "" : ",", name, tolerance, iterations, found,
+	       samples.json().c_str(), pixels / (samples.percentile(50) / 1e6), allocations);
+	first = false;
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	const int32_t width = (int32_t)bench::intOption(argc, argv, "width", 1920);
+	const int32_t height = (int32_t)bench::intOption(argc, argv, "height", 1080);
+	const int32_t needleSize = (int32_t)bench::intOption(argc, argv, "needle", 32);
+	const double noise = bench::doubleOption(argc, argv, "noise", 0.0);
+	const long matches = bench::intOption(argc, argv, "matches", 1);
+	const long iterations = bench::intOption(argc, argv, "iterations", 20);
+	const long seed = bench::intOption(argc, argv, "seed", 1);
+	const std::vector<float> tolerances =
+		parseTolerances(bench::stringOption(argc, argv, "tolerances", "0,0.05,0.2"));
+
+	if (width < 1 || height < 1 || needleSize < 1 || needleSize > width ||
+	    needleSize > height || iterations < 1 || tolerances.empty()) {
+		fprintf(stderr, "Invalid options\n");
+		return 1;
+	}
+
+	Random random((uint32_t)seed);
+	MMBitmapRef haystack = createHaystack(width, height, random);
+	MMBitmapRef needle = createNeedle(needleSize, random);
+
+	// Planted copies may overlap each other; later ones win.
+	for (long i = 0; i < matches; i++) {
+		plant(haystack, needle,
+		      (int32_t)random.below(width - needleSize + 1),
+		      (int32_t)random.below(height - needleSize + 1));
+	}
+	for (long i = 0; i < matches; i++) {
+		setPixel(haystack, (int32_t)random.below(width), (int32_t)random.below(height), kTargetColor);
+	}
+	addNoise(haystack, noise, random);
+
+	const MMRect bounds = MMRectMake(0, 0, width, height);
+	const size_t pixels = (size_t)width * height;
+
+	printf("{\"haystack\":{\"width\":%d,\"height\":%d},\"needle\":%d,\"noise\":%g,"
+	       "\"matches\":%ld,\"seed\":%ld,\"allocationCounting\":%s,\"results\":[",
+	       (int)width, (int)height, (int)needleSize, noise, matches, seed,
+	       benchAllocations() >= 0 ? "true" : "false");
+
+	bool first = true;
+	for (float tolerance : tolerances) {
+		run("findBitmapInRect", tolerance, iterations, pixels, [&]() -> long {
+			MMPoint point;
+			return findBitmapInRect(needle, haystack, &point, bounds, tolerance) == 0;
+		}, first);
+		run("countOfBitmapInRect", tolerance, iterations, pixels, [&]() -> long {
+			return (long)countOfBitmapInRect(needle, haystack, bounds, tolerance);
+		}, first);
+		run("findAllBitmapInRect", tolerance, iterations, pixels, [&]() -> long {
+			const MMArenaMark mark = MMArenaGetMark();
+			MMPointArrayRef points = findAllBitmapInRect(needle, haystack, bounds, tolerance);
+			const long count = (long)points->count;
+			MMArenaRewind(mark);
+			return count;
+		}, first);
+		run("findColorInRect", tolerance, iterations, pixels, [&]() -> long {
+			MMPoint point;
+			return findColorInRect(haystack, kTargetColor, &point, bounds, tolerance) == 0;
+		}, first);
+		run("countOfColorsInRect", tolerance, iterations, pixels, [&]() -> long {
+			return (long)countOfColorsInRect(haystack, kTargetColor, bounds, tolerance);
+		}, first);
+		run("findAllColorInRect", tolerance, iterations, pixels, [&]() -> long {
+			const MMArenaMark mark = MMArenaGetMark();
+			MMPointArrayRef points = findAllColorInRect(haystack, kTargetColor, bounds, tolerance);
+			const long count = (long)points->count;
+			MMArenaRewind(mark);
+			return count;
+		}, first);
+		// The comparison alone, over every pixel, without the search around it.
+		run("MMRGBHexSimilarToColor", tolerance, iterations, pixels, [&]() -> long {
+			long similar = 0;
+			for (int32_t y = 0; y < height; y++) {
+				for (int32_t x = 0; x < width; x++) {
+					similar += MMRGBHexSimilarToColor(MMRGBHexAtPoint(haystack, x, y),
+					                                  kTargetColor, tolerance);
+				}
+			}
+			return similar;
+		}, first);
+	}
+
+	printf("]}\n");
+
+	destroyMMBitmap(needle);
+	destroyMMBitmap(haystack);
+	return 0;
+}
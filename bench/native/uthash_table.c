@@ -0,0 +1,48 @@
+/* bench/native/uthash_table.c
+ *
+ * The needle color table as bitmap_find.c built it on UTHashTable, for
+ * color_table.cc to compare against MMColorTable; the bundled uthash.h only
+ * compiles as C. */
+#include "../../src/UTHashTable.h"
+#include "../../src/rgb.h"
+#include <stdint.h>
+
+struct shiftNode {
+	UTHashNode_HEAD /* Make structure hashable */
+	MMRGBHex color; /* Key */
+	uint32_t index; /* Value */
+};
+
+/* Adds each of |count| |pixels| not already in |table|, mapped to its index
+ * from the end. Returns the number of colors in |table|. */
+long benchBuildUTHashTable(UTHashTable *table, const MMRGBHex *pixels, size_t count)
+{
+	size_t i;
+
+	initHashTable(table, count, sizeof(struct shiftNode));
+	for (i = 0; i < count; i++) {
+		struct shiftNode *uttable = table->uttable;
+		struct shiftNode *node;
+		MMRGBHex color = pixels[i];
+		HASH_FIND_INT(uttable, &color, node);
+		if (node != NULL) continue;
+
+		node = getNewNode(table);
+		node->color = color;
+		node->index = (uint32_t)(count - 1 - i);
+		UTHASHTABLE_ADD_INT(table, color, node, struct shiftNode);
+	}
+
+	return (long)table->nodeCount;
+}
+
+/* Like MMColorTableGet(). */
+int benchUTHashTableGet(const UTHashTable *table, MMRGBHex color, uint32_t *value)
+{
+	struct shiftNode *uttable = table->uttable;
+	struct shiftNode *node;
+	HASH_FIND_INT(uttable, &color, node);
+	if (node == NULL) return 0;
+	*value = node->index;
+	return 1;
+}
@@ -0,0 +1,154 @@
+// PNG encode throughput for screen-sized bitmaps.
+//
+//   node bench/png.js [--iterations N] [--json]
+//
+// Frames are synthetic (no display needed): flat panels, gradients and text-
+// like noise, which compress roughly like real desktop captures.
+
+var robot = require('..');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var iterations = 5;
+if (args.indexOf('--iterations') !== -1)
+{
+    iterations = parseInt(args[args.indexOf('--iterations') + 1], 10);
+}
+
+var sizes = [
+    { name: '1080p', width: 1920, height: 1080 },
+    { name: '4K', width: 3840, height: 2160 }
+];
+
+var settings = [
+    { level: 1, filter: 'none' },
+    { level: 1, filter: 'up', threads: 0 },
+    { level: 6, filter: 'default', threads: 0 },
+    { level: 1, filter: 'up' },
+    { level: 1, filter: 'paeth' },
+    { level: 6, filter: 'up' },
+    { level: 6, filter: 'default' },
+    { level: 9, filter: 'default' }
+];
+
+function makeFrame(width, height)
+{
+    var bytesPerPixel = 4;
+    var byteWidth = width * bytesPerPixel;
+    var image = Buffer.alloc(byteWidth * height);
+    var seed = 1;
+
+    for (var y = 0; y < height; y++)
+    {
+        for (var x = 0; x < width; x++)
+        {
+            var i = y * byteWidth + x * bytesPerPixel;
+            var b, g, r;
+
+            if (y < height / 10)
+            {
+                // Title bar gradient.
+                b = 200; g = 120 + (x * 60 / width) | 0; r = 40;
+            }
+            else if (x < width / 5)
+            {
+                // Flat side panel.
+                b = g = r = 240;
+            }
+            else if ((y >> 4) % 2 === 0 && (x >> 3) % 3 !== 0)
+            {
+                // Lines of "text".
+                seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+                b = g = r = (seed >> 16) & 1 ? 30 : 255;
+            }
+            else
+            {
+                b = g = r = 255;
+            }
+
+            image[i] = b;
+            image[i + 1] = g;
+            image[i + 2] = r;
+            image[i + 3] = 255;
+        }
+    }
+
+    return {
+        width: width,
+        height: height,
+        byteWidth: byteWidth,
+        bitsPerPixel: 32,
+        bytesPerPixel: bytesPerPixel,
+        image: image
+    };
+}
+
+function run(bitmap, options)
+{
+    var times = [];
+    var length = 0;
+    var chain = Promise.resolve();
+
+    for (var i = 0; i < iterations; i++)
+    {
+        chain = chain.then(function()
+        {
+            var start = process.hrtime.bigint();
+            return robot.encodePNG(bitmap, options).then(function(png)
+            {
+                times.push(Number(process.hrtime.bigint() - start) / 1e6);
+                length = png.length;
+            });
+        });
+    }
+
+    return chain.then(function()
+    {
+        times.sort(function(a, b) { return a - b; });
+        var median = times[times.length >> 1];
+        return {
+            level: options.level,
+            filter: options.filter,
+            threads: options.threads === undefined ? 1 : options.threads,
+            ms: median,
+            mbPerSecond: bitmap.image.length / 1e6 / (median / 1000),
+            bytes: length,
+            ratio: bitmap.image.length / length
+        };
+    });
+}
+
+var results = [];
+var chain = Promise.resolve();
+
+sizes.forEach(function(size)
+{
+    var bitmap = makeFrame(size.width, size.height);
+
+    settings.forEach(function(options)
+    {
+        chain = chain.then(function()
+        {
+            return run(bitmap, options);
+        }).then(function(result)
+        {
+            result.size = size.name;
+            results.push(result);
+            if (!json)
+            {
+                console.log(size.name + '\tlevel ' + result.level + '\t' + result.filter + '\t' +
+                    (result.threads === 0 ? 'all' : result.threads) + ' thread(s)\t' +
+                    result.ms.toFixed(1) + ' ms\t' + result.mbPerSecond.toFixed(0) + ' MB/s\t' +
+                    result.bytes + ' bytes (' + result.ratio.toFixed(0) + ':1)');
+            }
+        });
+    });
+});
+
+chain.then(function()
+{
+    if (json)
+    {
+        console.log(JSON.stringify({ iterations: iterations, results: results }, null, 2));
+    }
+});
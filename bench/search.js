@@ -0,0 +1,73 @@
+// Image search kernel throughput, from the native harness.
+//
+//   node bench/search.js [--json] [--baseline FILE] [harness options]
+//
+// Runs build/Release/search_bench (node-gyp rebuild --build_benchmarks=true)
+// and prints, for each kernel and tolerance, haystack pixels scanned per
+// second, heap allocations per call and what was found. Any other options
+// (--width, --height, --needle, --noise, --matches, --tolerances,
+// --iterations, --seed) are passed through; see bench/native/search.cc.
+// --baseline takes the --json output of an earlier run and prints the
+// speedup against it.
+
+var fs = require('fs');
+var path = require('path');
+var childProcess = require('child_process');
+
+var args = process.argv.slice(2);
+var json = args.indexOf('--json') !== -1;
+var baseline = null;
+var harnessArgs = [];
+
+for (var i = 0; i < args.length; i++)
+{
+    if (args[i] === '--json')
+    {
+        continue;
+    }
+    if (args[i] === '--baseline')
+    {
+        baseline = JSON.parse(fs.readFileSync(args[++i], 'utf8'));
+        continue;
+    }
+    harnessArgs.push(args[i]);
+}
+
+var harness = path.join(__dirname, '..', 'build', 'Release', 'search_bench');
+if (process.platform === 'win32')
+{
+    harness += '.exe';
+}
+
+if (!fs.existsSync(harness))
+{
+    console.error('search_bench is not built; run node-gyp rebuild --build_benchmarks=true');
+    process.exit(1);
+}
+
+var results = JSON.parse(childProcess.execFileSync(harness, harnessArgs, { encoding: 'utf8' }));
+
+if (json)
+{
+    console.log(JSON.stringify(results, null, 2));
+    process.exit(0);
+}
+
+console.log('Haystack ' + results.haystack.width + 'x' + results.haystack.height +
+    ', needle ' + results.needle + 'x' + results.needle + ', noise ' + results.noise +
+    ', ' + results.matches + ' planted' + (results.allocationCounting ? '' : ', allocations not counted'));
+
+results.results.forEach(function(result)
+{
+    var before = baseline && baseline.results.filter(function(entry)
+    {
+        return entry.kernel === result.kernel && entry.tolerance === result.tolerance;
+    })[0];
+
+    console.log(result.kernel + '\ttolerance ' + result.tolerance +
+        '\t' + (result.pixelsPerSecond / 1e6).toFixed(0) + ' Mpixel/s' +
+        (before ? ' (' + (result.pixelsPerSecond / before.pixelsPerSecond).toFixed(2) + 'x)' : '') +
+        '\tp50 ' + result.us.p50.toFixed(1) + ' us' +
+        (result.allocationsPerCall !== null ? '\t' + result.allocationsPerCall + ' allocs' : '') +
+        '\tfound ' + result.found);
+});
@@ -36,11 +36,24 @@
             '-lpng',
             '-lz',
             '-lX11',
+            '-lXext',
+            '-lXrandr',
             '-lXtst'
           ]
         },
+        'defines': [ 'USE_LIBPNG' ],
         'sources': [
-          'src/xdisplay.c'
+          'src/xdisplay.c',
+          'src/xkeymap.c',
+          'src/io.c',
+          'src/bmp_io.c',
+          'src/png_io.c',
+          'src/png_filter.c',
+          'src/png_parallel.c',
+          'src/image_stream.c',
+          'src/str_io.c',
+          'src/base64.c',
+          'src/zlib_util.c'
         ]
       }],
       ["OS=='win'", {
@@ -56,8 +69,88 @@
       'src/screen.c',
       'src/screengrab.c',
       'src/snprintf.c',
-      'src/MMBitmap.c'
+      'src/MMBitmap.c',
+      'src/timing.c',
+      'src/stats.c',
+      'src/arena.c',
+      'src/display_watch.c',
+      'src/screen_cache.c',
+      'src/screen_reader.c',
+      'src/screen_stitch.c',
+      'src/pixel_watch.c',
+      'src/bitmap_watch.c',
+      'src/bitmap_find.c',
+      'src/color_table.c',
+      'src/MMPointArray.c',
+      'src/macro.c',
+      'src/mapped_bitmap.c'
     ],
     'defines': [ 'NAPI_DISABLE_CPP_EXCEPTIONS' ],
-  }]
+  }],
+  # Native benchmarks, built with `node-gyp rebuild --build_benchmarks=true`.
+  'variables': {
+    'build_benchmarks%': 'false'
+  },
+  'conditions': [
+    ['build_benchmarks == "true" and OS == "linux"', {
+      'targets': [{
+        'target_name': 'capture_bench',
+        'type': 'executable',
+        'link_settings': {
+          'libraries': [
+            '-lX11',
+            '-lXrandr',
+            '-lpthread'
+          ]
+        },
+        'sources': [
+          'bench/native/capture.cc',
+          'src/screengrab.c',
+          'src/screen.c',
+          'src/display_watch.c',
+          'src/MMBitmap.c',
+          'src/xdisplay.c',
+          'src/xkeymap.c'
+        ]
+      }, {
+        'target_name': 'input_observer',
+        'type': 'executable',
+        'link_settings': {
+          'libraries': [
+            '-lX11'
+          ]
+        },
+        'sources': [
+          'bench/native/input_observer.cc'
+        ]
+      }]
+    }],
+    ['build_benchmarks == "true"', {
+      'targets': [{
+        'target_name': 'search_bench',
+        'type': 'executable',
+        'sources': [
+          'bench/native/search.cc',
+          'bench/native/alloc_count.c',
+          'src/arena.c',
+          'src/bitmap_find.c',
+          'src/color_find.c',
+          'src/color_table.c',
+          'src/MMBitmap.c',
+          'src/MMPointArray.c'
+        ]
+      }, {
+        'target_name': 'color_table_bench',
+        'type': 'executable',
+        'sources': [
+          'bench/native/color_table.cc',
+          'bench/native/uthash_table.c',
+          'bench/native/alloc_count.c',
+          'src/arena.c',
+          'src/color_table.c',
+          'src/UTHashTable.c'
+        ]
+      }]
+    }]
+  ]
 }
\ No newline at end of file
@@ -1,11 +1,51 @@
-export interface Bitmap {
-  width: number
-  height: number
-  image: any
-  byteWidth: number
-  bitsPerPixel: number
-  bytesPerPixel: number
+import { Readable, Writable } from 'stream'
+
+export class Bitmap {
+  constructor(width: number, height: number, byteWidth: number, bitsPerPixel: number, bytesPerPixel: number, image: Buffer)
+  readonly width: number
+  readonly height: number
+  readonly image: Buffer
+  readonly byteWidth: number
+  readonly bitsPerPixel: number
+  readonly bytesPerPixel: number
   colorAt(x: number, y: number): string
+  crop(x: number, y: number, width: number, height: number): Bitmap
+  find(needle: Bitmap, options?: BitmapFindOptions): { x: number, y: number } | null
+  toPNG(options?: PNGOptions): Promise<Buffer>
+  toStream(options?: ImageStreamOptions): Readable
+  toString(): string
+}
+
+export interface BitmapFindOptions {
+  x?: number
+  y?: number
+  width?: number
+  height?: number
+  tolerance?: number
+}
+
+export interface PNGOptions {
+  level?: number
+  filter?: 'default' | 'none' | 'sub' | 'up' | 'average' | 'paeth' | 'all'
+  threads?: number
+}
+
+export interface NeedleSignature {
+  checksum: bigint
+  firstColor: string
+  anchorColor: string
+  anchorX: number
+  anchorY: number
+  colorCount: number
+}
+
+export interface MappedBitmap extends Bitmap {
+  signature: NeedleSignature
+}
+
+export interface ImageStreamOptions extends PNGOptions {
+  format?: 'png' | 'bmp'
+  chunkSize?: number
 }
 
 export interface Screen {
@@ -21,6 +61,95 @@ export interface ScreenInfo {
   displayId: number
 }
 
+export interface DesktopCapture {
+  x: number
+  y: number
+  bitmap: Bitmap
+  screens: Array<ScreenInfo & { bitmap: Bitmap }>
+}
+
+export interface OperationStats {
+  count: number
+  bytes: number
+  totalMs: number
+  meanMs: number
+  maxMs: number
+  p50Ms: number
+  p90Ms: number
+  p99Ms: number
+  p999Ms: number
+}
+
+export interface Stats {
+  capture: OperationStats
+  convert: OperationStats
+  object: OperationStats
+  mouse: OperationStats
+  keyboard: OperationStats
+  screenCache: ScreenCacheStats
+  arena: ArenaStats
+}
+
+export interface ScreenCacheStats {
+  hits: number
+  misses: number
+  bypasses: number
+  ttlMs: number
+  /** -1 while no frame is cached. */
+  ageMs: number
+}
+
+export interface ArenaStats {
+  allocations: number
+  bytes: number
+  heapAllocations: number
+  /** Held by the arenas now; not cleared by resetStats(). */
+  reservedBytes: number
+}
+
+export interface PixelCondition {
+  x: number
+  y: number
+  /** 0xRRGGBB, or "#rrggbb". */
+  color: number | string
+  /** From 0 (the exact color) to 1 (any color). */
+  tolerance?: number
+  /** Given with height, any pixel of the region will do. */
+  width?: number
+  height?: number
+}
+
+export interface PixelWaitOptions {
+  /** 10000 by default; at most 2147483647, like setTimeout's delay. */
+  timeoutMs?: number
+  /** The longest pause between reads while the pixels hold still; 10 by default. */
+  maxIntervalMs?: number
+}
+
+export interface BitmapWaitOptions extends PixelWaitOptions {
+  /** The region to look in; the whole main screen by default. */
+  x?: number
+  y?: number
+  width?: number
+  height?: number
+  /** From 0 (the exact colors) to 1 (any colors). */
+  tolerance?: number
+}
+
+export interface PixelMatch {
+  x: number
+  y: number
+  color: string
+}
+
+export interface ScreenCacheOptions {
+  ttl: number
+  x?: number
+  y?: number
+  width?: number
+  height?: number
+}
+
 export interface VirtualScreenSize {
   width: number
   height: number
@@ -37,12 +166,38 @@ export interface MonitorSize {
   y: number
 }
 
+export interface MacroEvent {
+  type: 'keyTap' | 'keyToggle' | 'moveMouse' | 'dragMouse' | 'mouseClick' | 'mouseToggle' | 'scrollMouse' | 'delay'
+  delay?: number
+  key?: string
+  modifier?: string | string[]
+  down?: string
+  x?: number
+  y?: number
+  button?: string
+  double?: boolean
+  ms?: number
+}
+
+export interface MacroStats {
+  count: number
+  elapsed: number
+  meanLateness: number
+  maxLateness: number
+  scheduled: Float64Array
+  actual: Float64Array
+  durations: Float64Array
+}
+
 export function setKeyboardDelay(ms: number) : void
 export function keyTap(key: string, modifier?: string | string[]) : void
 export function keyToggle(key: string, down: string, modifier?: string | string[]) : void
 export function typeString(string: string) : void
 export function typeStringDelayed(string: string, cpm: number) : void
 export function setMouseDelay(delay: number) : void
+export function setSpinWindow(ms: number) : void
+export function compileMacro(events: MacroEvent[]) : Buffer
+export function playMacro(macro: Buffer) : MacroStats
 export function updateScreenMetrics() : void
 export function moveMouse(x: number, y: number) : void
 export function moveMouseSmooth(x: number, y: number,speed?:number) : void
@@ -53,8 +208,32 @@ export function scrollMouse(x: number, y: number) : void
 export function getMousePos(): { x: number, y: number }
 export function getMouseColor(): { x: number, y: number, r: number, g: number, b: number, hex: string }
 export function getPixelColor(x: number, y: number, rgb?: boolean): string | { r: number, g: number, b: number }
+export function getPixelColors(points: Array<{ x: number, y: number }> | Int32Array): Uint32Array
+export function setScreenCache(options: number | false | ScreenCacheOptions): boolean
+export function invalidateScreenCache(): boolean
+export function waitForPixel(condition: PixelCondition & PixelWaitOptions): Promise<PixelMatch | null>
+export function waitForPixels(conditions: PixelCondition[], options?: PixelWaitOptions & { all?: boolean, tolerance?: number }): Promise<Array<PixelMatch | null> | null>
+export function waitForBitmap(needle: Bitmap, options?: BitmapWaitOptions): Promise<{ x: number, y: number } | null>
 export function getScreenSize(screenIndex?: number): VirtualScreenSize | MonitorSize | null
+export function encodePNG(bitmap: Bitmap, options?: PNGOptions): Promise<Buffer>
+export function createImageStream(bitmap: Bitmap, options?: ImageStreamOptions): Readable
+export function writeImage(bitmap: Bitmap, target: number | Writable, options?: ImageStreamOptions): Promise<number>
+export function readBitmap(path: string): Bitmap
+export function saveBitmapFile(bitmap: Bitmap, path: string): void
+export function mapBitmap(path: string): MappedBitmap
+export function bitmapFromString(string: string): Bitmap
+export function saveMappedBitmap(bitmap: Bitmap, path: string): void
+export function convertToMappedBitmap(input: string, output: string): void
 export function getScreens(): ScreenInfo[]
+export function captureAllScreens(): DesktopCapture
+export function on(event: 'screenschange', listener: (screens: ScreenInfo[]) => void): void
+export function once(event: 'screenschange', listener: (screens: ScreenInfo[]) => void): void
+export function off(event: 'screenschange', listener: (screens: ScreenInfo[]) => void): void
+export function addListener(event: 'screenschange', listener: (screens: ScreenInfo[]) => void): void
+export function removeListener(event: 'screenschange', listener: (screens: ScreenInfo[]) => void): void
+export function removeAllListeners(event?: 'screenschange'): void
+export function getStats(): Stats
+export function resetStats(): void
 export function getVersion(): string
 
 export var screen: Screen
@@ -30,37 +30,165 @@ try {
     }
 }
 
+var stream = require('stream');
+var EventEmitter = require('events').EventEmitter;
+
 module.exports = robotjs;
 
 module.exports.screen = {};
 
-function bitmap(width, height, byteWidth, bitsPerPixel, bytesPerPixel, image) 
+// Bitmaps are native objects, whose pixels are only copied into JS when
+// .image is first read; colorAt, crop, find and toPNG work on them in place.
+var Bitmap = robotjs.Bitmap;
+
+Bitmap.prototype.toStream = function(options)
 {
-    this.width = width;
-    this.height = height;
-    this.byteWidth = byteWidth;
-    this.bitsPerPixel = bitsPerPixel;
-    this.bytesPerPixel = bytesPerPixel;
-    this.image = image;
-
-    this.colorAt = function(x, y)
-    {
-        return robotjs.getColor(this, x, y);
-    };
+    return module.exports.createImageStream(this, options);
+};
 
-}
+// The compact "b<width>,<height>,<data>" form, for shipping bitmaps inline.
+Bitmap.prototype.toString = function()
+{
+    return robotjs.encodeBitmapString(this);
+};
 
 module.exports.screen.capture = function(x, y, width, height)
 {
     //If coords have been passed, use them.
     if (typeof x !== "undefined" && typeof y !== "undefined" && typeof width !== "undefined" && typeof height !== "undefined")
     {
-        b = robotjs.captureScreen(x, y, width, height);
+        return robotjs.captureScreen(x, y, width, height);
     }
-    else 
+
+    return robotjs.captureScreen();
+};
+
+// Inverse of bitmap.toString().
+module.exports.bitmapFromString = function(string)
+{
+    var b = robotjs.decodeBitmapString(string);
+    return new Bitmap(b.width, b.height, b.byteWidth, b.bitsPerPixel, b.bytesPerPixel, b.image);
+};
+
+// Reads a PNG or BMP file (by its extension) into a bitmap. BMPs of any of
+// the common depths are read; everything but 24-bit comes back as 32-bit.
+module.exports.readBitmap = function(path)
+{
+    var b = robotjs.readBitmapFile(path);
+    return new Bitmap(b.width, b.height, b.byteWidth, b.bitsPerPixel, b.bytesPerPixel, b.image);
+};
+
+// Loads a bitmap saved with saveMappedBitmap() (or converted by
+// scripts/convert-bitmaps.js) by mapping the file, without decoding or
+// copying it. The bitmap also carries the needle signature worked out when it
+// was saved, whose anchor find() and waitForBitmap() check first rather than
+// analysing the needle again.
+module.exports.mapBitmap = function(path)
+{
+    var b = robotjs.mapBitmapFile(path);
+    var result = new Bitmap(b.width, b.height, b.byteWidth, b.bitsPerPixel, b.bytesPerPixel, b.image);
+    result.signature = b.signature;
+    return result;
+};
+
+// Encodes |bitmap| a chunk at a time, as a readable stream, so the whole file
+// is never held in memory. Options are those of encodePNG, plus format ("png"
+// or "bmp") and chunkSize (bytes per chunk, 64 KB by default).
+module.exports.createImageStream = function(bitmap, options)
+{
+    var encoder = robotjs.createImageEncoder(bitmap, options);
+
+    return new stream.Readable({
+        read: function()
+        {
+            var self = this;
+            robotjs.readImageEncoder(encoder).then(function(chunk)
+            {
+                self.push(chunk);
+            }, function(error)
+            {
+                self.destroy(error);
+            });
+        }
+    });
+};
+
+// Writes |bitmap| to |target|, a file descriptor or a writable stream, as it
+// is encoded. Resolves with the number of bytes written.
+module.exports.writeImage = function(bitmap, target, options)
+{
+    if (typeof target === 'number')
     {
-        b = robotjs.captureScreen();
+        return robotjs.writeImageToFD(bitmap, target, options);
     }
 
-    return new bitmap(b.width, b.height, b.byteWidth, b.bitsPerPixel, b.bytesPerPixel, b.image);
+    var source = module.exports.createImageStream(bitmap, options);
+    var written = 0;
+    source.on('data', function(chunk)
+    {
+        written += chunk.length;
+    });
+
+    return new Promise(function(resolve, reject)
+    {
+        stream.pipeline(source, target, function(error)
+        {
+            if (error) reject(error);
+            else resolve(written);
+        });
+    });
 };
+
+// 'screenschange' is emitted, with getScreens(), when displays are added,
+// removed, resized or moved. The native side is only asked to listen while
+// there are listeners, and reports bursts of changes, so the screens are
+// compared with those last seen before anything is emitted.
+var screenEvents = new EventEmitter();
+var lastScreens = null;
+var screensSubscribed = false;
+
+// Subscribes or unsubscribes natively to match the number of listeners. This
+// is done after every call rather than from 'newListener'/'removeListener',
+// which removeAllListeners() with no event would itself remove.
+function syncScreensListener()
+{
+    var wanted = screenEvents.listenerCount('screenschange') > 0;
+    if (wanted === screensSubscribed)
+    {
+        return;
+    }
+    screensSubscribed = wanted;
+    if (wanted)
+    {
+        lastScreens = JSON.stringify(robotjs.getScreens());
+        robotjs.setScreensChangeListener(onScreensChange);
+    }
+    else
+    {
+        robotjs.setScreensChangeListener(null);
+    }
+}
+
+function onScreensChange()
+{
+    var screens = robotjs.getScreens();
+    var key = JSON.stringify(screens);
+    if (key === lastScreens)
+    {
+        return;
+    }
+    lastScreens = key;
+    screenEvents.emit('screenschange', screens);
+    // once() listeners have just been removed.
+    syncScreensListener();
+}
+
+['on', 'once', 'off', 'addListener', 'removeListener', 'removeAllListeners'].forEach(function(method)
+{
+    module.exports[method] = function()
+    {
+        screenEvents[method].apply(screenEvents, arguments);
+        syncScreensListener();
+        return module.exports;
+    };
+});
@@ -0,0 +1,70 @@
+// scripts/convert-bitmaps.js
+//
+// Converts PNG/BMP templates into mapped bitmaps (.mmb), which robot.mapBitmap()
+// loads without decoding.
+//
+//   node scripts/convert-bitmaps.js [--out DIR] FILE_OR_DIR...
+//
+// Directories are converted recursively. Output files go next to their
+// inputs, or under --out (keeping the directory structure). Files whose .mmb
+// is already newer than the source are skipped.
+const fs = require('fs');
+const path = require('path');
+const robot = require('..');
+
+const args = process.argv.slice(2);
+let outDir = null;
+const inputs = [];
+
+for (let i = 0; i < args.length; i++) {
+  if (args[i] === '--out') {
+    outDir = args[++i];
+  } else {
+    inputs.push(args[i]);
+  }
+}
+
+if (inputs.length === 0) {
+  console.error('Usage: node scripts/convert-bitmaps.js [--out DIR] FILE_OR_DIR...');
+  process.exit(1);
+}
+
+let converted = 0;
+let skipped = 0;
+let failed = 0;
+
+function convert(file, base) {
+  const relative = path.relative(base, file);
+  const target = (outDir ? path.join(outDir, relative) : file).replace(/\.(png|bmp)$/i, '.mmb');
+
+  try {
+    if (fs.existsSync(target) && fs.statSync(target).mtimeMs >= fs.statSync(file).mtimeMs) {
+      skipped++;
+      return;
+    }
+
+    fs.mkdirSync(path.dirname(target), { recursive: true });
+    robot.convertToMappedBitmap(file, target);
+    converted++;
+  } catch (err) {
+    console.error(`❌ ${file}: ${err.message}`);
+    failed++;
+  }
+}
+
+function walk(entry, base) {
+  if (fs.statSync(entry).isDirectory()) {
+    for (const name of fs.readdirSync(entry)) {
+      walk(path.join(entry, name), base);
+    }
+  } else if (/\.(png|bmp)$/i.test(entry)) {
+    convert(entry, base);
+  }
+}
+
+for (const input of inputs) {
+  walk(input, fs.statSync(input).isDirectory() ? input : path.dirname(input));
+}
+
+console.log(`Converted ${converted}, skipped ${skipped} up to date, ${failed} failed.`);
+process.exit(failed > 0 ? 1 : 0);
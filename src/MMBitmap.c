@@ -48,11 +48,13 @@ MMBitmapRef copyMMBitmap(MMBitmapRef bitmap)
 
 	assert(bitmap != NULL);
 	if (bitmap->imageBuffer != NULL) {
-		const int32_t bufsize = bitmap->height * bitmap->bytewidth;
-		copiedBuf = malloc(bufsize);
+		/* |bitmap| may be a view, with nothing to read past its last pixel;
+		 * the copy gets the whole of its last row all the same. */
+		const size_t bufsize = (size_t)bitmap->height * bitmap->bytewidth;
+		copiedBuf = calloc(1, bufsize);
 		if (copiedBuf == NULL) return NULL;
 
-		memcpy(copiedBuf, bitmap->imageBuffer, bufsize);
+		memcpy(copiedBuf, bitmap->imageBuffer, MMBitmapBufferSize(bitmap));
 	}
 
 	return createMMBitmap(copiedBuf,
@@ -67,27 +69,51 @@ MMBitmapRef copyMMBitmapFromPortion(MMBitmapRef source, MMSignedRect rect)
 {
 	assert(source != NULL);
 
-	if (source->imageBuffer == NULL || !MMBitmapRectInBounds(source, rect)) {
+	if (source->imageBuffer == NULL || rect.origin.x < 0 || rect.origin.y < 0 ||
+	    !MMBitmapRectInBounds(source, rect)) {
 		return NULL;
 	} else {
-		uint8_t *copiedBuf = NULL;
-		const int32_t bufsize = rect.size.height * source->bytewidth;
-		const int32_t offset = (source->bytewidth * rect.origin.y) +
-		                      (rect.origin.x * source->bytesPerPixel);
+		/* Rows of the copy are packed; only the part of each source row
+		 * inside |rect| is copied. */
+		const size_t rowSize = (size_t)rect.size.width * source->bytesPerPixel;
+		const uint8_t *src = source->imageBuffer +
+		                     (size_t)source->bytewidth * rect.origin.y +
+		                     (size_t)rect.origin.x * source->bytesPerPixel;
+		uint8_t *copiedBuf = malloc(rowSize * rect.size.height);
+		int32_t y;
 
-		/* Don't go over the bounds, programmer! */
-		assert((bufsize + offset) <= (source->bytewidth * source->height));
-
-		copiedBuf = malloc(bufsize);
 		if (copiedBuf == NULL) return NULL;
 
-		memcpy(copiedBuf, source->imageBuffer + offset, bufsize);
+		for (y = 0; y < rect.size.height; y++) {
+			memcpy(copiedBuf + rowSize * y, src + (size_t)source->bytewidth * y, rowSize);
+		}
 
 		return createMMBitmap(copiedBuf,
 		                      rect.size.width,
 		                      rect.size.height,
-		                      source->bytewidth,
+		                      (int32_t)rowSize,
 		                      source->bitsPerPixel,
 		                      source->bytesPerPixel);
 	}
 }
+
+int MMBitmapViewOfPortion(MMBitmapRef source, MMSignedRect rect, MMBitmapRef view)
+{
+	assert(source != NULL && view != NULL);
+
+	if (source->imageBuffer == NULL || rect.origin.x < 0 || rect.origin.y < 0 ||
+	    rect.size.width < 1 || rect.size.height < 1 ||
+	    !MMBitmapRectInBounds(source, rect)) {
+		return -1;
+	}
+
+	view->imageBuffer = source->imageBuffer +
+	                    (size_t)source->bytewidth * rect.origin.y +
+	                    (size_t)rect.origin.x * source->bytesPerPixel;
+	view->width = rect.size.width;
+	view->height = rect.size.height;
+	view->bytewidth = source->bytewidth;
+	view->bitsPerPixel = source->bitsPerPixel;
+	view->bytesPerPixel = source->bytesPerPixel;
+	return 0;
+}
@@ -14,7 +14,8 @@ extern "C"
 
 struct _MMBitmap {
 	uint8_t *imageBuffer;  /* Pixels stored in Quad I format; i.e., origin is in
-	                        * top left. Length should be height * bytewidth. */
+	                        * top left. Length should be height * bytewidth,
+	                        * or at least MMBitmapBufferSize() for a view. */
 	int32_t width;          /* Never 0, unless image is NULL. */
 	int32_t height;         /* Never 0, unless image is NULL. */
 	int32_t bytewidth;      /* The aligned width (width + padding). */
@@ -44,6 +45,19 @@ MMBitmapRef copyMMBitmap(MMBitmapRef bitmap);
  * by the caller.), or NULL on error. */
 MMBitmapRef copyMMBitmapFromPortion(MMBitmapRef source, MMSignedRect rect);
 
+/* Points |view| at the pixels of |rect| in |source| without copying them.
+ * The view keeps the rows of |source|, and so its bytewidth; its pixels are
+ * not its own, and must not be destroy()'d, nor outlive those of |source|.
+ * Returns 0, or -1 if |rect| is not inside |source|. */
+int MMBitmapViewOfPortion(MMBitmapRef source, MMSignedRect rect, MMBitmapRef view);
+
+/* Number of bytes the pixels of |image| span: each row but the last in full,
+ * padding and all, then the last up to its final pixel. A view's last row can
+ * end well short of its bytewidth, so this is all of it that may be read. */
+#define MMBitmapBufferSize(image)                                   \
+	((size_t)(image)->bytewidth * ((size_t)(image)->height - 1) +   \
+	 (size_t)(image)->width * (image)->bytesPerPixel)
+
 #define MMBitmapPointInBounds(image, p) ((p).x < (image)->width && \
                                          (p).y < (image)->height)
 #define MMBitmapRectInBounds(image, r)                    \
@@ -76,7 +90,7 @@ MMBitmapRef copyMMBitmapFromPortion(MMBitmapRef source, MMSignedRect rect);
 do {                                           \
   if (++(pixel).x >= (width)) {                \
     (pixel).x = start_x;                       \
-    ++(point).y;                               \
+    ++(pixel).y;                               \
   }                                            \
 } while (0);
 
@@ -1,41 +1,32 @@
 #include "MMPointArray.h"
-#include <stdlib.h>
+#include "arena.h"
+#include <string.h> /* memcpy() */
 
 MMPointArrayRef createMMPointArray(size_t initialCount)
 {
-	MMPointArrayRef pointArray = calloc(1, sizeof(MMPointArray));
+	MMPointArrayRef pointArray = MMArenaCalloc(1, sizeof(MMPointArray));
+	if (pointArray == NULL) return NULL;
 
 	if (initialCount == 0) initialCount = 1;
 
 	pointArray->_allocedCount = initialCount;
-	pointArray->array = malloc(pointArray->_allocedCount * sizeof(MMPoint));
+	pointArray->array = MMArenaAlloc(pointArray->_allocedCount * sizeof(MMPoint));
 	if (pointArray->array == NULL) return NULL;
 
 	return pointArray;
 }
 
-void destroyMMPointArray(MMPointArrayRef pointArray)
-{
-	if (pointArray->array != NULL) {
-		free(pointArray->array);
-		pointArray->array = NULL;
-	}
-
-	free(pointArray);
-}
-
 void MMPointArrayAppendPoint(MMPointArrayRef pointArray, MMPoint point)
 {
-	const size_t newCount = ++(pointArray->count);
-	if (pointArray->_allocedCount < newCount) {
-		do {
-			/* Double size each time to avoid calls to realloc(). */
-			pointArray->_allocedCount <<= 1;
-		} while (pointArray->_allocedCount < newCount);
-		pointArray->array = realloc(pointArray->array,
-		                            sizeof(point) *
-		                            pointArray->_allocedCount);
+	if (pointArray->_allocedCount == pointArray->count) {
+		/* Double size each time, as the old points are copied over; their
+		 * space comes back when the arena is rewound. */
+		MMPoint *array = MMArenaAlloc(pointArray->_allocedCount * 2 * sizeof(MMPoint));
+		if (array == NULL) return;
+		memcpy(array, pointArray->array, pointArray->count * sizeof(MMPoint));
+		pointArray->array = array;
+		pointArray->_allocedCount *= 2;
 	}
 
-	pointArray->array[pointArray->count - 1] = point;
+	pointArray->array[pointArray->count++] = point;
 }
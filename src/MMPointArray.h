@@ -4,6 +4,11 @@
 
 #include "types.h"
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 struct _MMPointArray {
 	MMPoint *array; /* Pointer to actual data. */
 	size_t count;   /* Number of elements in array. */
@@ -13,15 +18,15 @@ struct _MMPointArray {
 typedef struct _MMPointArray MMPointArray;
 typedef MMPointArray *MMPointArrayRef;
 
-/* Creates array of an initial size (the maximum size is still limitless).
- * This follows the "Create" Rule; i.e., responsibility for "destroying" the
- * array is given to the caller. */
+/* Creates array of an initial size (the maximum size is still limitless), or
+ * returns NULL if out of memory. The array and its points come from the
+ * calling thread's arena (see arena.h), so there is nothing to destroy: they
+ * last until the arena is rewound past them. */
 MMPointArrayRef createMMPointArray(size_t initialCount);
 
-/* Frees memory occupied by |pointArray|. Does not accept NULL. */
-void destroyMMPointArray(MMPointArrayRef pointArray);
-
-/* Appends a point to an array, increasing the internal size if necessary. */
+/* Appends a point to an array, increasing the internal size if necessary.
+ * Must be called on the thread that created the array. Out of memory, the
+ * point is dropped. */
 void MMPointArrayAppendPoint(MMPointArrayRef pointArray, MMPoint point);
 
 /* Retrieve point from array. */
@@ -30,4 +35,8 @@ void MMPointArrayAppendPoint(MMPointArrayRef pointArray, MMPoint point);
 /* Set point in array. */
 #define MMPointArraySetItem(a, i, item) ((a)->array[i] = item)
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* MMARRAY_H */
@@ -17,40 +17,29 @@ void initHashTable(UTHashTable *table, size_t initialCount, size_t nodeSize)
 
 	table->uttable = NULL; /* Must be set to NULL for uthash. */
 	table->allocedNodeCount = (initialCount == 0) ? 1 : initialCount;
+	table->usedNodeCount = 0;
 	table->nodeCount = 0;
 	table->nodeSize = nodeSize;
-	table->nodes = calloc(table->nodeSize, nodeSize * table->allocedNodeCount);
+	table->nodes = MMArenaCalloc(table->allocedNodeCount, nodeSize);
 }
 
 void destroyHashTable(UTHashTable *table)
 {
-	UTHashNode *uttable = table->uttable;
-	UTHashNode *node;
-
-	/* Let uthash do its magic. */
-	while (uttable != NULL) {
-		node = uttable; /* Grab pointer to first item. */
-		HASH_DEL(uttable, node); /* Delete it (table advances to next). */
-	}
-
-	/* Only giant malloc'd block containing each node must be freed. */
-	if (table->nodes != NULL) free(table->nodes);
+	/* Nodes and buckets alike are the arena's to free. */
 	table->uttable = table->nodes = NULL;
+	table->allocedNodeCount = table->usedNodeCount = table->nodeCount = 0;
 }
 
 void *getNewNode(UTHashTable *table)
 {
-	/* Increment node count, resizing table if necessary. */
-	const size_t newNodeCount = ++(table->nodeCount);
-	if (table->allocedNodeCount < newNodeCount) {
-		do {
-			/* Double size each time to avoid calls to realloc(). */
-			table->allocedNodeCount <<= 1;
-		} while (table->allocedNodeCount < newNodeCount);
-
-		table->nodes = realloc(table->nodes, table->nodeSize *
-		                                     table->allocedNodeCount);
+	/* Start a new array, twice the size, when this one is full. */
+	if (table->usedNodeCount == table->allocedNodeCount) {
+		table->allocedNodeCount <<= 1;
+		table->nodes = MMArenaCalloc(table->allocedNodeCount, table->nodeSize);
+		if (table->nodes == NULL) return NULL;
+		table->usedNodeCount = 0;
 	}
 
-	return (char *)table->nodes + (table->nodeSize * (table->nodeCount - 1));
+	++(table->nodeCount);
+	return (char *)table->nodes + (table->nodeSize * table->usedNodeCount++);
 }
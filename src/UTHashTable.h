@@ -3,6 +3,12 @@
 #define UTHASHTABLE_H
 
 #include <stddef.h>
+#include "arena.h"
+
+/* Tables live in the calling thread's arena, nodes, buckets and all, and are
+ * given back when it is rewound past them (see arena.h). */
+#define uthash_malloc(sz) MMArenaAlloc(sz)
+#define uthash_free(ptr) ((void)(ptr))
 #include "uthash.h"
 
 /* All node structs must begin with this (note that there is NO semicolon). */
@@ -14,8 +20,9 @@
  * The main purpose of this is for convenience of creating/freeing nodes. */
 struct _UTHashTable {
 	void *uttable; /* The uthash table -- must start out as NULL. */
-	void *nodes; /* Contiguous array of nodes. */
-	size_t allocedNodeCount; /* Node count currently allocated for. */
+	void *nodes; /* Contiguous array of the latest nodes. */
+	size_t allocedNodeCount; /* Node count |nodes| is allocated for. */
+	size_t usedNodeCount; /* Node count used of |nodes|. */
 	size_t nodeCount; /* Current node count. */
 	size_t nodeSize; /* Size of each node. */
 };
@@ -27,15 +34,17 @@ typedef struct _UTHashTable UTHashTable;
  *
  * If the |initialCount| argument in initHashTable is given, |nodes| is
  * allocated immediately to the maximum size and new nodes are simply slices of
- * that array. This can save calls to malloc if many nodes are to be added, and
- * the a reasonable maximum number is known ahead of time.
+ * that array. This saves allocations if many nodes are to be added, and
+ * a reasonable maximum number is known ahead of time.
  *
- * If the node count goes over this maximum, or if |initialCount| is 0, the
- * array is dynamically reallocated to fit the size.
+ * If the node count goes over this maximum, or if |initialCount| is 0, a new
+ * array twice the size is allocated for the nodes that follow; nodes are
+ * never moved, as uthash links them by address.
  */
 void initHashTable(UTHashTable *table, size_t initialCount, size_t nodeSize);
 
-/* Frees memory occupied by a UTHashTable's members.
+/* Empties a UTHashTable. Its memory is only given back when the arena is
+ * rewound past it.
  *
  * Note that this does NOT free memory for the UTHashTable pointed to by
  * |table| itself; if that was allocated on the heap, you must free() it
@@ -0,0 +1,172 @@
+#include "arena.h"
+#include <stdlib.h> /* malloc() */
+#include <string.h> /* memset() */
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define THREAD_LOCAL __declspec(thread)
+	#define ATOMIC_ADD(ptr, value) \
+		((void)_InterlockedExchangeAdd64((volatile __int64 *)(ptr), (__int64)(value)))
+	#define ATOMIC_LOAD(ptr) \
+		((uint64_t)_InterlockedOr64((volatile __int64 *)(ptr), 0))
+	#define ATOMIC_STORE(ptr, value) \
+		((void)_InterlockedExchange64((volatile __int64 *)(ptr), (__int64)(value)))
+#else
+	#define THREAD_LOCAL __thread
+	#define ATOMIC_ADD(ptr, value) \
+		((void)__atomic_fetch_add((ptr), (uint64_t)(value), __ATOMIC_RELAXED))
+	#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+	#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (uint64_t)(value), __ATOMIC_RELAXED)
+#endif
+
+/* Everything handed out is aligned to this, which suits any type. */
+#define ARENA_ALIGNMENT 16
+
+/* The smallest block worth asking the heap for. */
+#define MIN_BLOCK_SIZE (64 * 1024)
+
+/* A block's memory follows its header, rounded up to the alignment. */
+struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t size;  /* Of the memory after the header. */
+	size_t used;
+};
+
+#define BLOCK_HEADER_SIZE \
+	((sizeof(struct ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define BLOCK_DATA(block) ((uint8_t *)(block) + BLOCK_HEADER_SIZE)
+
+/* This thread's blocks, in the order they were filled. */
+struct Arena {
+	struct ArenaBlock *first;
+	struct ArenaBlock *current;
+};
+
+static THREAD_LOCAL struct Arena arena;
+
+static MMArenaStats counters;
+
+static struct ArenaBlock *newBlock(size_t size)
+{
+	struct ArenaBlock *block;
+
+	if (size < MIN_BLOCK_SIZE) size = MIN_BLOCK_SIZE;
+	if (size > SIZE_MAX - BLOCK_HEADER_SIZE) return NULL;
+	block = malloc(BLOCK_HEADER_SIZE + size);
+	if (block == NULL) return NULL;
+
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	ATOMIC_ADD(&counters.heapAllocations, 1);
+	ATOMIC_ADD(&counters.reservedBytes, size);
+	return block;
+}
+
+static void freeBlocks(struct ArenaBlock *block)
+{
+	while (block != NULL) {
+		struct ArenaBlock *next = block->next;
+		ATOMIC_ADD(&counters.reservedBytes, -(int64_t)block->size);
+		free(block);
+		block = next;
+	}
+}
+
+void *MMArenaAlloc(size_t size)
+{
+	struct ArenaBlock *block = arena.current;
+	void *result;
+
+	if (size > SIZE_MAX - ARENA_ALIGNMENT) return NULL;
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+	if (block == NULL || block->size - block->used < size) {
+		/* On to the next block, if it's big enough; the ones after it only
+		 * hold what was allocated before a rewind, so can go if it isn't. */
+		struct ArenaBlock *next = block != NULL ? block->next : arena.first;
+		if (next == NULL || next->size < size) {
+			struct ArenaBlock *fresh = newBlock(block != NULL && block->size * 2 > size ?
+			                                    block->size * 2 : size);
+			if (fresh == NULL) return NULL;
+			freeBlocks(next);
+			if (block != NULL) {
+				block->next = fresh;
+			} else {
+				arena.first = fresh;
+			}
+			next = fresh;
+		}
+		next->used = 0;
+		arena.current = block = next;
+	}
+
+	result = BLOCK_DATA(block) + block->used;
+	block->used += size;
+	ATOMIC_ADD(&counters.allocations, 1);
+	ATOMIC_ADD(&counters.bytes, size);
+	return result;
+}
+
+void *MMArenaCalloc(size_t count, size_t size)
+{
+	void *result;
+
+	if (size != 0 && count > SIZE_MAX / size) return NULL;
+	result = MMArenaAlloc(count * size);
+	if (result != NULL) memset(result, 0, count * size);
+	return result;
+}
+
+MMArenaMark MMArenaGetMark(void)
+{
+	MMArenaMark mark;
+	mark.block = arena.current;
+	mark.used = arena.current != NULL ? arena.current->used : 0;
+	return mark;
+}
+
+void MMArenaRewind(MMArenaMark mark)
+{
+	struct ArenaBlock *block = mark.block;
+
+	if (block != NULL && (block != arena.first || mark.used > 0)) {
+		block->used = mark.used;
+		arena.current = block;
+		return;
+	}
+
+	/* Back to the start. If the call needed more than one block, swap them
+	 * for one as big as all of them together, so it won't need more again. */
+	if (arena.first != NULL && arena.first->next != NULL) {
+		size_t total = 0;
+		for (block = arena.first; block != NULL; block = block->next) {
+			total += block->size;
+		}
+		freeBlocks(arena.first);
+		arena.first = newBlock(total);
+	}
+	if (arena.first != NULL) arena.first->used = 0;
+	arena.current = NULL;
+}
+
+void MMArenaRelease(void)
+{
+	freeBlocks(arena.first);
+	arena.first = arena.current = NULL;
+}
+
+void MMArenaGetStats(MMArenaStats *stats)
+{
+	stats->allocations = ATOMIC_LOAD(&counters.allocations);
+	stats->bytes = ATOMIC_LOAD(&counters.bytes);
+	stats->heapAllocations = ATOMIC_LOAD(&counters.heapAllocations);
+	stats->reservedBytes = ATOMIC_LOAD(&counters.reservedBytes);
+}
+
+void MMArenaResetStats(void)
+{
+	ATOMIC_STORE(&counters.allocations, 0);
+	ATOMIC_STORE(&counters.bytes, 0);
+	ATOMIC_STORE(&counters.heapAllocations, 0);
+}
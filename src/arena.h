@@ -0,0 +1,65 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* A bump allocator for the temporaries of a single call, one per thread.
+ * Memory is handed out from a few large blocks and never freed piecemeal;
+ * instead the arena is rewound to a mark taken when the call started, which
+ * lets go of everything allocated since in one step. Rewinding all the way
+ * to the start merges the blocks into one big enough for the whole call, so
+ * once a call has run the same call again never touches the heap.
+ *
+ * Marks nest: a call may take its own mark inside another's and rewind to
+ * it, as long as marks are rewound to in the reverse order they were taken. */
+
+struct _MMArenaMark {
+	void *block;  /* The block in use when the mark was taken, or NULL. */
+	size_t used;  /* And how much of it was. */
+};
+
+typedef struct _MMArenaMark MMArenaMark;
+
+/* Allocation counters, summed over every thread's arena. */
+struct _MMArenaStats {
+	uint64_t allocations;     /* Handed out by MMArenaAlloc(). */
+	uint64_t bytes;           /* Their total size. */
+	uint64_t heapAllocations; /* Blocks the arenas had to malloc(). */
+	uint64_t reservedBytes;   /* Held in blocks right now (not reset). */
+};
+
+typedef struct _MMArenaStats MMArenaStats;
+
+/* Returns |size| bytes from this thread's arena, aligned for any type, or
+ * NULL if out of memory. Valid until the arena is rewound past it. */
+void *MMArenaAlloc(size_t size);
+
+/* Like MMArenaAlloc(), but zeroed, for |count| items of |size| bytes. */
+void *MMArenaCalloc(size_t count, size_t size);
+
+MMArenaMark MMArenaGetMark(void);
+
+/* Lets go of everything allocated on this thread since |mark| was taken. */
+void MMArenaRewind(MMArenaMark mark);
+
+/* Frees this thread's blocks, which would otherwise outlive it. Call before
+ * a thread that used the arena exits. */
+void MMArenaRelease(void);
+
+void MMArenaGetStats(MMArenaStats *stats);
+
+/* Zeroes the counters, except |reservedBytes|. */
+void MMArenaResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARENA_H */
@@ -29,83 +29,122 @@ const static int8_t b64_decode_table[256] = {
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1	/* F0-FF */
 };
 
+size_t base64encodeInto(const uint8_t *src, size_t buflen, uint8_t *dest)
+{
+	uint8_t *out = dest;
+	size_t i;
+
+	/* Whole 3 byte groups, each looked up as four 6-bit digits. */
+	for (i = 0; i + 3 <= buflen; i += 3) {
+		const uint32_t group = ((uint32_t)src[i] << 16) |
+		                       ((uint32_t)src[i + 1] << 8) | src[i + 2];
+		out[0] = b64_encode_table[group >> 18];
+		out[1] = b64_encode_table[(group >> 12) & 0x3F];
+		out[2] = b64_encode_table[(group >> 6) & 0x3F];
+		out[3] = b64_encode_table[group & 0x3F];
+		out += 4;
+	}
+
+	/* Then whatever is left over, padded. */
+	if (i < buflen) {
+		const uint32_t group = ((uint32_t)src[i] << 16) |
+		                       (i + 1 < buflen ? (uint32_t)src[i + 1] << 8 : 0);
+		out[0] = b64_encode_table[group >> 18];
+		out[1] = b64_encode_table[(group >> 12) & 0x3F];
+		out[2] = i + 1 < buflen ? b64_encode_table[(group >> 6) & 0x3F] : '=';
+		out[3] = '=';
+		out += 4;
+	}
+
+	return (size_t)(out - dest);
+}
+
+size_t base64decodeInto(const uint8_t *src, size_t buflen, uint8_t *dest)
+{
+	uint8_t *out = dest;
+	uint32_t group = 0;
+	unsigned int digits = 0;
+	size_t i = 0;
+
+	while (i < buflen) {
+		/* Fast path: four digits in a row, the usual case. */
+		if (digits == 0 && i + 4 <= buflen) {
+			const int8_t a = b64_decode_table[src[i]];
+			const int8_t b = b64_decode_table[src[i + 1]];
+			const int8_t c = b64_decode_table[src[i + 2]];
+			const int8_t d = b64_decode_table[src[i + 3]];
+
+			if ((a | b | c | d) >= 0) {
+				const uint32_t value = ((uint32_t)a << 18) | ((uint32_t)b << 12) |
+				                       ((uint32_t)c << 6) | (uint32_t)d;
+				out[0] = (uint8_t)(value >> 16);
+				out[1] = (uint8_t)(value >> 8);
+				out[2] = (uint8_t)value;
+				out += 3;
+				i += 4;
+				continue;
+			}
+		}
+
+		/* Otherwise a digit at a time, skipping noise and padding. */
+		{
+			const int8_t digit = b64_decode_table[src[i++]];
+			if (digit < 0) continue;
+
+			group = (group << 6) | (uint32_t)digit;
+			if (++digits == 4) {
+				out[0] = (uint8_t)(group >> 16);
+				out[1] = (uint8_t)(group >> 8);
+				out[2] = (uint8_t)group;
+				out += 3;
+				group = 0;
+				digits = 0;
+			}
+		}
+	}
+
+	/* A trailing partial group holds one byte per digit after the first. */
+	if (digits >= 2) {
+		group <<= 6 * (4 - digits);
+		*out++ = (uint8_t)(group >> 16);
+		if (digits == 3) *out++ = (uint8_t)(group >> 8);
+	}
+
+	return (size_t)(out - dest);
+}
+
 uint8_t *base64decode(const uint8_t *src, const size_t buflen, size_t *retlen)
 {
-	int8_t digit, lastdigit;
-	size_t i, j;
 	uint8_t *decoded;
-	const size_t maxlen = ((buflen + 3) / 4) * 3;
+	size_t len;
 
 	/* Sanity check */
 	assert(src != NULL);
 
-	digit = lastdigit = j = 0;
-	decoded = malloc(maxlen + 1);
+	decoded = malloc(BASE64_DECODED_MAX_LENGTH(buflen) + 1);
 	if (decoded == NULL) return NULL;
-	for (i = 0; i < buflen; ++i) {
-		if ((digit = b64_decode_table[src[i]]) != -1) {
-			/* Decode block */
-			switch (i % 4) {
-				case 1:
-					decoded[j++] = ((lastdigit << 2) | ((digit & 0x30) >> 4));
-					break;
-				case 2:
-					decoded[j++] = (((lastdigit & 0xF) << 4) | ((digit & 0x3C) >> 2));
-					break;
-				case 3:
-					decoded[j++] = (((lastdigit & 0x03) << 6) | digit);
-					break;
-			}
-			lastdigit = digit;
-		}
-	}
 
-	if (retlen != NULL) *retlen = j;
-	decoded[j] = '\0';
+	len = base64decodeInto(src, buflen, decoded);
+
+	if (retlen != NULL) *retlen = len;
+	decoded[len] = '\0';
 	return decoded; /* Must be free()'d by caller */
 }
 
 uint8_t *base64encode(const uint8_t *src, const size_t buflen, size_t *retlen)
 {
-	size_t i, j;
-	const size_t maxlen = (((buflen + 3) & ~3)) * 4;
-	uint8_t *encoded = malloc(maxlen + 1);
-	if (encoded == NULL) return NULL;
+	uint8_t *encoded;
+	size_t len;
 
 	/* Sanity check */
 	assert(src != NULL);
-	assert(buflen > 0);
-
-	j = 0;
-	for (i = 0; i < buflen + 1; ++i) {
-		/* Encode block */
-		switch (i % 3) {
-			case 0:
-				encoded[j++] = b64_encode_table[src[i] >> 2];
-				encoded[j++] = b64_encode_table[((src[i] & 0x03) << 4) |
-				                                ((src[i + 1] & 0xF0) >> 4)];
-				break;
-			case 1:
-				encoded[j++] = b64_encode_table[((src[i] & 0x0F) << 2) |
-				                                ((src[i + 1] & 0xC0) >> 6)];
-				break;
-			case 2:
-				encoded[j++] = b64_encode_table[(src[i] & 0x3F)];
-				break;
-		}
-	}
 
-	/* Add padding if necessary */
-	if ((j % 4) != 0) {
-		const size_t with_padding = ((j + 3) & ~3); /* Align to 4 bytes */
-		do {
-			encoded[j++] = '=';
-		} while (j < with_padding);
-	}
+	encoded = malloc(BASE64_ENCODED_LENGTH(buflen) + 1);
+	if (encoded == NULL) return NULL;
 
-	assert(j <= maxlen);
+	len = base64encodeInto(src, buflen, encoded);
 
-	if (retlen != NULL) *retlen = j;
-	encoded[j] = '\0';
+	if (retlen != NULL) *retlen = len;
+	encoded[len] = '\0';
 	return encoded; /* Must be free()'d by caller */
 }
@@ -10,6 +10,11 @@
 	#include <stdint.h>
 #endif
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 /* Decode a base64 encoded string discarding line breaks and noise.
  *
  * Returns a new string to be free()'d by caller, or NULL on error.
@@ -28,4 +33,25 @@ uint8_t *base64decode(const uint8_t *buf, const size_t buflen, size_t *retlen);
  * (minus the NUL-terminator) on successful return. */
 uint8_t *base64encode(const uint8_t *buf, const size_t buflen, size_t *retlen);
 
+/* Returns the exact length of |buflen| bytes once encoded, padding included
+ * (but not a NUL-terminator). */
+#define BASE64_ENCODED_LENGTH(buflen) ((((buflen) + 2) / 3) * 4)
+
+/* Returns the most bytes |buflen| characters of base64 can decode to. */
+#define BASE64_DECODED_MAX_LENGTH(buflen) ((((buflen) + 3) / 4) * 3)
+
+/* Encodes |buflen| bytes of |buf| into |dest|, which must have room for
+ * BASE64_ENCODED_LENGTH(buflen) bytes. Does not NUL-terminate. Returns the
+ * number of bytes written. */
+size_t base64encodeInto(const uint8_t *buf, size_t buflen, uint8_t *dest);
+
+/* Decodes |buflen| characters of |buf| into |dest|, which must have room for
+ * BASE64_DECODED_MAX_LENGTH(buflen) bytes, discarding line breaks and noise
+ * like base64decode(). Returns the number of bytes written. */
+size_t base64decodeInto(const uint8_t *buf, size_t buflen, uint8_t *dest);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* BASE64_H */
@@ -1,40 +1,15 @@
 #include "bitmap_find.h"
-#include "UTHashTable.h"
+#include "color_table.h"
+#include "arena.h"
 #include <assert.h>
 
-/* Node to be used in hash table. */
-struct shiftNode {
-	UTHashNode_HEAD /* Make structure hashable */
-	MMRGBHex color; /* Key */
-	MMPoint offset; /* Value */
-};
-
-/* --- Hash table helper functions --- */
-
-/* Adds hex-color/offset pair to jump table. */
-static void addNodeToTable(UTHashTable *table, MMRGBHex color, MMPoint offset);
-
-/* Returns node associated with color in jump table, or NULL if it
- * doesn't exist. */
-static struct shiftNode *nodeForColor(UTHashTable *table, MMRGBHex color);
-
-/* Returns nonzero (true) if table has key, or zero (false) if not. */
-#define tableHasKey(table, color) (nodeForColor(table, color) != NULL)
+/* The most colors findNeedleAnchor() counts; needles with more are anchored
+ * on their top left pixel. Keeps what the arena holds on to after analysing
+ * a big needle to about 1.5 MB. */
+#define ANCHOR_MAX_COLORS (1 << 16)
 
 /* --- Boyer-Moore helper functions --- */
 
-/* Calculates the first table for use in a Boyer-Moore search algorithm.
- * Table is in the form [colors: shift_values], where colors are those in
- * |needle|, and the shift values are each color's distance from the rightmost
- * offset. All other colors are assumed to have a shift value equal to the
- * length of needle.
- */
-static void initBadShiftTable(UTHashTable *jumpTable, MMBitmapRef needle);
-
-/* Frees memory occupied by calling initBadShiftTable().
- * Currently this is just an alias for destroyHashTable(). */
-#define destroyBadShiftTable(jumpTable) destroyHashTable(jumpTable)
-
 /* Returns true if |needle| is found in |haystack| at |offset|. */
 static int needleAtOffset(MMBitmapRef needle, MMBitmapRef haystack,
                           MMPoint offset, float tolerance);
@@ -46,9 +21,15 @@ static int needleAtOffset(MMBitmapRef needle, MMBitmapRef haystack,
  * TODO: The Boyer-Moore algorithm (with the second jump table) would probably
  * be more efficient, but this was simpler (for now).
  *
- * The jump table (|badShiftTable|) is passed as a parameter to avoid being
- * recalculated each time. It should be a pointer to a UTHashTable init'd with
- * initBadShiftTable().
+ * The skipping that would use the first Boyer-Moore table (the bad-shift
+ * table) fails on certain edge cases (issue#7), so for now every offset is
+ * scanned and the table isn't built. When skipping comes back, the table is
+ * an MMColorTable (see color_table.h) from each color in |needle| to the
+ * index of its last pixel, built once per search and passed in here; colors
+ * not in it shift the whole needle.
+ *
+ * Each offset is first checked at the pixel of |needle| at |anchor|, which
+ * rules most of them out in one comparison when it is a rare color.
  *
  * Returns 0 and sets |point| to the starting point of |needle| in |haystack|
  * if |needle| was found in |haystack|, or returns -1 if not. */
@@ -58,69 +39,60 @@ static int findBitmapInRectAt(MMBitmapRef needle,
                                 MMRect rect,
                                 float tolerance,
                                 MMPoint startPoint,
-                                UTHashTable *badShiftTable)
+                                MMPoint anchor)
 {
-	const size_t scanHeight = rect.size.height - needle->height;
-	const size_t scanWidth = rect.size.width - needle->width;
 	MMPoint pointOffset = startPoint;
-	/* const MMPoint lastPoint = MMPointMake(needle->width - 1, needle->height - 1); */
+	size_t scanHeight, scanWidth;
+	MMRGBHex anchorColor;
 
 	/* Sanity check */
-	if (needle->height > haystack->height || needle->width > haystack->width ||
+	if ((size_t)needle->height > rect.size.height ||
+	    (size_t)needle->width > rect.size.width ||
 	    !MMBitmapRectInBounds(haystack, rect)) {
 		return -1;
 	}
 
+	/* The last offsets at which |needle| still fits inside |rect|. */
+	scanHeight = rect.origin.y + rect.size.height - needle->height;
+	scanWidth = rect.origin.x + rect.size.width - needle->width;
+
 	assert(point != NULL);
 	assert(needle != NULL);
 	assert(needle->height > 0 && needle->width > 0);
 	assert(haystack != NULL);
 	assert(haystack->height > 0 && haystack->width > 0);
-	assert(badShiftTable != NULL);
+	assert(anchor.x < (size_t)needle->width && anchor.y < (size_t)needle->height);
+
+	anchorColor = MMRGBHexAtPoint(needle, anchor.x, anchor.y);
 
 	/* Search |haystack|, while |needle| can still be within it. */
 	while (pointOffset.y <= scanHeight) {
-		/* struct shiftNode *node = NULL;
-		MMRGBHex lastColor; */
-
 		while (pointOffset.x <= scanWidth) {
-			/* Check offset in |haystack| for |needle|. */
-			if (needleAtOffset(needle, haystack, pointOffset, tolerance)) {
-				++pointOffset.x;
-				++pointOffset.y;
+			/* Check offset in |haystack| for |needle|, anchor first. */
+			const MMRGBHex hcolor = MMRGBHexAtPoint(haystack, pointOffset.x + anchor.x,
+			                                                  pointOffset.y + anchor.y);
+			if (MMRGBHexSimilarToColor(anchorColor, hcolor, tolerance) &&
+			    needleAtOffset(needle, haystack, pointOffset, tolerance)) {
 				*point = pointOffset;
 				return 0;
 			}
 
-			/* Otherwise, calculate next x offset to check. */
-			/*
-			 * Note that here we are getting the skip value based on the last
-			 * color of |needle|, no matter where we didn't match. The
-			 * alternative of pretending that the mismatched color was the previous
-			 * color is slower in the normal case.
-			 */
-			/* lastColor = MMRGBHexAtPoint(haystack, pointOffset.x + lastPoint.x,
-			                                      pointOffset.y + lastPoint.y); */
-
-			/* TODO: This fails on certain edge cases (issue#7). */
-			/* When a color is encountered that does not occur in |needle|, we can
-			 * safely skip ahead for the whole length of |needle|.
-			 * Otherwise, use the value stored in the jump table. */
-			/* node = nodeForColor(badShiftTable, lastColor);
-			pointOffset.x += (node == NULL) ? needle->width : (node->offset).x; */
-
-			/* For now, be naive. */
+			/* Otherwise, calculate next x offset to check.
+			 *
+			 * TODO: Skipping by the bad-shift table fails on certain edge
+			 * cases (issue#7). It would take the haystack color under the last
+			 * pixel of |needle|, no matter where we didn't match (pretending
+			 * the mismatched color was the previous color is slower in the
+			 * normal case), and skip the whole width of |needle| for a color
+			 * not in it, or the color's shift from the table otherwise.
+			 *
+			 * For now, be naive. */
 			++pointOffset.x;
 		}
 
 		pointOffset.x = rect.origin.x;
 
-		/* lastColor = MMRGBHexAtPoint(haystack, pointOffset.x + lastPoint.x,
-		                               pointOffset.y + lastPoint.y);
-		node = nodeForColor(badShiftTable, lastColor);
-		pointOffset.y += node == NULL ? lastPoint.y : (node->offset).y; */
-
-		/* TODO: The above commented out code fails at certain edge cases, e.g.:
+		/* TODO: Skipping rows the same way fails at certain edge cases, e.g.:
 		 * Needle: [B, b
 		 *          b, b,
 		 *          B, b]
@@ -145,37 +117,92 @@ static int findBitmapInRectAt(MMBitmapRef needle,
 	return -1;
 }
 
+MMPoint findNeedleAnchor(MMBitmapRef needle, uint32_t *colorCount)
+{
+	const size_t pixels = (size_t)needle->width * (size_t)needle->height;
+	const size_t maxColors = pixels < ANCHOR_MAX_COLORS ? pixels : ANCHOR_MAX_COLORS;
+	const MMArenaMark mark = MMArenaGetMark();
+	MMColorTable table; /* Color to its place in |counts| and |firsts|. */
+	uint32_t *counts, *firsts;
+	uint32_t used = 0, rarest, i;
+	MMPoint anchor = MMPointZero;
+	MMPoint scan;
+	int counting;
+
+	counts = MMArenaAlloc(maxColors * sizeof(uint32_t));
+	firsts = MMArenaAlloc(maxColors * sizeof(uint32_t));
+	counting = counts != NULL && firsts != NULL &&
+	           initMMColorTable(&table, maxColors) == 0;
+
+	for (scan.y = 0; counting && scan.y < (size_t)needle->height; ++scan.y) {
+		for (scan.x = 0; counting && scan.x < (size_t)needle->width; ++scan.x) {
+			const MMRGBHex color = MMRGBHexAtPoint(needle, scan.x, scan.y);
+			uint32_t index;
+
+			if (MMColorTableGet(&table, color, &index)) {
+				++counts[index];
+			} else if (MMColorTableAdd(&table, color, used) == 1) {
+				counts[used] = 1;
+				firsts[used] = (uint32_t)(scan.y * (size_t)needle->width + scan.x);
+				++used;
+			} else {
+				/* Too many colors to be worth anchoring on one. */
+				counting = 0;
+			}
+		}
+	}
+
+	if (counting && used > 0) {
+		/* Colors are numbered in order of first appearance, so of the rarest
+		 * this finds the one that appears first. */
+		rarest = 0;
+		for (i = 1; i < used; ++i) {
+			if (counts[i] < counts[rarest]) rarest = i;
+		}
+		anchor = MMPointMake(firsts[rarest] % (uint32_t)needle->width,
+		                     firsts[rarest] / (uint32_t)needle->width);
+	} else {
+		used = 0;
+	}
+
+	if (colorCount != NULL) *colorCount = used;
+	MMArenaRewind(mark);
+	return anchor;
+}
+
 int findBitmapInRect(MMBitmapRef needle,
 		             MMBitmapRef haystack,
                      MMPoint *point,
                      MMRect rect,
                      float tolerance)
 {
-	UTHashTable badShiftTable;
-	int ret;
-
-	initBadShiftTable(&badShiftTable, needle);
-	ret = findBitmapInRectAt(needle, haystack, point, rect,
-	                         tolerance, MMPointZero, &badShiftTable);
-	destroyBadShiftTable(&badShiftTable);
-	return ret;
+	return findBitmapInRectAt(needle, haystack, point, rect, tolerance,
+	                          rect.origin, findNeedleAnchor(needle, NULL));
+}
+
+int findBitmapInRectFromAnchor(MMBitmapRef needle, MMBitmapRef haystack,
+                               MMPoint *point, MMRect rect, float tolerance,
+                               MMPoint anchor)
+{
+	return findBitmapInRectAt(needle, haystack, point, rect, tolerance,
+	                          rect.origin, anchor);
 }
 
 MMPointArrayRef findAllBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
                                     MMRect rect, float tolerance)
 {
 	MMPointArrayRef pointArray = createMMPointArray(0);
-	MMPoint point = MMPointZero;
-	UTHashTable badShiftTable;
+	MMPoint point = rect.origin;
+	const MMPoint anchor = findNeedleAnchor(needle, NULL);
+
+	if (pointArray == NULL) return NULL;
 
-	initBadShiftTable(&badShiftTable, needle);
 	while (findBitmapInRectAt(needle, haystack, &point, rect,
-	                          tolerance, point, &badShiftTable) == 0) {
-		const size_t scanWidth = (haystack->width - needle->width) + 1;
+	                          tolerance, point, anchor) == 0) {
+		const size_t scanWidth = rect.origin.x + rect.size.width - needle->width + 1;
 		MMPointArrayAppendPoint(pointArray, point);
-		ITER_NEXT_POINT(point, scanWidth, 0);
+		ITER_NEXT_POINT(point, scanWidth, rect.origin.x);
 	}
-	destroyBadShiftTable(&badShiftTable);
 
 	return pointArray;
 }
@@ -184,48 +211,21 @@ size_t countOfBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
                            MMRect rect, float tolerance)
 {
 	size_t count = 0;
-	MMPoint point = MMPointZero;
-	UTHashTable badShiftTable;
+	MMPoint point = rect.origin;
+	const MMPoint anchor = findNeedleAnchor(needle, NULL);
 
-	initBadShiftTable(&badShiftTable, needle);
 	while (findBitmapInRectAt(needle, haystack, &point, rect,
-	                          tolerance, point, &badShiftTable) == 0) {
-		const size_t scanWidth = (haystack->width - needle->width) + 1;
+	                          tolerance, point, anchor) == 0) {
+		const size_t scanWidth = rect.origin.x + rect.size.width - needle->width + 1;
 		++count;
-		ITER_NEXT_POINT(point, scanWidth, 0);
+		ITER_NEXT_POINT(point, scanWidth, rect.origin.x);
 	}
-	destroyBadShiftTable(&badShiftTable);
 
 	return count;
 }
 
 /* --- Boyer-Moore helper functions --- */
 
-static void initBadShiftTable(UTHashTable *jumpTable, MMBitmapRef needle)
-{
-	const MMPoint lastPoint = MMPointMake(needle->width - 1, needle->height - 1);
-	const size_t maxColors = needle->width * needle->height;
-	MMPoint scan;
-
-	/* Allocate max size initially to avoid a million calls to malloc(). */
-	initHashTable(jumpTable, maxColors, sizeof(struct shiftNode));
-
-	/* Populate jumpTable with analysis of |needle|. */
-	for (scan.y = lastPoint.y; ; --scan.y) {
-		for (scan.x = lastPoint.x; ; --scan.x) {
-			MMRGBHex color = MMRGBHexAtPoint(needle, scan.x, scan.y);
-			if (!tableHasKey(jumpTable, color)) {
-				addNodeToTable(jumpTable, color,
-				               MMPointMake(needle->width - scan.x,
-				                           needle->height - scan.y));
-			}
-
-			if (scan.x == 0) break; /* Avoid infinite loop from unsigned type. */
-		}
-		if (scan.y == 0) break;
-	}
-}
-
 static int needleAtOffset(MMBitmapRef needle, MMBitmapRef haystack,
                           MMPoint offset, float tolerance)
 {
@@ -247,24 +247,3 @@ static int needleAtOffset(MMBitmapRef needle, MMBitmapRef haystack,
 
 	return 1;
 }
-
-/* --- Hash table helper functions --- */
-
-static void addNodeToTable(UTHashTable *table,
-                           MMRGBHex hexColor,
-                           MMPoint offset)
-{
-	struct shiftNode *node = getNewNode(table);
-	node->color = hexColor;
-	node->offset = offset;
-	UTHASHTABLE_ADD_INT(table, color, node, struct shiftNode);
-}
-
-static struct shiftNode *nodeForColor(UTHashTable *table,
-                                      MMRGBHex color)
-{
-	struct shiftNode *uttable = table->uttable;
-	struct shiftNode *node;
-	HASH_FIND_INT(uttable, &color, node);
-	return node;
-}
@@ -6,6 +6,11 @@
 #include "MMBitmap.h"
 #include "MMPointArray.h"
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 /* Convenience wrapper around findBitmapInRect(), where |rect| is the bounds
  * of |haystack|. */
 #define findBitmapInBitmap(needle, haystack, pointPtr, tol) \
@@ -20,6 +25,19 @@
 int findBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
                      MMPoint *point, MMRect rect, float tolerance);
 
+/* Returns the pixel of |needle| worth comparing first when searching for
+ * it: the first pixel, row by row, of its rarest color. Sets |colorCount|,
+ * if not NULL, to the number of colors in |needle|; if there are too many to
+ * count, it is set to 0 and the top left pixel is returned. */
+MMPoint findNeedleAnchor(MMBitmapRef needle, uint32_t *colorCount);
+
+/* Like findBitmapInRect(), but with the anchor of |needle| (see
+ * findNeedleAnchor()) worked out beforehand, such as for a mapped bitmap,
+ * which carries its own. */
+int findBitmapInRectFromAnchor(MMBitmapRef needle, MMBitmapRef haystack,
+                               MMPoint *point, MMRect rect, float tolerance,
+                               MMPoint anchor);
+
 /* Convenience wrapper around findAllBitmapInRect(), where |rect| is the bounds
  * of |haystack|. */
 #define findAllBitmapInBitmap(needle, haystack, tolerance) \
@@ -27,14 +45,15 @@ int findBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
 			            MMBitmapGetBounds(haystack), tolerance)
 
 /* Returns MMPointArray of all occurrences of |needle| in |haystack| inside of
- * |rect|. Note that an is returned regardless of whether |needle| was found;
- * check array->count to see if it actually was.
+ * |rect|. Note that an is returned regardless of whether |needle| was found
+ * (it is NULL only if out of memory); check array->count to see if it
+ * actually was.
  *
  * |tolerance| should be in the range 0.0f - 1.0f, denoting how closely the
  * colors in the bitmaps need to match, with 0 being exact and 1 being any.
  *
- * Responsibility for freeing the MMPointArray with destroyMMPointArray() is
- * given to the caller.
+ * The MMPointArray is in the calling thread's arena, so it lasts until the
+ * caller rewinds the arena past it (see MMPointArray.h).
  */
 MMPointArrayRef findAllBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
                                     MMRect rect, float tolerance);
@@ -49,4 +68,8 @@ MMPointArrayRef findAllBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
 size_t countOfBitmapInRect(MMBitmapRef needle, MMBitmapRef haystack,
                            MMRect rect, float tolerance);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* BITMAP_H */
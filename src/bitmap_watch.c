@@ -0,0 +1,229 @@
+#include "bitmap_watch.h"
+#include "bitmap_find.h"
+#include "screen_reader.h"
+#include <stdlib.h> /* calloc() */
+#include <string.h> /* memcpy() */
+
+/* Tiles are at least this big, and at least as big as the needle, so that
+ * the margin searched around a changed tile never dwarfs the tile. */
+#define MIN_TILE_SIZE 32
+
+/* A run of changed tiles [first, last) in each of the tile rows from |top|
+ * down, waiting to be searched as one rect. */
+struct TileRun {
+	size_t first;
+	size_t last;
+	size_t top;
+};
+
+struct _MMBitmapWatch {
+	MMBitmapRef needle;
+	MMPoint anchor;
+	MMSignedRect rect;
+	float tolerance;
+	MMScreenReaderRef reader;
+
+	/* Laid out on the first poll, once the size of a capture is known. */
+	size_t tileSize;
+	size_t columns;
+	size_t rows;
+	uint64_t *hashes;   /* Of each tile at the last poll. */
+	bool *changed;      /* Of each tile in the current row. */
+	struct TileRun *runs;
+	struct TileRun *nextRuns;
+	bool polled;
+};
+
+MMBitmapWatchRef createMMBitmapWatch(MMBitmapRef needle, MMPoint anchor,
+                                     MMSignedRect rect, float tolerance)
+{
+	MMBitmapWatchRef watch = calloc(1, sizeof(MMBitmapWatch));
+	if (watch == NULL) return NULL;
+
+	watch->needle = needle;
+	watch->anchor = anchor;
+	watch->rect = rect;
+	watch->tolerance = tolerance;
+	watch->reader = createMMScreenReader(&rect, 1);
+	if (watch->reader == NULL) {
+		free(watch);
+		return NULL;
+	}
+
+	return watch;
+}
+
+static bool layOutTiles(MMBitmapWatchRef watch, MMBitmapRef frame)
+{
+	size_t tileSize = MIN_TILE_SIZE;
+	while (tileSize < (size_t)watch->needle->width ||
+	       tileSize < (size_t)watch->needle->height) {
+		tileSize *= 2;
+	}
+
+	watch->tileSize = tileSize;
+	watch->columns = ((size_t)frame->width + tileSize - 1) / tileSize;
+	watch->rows = ((size_t)frame->height + tileSize - 1) / tileSize;
+	watch->hashes = calloc(watch->columns * watch->rows, sizeof(uint64_t));
+	watch->changed = calloc(watch->columns, sizeof(bool));
+	watch->runs = calloc(watch->columns, sizeof(struct TileRun));
+	watch->nextRuns = calloc(watch->columns, sizeof(struct TileRun));
+	return watch->hashes != NULL && watch->changed != NULL &&
+	       watch->runs != NULL && watch->nextRuns != NULL;
+}
+
+/* FNV-1a over the tile's rows, a word at a time. */
+static uint64_t hashTile(MMBitmapRef frame, size_t left, size_t top, size_t size)
+{
+	const size_t right = left + size < (size_t)frame->width ? left + size : (size_t)frame->width;
+	const size_t bottom = top + size < (size_t)frame->height ? top + size : (size_t)frame->height;
+	const size_t length = (right - left) * frame->bytesPerPixel;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t y, i;
+
+	for (y = top; y < bottom; y++) {
+		const uint8_t *row = frame->imageBuffer + y * frame->bytewidth + left * frame->bytesPerPixel;
+		for (i = 0; i + 8 <= length; i += 8) {
+			uint64_t word;
+			memcpy(&word, row + i, 8);
+			hash = (hash ^ word) * 1099511628211ULL;
+		}
+		for (; i < length; i++) hash = (hash ^ row[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/* Searches every offset at which the needle would overlap the tiles of
+ * |run|, down to (but not including) tile row |bottom|. */
+static bool searchRun(MMBitmapWatchRef watch, MMBitmapRef frame,
+                      const struct TileRun *run, size_t bottom, MMPoint *found)
+{
+	const size_t size = watch->tileSize;
+	const size_t needleWidth = (size_t)watch->needle->width;
+	const size_t needleHeight = (size_t)watch->needle->height;
+	const size_t left = run->first * size;
+	const size_t top = run->top * size;
+	size_t right = run->last * size - 1 + needleWidth;
+	size_t lower = bottom * size - 1 + needleHeight;
+	MMRect rect;
+
+	rect.origin.x = left >= needleWidth - 1 ? left - (needleWidth - 1) : 0;
+	rect.origin.y = top >= needleHeight - 1 ? top - (needleHeight - 1) : 0;
+	if (right > (size_t)frame->width) right = (size_t)frame->width;
+	if (lower > (size_t)frame->height) lower = (size_t)frame->height;
+	rect.size.width = right - rect.origin.x;
+	rect.size.height = lower - rect.origin.y;
+
+	return findBitmapInRectFromAnchor(watch->needle, frame, found, rect,
+	                                  watch->tolerance, watch->anchor) == 0;
+}
+
+/* Hashes every tile of |frame|, and searches around the ones that changed.
+ * Changed tiles are gathered into runs along each row, and a run is carried
+ * down for as long as the rows below change in exactly the same columns, so
+ * that a whole new frame is searched in one go rather than row by row. */
+static bool searchChanges(MMBitmapWatchRef watch, MMBitmapRef frame,
+                          MMPoint *found, bool *anyChanged)
+{
+	size_t runCount = 0;
+	size_t row, column, i;
+
+	*anyChanged = !watch->polled;
+
+	for (row = 0; row <= watch->rows; row++) {
+		size_t nextCount = 0;
+
+		/* The runs in this row; an empty one past the last row closes all. */
+		if (row < watch->rows) {
+			for (column = 0; column < watch->columns; column++) {
+				uint64_t *hash = &watch->hashes[row * watch->columns + column];
+				const uint64_t current = hashTile(frame, column * watch->tileSize,
+				                                  row * watch->tileSize, watch->tileSize);
+				watch->changed[column] = !watch->polled || current != *hash;
+				if (watch->changed[column]) *anyChanged = true;
+				*hash = current;
+			}
+
+			for (column = 0; column < watch->columns; column++) {
+				struct TileRun run;
+				if (!watch->changed[column]) continue;
+				run.first = column;
+				while (column < watch->columns && watch->changed[column]) column++;
+				run.last = column;
+				run.top = row;
+				watch->nextRuns[nextCount++] = run;
+			}
+		}
+
+		/* Carry on the runs that continue; search the ones that stop. */
+		for (i = 0; i < runCount; i++) {
+			const struct TileRun *run = &watch->runs[i];
+			size_t j;
+			bool continued = false;
+
+			for (j = 0; j < nextCount; j++) {
+				if (watch->nextRuns[j].first == run->first &&
+				    watch->nextRuns[j].last == run->last) {
+					watch->nextRuns[j].top = run->top;
+					continued = true;
+					break;
+				}
+			}
+
+			if (!continued && searchRun(watch, frame, run, row, found)) return true;
+		}
+
+		memcpy(watch->runs, watch->nextRuns, nextCount * sizeof(struct TileRun));
+		runCount = nextCount;
+	}
+
+	return false;
+}
+
+int pollMMBitmapWatch(MMBitmapWatchRef watch, MMSignedPoint *point, bool *changed)
+{
+	MMBitmap frame;
+	uint8_t *owned;
+	MMPoint found;
+	bool isFound;
+
+	if (!readMMScreenReader(watch->reader, 0, &frame, &owned)) {
+		free(owned);
+		return -1;
+	}
+
+	if (watch->hashes == NULL && !layOutTiles(watch, &frame)) {
+		free(owned);
+		return -1;
+	}
+
+	isFound = searchChanges(watch, &frame, &found, changed);
+
+	/* A match ends the search part way, with tiles hashed that were never
+	 * searched, so the next poll starts over. */
+	watch->polled = !isFound;
+
+	if (isFound) {
+		/* Back to screen coordinates, which are coarser on HiDPI displays. */
+		const MMSignedRect rect = watch->rect;
+		*point = MMSignedPointMake(
+			rect.origin.x + (int32_t)((int64_t)found.x * rect.size.width / frame.width),
+			rect.origin.y + (int32_t)((int64_t)found.y * rect.size.height / frame.height));
+	}
+
+	free(owned);
+	return isFound ? 1 : 0;
+}
+
+void destroyMMBitmapWatch(MMBitmapWatchRef watch)
+{
+	if (watch == NULL) return;
+
+	destroyMMScreenReader(watch->reader);
+	free(watch->hashes);
+	free(watch->changed);
+	free(watch->runs);
+	free(watch->nextRuns);
+	free(watch);
+}
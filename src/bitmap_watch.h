@@ -0,0 +1,50 @@
+#pragma once
+#ifndef BITMAP_WATCH_H
+#define BITMAP_WATCH_H
+
+#include "types.h"
+#include "MMBitmap.h"
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Looks for a needle in a rect of the display, capture after capture. The
+ * rect is split into tiles, and each poll only searches again where the
+ * needle could overlap a tile that changed since the previous one; a still
+ * screen costs a capture and a hash per poll, not a search. */
+typedef struct _MMBitmapWatch MMBitmapWatch;
+typedef MMBitmapWatch *MMBitmapWatchRef;
+
+/* Sets up to search |rect| of the main display for |needle|, which must
+ * outlive the watch, within |tolerance|, comparing the pixel at |anchor|
+ * first (see findBitmapInRectFromAnchor()). Like an
+ * MMScreenReader, which it reads through, the watch may be polled from any
+ * one thread at a time.
+ *
+ * Returns NULL if the display could not be opened. */
+MMBitmapWatchRef createMMBitmapWatch(MMBitmapRef needle, MMPoint anchor,
+                                     MMSignedRect rect, float tolerance);
+
+/* Reads the rect once and searches the parts of it that changed. |changed|
+ * is set to whether any did (always true on the first poll).
+ *
+ * Returns 1 and sets |point| to the screen position of the needle's top left
+ * corner if it was found, 0 if it wasn't, or -1 if the display could not be
+ * read. */
+int pollMMBitmapWatch(MMBitmapWatchRef watch, MMSignedPoint *point, bool *changed);
+
+void destroyMMBitmapWatch(MMBitmapWatchRef watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BITMAP_WATCH_H */
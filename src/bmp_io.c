@@ -2,6 +2,7 @@
 #include "os.h"
 #include "endian.h"
 #include <stdio.h> /* fopen() */
+#include <stdlib.h> /* malloc() */
 #include <string.h> /* memcpy() */
 
 #if defined(_MSC_VER)
@@ -26,13 +27,20 @@ struct BITMAP_FILE_HEADER {
 
 #define BMP_MAGIC 0x4D42 /* The starting key that marks the file as a BMP. */
 
+#define BMP_READ_BLOCK_SIZE 262144 /* Pixel data is read this much at a time. */
+
+#define BMP_MAX_RLE_PIXELS (1 << 26) /* RLE data can skip any number of pixels,
+                                      * so the file's size doesn't bound the
+                                      * image's; this (8192x8192) does. */
+
 enum _BMP_COMPRESSION {
 	kBMP_RGB = 0, /* No compression. */
 	kBMP_RLE8 = 1, /* Can only be used with 8-bit bitmaps. */
 	kBMP_RLE4 = 2, /* Can only be used with 4-bit bitmaps. */
 	kBMP_BITFIELDS = 3, /* Can only be used with 16/32-bit bitmaps. */
 	kBMP_JPEG = 4, /* Bitmap contains a JPEG image. */
-	kBMP_PNG = 5 /* Bitmap contains a PNG image. */
+	kBMP_PNG = 5, /* Bitmap contains a PNG image. */
+	kBMP_ALPHABITFIELDS = 6 /* Like kBMP_BITFIELDS, with an alpha mask. */
 };
 
 typedef uint32_t BMP_COMPRESSION;
@@ -83,9 +91,9 @@ struct BITMAP_CORE_HEADER {
 static void convertBitmapFileHeader(struct BITMAP_FILE_HEADER *header)
 {
 	header->magic = swapLittleAndHost16(header->magic);
-	swapLittleAndHost32(header->fileSize);
-	swapLittleAndHost32(header->reserved);
-	swapLittleAndHost32(header->imageOffset);
+	header->fileSize = swapLittleAndHost32(header->fileSize);
+	header->reserved = swapLittleAndHost32(header->reserved);
+	header->imageOffset = swapLittleAndHost32(header->imageOffset);
 }
 
 /* Converts bitmap info header from to and from little endian, if and only if
@@ -111,13 +119,63 @@ static void convertBitmapInfoHeader(struct BITMAP_INFO_HEADER *header)
 	#define convertBitmapInfoHeader(header)
 #endif
 
-/* Returns newly alloc'd image data from bitmap file. The current position of
- * the file must be at the start of the image before calling this. */
-static uint8_t *readImageData(FILE *fp, size_t width, size_t height,
-                              uint8_t bytesPerPixel, size_t bytewidth);
+/* SSE2 is always there on x86-64, and on 32-bit x86 when asked for. */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define BMP_USE_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define BMP_USE_SSE2 0
+#endif
+
+/* Where one channel sits in a packed 16 or 32-bit pixel, and how to scale it
+ * to 8 bits: ((value << left) >> down) | (value >> repeat), which copies the
+ * top bits of a short channel into the bottom ones (so 5-bit 31 becomes 255).
+ * An absent channel has a mask of 0, and always comes out as 0. */
+struct _BMPChannel {
+	uint32_t shift; /* Position of the mask's lowest bit. */
+	uint32_t mask;  /* The mask, shifted down by |shift|. */
+	uint32_t left;
+	uint32_t down;
+	uint32_t repeat;
+};
+
+/* A packed pixel layout; channels are in MMRGBColor order (blue, green, red),
+ * then alpha. */
+struct _BMPPixelFormat {
+	struct _BMPChannel channels[4];
+	bool hasAlpha; /* Otherwise, alpha comes out as 0xFF. */
+};
+
+/* Everything needed to decode the pixel data, worked out from the headers. */
+struct _BMPDecoder {
+	int32_t width;
+	int32_t height;                /* Always positive; */
+	bool topDown;                  /* true if the file starts at the top. */
+	uint16_t bitsPerPixel;         /* Of the file. */
+	BMP_COMPRESSION compression;
+	size_t stride;                 /* Bytes per row in the file. */
+	bool direct;                   /* Rows need no converting. */
+	uint32_t palette[256];         /* BGRA, for 1, 4 and 8-bit files. */
+	struct _BMPPixelFormat format; /* For 16 and 32-bit files. */
+	uint8_t *dest;
+	size_t bytewidth;              /* Of |dest|. */
+};
+
+/* Reads uncompressed pixel data into |decoder->dest|. The current position of
+ * the file must be at the start of the image before calling this.
+ * Returns 0 on success, -1 on error. */
+static int readImageData(FILE *fp, const struct _BMPDecoder *decoder);
+
+/* Reads the rest of the file as RLE8 or RLE4 data, and decodes it into
+ * |decoder->dest|. Returns 0 on success, -1 on error. */
+static int readRLEImageData(FILE *fp, const struct _BMPDecoder *decoder,
+                            size_t length);
 
-/* Copys image buffer from |bitmap| to |dest| in BGR format. */
-static void copyBGRDataFromMMBitmap(MMBitmapRef bitmap, uint8_t *dest);
+/* Copys image buffer from |bitmap| to |dest| in BGR(X) format, |bytewidth|
+ * bytes per row. */
+static void copyBGRDataFromMMBitmap(MMBitmapRef bitmap, uint8_t *dest,
+                                    size_t bytewidth);
 
 const char *MMBMPReadErrorString(MMIOError error)
 {
@@ -136,20 +194,285 @@ const char *MMBMPReadErrorString(MMIOError error)
 			return "Unsupported file compression in BMP file";
 		case kBMPInvalidPixelDataError:
 			return "Could not read BMP pixel data";
+		case kBMPInvalidDimensionsError:
+			return "Invalid dimensions in BMP file";
+		case kBMPInvalidColorMasksError:
+			return "Invalid color masks in BMP file";
 		default:
 			return NULL;
 	}
 }
 
+/* Sets up |channel| for |mask|. Returns false if the mask isn't one run of at
+ * most 16 bits. */
+static bool setupBMPChannel(struct _BMPChannel *channel, uint32_t mask)
+{
+	uint32_t bits = 0;
+
+	memset(channel, 0, sizeof(*channel));
+	if (mask == 0) return true;
+
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		++channel->shift;
+	}
+
+	channel->mask = mask;
+	while (mask & 1) {
+		mask >>= 1;
+		++bits;
+	}
+
+	if (mask != 0 || bits > 16) return false;
+
+	if (bits >= 8) {
+		channel->down = bits - 8;
+		channel->repeat = bits; /* Always 0. */
+	} else {
+		channel->left = 8 - bits;
+		channel->repeat = bits * 2 >= 8 ? bits * 2 - 8 : bits;
+	}
+
+	return true;
+}
+
+static uint8_t expandBMPChannel(const struct _BMPChannel *channel,
+                                uint32_t pixel)
+{
+	const uint32_t value = (pixel >> channel->shift) & channel->mask;
+	return (uint8_t)(((value << channel->left) >> channel->down) |
+	                 (value >> channel->repeat));
+}
+
+#if BMP_USE_SSE2
+
+/* The channels of a _BMPPixelFormat as shift counts and masks, ready for
+ * four pixels at a time. */
+struct _BMPChannelsSSE2 {
+	__m128i shift[4];
+	__m128i mask[4];
+	__m128i left[4];
+	__m128i down[4];
+	__m128i repeat[4];
+	__m128i place[4]; /* Shift up into the output pixel. */
+	__m128i opaque;   /* 0xFF000000, or 0 if alpha is decoded. */
+	int count;
+};
+
+static __m128i expandBMPPixelsSSE2(__m128i pixels,
+                                   const struct _BMPChannelsSSE2 *channels)
+{
+	__m128i out = channels->opaque;
+	int i;
+
+	for (i = 0; i < channels->count; ++i) {
+		const __m128i value = _mm_and_si128(_mm_srl_epi32(pixels, channels->shift[i]),
+		                                    channels->mask[i]);
+		const __m128i scaled =
+		    _mm_or_si128(_mm_srl_epi32(_mm_sll_epi32(value, channels->left[i]),
+		                               channels->down[i]),
+		                 _mm_srl_epi32(value, channels->repeat[i]));
+		out = _mm_or_si128(out, _mm_sll_epi32(scaled, channels->place[i]));
+	}
+
+	return out;
+}
+
+/* Converts as much of a row of packed pixels as fills whole registers.
+ * Returns the number of pixels converted. */
+static size_t convertPackedBMPRowSSE2(const uint8_t *src, uint8_t *dest,
+                                      size_t width, uint8_t bytesPerPixel,
+                                      const struct _BMPPixelFormat *format)
+{
+	struct _BMPChannelsSSE2 channels;
+	size_t x = 0;
+	int i;
+
+	channels.count = format->hasAlpha ? 4 : 3;
+	channels.opaque = _mm_set1_epi32(format->hasAlpha ? 0 : (int)0xFF000000);
+	for (i = 0; i < channels.count; ++i) {
+		const struct _BMPChannel *channel = &format->channels[i];
+		channels.shift[i] = _mm_cvtsi32_si128((int)channel->shift);
+		channels.mask[i] = _mm_set1_epi32((int)channel->mask);
+		channels.left[i] = _mm_cvtsi32_si128((int)channel->left);
+		channels.down[i] = _mm_cvtsi32_si128((int)channel->down);
+		channels.repeat[i] = _mm_cvtsi32_si128((int)channel->repeat);
+		channels.place[i] = _mm_cvtsi32_si128(i * 8);
+	}
+
+	if (bytesPerPixel == 2) {
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 8 <= width; x += 8) {
+			const __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 2));
+			_mm_storeu_si128((__m128i *)(dest + x * 4),
+			                 expandBMPPixelsSSE2(_mm_unpacklo_epi16(pixels, zero), &channels));
+			_mm_storeu_si128((__m128i *)(dest + x * 4 + 16),
+			                 expandBMPPixelsSSE2(_mm_unpackhi_epi16(pixels, zero), &channels));
+		}
+	} else {
+		for (; x + 4 <= width; x += 4) {
+			const __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 4));
+			_mm_storeu_si128((__m128i *)(dest + x * 4),
+			                 expandBMPPixelsSSE2(pixels, &channels));
+		}
+	}
+
+	return x;
+}
+
+#endif /* BMP_USE_SSE2 */
+
+/* Converts a row of packed 16 or 32-bit little endian pixels to BGRA. */
+static void convertPackedBMPRow(const uint8_t *src, uint8_t *dest, size_t width,
+                                uint8_t bytesPerPixel,
+                                const struct _BMPPixelFormat *format)
+{
+	const struct _BMPChannel *channels = format->channels;
+	size_t x = 0;
+
+#if BMP_USE_SSE2
+	x = convertPackedBMPRowSSE2(src, dest, width, bytesPerPixel, format);
+	src += x * bytesPerPixel;
+	dest += x * 4;
+#endif
+
+	for (; x < width; ++x, src += bytesPerPixel, dest += 4) {
+		uint32_t pixel = (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+		if (bytesPerPixel == 4) {
+			pixel |= ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+		}
+
+		dest[0] = expandBMPChannel(&channels[0], pixel);
+		dest[1] = expandBMPChannel(&channels[1], pixel);
+		dest[2] = expandBMPChannel(&channels[2], pixel);
+		dest[3] = format->hasAlpha ? expandBMPChannel(&channels[3], pixel) : 0xFF;
+	}
+}
+
+/* Converts a row of 1, 4 or 8-bit palette indices to BGRA. */
+static void convertIndexedBMPRow(const uint8_t *src, uint8_t *dest, size_t width,
+                                 uint8_t bitsPerPixel, const uint32_t *palette)
+{
+	size_t x;
+
+	if (bitsPerPixel == 8) {
+		for (x = 0; x < width; ++x) {
+			memcpy(dest + x * 4, &palette[src[x]], 4);
+		}
+	} else {
+		/* Pixels are packed from the most significant bit down. */
+		const size_t perByte = 8 / bitsPerPixel;
+		const uint8_t mask = (uint8_t)((1 << bitsPerPixel) - 1);
+		for (x = 0; x < width; ++x) {
+			const unsigned int shift = 8 - bitsPerPixel * (unsigned int)(x % perByte + 1);
+			memcpy(dest + x * 4, &palette[(src[x / perByte] >> shift) & mask], 4);
+		}
+	}
+}
+
+/* Returns where row |y| of the file goes in the bitmap, which is flipped if
+ * the file is stored bottom-up. */
+static uint8_t *decodedRow(const struct _BMPDecoder *decoder, int32_t y)
+{
+	const int32_t row = decoder->topDown ? y : decoder->height - 1 - y;
+	return decoder->dest + (size_t)row * decoder->bytewidth;
+}
+
+/* Reads the masks of a 16 or 32-bit file into |format|, and sets |isBGR| if
+ * its pixels can be copied as they are. Returns false on error. */
+static bool readPixelFormat(FILE *fp, const struct BITMAP_INFO_HEADER *header,
+                            struct _BMPPixelFormat *format, bool *isBGR)
+{
+	/* Blue, green, red and alpha, in the order they are stored. */
+	uint32_t masks[4] = {0};
+	int i;
+
+	if (header->compression == kBMP_RGB) {
+		if (header->bitsPerPixel == 16) { /* 5-5-5 */
+			masks[0] = 0x001F;
+			masks[1] = 0x03E0;
+			masks[2] = 0x7C00;
+		} else {
+			masks[0] = 0x0000FF;
+			masks[1] = 0x00FF00;
+			masks[2] = 0xFF0000;
+		}
+	} else {
+		/* The masks follow the v3 header (or are the next part of a longer
+		 * one), red first. Only headers of 56 bytes or more, and
+		 * kBMP_ALPHABITFIELDS, carry alpha. */
+		uint32_t stored[4] = {0};
+		const size_t count = header->compression == kBMP_ALPHABITFIELDS ||
+		                     header->headerSize >= 56 ? 4 : 3;
+
+		if (fseek(fp, sizeof(struct BITMAP_FILE_HEADER) +
+		              sizeof(struct BITMAP_INFO_HEADER), SEEK_SET) != 0 ||
+		    fread(stored, sizeof(uint32_t), count, fp) != count) {
+			return false;
+		}
+
+		masks[0] = swapLittleAndHost32(stored[2]);
+		masks[1] = swapLittleAndHost32(stored[1]);
+		masks[2] = swapLittleAndHost32(stored[0]);
+		masks[3] = swapLittleAndHost32(stored[3]);
+	}
+
+	if (header->bitsPerPixel == 16) {
+		for (i = 0; i < 4; ++i) masks[i] &= 0xFFFF;
+	}
+
+	for (i = 0; i < 4; ++i) {
+		if (!setupBMPChannel(&format->channels[i], masks[i])) return false;
+	}
+	format->hasAlpha = masks[3] != 0;
+
+	/* Already laid out the way we keep them? (Any alpha is copied as is.) */
+	*isBGR = header->bitsPerPixel == 32 && masks[0] == 0x0000FF &&
+	         masks[1] == 0x00FF00 && masks[2] == 0xFF0000 &&
+	         (masks[3] == 0 || masks[3] == 0xFF000000);
+	return true;
+}
+
+/* Reads the palette of a 1, 4 or 8-bit file into |palette| as BGRA. Entries
+ * are 4 bytes (BGRX), or 3 (BGR) after an OS/2 v1 header. */
+static bool readPalette(FILE *fp, const struct BITMAP_INFO_HEADER *header,
+                        uint32_t *palette)
+{
+	const size_t entrySize = header->headerSize == 12 ? 3 : 4;
+	const size_t maximum = (size_t)1 << header->bitsPerPixel;
+	const size_t count = header->colorsUsed > 0 && header->colorsUsed < maximum ?
+	                     header->colorsUsed : maximum;
+	uint8_t entries[256 * 4];
+	size_t i;
+
+	if (fseek(fp, sizeof(struct BITMAP_FILE_HEADER) + header->headerSize,
+	          SEEK_SET) != 0 ||
+	    fread(entries, entrySize, count, fp) != count) {
+		return false;
+	}
+
+	for (i = 0; i < count; ++i) {
+		const uint8_t color[4] = {entries[i * entrySize],
+		                          entries[i * entrySize + 1],
+		                          entries[i * entrySize + 2], 0xFF};
+		memcpy(&palette[i], color, 4);
+	}
+
+	return true;
+}
+
 MMBitmapRef newMMBitmapFromBMP(const char *path, MMBMPReadError *err)
 {
 	FILE *fp;
 	struct BITMAP_FILE_HEADER fileHeader = {0}; /* Initialize elements to 0. */
 	struct BITMAP_INFO_HEADER dibHeader = {0};
+	struct _BMPDecoder decoder;
 	uint32_t headerSize = 0;
-	uint8_t bytesPerPixel;
-	size_t bytewidth;
-	uint8_t *imageBuf;
+	uint8_t bytesPerPixel; /* Of the bitmap. */
+	bool isBGR = false;
+	long fileSize;
+	size_t imageLength;
+	int status;
 
 	if ((fp = fopen(path, "rb")) == NULL) {
 		if (err != NULL) *err = kBMPAccessError;
@@ -158,6 +481,7 @@ MMBitmapRef newMMBitmapFromBMP(const char *path, MMBMPReadError *err)
 
 	/* Initialize error code to generic value. */
 	if (err != NULL) *err = kBMPGenericError;
+	memset(&decoder, 0, sizeof(decoder));
 
 	if (fread(&fileHeader, sizeof(fileHeader), 1, fp) == 0) goto bail;
 
@@ -181,68 +505,136 @@ MMBitmapRef newMMBitmapFromBMP(const char *path, MMBMPReadError *err)
 		struct BITMAP_CORE_HEADER coreHeader = {0};
 		if (fread(&coreHeader, sizeof(coreHeader), 1, fp) == 0) goto bail;
 
-		dibHeader.width = coreHeader.width;
-		dibHeader.height = coreHeader.height;
-		dibHeader.colorPlanes = coreHeader.colorPlanes;
-		dibHeader.bitsPerPixel = coreHeader.bitsPerPixel;
-	} else if (headerSize == 40 || headerSize == 108 || headerSize == 124) {
-		/* Windows v3/v4/v5 header */
+		dibHeader.headerSize = 12;
+		dibHeader.width = swapLittleAndHost16(coreHeader.width);
+		dibHeader.height = swapLittleAndHost16(coreHeader.height);
+		dibHeader.colorPlanes = swapLittleAndHost16(coreHeader.colorPlanes);
+		dibHeader.bitsPerPixel = swapLittleAndHost16(coreHeader.bitsPerPixel);
+	} else if (headerSize == 40 || headerSize == 52 || headerSize == 56 ||
+	           headerSize == 64 || headerSize == 108 || headerSize == 124) {
+		/* Windows v3/v4/v5 header (or Adobe's or OS/2 v2's in between). */
 		/* Read only the common part (v3) and skip over the rest. */
 		if (fread(&dibHeader, sizeof(dibHeader), 1, fp) == 0) goto bail;
+		convertBitmapInfoHeader(&dibHeader);
+
+		/* OS/2 v2 reuses these for Huffman and RLE24, which we don't do. */
+		if (headerSize == 64 && dibHeader.compression >= kBMP_BITFIELDS) {
+			if (err != NULL) *err = kBMPUnsupportedCompressionError;
+			goto bail;
+		}
 	} else {
 		if (err != NULL) *err = kBMPUnsupportedHeaderError;
 		goto bail;
 	}
 
-	convertBitmapInfoHeader(&dibHeader);
-
 	if (dibHeader.colorPlanes != 1) {
 		if (err != NULL) *err = kBMPInvalidColorPanesError;
 		goto bail;
 	}
 
-	/* Currently only 24-bit and 32-bit are supported. */
-	if (dibHeader.bitsPerPixel != 24 && dibHeader.bitsPerPixel != 32) {
+	switch (dibHeader.compression) {
+		case kBMP_RGB:
+			status = dibHeader.bitsPerPixel == 1 || dibHeader.bitsPerPixel == 4 ||
+			         dibHeader.bitsPerPixel == 8 || dibHeader.bitsPerPixel == 16 ||
+			         dibHeader.bitsPerPixel == 24 || dibHeader.bitsPerPixel == 32;
+			break;
+		case kBMP_RLE8:
+			status = dibHeader.bitsPerPixel == 8;
+			break;
+		case kBMP_RLE4:
+			status = dibHeader.bitsPerPixel == 4;
+			break;
+		case kBMP_BITFIELDS:
+		case kBMP_ALPHABITFIELDS:
+			status = dibHeader.bitsPerPixel == 16 || dibHeader.bitsPerPixel == 32;
+			break;
+		default:
+			if (err != NULL) *err = kBMPUnsupportedCompressionError;
+			goto bail;
+	}
+
+	if (!status) {
 		if (err != NULL) *err = kBMPUnsupportedColorDepthError;
 		goto bail;
 	}
 
-	if (dibHeader.compression != kBMP_RGB) {
-		if (err != NULL) *err = kBMPUnsupportedCompressionError;
+	/* A negative height indicates that the image is flipped.
+	 *
+	 * We store our bitmaps as "flipped" according to the BMP format; i.e.,
+	 * (0, 0) is the top left, not bottom left. So rows are put in reverse
+	 * order as they are read, unless the height is negative. */
+	if (dibHeader.width <= 0 || dibHeader.height == 0 ||
+	    dibHeader.height == INT32_MIN || dibHeader.width > (INT32_MAX - 3) / 4) {
+		if (err != NULL) *err = kBMPInvalidDimensionsError;
 		goto bail;
 	}
 
-	/* This can happen because we don't fully parse Windows v4/v5 headers. */
-	if (ftell(fp) != (long)fileHeader.imageOffset) {
-		fseek(fp, fileHeader.imageOffset, SEEK_SET);
+	decoder.width = dibHeader.width;
+	decoder.topDown = dibHeader.height < 0;
+	decoder.height = decoder.topDown ? -dibHeader.height : dibHeader.height;
+	decoder.bitsPerPixel = dibHeader.bitsPerPixel;
+	decoder.compression = dibHeader.compression;
+	decoder.stride = (((size_t)decoder.width * decoder.bitsPerPixel + 31) / 32) * 4;
+
+	if (decoder.bitsPerPixel <= 8) {
+		if (!readPalette(fp, &dibHeader, decoder.palette)) goto bail;
+	} else if (decoder.bitsPerPixel != 24) {
+		if (!readPixelFormat(fp, &dibHeader, &decoder.format, &isBGR)) {
+			if (err != NULL) *err = kBMPInvalidColorMasksError;
+			goto bail;
+		}
 	}
 
-	/* Get bytes per row, including padding. */
-	bytesPerPixel = dibHeader.bitsPerPixel / 8;
-	bytewidth = ADD_PADDING(dibHeader.width * bytesPerPixel);
+	/* 24-bit files stay 24-bit; everything else becomes 32-bit BGRA. */
+	bytesPerPixel = decoder.bitsPerPixel == 24 ? 3 : 4;
+	decoder.direct = decoder.bitsPerPixel == 24 || isBGR;
+	decoder.bytewidth = ADD_PADDING((size_t)decoder.width * bytesPerPixel);
 
-	imageBuf = readImageData(fp, dibHeader.width, abs(dibHeader.height),
-	                         bytesPerPixel, bytewidth);
-	fclose(fp);
+	/* Check the file is big enough before allocating anything for it. */
+	if (fseek(fp, 0, SEEK_END) != 0 || (fileSize = ftell(fp)) < 0 ||
+	    (unsigned long)fileSize <= fileHeader.imageOffset) {
+		if (err != NULL) *err = kBMPInvalidPixelDataError;
+		goto bail;
+	}
 
-	if (imageBuf == NULL) {
+	imageLength = (size_t)fileSize - fileHeader.imageOffset;
+	if (dibHeader.compression == kBMP_RLE8 || dibHeader.compression == kBMP_RLE4) {
+		if ((uint64_t)decoder.width * decoder.height > BMP_MAX_RLE_PIXELS) {
+			if (err != NULL) *err = kBMPInvalidDimensionsError;
+			goto bail;
+		}
+	} else if (imageLength / decoder.stride < (size_t)decoder.height) {
 		if (err != NULL) *err = kBMPInvalidPixelDataError;
-		return NULL;
+		goto bail;
 	}
 
-	/* A negative height indicates that the image is flipped.
-	 *
-	 * We store our bitmaps as "flipped" according to the BMP format; i.e., (0, 0)
-	 * is the top left, not bottom left. So we only need to flip the bitmap if
-	 * the height is NOT negative. */
-	if (dibHeader.height < 0) {
-		dibHeader.height = -dibHeader.height;
+	if ((size_t)decoder.height > SIZE_MAX / decoder.bytewidth) goto bail;
+
+	/* RLE files need not cover every pixel; the rest are left black. */
+	decoder.dest = dibHeader.compression == kBMP_RLE8 ||
+	               dibHeader.compression == kBMP_RLE4 ?
+	               calloc(decoder.height, decoder.bytewidth) :
+	               malloc(decoder.bytewidth * decoder.height);
+	if (decoder.dest == NULL) goto bail;
+
+	if (fseek(fp, fileHeader.imageOffset, SEEK_SET) != 0) {
+		status = -1;
+	} else if (dibHeader.compression == kBMP_RLE8 ||
+	           dibHeader.compression == kBMP_RLE4) {
+		status = readRLEImageData(fp, &decoder, imageLength);
 	} else {
-		flipBitmapData(imageBuf, dibHeader.width, dibHeader.height, bytewidth);
+		status = readImageData(fp, &decoder);
+	}
+	fclose(fp);
+
+	if (status != 0) {
+		free(decoder.dest);
+		if (err != NULL) *err = kBMPInvalidPixelDataError;
+		return NULL;
 	}
 
-	return createMMBitmap(imageBuf, dibHeader.width, dibHeader.height,
-	                      bytewidth, (uint8_t)dibHeader.bitsPerPixel,
+	return createMMBitmap(decoder.dest, decoder.width, decoder.height,
+	                      (int32_t)decoder.bytewidth, bytesPerPixel * 8,
 	                      bytesPerPixel);
 
 bail:
@@ -270,7 +662,7 @@ uint8_t *createBitmapData(MMBitmapRef bitmap, size_t *len)
 	/* Save top header. */
 	fileHeader = (struct BITMAP_FILE_HEADER *)data;
 	fileHeader->magic = BMP_MAGIC;
-	fileHeader->fileSize = (uint32_t)(sizeof(*dibHeader) + imageSize);
+	fileHeader->fileSize = (uint32_t)dataLen;
 	fileHeader->imageOffset = (uint32_t)imageOffset;
 
 	/* BMP files are always stored as little-endian, so we need to convert back
@@ -283,14 +675,14 @@ uint8_t *createBitmapData(MMBitmapRef bitmap, size_t *len)
 	dibHeader->width = (int32_t)bitmap->width;
 	dibHeader->height = -(int32_t)bitmap->height; /* Our bitmaps are "flipped". */
 	dibHeader->colorPlanes = 1;
-	dibHeader->bitsPerPixel = bitmap->bitsPerPixel;
+	dibHeader->bitsPerPixel = bitmap->bytesPerPixel * 8;
 	dibHeader->compression = kBMP_RGB; /* Don't save with compression. */
 	dibHeader->imageSize = (uint32_t)imageSize;
 
 	convertBitmapInfoHeader(dibHeader);
 
 	/* Lastly, copy the pixel data. */
-	copyBGRDataFromMMBitmap(bitmap, data + imageOffset);
+	copyBGRDataFromMMBitmap(bitmap, data + imageOffset, bytewidth);
 
 	if (len != NULL) *len = dataLen;
 	return data;
@@ -320,77 +712,162 @@ int saveMMBitmapAsBMP(MMBitmapRef bitmap, const char *path)
 	return 0;
 }
 
-static uint8_t *readImageData(FILE *fp, size_t width, size_t height,
-                              uint8_t bytesPerPixel, size_t bytewidth)
+/* Converts one row of the file into |dest|. */
+static void convertBMPRow(const struct _BMPDecoder *decoder, const uint8_t *row,
+                          uint8_t *dest)
 {
-	size_t imageSize = bytewidth * height;
-	uint8_t *imageBuf = calloc(1, imageSize);
+	const size_t width = (size_t)decoder->width;
+	size_t length;
+
+	if (decoder->direct) {
+		length = width * (decoder->bitsPerPixel / 8);
+		memcpy(dest, row, length);
+	} else if (decoder->bitsPerPixel <= 8) {
+		length = width * 4;
+		convertIndexedBMPRow(row, dest, width, (uint8_t)decoder->bitsPerPixel,
+		                     decoder->palette);
+	} else {
+		length = width * 4;
+		convertPackedBMPRow(row, dest, width, (uint8_t)(decoder->bitsPerPixel / 8),
+		                    &decoder->format);
+	}
 
-	if (MMRGB_IS_BGR && (bytewidth % 4) == 0) { /* No conversion needed. */
-		if (fread(imageBuf, imageSize, 1, fp) == 0) {
-			free(imageBuf);
-			return NULL;
+	if (length < decoder->bytewidth) {
+		memset(dest + length, 0, decoder->bytewidth - length);
+	}
+}
+
+static int readImageData(FILE *fp, const struct _BMPDecoder *decoder)
+{
+	uint8_t *block;
+	size_t rows;
+	int32_t y = 0;
+
+	/* Top-down files we keep as they are come in one read. */
+	if (decoder->direct && decoder->topDown &&
+	    decoder->stride == decoder->bytewidth) {
+		return fread(decoder->dest, decoder->bytewidth * decoder->height, 1, fp)
+		       == 1 ? 0 : -1;
+	}
+
+	/* Otherwise rows are read a block at a time, and each goes straight to
+	 * where it belongs from there, so bottom-up files are flipped as they
+	 * are read rather than afterwards. */
+	rows = BMP_READ_BLOCK_SIZE / decoder->stride;
+	if (rows == 0) rows = 1;
+	if (rows > (size_t)decoder->height) rows = (size_t)decoder->height;
+
+	if ((block = malloc(rows * decoder->stride)) == NULL) return -1;
+
+	while (y < decoder->height) {
+		const size_t count = (size_t)(decoder->height - y) < rows ?
+		                     (size_t)(decoder->height - y) : rows;
+		size_t i;
+
+		if (fread(block, decoder->stride, count, fp) != count) {
+			free(block);
+			return -1;
 		}
-	} else { /* Convert from BGR with 4-byte alignment. */
-		uint8_t *row = malloc(bytewidth);
-		size_t y;
-		const size_t bmp_bytewidth = (width * bytesPerPixel + 3) & ~3;
-
-		if (row == NULL) return NULL;
-		assert(bmp_bytewidth <= bytewidth);
-
-		/* Read image data row by row. */
-		for (y = 0; y < height; ++y) {
-			const size_t rowOffset = y * bytewidth;
-			size_t x;
-			uint8_t *rowptr = row;
-			if (fread(row, bmp_bytewidth, 1, fp) == 0) {
-				free(imageBuf);
-				free(row);
-				return NULL;
-			}
 
-			for (x = 0; x < width; ++x) {
-				const size_t colOffset = x * bytesPerPixel;
-				MMRGBColor *color = (MMRGBColor *)(imageBuf +
-				                                   rowOffset + colOffset);
+		for (i = 0; i < count; ++i, ++y) {
+			convertBMPRow(decoder, block + i * decoder->stride,
+			              decodedRow(decoder, y));
+		}
+	}
+
+	free(block);
+	return 0;
+}
 
-				/* BMP files are stored in BGR format. */
-				color->blue = rowptr[0];
-				color->green = rowptr[1];
-				color->red = rowptr[2];
-				rowptr += bytesPerPixel;
+/* Decodes RLE8 or RLE4 |data| into |decoder->dest|. Pixels the runs skip
+ * over (with deltas, or by ending lines or the bitmap early) are left as they
+ * were, as are runs past the end of a line. */
+static void decodeRLEData(const struct _BMPDecoder *decoder, const uint8_t *data,
+                          size_t length)
+{
+	const bool rle4 = decoder->compression == kBMP_RLE4;
+	const uint32_t *palette = decoder->palette;
+	int32_t x = 0;
+	int32_t y = 0;
+	size_t i = 0;
+
+	while (i + 2 <= length && y < decoder->height) {
+		const uint8_t count = data[i];
+		const uint8_t value = data[i + 1];
+		i += 2;
+
+		if (count > 0) {
+			/* |count| pixels of one color (alternating between two for RLE4). */
+			uint8_t *row = decodedRow(decoder, y);
+			const uint32_t colors[2] = {palette[rle4 ? value >> 4 : value],
+			                            palette[rle4 ? value & 0xF : value]};
+			int32_t k;
+
+			for (k = 0; k < count && x < decoder->width; ++k, ++x) {
+				memcpy(row + (size_t)x * 4, &colors[k & 1], 4);
+			}
+		} else if (value == 0) { /* End of line. */
+			x = 0;
+			++y;
+		} else if (value == 1) { /* End of bitmap. */
+			break;
+		} else if (value == 2) { /* Move right and up. */
+			if (i + 2 > length) break;
+			x += data[i];
+			y += data[i + 1];
+			i += 2;
+		} else {
+			/* |value| pixels given one by one, padded to 16 bits. */
+			const size_t bytes = rle4 ? ((size_t)value + 1) / 2 : value;
+			uint8_t *row = decodedRow(decoder, y);
+			int32_t k;
+
+			if (i + bytes > length) break;
+
+			for (k = 0; k < value && x < decoder->width; ++k, ++x) {
+				const uint8_t index = !rle4 ? data[i + k] :
+				                      (k & 1) ? data[i + k / 2] & 0xF :
+				                                data[i + k / 2] >> 4;
+				memcpy(row + (size_t)x * 4, &palette[index], 4);
 			}
+
+			i += (bytes + 1) & ~(size_t)1;
 		}
+	}
+}
+
+static int readRLEImageData(FILE *fp, const struct _BMPDecoder *decoder,
+                            size_t length)
+{
+	uint8_t *data = malloc(length);
+	if (data == NULL) return -1;
 
-		free(row);
+	if (fread(data, length, 1, fp) != 1) {
+		free(data);
+		return -1;
 	}
 
-	return imageBuf;
+	decodeRLEData(decoder, data, length);
+	free(data);
+	return 0;
 }
 
-static void copyBGRDataFromMMBitmap(MMBitmapRef bitmap, uint8_t *dest)
+static void copyBGRDataFromMMBitmap(MMBitmapRef bitmap, uint8_t *dest,
+                                    size_t bytewidth)
 {
-	if (MMRGB_IS_BGR && (bitmap->bytewidth % 4) == 0) { /* No conversion needed. */
-		memcpy(dest, bitmap->imageBuffer, bitmap->bytewidth * bitmap->height);
-	} else { /* Convert to RGB with other-than-4-byte alignment. */
-		const size_t bytewidth = (bitmap->width * bitmap->bytesPerPixel + 3) & ~3;
-		size_t y;
+	/* Our pixels are already BGR(X), so rows are copied as they are. */
+	assert(MMRGB_IS_BGR);
 
-		/* Copy image data row by row. */
-		for (y = 0; y < bitmap->height; ++y) {
-			uint8_t *rowptr = dest + (y * bytewidth);
-			size_t x;
-			for (x = 0; x < bitmap->width; ++x) {
-				MMRGBColor *color = MMRGBColorRefAtPoint(bitmap, x, y);
-
-				/* BMP files are stored in BGR format. */
-				rowptr[0] = color->blue;
-				rowptr[1] = color->green;
-				rowptr[2] = color->red;
+	if ((size_t)bitmap->bytewidth == bytewidth) {
+		/* Not height * bytewidth: a view's last row ends at its last pixel. */
+		memcpy(dest, bitmap->imageBuffer, MMBitmapBufferSize(bitmap));
+	} else { /* Different padding; padding in |dest| is left as it was. */
+		const size_t length = (size_t)bitmap->width * bitmap->bytesPerPixel;
+		int32_t y;
 
-				rowptr += bitmap->bytesPerPixel;
-			}
+		for (y = 0; y < bitmap->height; ++y) {
+			memcpy(dest + y * bytewidth,
+			       bitmap->imageBuffer + (size_t)y * bitmap->bytewidth, length);
 		}
 	}
 }
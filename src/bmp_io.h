@@ -18,7 +18,9 @@ enum _BMPReadError {
 	kBMPInvalidColorPanesError,
 	kBMPUnsupportedColorDepthError,
 	kBMPUnsupportedCompressionError,
-	kBMPInvalidPixelDataError
+	kBMPInvalidPixelDataError,
+	kBMPInvalidDimensionsError,
+	kBMPInvalidColorMasksError
 };
 
 typedef MMIOError MMBMPReadError;
@@ -32,16 +34,21 @@ const char *MMBMPReadErrorString(MMIOError error);
  * on return.
  *
  * Currently supports:
- *     - Uncompressed Windows v3/v4/v5 24-bit or 32-bit BMP.
- *     - OS/2 v1 or v2 24-bit BMP.
- *     - Does NOT yet support: 1-bit, 4-bit, 8-bit, 16-bit, compressed bitmaps,
- *       or PNGs/JPEGs disguised as BMPs (and returns NULL if those are given).
+ *     - Windows v3/v4/v5 1, 4, 8, 16, 24 or 32-bit BMP, uncompressed, RLE8,
+ *       RLE4 or with bitfields (color masks).
+ *     - OS/2 v1 or v2 1, 4, 8 or 24-bit BMP.
+ *     - Does NOT yet support: Huffman or RLE24 compressed bitmaps, or
+ *       PNGs/JPEGs disguised as BMPs (and returns NULL if those are given).
+ *
+ * 24-bit files are read as 24-bit bitmaps, and everything else as 32-bit
+ * (BGRA, with alpha 0xFF unless the file has an alpha mask). Rows are decoded
+ * straight into place, bottom-up files included.
  *
  * Responsibility for destroy()'ing returned MMBitmap is left up to caller. */
 MMBitmapRef newMMBitmapFromBMP(const char *path, MMBMPReadError *error);
 
-/* Returns a buffer containing the raw BMP file data in Windows v3 BMP format,
- * ready to be saved to a file. If |len| is not NULL, it will be set to the
+/* Returns a buffer containing the raw BMP file data in Windows v3 BMP format
+ * (24 or 32-bit, as |bitmap| is), ready to be saved to a file. If |len| is not NULL, it will be set to the
  * number of bytes allocated in the returned buffer.
  *
  * Responsibility for free()'ing data is left up to the caller. */
@@ -5,6 +5,11 @@
 #include "MMBitmap.h"
 #include "MMPointArray.h"
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 /* Convenience wrapper around findColorInRect(), where |rect| is the bounds of
  * the image. */
 #define findColorInImage(image, color, pointPtr, tolerance) \
@@ -27,10 +32,11 @@ int findColorInRect(MMBitmapRef image, MMRGBHex color, MMPoint *point,
 
 /* Returns MMPointArray of all pixels of given color in |image| inside of
  * |rect|. Note that an array is returned regardless of whether the color was
- * found; check array->count to see if it actually was.
+ * found (it is NULL only if out of memory); check array->count to see if it
+ * actually was.
  *
- * Responsibility for freeing the MMPointArray with destroyMMPointArray() is
- * given to the caller.
+ * The MMPointArray is in the calling thread's arena, so it lasts until the
+ * caller rewinds the arena past it (see MMPointArray.h).
  *
  * |tolerance| should be in the range 0.0f - 1.0f, denoting how closely the
  * colors need to match, with 0 being exact and 1 being any. */
@@ -46,4 +52,8 @@ MMPointArrayRef findAllColorInRect(MMBitmapRef image, MMRGBHex color,
 size_t countOfColorsInRect(MMBitmapRef image, MMRGBHex color, MMRect rect,
                            float tolerance);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* COLOR_FIND_H */
@@ -0,0 +1,132 @@
+#include "color_table.h"
+#include "arena.h"
+#include <string.h> /* memset() */
+
+/* SSE2 is always there on x86-64, and on 32-bit x86 when asked for. */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define COLOR_TABLE_USE_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define COLOR_TABLE_USE_SSE2 0
+#endif
+
+#define GROUP_SIZE 4
+
+/* The smallest table, in groups. */
+#define MIN_GROUPS 4
+
+/* Fibonacci hashing: the top bits of the color times 2^32 / phi, which
+ * spreads out runs of similar colors. */
+#define groupForColor(table, color) \
+	((size_t)(((uint32_t)(color) * 2654435769U) >> (table)->groupShift))
+
+/* Compares |color| with the four keys of a group, setting |matches| and
+ * |empties| to bitmasks of the slots that hold it and that are empty. */
+static void probeGroup(const uint32_t *keys, uint32_t color,
+                       unsigned int *matches, unsigned int *empties)
+{
+#if COLOR_TABLE_USE_SSE2
+	const __m128i group = _mm_load_si128((const __m128i *)keys);
+	*matches = (unsigned int)_mm_movemask_ps(
+		_mm_castsi128_ps(_mm_cmpeq_epi32(group, _mm_set1_epi32((int)color))));
+	*empties = (unsigned int)_mm_movemask_ps(
+		_mm_castsi128_ps(_mm_cmpeq_epi32(group, _mm_set1_epi32(-1))));
+#else
+	unsigned int i;
+	*matches = *empties = 0;
+	for (i = 0; i < GROUP_SIZE; i++) {
+		*matches |= (unsigned int)(keys[i] == color) << i;
+		*empties |= (unsigned int)(keys[i] == kMMColorTableEmpty) << i;
+	}
+#endif
+}
+
+/* Index of the lowest set bit of |mask|, which must not be 0. */
+static unsigned int lowestBit(unsigned int mask)
+{
+	unsigned int index = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		++index;
+	}
+	return index;
+}
+
+int initMMColorTable(MMColorTable *table, size_t maxCount)
+{
+	size_t groups = MIN_GROUPS;
+	unsigned int bits = 2;
+
+	table->keys = table->values = NULL;
+	table->groupMask = 0;
+	table->groupShift = 0;
+	table->count = 0;
+
+	/* At least two slots per color. */
+	while (groups * GROUP_SIZE < maxCount * 2) {
+		if (bits == 30) return -1;
+		groups <<= 1;
+		++bits;
+	}
+
+	table->keys = MMArenaAlloc(groups * GROUP_SIZE * sizeof(uint32_t));
+	table->values = MMArenaAlloc(groups * GROUP_SIZE * sizeof(uint32_t));
+	if (table->keys == NULL || table->values == NULL) {
+		table->keys = table->values = NULL;
+		return -1;
+	}
+
+	memset(table->keys, 0xFF, groups * GROUP_SIZE * sizeof(uint32_t));
+	table->groupMask = groups - 1;
+	table->groupShift = 32 - bits;
+	return 0;
+}
+
+int MMColorTableAdd(MMColorTable *table, MMRGBHex color, uint32_t value)
+{
+	size_t group;
+
+	if (table->keys == NULL) return -1;
+	group = groupForColor(table, color);
+
+	/* A color is in the first group that has it or has room, as nothing is
+	 * taken out; so is where it goes, if it isn't there. */
+	for (;;) {
+		uint32_t *keys = table->keys + group * GROUP_SIZE;
+		unsigned int matches, empties;
+		probeGroup(keys, color, &matches, &empties);
+
+		if (matches != 0) return 0;
+		if (empties != 0) {
+			const unsigned int slot = lowestBit(empties);
+			if (table->count * 2 >= (table->groupMask + 1) * GROUP_SIZE) return -1;
+			keys[slot] = color;
+			table->values[group * GROUP_SIZE + slot] = value;
+			++table->count;
+			return 1;
+		}
+		group = (group + 1) & table->groupMask;
+	}
+}
+
+int MMColorTableGet(const MMColorTable *table, MMRGBHex color, uint32_t *value)
+{
+	size_t group;
+
+	if (table->keys == NULL) return 0;
+	group = groupForColor(table, color);
+
+	for (;;) {
+		const uint32_t *keys = table->keys + group * GROUP_SIZE;
+		unsigned int matches, empties;
+		probeGroup(keys, color, &matches, &empties);
+
+		if (matches != 0) {
+			*value = table->values[group * GROUP_SIZE + lowestBit(matches)];
+			return 1;
+		}
+		if (empties != 0) return 0;
+		group = (group + 1) & table->groupMask;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef COLOR_TABLE_H
+#define COLOR_TABLE_H
+
+#include "rgb.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* A flat hash map from colors to 32-bit values, for analysing needles. Keys
+ * and values sit in two plain arrays, with no nodes or pointers to chase,
+ * and are probed a group of four slots at a time: a whole group is compared
+ * in one go (with SSE2 where there is SSE2), and the groups are probed
+ * linearly from one picked by the color's hash. Nothing is ever removed.
+ *
+ * The arrays come from the calling thread's arena (see arena.h), so a table
+ * lasts until the arena is rewound past it and needs no destroying. */
+struct _MMColorTable {
+	uint32_t *keys;   /* Colors, or kMMColorTableEmpty. */
+	uint32_t *values;
+	size_t groupMask; /* Number of groups, less one; a power of two, less one. */
+	unsigned int groupShift; /* 32 less log2 of the number of groups. */
+	size_t count;
+};
+
+typedef struct _MMColorTable MMColorTable;
+
+/* MMRGBHex colors only use the low 24 bits, leaving this free. */
+#define kMMColorTableEmpty UINT32_MAX
+
+/* Sets |table| up for up to |maxCount| colors, at most half full so probes
+ * stay short. Returns 0, or -1 if out of memory, leaving |table| empty with
+ * room for nothing. */
+int initMMColorTable(MMColorTable *table, size_t maxCount);
+
+/* Maps |color| to |value|, unless it is already mapped, in which case its
+ * value is left alone. Returns 1 if the color was added, 0 if it was there
+ * already, or -1 if the table holds |maxCount| colors already. */
+int MMColorTableAdd(MMColorTable *table, MMRGBHex color, uint32_t value);
+
+/* Returns 1 and sets |value| to what |color| maps to, or returns 0 if it
+ * maps to nothing. */
+int MMColorTableGet(const MMColorTable *table, MMRGBHex color, uint32_t *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COLOR_TABLE_H */
@@ -0,0 +1,155 @@
+#include "display_watch.h"
+#include "os.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define ATOMIC_LOAD(ptr) \
+		((uint64_t)_InterlockedOr64((volatile __int64 *)(ptr), 0))
+	#define ATOMIC_STORE(ptr, value) \
+		((void)_InterlockedExchange64((volatile __int64 *)(ptr), (__int64)(value)))
+#else
+	#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+	#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (uint64_t)(value), __ATOMIC_RELEASE)
+#endif
+
+static uint64_t generation = 0;
+
+uint64_t MMDisplayWatchGeneration(void)
+{
+	return ATOMIC_LOAD(&generation);
+}
+
+#if defined(USE_X11)
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h> /* pipe() */
+#include "xdisplay.h"
+
+/* How long notifications must stop for before a change is reported. */
+#define SETTLE_MILLISECONDS 50
+
+static Display *display = NULL;
+static int eventBase;
+static int wakePipe[2];
+static pthread_t thread;
+static MMDisplayChangeCallback changeCallback;
+static void *changeContext;
+/* The last generation handed out. It never goes back, even when the watch is
+ * stopped, so that geometry cached under one watch can't pass for current
+ * under the next. Only touched with no thread, or by the thread. */
+static uint64_t lastGeneration = 0;
+
+static void *watchThread(void *unused)
+{
+	struct pollfd fds[2];
+	bool changed = false;
+
+	fds[0].fd = ConnectionNumber(display);
+	fds[0].events = POLLIN;
+	fds[1].fd = wakePipe[0];
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		/* Xlib may already have read events off the connection. */
+		if (XPending(display) == 0) {
+			const int ready = poll(fds, 2, changed ? SETTLE_MILLISECONDS : -1);
+			if (ready > 0 && (fds[1].revents & POLLIN)) break;
+			if (ready == 0) {
+				ATOMIC_STORE(&generation, ++lastGeneration);
+				changeCallback(changeContext);
+				changed = false;
+				continue;
+			}
+			if (ready < 0 || (fds[0].revents & (POLLERR | POLLHUP))) break;
+		}
+
+		while (XPending(display) > 0) {
+			XEvent event;
+			XNextEvent(display, &event);
+			if (event.type == eventBase + RRScreenChangeNotify ||
+			    event.type == eventBase + RRNotify) {
+				XRRUpdateConfiguration(&event);
+				changed = true;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+bool MMDisplayWatchStart(MMDisplayChangeCallback callback, void *context)
+{
+	int errorBase, major = 0, minor = 0;
+	int mask = RRScreenChangeNotifyMask;
+
+	if (display != NULL) return false;
+
+	display = XOpenDisplay(getXDisplay());
+	if (display == NULL) display = XOpenDisplay(NULL);
+	if (display == NULL) return false;
+
+	if (!XRRQueryExtension(display, &eventBase, &errorBase) ||
+	    !XRRQueryVersion(display, &major, &minor) ||
+	    pipe(wakePipe) != 0) {
+		XCloseDisplay(display);
+		display = NULL;
+		return false;
+	}
+
+	/* CRTCs and outputs, which change without the screen's size changing
+	 * (say, a monitor moved), are 1.2; asking for them of an older server is
+	 * an error. */
+	if (major > 1 || (major == 1 && minor >= 2)) {
+		mask |= RRCrtcChangeNotifyMask | RROutputChangeNotifyMask;
+	}
+	XRRSelectInput(display, DefaultRootWindow(display), mask);
+	XFlush(display);
+
+	changeCallback = callback;
+	changeContext = context;
+	ATOMIC_STORE(&generation, ++lastGeneration);
+
+	if (pthread_create(&thread, NULL, watchThread, NULL) != 0) {
+		ATOMIC_STORE(&generation, 0);
+		close(wakePipe[0]);
+		close(wakePipe[1]);
+		XCloseDisplay(display);
+		display = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void MMDisplayWatchStop(void)
+{
+	const char wake = 0;
+
+	if (display == NULL) return;
+
+	while (write(wakePipe[1], &wake, 1) != 1 && errno == EINTR) {}
+	pthread_join(thread, NULL);
+	ATOMIC_STORE(&generation, 0);
+
+	close(wakePipe[0]);
+	close(wakePipe[1]);
+	XCloseDisplay(display);
+	display = NULL;
+}
+
+#else
+
+bool MMDisplayWatchStart(MMDisplayChangeCallback callback, void *context)
+{
+	return false;
+}
+
+void MMDisplayWatchStop(void)
+{
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef DISPLAY_WATCH_H
+#define DISPLAY_WATCH_H
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Watches, on a thread of its own, for displays being added, removed,
+ * resized or moved about, so that what is known of their geometry can be
+ * kept until it changes (see screen.c). On X11 this is RandR's change
+ * notifications, read on a display connection of its own. Elsewhere there is
+ * nothing to watch with yet, and MMDisplayWatchStart() fails. */
+
+typedef void (*MMDisplayChangeCallback)(void *context);
+
+/* Starts watching, calling |callback| with |context| on the watching thread
+ * after each change; a burst of notifications, which one change brings,
+ * counts as one. Returns false if the watch could not be started or is
+ * running already. */
+bool MMDisplayWatchStart(MMDisplayChangeCallback callback, void *context);
+
+/* Stops watching, if it is, and waits for the thread to finish. Not to be
+ * called from the callback. */
+void MMDisplayWatchStop(void);
+
+/* A number that goes up with each change seen, and each time watching starts;
+ * or 0 when not watching. It never repeats, so geometry read when this was
+ * some value is good for as long as it still is. Safe from any thread. */
+uint64_t MMDisplayWatchGeneration(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISPLAY_WATCH_H */
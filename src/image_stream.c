@@ -0,0 +1,359 @@
+#include "image_stream.h"
+#include "png_filter.h"
+#include "os.h"
+#include <zlib.h>
+#include <stdlib.h> /* malloc() */
+#include <string.h> /* memcpy() */
+#include <errno.h>
+#include <limits.h> /* INT_MAX */
+
+#if defined(IS_WINDOWS)
+	#include <io.h> /* For _write() */
+#else
+	#include <unistd.h> /* For write() */
+#endif
+
+#define BMP_HEADER_SIZE 54 /* File header plus Windows v3 info header. */
+
+enum _MMImageEncoderStage {
+	kStageHeader = 0,
+	kStageData,
+	kStageTrailer,
+	kStageFinished,
+	kStageFailed
+};
+
+struct _MMImageEncoder {
+	MMBitmapRef bitmap;
+	MMImageType type;
+	int stage;
+	int32_t y; /* Next row to encode. */
+
+	/* Encoded data not yet handed out (BMP). */
+	uint8_t *pending;
+	size_t pendingLength;
+
+	/* Row buffers. For PNG: the current and previous rows as RGB, scratch
+	 * for filtering, then the filtered row. For BMP: one padded BGR row (or
+	 * the header). */
+	uint8_t *rows;
+	size_t rowLength;
+
+	int filters;
+	z_stream zst;
+	bool deflating;
+};
+
+static void writeLE16(uint8_t *out, uint16_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+}
+
+static void writeLE32(uint8_t *out, uint32_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+	out[2] = (uint8_t)(value >> 16);
+	out[3] = (uint8_t)(value >> 24);
+}
+
+MMImageEncoderRef createMMImageEncoder(MMBitmapRef bitmap, MMImageType type,
+                                       int level, int filters)
+{
+	MMImageEncoderRef encoder;
+	size_t size;
+
+	if (bitmap == NULL || bitmap->imageBuffer == NULL ||
+	    bitmap->width <= 0 || bitmap->height <= 0 ||
+	    (bitmap->bytesPerPixel != 3 && bitmap->bytesPerPixel != 4)) {
+		return NULL;
+	}
+
+	encoder = calloc(1, sizeof(MMImageEncoder));
+	if (encoder == NULL) return NULL;
+
+	encoder->bitmap = bitmap;
+	encoder->type = type;
+	encoder->stage = kStageHeader;
+
+	switch (type) {
+		case kPNGImageType:
+			encoder->filters = resolvePNGFilters(filters);
+			if (encoder->filters == 0) goto bail;
+
+			encoder->rowLength = (size_t)bitmap->width * 3;
+			size = encoder->rowLength * 4 + 1;
+
+			if (deflateInit(&encoder->zst, level) != Z_OK) goto bail;
+			encoder->deflating = true;
+			break;
+		case kBMPImageType:
+			encoder->rowLength = ((size_t)bitmap->width * 3 + 3) & ~(size_t)3;
+			size = encoder->rowLength > BMP_HEADER_SIZE ? encoder->rowLength
+			                                            : BMP_HEADER_SIZE;
+			if ((uint64_t)encoder->rowLength * (uint64_t)bitmap->height >
+			    UINT32_MAX - BMP_HEADER_SIZE) {
+				goto bail;
+			}
+			break;
+		default:
+			goto bail;
+	}
+
+	/* Zeroed, so the row above the first PNG row reads as black. */
+	encoder->rows = calloc(1, size);
+	if (encoder->rows == NULL) goto bail;
+
+	return encoder;
+
+bail:
+	destroyMMImageEncoder(encoder);
+	return NULL;
+}
+
+void destroyMMImageEncoder(MMImageEncoderRef encoder)
+{
+	if (encoder == NULL) return;
+
+	if (encoder->deflating) deflateEnd(&encoder->zst);
+	free(encoder->rows);
+	free(encoder);
+}
+
+bool MMImageEncoderFinished(MMImageEncoderRef encoder)
+{
+	return encoder->stage == kStageFinished;
+}
+
+/* Filters the next row into the input of the compressor. */
+static void nextPNGRow(MMImageEncoderRef encoder)
+{
+	const size_t length = encoder->rowLength;
+	uint8_t *row = encoder->rows + (encoder->y % 2 == 0 ? 0 : length);
+	uint8_t *prior = encoder->rows + (encoder->y % 2 == 0 ? length : 0);
+	uint8_t *filtered = encoder->rows + 3 * length;
+
+	convertPNGRow(encoder->bitmap, encoder->y, row);
+	filterPNGRow(encoder->filters, row, prior, length, filtered,
+	             encoder->rows + 2 * length);
+	++encoder->y;
+
+	encoder->zst.next_in = filtered;
+	encoder->zst.avail_in = (uInt)(length + 1);
+}
+
+static int readPNG(MMImageEncoderRef encoder, uint8_t *buf, size_t len,
+                   size_t *written)
+{
+	uint8_t *out = buf;
+	z_stream *zst = &encoder->zst;
+
+	if (encoder->stage == kStageHeader) {
+		out = writePNGHeader(encoder->bitmap, out);
+		encoder->stage = kStageData;
+	}
+
+	/* Deflate straight into the data of an IDAT that fills the rest of the
+	 * buffer, pulling in rows as the compressor asks for them. */
+	if (encoder->stage == kStageData &&
+	    (size_t)(buf + len - out) > PNG_CHUNK_OVERHEAD) {
+		const size_t room = (size_t)(buf + len - out) - PNG_CHUNK_OVERHEAD;
+		size_t produced;
+
+		zst->next_out = out + 8;
+		zst->avail_out = room > UINT32_MAX ? UINT32_MAX : (uInt)room;
+
+		while (zst->avail_out > 0) {
+			int err, flush = Z_NO_FLUSH;
+
+			if (zst->avail_in == 0) {
+				if (encoder->y < encoder->bitmap->height) {
+					nextPNGRow(encoder);
+				} else {
+					flush = Z_FINISH;
+				}
+			}
+
+			err = deflate(zst, flush);
+			if (err == Z_STREAM_END) {
+				encoder->stage = kStageTrailer;
+				break;
+			}
+			if (err != Z_OK && err != Z_BUF_ERROR) return -1;
+		}
+
+		produced = (size_t)(zst->next_out - (out + 8));
+		if (produced > 0) out = finishPNGChunk(out, "IDAT", produced);
+	}
+
+	if (encoder->stage == kStageTrailer &&
+	    (size_t)(buf + len - out) >= PNG_CHUNK_OVERHEAD) {
+		out = finishPNGChunk(out, "IEND", 0);
+		encoder->stage = kStageFinished;
+	}
+
+	*written = (size_t)(out - buf);
+	return 0;
+}
+
+static void writeBMPHeader(MMImageEncoderRef encoder, uint8_t *out)
+{
+	const MMBitmapRef bitmap = encoder->bitmap;
+	const uint32_t imageSize = (uint32_t)(encoder->rowLength * (size_t)bitmap->height);
+
+	memset(out, 0, BMP_HEADER_SIZE);
+
+	/* BITMAP_FILE_HEADER */
+	out[0] = 'B';
+	out[1] = 'M';
+	writeLE32(out + 2, BMP_HEADER_SIZE + imageSize);
+	writeLE32(out + 10, BMP_HEADER_SIZE);
+
+	/* BITMAP_INFO_HEADER; the negative height marks the rows as top-down,
+	 * which is how they are stored in the bitmap. */
+	writeLE32(out + 14, 40);
+	writeLE32(out + 18, (uint32_t)bitmap->width);
+	writeLE32(out + 22, (uint32_t)-bitmap->height);
+	writeLE16(out + 26, 1); /* Color planes */
+	writeLE16(out + 28, 24); /* Bits per pixel */
+	writeLE32(out + 34, imageSize);
+	writeLE32(out + 38, 2835); /* 72 DPI */
+	writeLE32(out + 42, 2835);
+}
+
+/* Writes the next row to the row buffer as padded BGR. */
+static void nextBMPRow(MMImageEncoderRef encoder)
+{
+	const MMBitmapRef bitmap = encoder->bitmap;
+	const uint8_t *pixel = bitmap->imageBuffer + (size_t)bitmap->bytewidth * encoder->y;
+	const uint8_t bytesPerPixel = bitmap->bytesPerPixel;
+	uint8_t *out = encoder->rows;
+	int32_t x;
+
+	for (x = 0; x < bitmap->width; ++x, pixel += bytesPerPixel) {
+		const MMRGBColor *color = (const MMRGBColor *)pixel;
+		*out++ = color->blue;
+		*out++ = color->green;
+		*out++ = color->red;
+	}
+
+	while (out < encoder->rows + encoder->rowLength) *out++ = 0;
+	++encoder->y;
+}
+
+static int readBMP(MMImageEncoderRef encoder, uint8_t *buf, size_t len,
+                   size_t *written)
+{
+	size_t total = 0;
+
+	while (total < len) {
+		size_t n;
+
+		if (encoder->pendingLength == 0) {
+			if (encoder->stage == kStageHeader) {
+				writeBMPHeader(encoder, encoder->rows);
+				encoder->pendingLength = BMP_HEADER_SIZE;
+				encoder->stage = kStageData;
+			} else if (encoder->y < encoder->bitmap->height) {
+				nextBMPRow(encoder);
+				encoder->pendingLength = encoder->rowLength;
+			} else {
+				encoder->stage = kStageFinished;
+				break;
+			}
+			encoder->pending = encoder->rows;
+		}
+
+		n = len - total;
+		if (n > encoder->pendingLength) n = encoder->pendingLength;
+		memcpy(buf + total, encoder->pending, n);
+		encoder->pending += n;
+		encoder->pendingLength -= n;
+		total += n;
+	}
+
+	if (encoder->pendingLength == 0 && encoder->stage == kStageData &&
+	    encoder->y == encoder->bitmap->height) {
+		encoder->stage = kStageFinished;
+	}
+
+	*written = total;
+	return 0;
+}
+
+int readMMImageEncoder(MMImageEncoderRef encoder, uint8_t *buf, size_t len,
+                       size_t *written)
+{
+	int err;
+
+	*written = 0;
+	if (encoder->stage == kStageFailed || len < MM_IMAGE_MIN_CHUNK_SIZE) return -1;
+	if (encoder->stage == kStageFinished) return 0;
+
+	err = encoder->type == kPNGImageType ? readPNG(encoder, buf, len, written)
+	                                        : readBMP(encoder, buf, len, written);
+	if (err != 0) encoder->stage = kStageFailed;
+
+	return err;
+}
+
+/* Writes all of |data|, retrying after short writes and interruptions. */
+static int writeAll(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+#if defined(IS_WINDOWS)
+		const int n = _write(fd, data, len > INT_MAX ? INT_MAX : (unsigned int)len);
+#else
+		const ssize_t n = write(fd, data, len);
+#endif
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+int writeMMBitmapToFD(MMBitmapRef bitmap, int fd, MMImageType type,
+                      int level, int filters, size_t chunkSize,
+                      size_t *written)
+{
+	MMImageEncoderRef encoder;
+	uint8_t *chunk;
+	size_t total = 0;
+	int err = 0;
+
+	if (written != NULL) *written = 0;
+	if (chunkSize < MM_IMAGE_MIN_CHUNK_SIZE) return -1;
+
+	encoder = createMMImageEncoder(bitmap, type, level, filters);
+	chunk = malloc(chunkSize);
+	if (encoder == NULL || chunk == NULL) {
+		destroyMMImageEncoder(encoder);
+		free(chunk);
+		return -1;
+	}
+
+	while (!MMImageEncoderFinished(encoder)) {
+		size_t length;
+
+		if (readMMImageEncoder(encoder, chunk, chunkSize, &length) != 0 ||
+		    writeAll(fd, chunk, length) != 0) {
+			err = -1;
+			break;
+		}
+
+		total += length;
+	}
+
+	destroyMMImageEncoder(encoder);
+	free(chunk);
+
+	if (written != NULL) *written = total;
+	return err;
+}
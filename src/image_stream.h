@@ -0,0 +1,74 @@
+#pragma once
+#ifndef IMAGE_STREAM_H
+#define IMAGE_STREAM_H
+
+#include "MMBitmap.h"
+#include "io.h" /* For MMImageType. */
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+	#include "ms_stdint.h"
+#else
+	#include <stdbool.h>
+	#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Encoders that hand out an image file a chunk at a time, so that however
+ * large the bitmap is, only a few rows of it (plus the compressor's state,
+ * for PNG) are ever held in encoded form. */
+
+/* Smallest buffer readMMImageEncoder() accepts. */
+#define MM_IMAGE_MIN_CHUNK_SIZE 64
+
+typedef struct _MMImageEncoder MMImageEncoder;
+typedef MMImageEncoder *MMImageEncoderRef;
+
+/* Returns an encoder for |bitmap| as a kPNGImageType or kBMPImageType file,
+ * or NULL on error. PNGs are written as 8-bit RGB, with |level| and |filters|
+ * as for createPNGDataParallel() (see png_parallel.h); BMPs are written as
+ * uncompressed top-down 24-bit Windows v3 files, and ignore both.
+ *
+ * The bitmap is read from as the encoder goes, so it must outlive the encoder
+ * and not change in the meantime. */
+MMImageEncoderRef createMMImageEncoder(MMBitmapRef bitmap, MMImageType type,
+                                       int level, int filters);
+
+void destroyMMImageEncoder(MMImageEncoderRef encoder);
+
+/* Encodes the next part of the file into |buf|, which must have room for at
+ * least MM_IMAGE_MIN_CHUNK_SIZE bytes, and sets |written| to the number of
+ * bytes written. That is |len| until the end of the file (where the last
+ * one or two chunks may be shorter); once the whole file has been read it
+ * is 0.
+ *
+ * Each PNG chunk read holds a whole IDAT chunk, so the chunk size also sets
+ * the size of the IDATs.
+ *
+ * Returns 0 on success, or -1 on error (after which the encoder is no longer
+ * usable). */
+int readMMImageEncoder(MMImageEncoderRef encoder, uint8_t *buf, size_t len,
+                       size_t *written);
+
+/* Returns whether the whole file has been read. */
+bool MMImageEncoderFinished(MMImageEncoderRef encoder);
+
+/* Encodes |bitmap| straight to the file descriptor |fd| in writes of
+ * |chunkSize| bytes, through a buffer of that size. If |written| is not NULL
+ * it is set to the number of bytes written.
+ *
+ * Returns 0 on success, or -1 on error (with errno set if a write failed). */
+int writeMMBitmapToFD(MMBitmapRef bitmap, int fd, MMImageType type,
+                      int level, int filters, size_t chunkSize,
+                      size_t *written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMAGE_STREAM_H */
@@ -12,6 +12,9 @@ CFStringRef createStringForKey(CGKeyCode keyCode);
 
 #elif defined(USE_X11)
 
+#include <limits.h> /* For UCHAR_MAX */
+#include <stdbool.h>
+
 /*
  * Structs to store key mappings not handled by XStringToKeysym() on some
  * Linux systems.
@@ -104,9 +107,17 @@ MMKeyCode keyCodeForChar(const char c)
 #elif defined(IS_WINDOWS)
 	return VkKeyScan(c);
 #elif defined(USE_X11)
+	/* The char to keysym mapping doesn't depend on the keyboard layout, so
+	 * look each character up once and remember the result. */
+	static MMKeyCode cache[UCHAR_MAX + 1];
+	static bool cached[UCHAR_MAX + 1];
+	const unsigned char index = (unsigned char)c;
 	MMKeyCode code;
 
 	char buf[2];
+
+	if (cached[index]) return cache[index];
+
 	buf[0] = c;
 	buf[1] = '\0';
 
@@ -126,6 +137,8 @@ MMKeyCode keyCodeForChar(const char c)
 		}
 	}
 
+	cache[index] = code;
+	cached[index] = true;
 	return code;
 #endif
 }
@@ -3,6 +3,8 @@
 #include "microsleep.h"
 
 #include <ctype.h> /* For isupper() */
+#include <stdlib.h> /* For malloc() */
+#include <string.h> /* For strlen() */
 
 #if defined(IS_MACOSX)
 	#include <ApplicationServices/ApplicationServices.h>
@@ -11,6 +13,7 @@
 #elif defined(USE_X11)
 	#include <X11/extensions/XTest.h>
 	#include "xdisplay.h"
+	#include "xkeymap.h"
 #endif
 
 /* Convenience wrappers around ugly APIs. */
@@ -18,14 +21,16 @@
 	#define WIN32_KEY_EVENT_WAIT(key, flags) \
 		(win32KeyEvent(key, flags), Sleep(DEADBEEF_RANDRANGE(63, 125)))
 #elif defined(USE_X11)
-	#define X_KEY_EVENT(display, key, is_press) \
-		(XTestFakeKeyEvent(display, \
-		                   XKeysymToKeycode(display, key), \
-		                   is_press, CurrentTime), \
+	#define X_KEYCODE_EVENT(display, keycode, is_press) \
+		(XTestFakeKeyEvent(display, keycode, is_press, CurrentTime), \
 		 XSync(display, false))
-	#define X_KEY_EVENT_WAIT(display, key, is_press) \
-		(X_KEY_EVENT(display, key, is_press), \
+	#define X_KEYCODE_EVENT_WAIT(display, keycode, is_press) \
+		(X_KEYCODE_EVENT(display, keycode, is_press), \
 		 microsleep(DEADBEEF_UNIFORM(62.5, 125.0)))
+	#define X_KEY_EVENT(display, key, is_press) \
+		X_KEYCODE_EVENT(display, XKeyCodeForKeySym(display, key, NULL), is_press)
+	#define X_KEY_EVENT_WAIT(display, key, is_press) \
+		X_KEYCODE_EVENT_WAIT(display, XKeyCodeForKeySym(display, key, NULL), is_press)
 #endif
 
 #if defined(IS_MACOSX)
@@ -164,6 +169,14 @@ void toggleKeyCode(MMKeyCode code, const bool down, MMKeyFlags flags)
 #elif defined(USE_X11)
 	Display *display = XGetMainDisplay();
 	const Bool is_press = down ? True : False; /* Just to be safe. */
+	unsigned int level;
+	const KeyCode keycode = XKeyCodeForKeySym(display, code, &level);
+
+	/* Nothing produces this keysym and no keycode was free to bind it to. */
+	if (keycode == 0) return;
+
+	/* Hold Shift for keysyms on the shifted level, e.g. '!' on US layouts. */
+	if (level == XKEY_LEVEL_SHIFT) flags |= MOD_SHIFT;
 
 	if (down) {
 		/* Parse modifier keys. */
@@ -172,10 +185,10 @@ void toggleKeyCode(MMKeyCode code, const bool down, MMKeyFlags flags)
 		if (flags & MOD_CONTROL) X_KEY_EVENT_WAIT(display, K_CONTROL, is_press);
 		if (flags & MOD_SHIFT) X_KEY_EVENT_WAIT(display, K_SHIFT, is_press);
 
-		X_KEY_EVENT_WAIT(display, code, is_press);
+		X_KEYCODE_EVENT_WAIT(display, keycode, is_press);
 	} else {
 		/* Reverse order for key up */
-		X_KEY_EVENT_WAIT(display, code, is_press);
+		X_KEYCODE_EVENT_WAIT(display, keycode, is_press);
 
 		/* Parse modifier keys. */
 		if (flags & MOD_META) X_KEY_EVENT(display, K_META, is_press);
@@ -255,58 +268,127 @@ void toggleUniKey(char c, const bool down)
 {
 	toggleUnicodeKey(c, down);
 }
+#elif defined(USE_X11)
+/* Returns the keysym that types the given code point. */
+static KeySym keySymForCodePoint(unsigned long ch)
+{
+	if (ch < 0x80) {
+		/* Keep the special handling of control characters like '\n'. */
+		return keyCodeForChar((char)ch);
+	}
+
+	/* Latin-1 keysyms match their code points; everything else uses the
+	 * Unicode keysym range. */
+	return ch < 0x100 ? (KeySym)ch : (KeySym)(0x01000000 | ch);
+}
+
+void toggleUnicodeKey(unsigned long ch, const bool down)
+{
+	/* Characters missing from the layout are bound to a spare keycode by
+	 * XKeyCodeForKeySym(). */
+	toggleKeyCode(keySymForCodePoint(ch), down, MOD_NONE);
+}
 #else
 	#define toggleUniKey(c, down) toggleKey(c, down, MOD_NONE)
 #endif
 
-static void tapUniKey(char c)
+static void tapUnicodeKey(unsigned long ch)
 {
-	toggleUniKey(c, true);
-	toggleUniKey(c, false);
+#if defined(IS_MACOSX) || defined(USE_X11)
+	toggleUnicodeKey(ch, true);
+	toggleUnicodeKey(ch, false);
+#else
+	toggleUniKey((char)ch, true);
+	toggleUniKey((char)ch, false);
+#endif
+}
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+size_t decodeUTF8(const char *str, unsigned long *ch)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	unsigned long n = s[0];
+	unsigned long min;
+	size_t length, i;
+
+	if (n < 0x80) {
+		*ch = n;
+		return 1;
+	} else if ((n & 0xE0) == 0xC0) {
+		length = 2;
+		min = 0x80;
+		n &= 0x1F;
+	} else if ((n & 0xF0) == 0xE0) {
+		length = 3;
+		min = 0x800;
+		n &= 0x0F;
+	} else if ((n & 0xF8) == 0xF0) {
+		length = 4;
+		min = 0x10000;
+		n &= 0x07;
+	} else {
+		*ch = REPLACEMENT_CHARACTER;
+		return 1;
+	}
+
+	for (i = 1; i < length; ++i) {
+		if ((s[i] & 0xC0) != 0x80) {
+			*ch = REPLACEMENT_CHARACTER;
+			return 1;
+		}
+		n = (n << 6) | (s[i] & 0x3F);
+	}
+
+	if (n < min || n > 0x10FFFF || (n >= 0xD800 && n <= 0xDFFF)) {
+		*ch = REPLACEMENT_CHARACTER;
+		return 1;
+	}
+
+	*ch = n;
+	return length;
 }
 
 void typeString(const char *str)
 {
-	unsigned short c;
-	unsigned short c1;
-	unsigned short c2;
-	unsigned short c3;
-	unsigned long n;
+#if defined(USE_X11)
+	/* Decode the whole string up front, so keycodes for everything missing
+	 * from the layout can be bound a batch at a time instead of with one
+	 * XChangeKeyboardMapping() round trip per character. */
+	Display *display = XGetMainDisplay();
+	KeySym *keysyms = malloc(strlen(str) * sizeof(KeySym));
+	size_t count = 0;
+	size_t i = 0;
+	unsigned long ch;
+
+	if (keysyms == NULL) return;
 
 	while (*str != '\0') {
-		c = *str++;
-
-		// warning, the following utf8 decoder
-		// doesn't perform validation
-		if (c <= 0x7F) {
-			// 0xxxxxxx one byte
-			n = c;
-		} else if ((c & 0xE0) == 0xC0)  {
-			// 110xxxxx two bytes
-			c1 = (*str++) & 0x3F;
-			n = ((c & 0x1F) << 6) | c1;
-		} else if ((c & 0xF0) == 0xE0) {
-			// 1110xxxx three bytes
-			c1 = (*str++) & 0x3F;
-			c2 = (*str++) & 0x3F;
-			n = ((c & 0x0F) << 12) | (c1 << 6) | c2;
-		} else if ((c & 0xF8) == 0xF0) {
-			// 11110xxx four bytes
-			c1 = (*str++) & 0x3F;
-			c2 = (*str++) & 0x3F;
-			c3 = (*str++) & 0x3F;
-			n = ((c & 0x07) << 18) | (c1 << 12) | (c2 << 6) | c3;
+		str += decodeUTF8(str, &ch);
+		keysyms[count++] = keySymForCodePoint(ch);
+	}
+
+	while (i < count) {
+		size_t end = i + XBindKeySyms(display, keysyms + i, count - i);
+
+		/* Nothing could be bound; let toggleKeyCode() skip the keysym. */
+		if (end == i) end = i + 1;
+
+		for (; i < end; ++i) {
+			toggleKeyCode(keysyms[i], true, MOD_NONE);
+			toggleKeyCode(keysyms[i], false, MOD_NONE);
 		}
+	}
 
-		#if defined(IS_MACOSX)
-		toggleUnicodeKey(n, true);
-		toggleUnicodeKey(n, false);
-		#else
-		toggleUniKey(n, true);
-		toggleUniKey(n, false);
-		#endif
+	free(keysyms);
+#else
+	unsigned long ch;
 
+	while (*str != '\0') {
+		str += decodeUTF8(str, &ch);
+		tapUnicodeKey(ch);
 	}
+#endif
 }
 
 void typeStringDelayed(const char *str, const unsigned cpm)
@@ -317,8 +399,15 @@ void typeStringDelayed(const char *str, const unsigned cpm)
 	/* Average milli-seconds per character */
 	const double mspc = (cps == 0.0) ? 0.0 : 1000.0 / cps;
 
+	/* Keep the characters on schedule, however long each tap takes. */
+	MMPacer pacer;
+	unsigned long ch;
+
+	MMPacerStart(&pacer);
+
 	while (*str != '\0') {
-		tapUniKey(*str++);
-		microsleep(mspc + (DEADBEEF_UNIFORM(0.0, 62.5)));
+		str += decodeUTF8(str, &ch);
+		tapUnicodeKey(ch);
+		MMPacerWait(&pacer, mspc + (DEADBEEF_UNIFORM(0.0, 62.5)));
 	}
 }
@@ -4,6 +4,7 @@
 
 #include "os.h"
 #include "keycode.h"
+#include <stddef.h> /* size_t */
 
 #if defined(_MSC_VER)
 	#include "ms_stdbool.h"
@@ -69,6 +70,13 @@ void tapKey(char c, MMKeyFlags flags);
 /* Sends a UTF-8 string without modifiers. */
 void typeString(const char *str);
 
+/* Decodes the UTF-8 sequence at |str| into |ch| and returns its length in
+ * bytes, as typeString() reads its string. Malformed input (stray or missing
+ * continuation bytes, overlong forms, surrogates, values past U+10FFFF)
+ * decodes to U+FFFD one byte at a time, and the terminating NUL is never
+ * skipped over. */
+size_t decodeUTF8(const char *str, unsigned long *ch);
+
 /* Macro to convert WPM to CPM integers.
  * (the average English word length is 5.1 characters.) */
 #define WPM_TO_CPM(WPM) (unsigned)(5.1 * WPM)
@@ -0,0 +1,102 @@
+#include "macro.h"
+#include "timing.h"
+#include <string.h>
+
+void initMMMacroHeader(MMMacroHeader *header, uint32_t count)
+{
+	memcpy(header->magic, MMMACRO_MAGIC, sizeof(header->magic));
+	header->version = MMMACRO_VERSION;
+	header->eventSize = (uint16_t)sizeof(MMMacroEvent);
+	header->count = count;
+	header->reserved = 0;
+}
+
+const MMMacroEvent *MMMacroEvents(const uint8_t *buf, size_t len, size_t *count)
+{
+	MMMacroHeader header;
+	const MMMacroEvent *events;
+	size_t i;
+
+	if (buf == NULL || len < sizeof(header)) return NULL;
+
+	memcpy(&header, buf, sizeof(header));
+	if (memcmp(header.magic, MMMACRO_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != MMMACRO_VERSION ||
+	    header.eventSize != sizeof(MMMacroEvent) ||
+	    len != MMMacroSize(header.count)) {
+		return NULL;
+	}
+
+	/* Events are only ever written by initMMMacroHeader()'s callers, but the
+	 * buffer comes from JS, so make sure every type is one we know. */
+	events = (const MMMacroEvent *)(buf + sizeof(header));
+	for (i = 0; i < header.count; ++i) {
+		if (events[i].type >= MMMACRO_EVENT_TYPE_COUNT) return NULL;
+	}
+
+	*count = header.count;
+	return events;
+}
+
+static void sendMacroEvent(const MMMacroEvent *event)
+{
+	switch (event->type) {
+		case MMMACRO_KEY_TOGGLE:
+			toggleKeyCode((MMKeyCode)event->code, event->down != 0,
+			              (MMKeyFlags)event->flags);
+			break;
+		case MMMACRO_KEY_TAP:
+			tapKeyCode((MMKeyCode)event->code, (MMKeyFlags)event->flags);
+			break;
+		case MMMACRO_MOUSE_MOVE:
+			moveMouse(MMSignedPointMake(event->x, event->y));
+			break;
+		case MMMACRO_MOUSE_DRAG:
+			dragMouse(MMSignedPointMake(event->x, event->y),
+			          (MMMouseButton)event->code);
+			break;
+		case MMMACRO_MOUSE_TOGGLE:
+			toggleMouse(event->down != 0, (MMMouseButton)event->code);
+			break;
+		case MMMACRO_MOUSE_CLICK:
+			if (event->down) {
+				doubleClick((MMMouseButton)event->code);
+			} else {
+				clickMouse((MMMouseButton)event->code);
+			}
+			break;
+		case MMMACRO_MOUSE_SCROLL:
+			scrollMouse(event->x, event->y);
+			break;
+		default: /* MMMACRO_DELAY */
+			break;
+	}
+}
+
+void playMMMacro(const MMMacroEvent *events, size_t count,
+                 MMMacroTiming *timings)
+{
+	MMPacer pacer;
+	MMTimestamp start;
+	double scheduled = 0.0;
+	size_t i;
+
+	MMPacerStart(&pacer);
+	start = pacer.next;
+
+	for (i = 0; i < count; ++i) {
+		const double delay = events[i].delay / 1000.0;
+		MMTimestamp sent;
+
+		MMPacerWait(&pacer, delay);
+		sent = MMTimestampNow();
+		sendMacroEvent(&events[i]);
+
+		if (timings != NULL) {
+			scheduled += delay;
+			timings[i].scheduled = scheduled;
+			timings[i].actual = MMTimestampToMilliseconds(sent - start);
+			timings[i].duration = MMTimestampToMilliseconds(MMTimestampNow() - sent);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#ifndef MACRO_H
+#define MACRO_H
+
+#include "os.h"
+#include "types.h"
+#include "keypress.h"
+#include "mouse.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* A compiled macro is a header followed by |count| fixed-size events, with
+ * key codes, flags and buttons already resolved for the current platform.
+ * The format is native-endian and platform-specific; it is meant to be
+ * compiled and replayed on the same machine, not exchanged between them. */
+
+#define MMMACRO_MAGIC "RJMC"
+#define MMMACRO_VERSION 1
+
+enum _MMMacroEventType {
+	MMMACRO_DELAY = 0,   /* Only waits. */
+	MMMACRO_KEY_TOGGLE,  /* code = key, flags = modifiers, down = state. */
+	MMMACRO_KEY_TAP,     /* code = key, flags = modifiers. */
+	MMMACRO_MOUSE_MOVE,  /* x, y. */
+	MMMACRO_MOUSE_DRAG,  /* x, y, code = button. */
+	MMMACRO_MOUSE_TOGGLE,/* code = button, down = state. */
+	MMMACRO_MOUSE_CLICK, /* code = button, down = double click. */
+	MMMACRO_MOUSE_SCROLL,/* x, y. */
+	MMMACRO_EVENT_TYPE_COUNT
+};
+
+typedef uint8_t MMMacroEventType;
+
+struct _MMMacroHeader {
+	char magic[4];      /* MMMACRO_MAGIC */
+	uint16_t version;   /* MMMACRO_VERSION */
+	uint16_t eventSize; /* sizeof(MMMacroEvent) */
+	uint32_t count;     /* Number of events following the header. */
+	uint32_t reserved;
+};
+
+typedef struct _MMMacroHeader MMMacroHeader;
+
+struct _MMMacroEvent {
+	MMMacroEventType type;
+	uint8_t down;
+	uint16_t reserved;
+	uint32_t delay; /* Microseconds between the previous event's deadline
+	                 * and this one's. */
+	uint32_t code;
+	uint32_t flags;
+	int32_t x;
+	int32_t y;
+};
+
+typedef struct _MMMacroEvent MMMacroEvent;
+
+/* Per-event timing collected by playMMMacro(), in milliseconds since the
+ * start of playback. */
+struct _MMMacroTiming {
+	double scheduled; /* When the event was due. */
+	double actual;    /* When it was sent. */
+	double duration;  /* How long sending it took. */
+};
+
+typedef struct _MMMacroTiming MMMacroTiming;
+
+/* Returns the number of bytes needed for a compiled macro of |count| events. */
+#define MMMacroSize(count) (sizeof(MMMacroHeader) + (count) * sizeof(MMMacroEvent))
+
+/* Writes a header for |count| events to |header|. */
+void initMMMacroHeader(MMMacroHeader *header, uint32_t count);
+
+/* Checks that |buf| holds a complete compiled macro. Returns a pointer to its
+ * first event and sets |count|, or returns NULL if the buffer is invalid. */
+const MMMacroEvent *MMMacroEvents(const uint8_t *buf, size_t len, size_t *count);
+
+/* Sends |count| events, each on an absolute schedule relative to the start of
+ * playback (see MMPacer). If |timings| is not NULL it must have room for
+ * |count| entries. */
+void playMMMacro(const MMMacroEvent *events, size_t count,
+                 MMMacroTiming *timings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MACRO_H */
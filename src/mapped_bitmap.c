@@ -0,0 +1,298 @@
+#include "mapped_bitmap.h"
+#include "os.h"
+#include "endian.h"
+#include "bitmap_find.h"
+#include <stdio.h> /* fopen() */
+#include <stdlib.h> /* malloc() */
+#include <string.h> /* memcpy() */
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#if !defined(IS_WINDOWS)
+	#include <fcntl.h> /* For open() */
+	#include <sys/mman.h> /* For mmap() */
+	#include <sys/stat.h> /* For fstat() */
+	#include <unistd.h> /* For close() */
+#endif
+
+/* The header has to be exactly as laid out on disk. */
+typedef char mappedBitmapHeaderSizeCheck[
+	sizeof(MMMappedBitmapHeader) == MAPPED_BITMAP_HEADER_SIZE ? 1 : -1];
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+
+static uint64_t swapLittleAndHost64(uint64_t i)
+{
+	return ((uint64_t)swapLittleAndHost32((uint32_t)i) << 32) |
+	       swapLittleAndHost32((uint32_t)(i >> 32));
+}
+
+/* Converts the header to and from little endian, if and only if host is big
+ * endian. */
+static void convertMappedBitmapHeader(MMMappedBitmapHeader *header)
+{
+	header->version = swapLittleAndHost16(header->version);
+	header->headerSize = swapLittleAndHost16(header->headerSize);
+	header->width = swapLittleAndHost32(header->width);
+	header->height = swapLittleAndHost32(header->height);
+	header->bytewidth = swapLittleAndHost32(header->bytewidth);
+	header->imageSize = swapLittleAndHost64(header->imageSize);
+	header->signature.checksum = swapLittleAndHost64(header->signature.checksum);
+	header->signature.firstColor = swapLittleAndHost32(header->signature.firstColor);
+	header->signature.anchorColor = swapLittleAndHost32(header->signature.anchorColor);
+	header->signature.anchorX = swapLittleAndHost32(header->signature.anchorX);
+	header->signature.anchorY = swapLittleAndHost32(header->signature.anchorY);
+	header->signature.colorCount = swapLittleAndHost32(header->signature.colorCount);
+}
+
+#elif __BYTE_ORDER == __LITTLE_ENDIAN
+	/* No conversion necessary if we are already little endian. */
+	#define convertMappedBitmapHeader(header)
+#endif
+
+const char *MMMappedBitmapReadErrorString(MMIOError error)
+{
+	switch (error) {
+		case kMappedBitmapAccessError:
+			return "Could not open file";
+		case kMappedBitmapInvalidHeaderError:
+			return "Not a mapped bitmap file";
+		case kMappedBitmapTruncatedError:
+			return "Mapped bitmap file is truncated";
+		case kMappedBitmapMapError:
+			return "Could not map file into memory";
+		default:
+			return NULL;
+	}
+}
+
+void computeNeedleSignature(MMBitmapRef bitmap, MMNeedleSignature *signature)
+{
+	MMPoint anchor;
+	size_t x, y;
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	for (y = 0; y < (size_t)bitmap->height; ++y) {
+		for (x = 0; x < (size_t)bitmap->width; ++x) {
+			const MMRGBHex color = MMRGBHexAtPoint(bitmap, x, y);
+			hash = (hash ^ RED_FROM_HEX(color)) * FNV_PRIME;
+			hash = (hash ^ GREEN_FROM_HEX(color)) * FNV_PRIME;
+			hash = (hash ^ BLUE_FROM_HEX(color)) * FNV_PRIME;
+		}
+	}
+
+	memset(signature, 0, sizeof(*signature));
+	signature->checksum = hash;
+	signature->firstColor = MMRGBHexAtPoint(bitmap, 0, 0);
+	anchor = findNeedleAnchor(bitmap, &signature->colorCount);
+	signature->anchorColor = MMRGBHexAtPoint(bitmap, anchor.x, anchor.y);
+	signature->anchorX = (int32_t)anchor.x;
+	signature->anchorY = (int32_t)anchor.y;
+}
+
+uint8_t *createMappedBitmapData(MMBitmapRef bitmap, size_t *len)
+{
+	MMMappedBitmapHeader header;
+	size_t bytewidth, imageSize;
+	uint8_t *data;
+	int32_t x, y;
+
+	if (bitmap == NULL || bitmap->imageBuffer == NULL ||
+	    bitmap->width <= 0 || bitmap->height <= 0 ||
+	    (bitmap->bytesPerPixel != 3 && bitmap->bytesPerPixel != 4) ||
+	    bitmap->width > (INT32_MAX - MAPPED_BITMAP_ROW_ALIGN) / 4) {
+		return NULL;
+	}
+
+	bytewidth = ((size_t)bitmap->width * 4 + MAPPED_BITMAP_ROW_ALIGN - 1) &
+	            ~(size_t)(MAPPED_BITMAP_ROW_ALIGN - 1);
+	imageSize = bytewidth * (size_t)bitmap->height;
+
+	data = calloc(1, MAPPED_BITMAP_HEADER_SIZE + imageSize);
+	if (data == NULL) return NULL;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAPPED_BITMAP_MAGIC, sizeof(header.magic));
+	header.version = MAPPED_BITMAP_VERSION;
+	header.headerSize = MAPPED_BITMAP_HEADER_SIZE;
+	header.width = bitmap->width;
+	header.height = bitmap->height;
+	header.bytewidth = (int32_t)bytewidth;
+	header.bitsPerPixel = 32;
+	header.bytesPerPixel = 4;
+	header.imageSize = imageSize;
+	computeNeedleSignature(bitmap, &header.signature);
+
+	convertMappedBitmapHeader(&header);
+	memcpy(data, &header, sizeof(header));
+
+	for (y = 0; y < bitmap->height; ++y) {
+		const uint8_t *src = bitmap->imageBuffer + (size_t)bitmap->bytewidth * y;
+		uint8_t *dest = data + MAPPED_BITMAP_HEADER_SIZE + bytewidth * y;
+
+		if (bitmap->bytesPerPixel == 4) {
+			memcpy(dest, src, (size_t)bitmap->width * 4);
+			continue;
+		}
+
+		for (x = 0; x < bitmap->width; ++x, src += 3, dest += 4) {
+			dest[0] = src[0];
+			dest[1] = src[1];
+			dest[2] = src[2];
+			dest[3] = 0xFF;
+		}
+	}
+
+	if (len != NULL) *len = MAPPED_BITMAP_HEADER_SIZE + imageSize;
+	return data;
+}
+
+int saveMMBitmapAsMapped(MMBitmapRef bitmap, const char *path)
+{
+	FILE *fp;
+	size_t dataLen;
+	uint8_t *data;
+
+	if ((data = createMappedBitmapData(bitmap, &dataLen)) == NULL) return -1;
+
+	if ((fp = fopen(path, "wb")) == NULL) {
+		free(data);
+		return -1;
+	}
+
+	if (fwrite(data, dataLen, 1, fp) == 0) {
+		free(data);
+		fclose(fp);
+		return -1;
+	}
+
+	free(data);
+	return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* Maps the whole of the file at |path| copy-on-write. */
+static void *mapFile(const char *path, size_t *length, MMMappedBitmapReadError *error)
+{
+	void *mapping;
+
+#if defined(IS_WINDOWS)
+	LARGE_INTEGER size;
+	HANDLE mapHandle;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		*error = kMappedBitmapAccessError;
+		return NULL;
+	}
+
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < MAPPED_BITMAP_HEADER_SIZE ||
+	    (uint64_t)size.QuadPart > SIZE_MAX) {
+		CloseHandle(file);
+		*error = kMappedBitmapTruncatedError;
+		return NULL;
+	}
+
+	/* The view keeps the file open; the handles aren't needed after it is
+	 * made. */
+	mapHandle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	mapping = mapHandle == NULL ? NULL : MapViewOfFile(mapHandle, FILE_MAP_COPY, 0, 0, 0);
+	if (mapHandle != NULL) CloseHandle(mapHandle);
+	CloseHandle(file);
+
+	*length = (size_t)size.QuadPart;
+#else
+	struct stat info;
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		*error = kMappedBitmapAccessError;
+		return NULL;
+	}
+
+	if (fstat(fd, &info) != 0 || info.st_size < MAPPED_BITMAP_HEADER_SIZE ||
+	    (uint64_t)info.st_size > SIZE_MAX) {
+		close(fd);
+		*error = kMappedBitmapTruncatedError;
+		return NULL;
+	}
+
+	mapping = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) mapping = NULL;
+
+	*length = (size_t)info.st_size;
+#endif
+
+	if (mapping == NULL) *error = kMappedBitmapMapError;
+	return mapping;
+}
+
+static void unmapFile(void *mapping, size_t length)
+{
+#if defined(IS_WINDOWS)
+	UnmapViewOfFile(mapping);
+#else
+	munmap(mapping, length);
+#endif
+}
+
+MMMappedBitmapRef mapMMBitmapFile(const char *path, MMMappedBitmapReadError *error)
+{
+	MMMappedBitmapReadError err = kMappedBitmapGenericError;
+	MMMappedBitmapRef mapped;
+	MMMappedBitmapHeader header;
+	size_t length;
+	void *mapping = mapFile(path, &length, &err);
+
+	if (mapping == NULL) {
+		if (error != NULL) *error = err;
+		return NULL;
+	}
+
+	memcpy(&header, mapping, sizeof(header));
+	convertMappedBitmapHeader(&header);
+
+	if (memcmp(header.magic, MAPPED_BITMAP_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != MAPPED_BITMAP_VERSION ||
+	    header.headerSize < MAPPED_BITMAP_HEADER_SIZE ||
+	    header.headerSize % MAPPED_BITMAP_ROW_ALIGN != 0 ||
+	    header.width <= 0 || header.height <= 0 ||
+	    header.bitsPerPixel != 32 || header.bytesPerPixel != 4 ||
+	    header.bytewidth % MAPPED_BITMAP_ROW_ALIGN != 0 ||
+	    header.bytewidth / 4 < header.width ||
+	    header.imageSize != (uint64_t)header.bytewidth * (uint64_t)header.height) {
+		err = kMappedBitmapInvalidHeaderError;
+	} else if ((uint64_t)header.headerSize + header.imageSize > length) {
+		err = kMappedBitmapTruncatedError;
+	} else if ((mapped = calloc(1, sizeof(MMMappedBitmap))) != NULL) {
+		mapped->bitmap.imageBuffer = (uint8_t *)mapping + header.headerSize;
+		mapped->bitmap.width = header.width;
+		mapped->bitmap.height = header.height;
+		mapped->bitmap.bytewidth = header.bytewidth;
+		mapped->bitmap.bitsPerPixel = header.bitsPerPixel;
+		mapped->bitmap.bytesPerPixel = header.bytesPerPixel;
+		mapped->signature = header.signature;
+		mapped->mapping = mapping;
+		mapped->length = length;
+		return mapped;
+	}
+
+	unmapFile(mapping, length);
+	if (error != NULL) *error = err;
+	return NULL;
+}
+
+void unmapMMBitmapFile(MMMappedBitmapRef mapped)
+{
+	if (mapped == NULL) return;
+
+	unmapFile(mapped->mapping, mapped->length);
+	free(mapped);
+}
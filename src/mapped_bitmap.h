@@ -0,0 +1,116 @@
+#pragma once
+#ifndef MAPPED_BITMAP_H
+#define MAPPED_BITMAP_H
+
+#include "MMBitmap.h"
+#include "io.h"
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+	#include "ms_stdint.h"
+#else
+	#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* A raw bitmap container that can be mmap()'d and searched in place: a fixed
+ * little-endian header followed by 32-bit BGRX rows, each padded to
+ * MAPPED_BITMAP_ROW_ALIGN bytes, starting MAPPED_BITMAP_HEADER_SIZE bytes in.
+ * Loading one costs a page fault per page touched rather than a decode and a
+ * copy. */
+
+#define MAPPED_BITMAP_MAGIC "RJBM"
+#define MAPPED_BITMAP_VERSION 1
+#define MAPPED_BITMAP_HEADER_SIZE 64
+#define MAPPED_BITMAP_ROW_ALIGN 16
+
+/* Facts about a bitmap worked out once, when it is saved, so a search for it
+ * doesn't have to scan it first. */
+struct _MMNeedleSignature {
+	uint64_t checksum;     /* FNV-1a hash of the pixels (without padding). */
+	MMRGBHex firstColor;   /* Color of the top left pixel. */
+	MMRGBHex anchorColor;  /* The rarest color in the bitmap, */
+	int32_t anchorX;       /* and where it first occurs; see */
+	int32_t anchorY;       /* findNeedleAnchor(). */
+	uint32_t colorCount;   /* Number of distinct colors, or 0 if there were
+	                        * too many to count (in which case the anchor is
+	                        * the top left pixel). */
+};
+
+typedef struct _MMNeedleSignature MMNeedleSignature;
+
+/* The on-disk header, as it is laid out in the file on little-endian
+ * machines. */
+struct _MMMappedBitmapHeader {
+	char magic[4];          /* MAPPED_BITMAP_MAGIC */
+	uint16_t version;       /* MAPPED_BITMAP_VERSION */
+	uint16_t headerSize;    /* Offset of the pixels. */
+	int32_t width;
+	int32_t height;
+	int32_t bytewidth;      /* A multiple of MAPPED_BITMAP_ROW_ALIGN. */
+	uint8_t bitsPerPixel;   /* Always 32. */
+	uint8_t bytesPerPixel;  /* Always 4. */
+	uint16_t reserved;
+	uint64_t imageSize;     /* bytewidth * height */
+	MMNeedleSignature signature;
+};
+
+typedef struct _MMMappedBitmapHeader MMMappedBitmapHeader;
+
+struct _MMMappedBitmap {
+	MMBitmap bitmap; /* |imageBuffer| points into the mapping. */
+	MMNeedleSignature signature;
+	void *mapping;
+	size_t length;
+};
+
+typedef struct _MMMappedBitmap MMMappedBitmap;
+typedef MMMappedBitmap *MMMappedBitmapRef;
+
+enum _MappedBitmapReadError {
+	kMappedBitmapGenericError = 0,
+	kMappedBitmapAccessError,
+	kMappedBitmapInvalidHeaderError,
+	kMappedBitmapTruncatedError,
+	kMappedBitmapMapError
+};
+
+typedef MMIOError MMMappedBitmapReadError;
+
+/* Returns description of given MMMappedBitmapReadError.
+ * Returned string is constant and hence should not be freed. */
+const char *MMMappedBitmapReadErrorString(MMIOError error);
+
+/* Works out the needle signature of |bitmap|. */
+void computeNeedleSignature(MMBitmapRef bitmap, MMNeedleSignature *signature);
+
+/* Returns a buffer containing |bitmap| as a mapped bitmap file, ready to be
+ * saved, and sets |len| to its size; or returns NULL on error.
+ *
+ * Responsibility for free()'ing data is left up to the caller. */
+uint8_t *createMappedBitmapData(MMBitmapRef bitmap, size_t *len);
+
+/* Saves |bitmap| as a mapped bitmap file. Returns 0 on success, -1 on
+ * error. */
+int saveMMBitmapAsMapped(MMBitmapRef bitmap, const char *path);
+
+/* Maps the mapped bitmap file at |path| into memory; returns it on success,
+ * or NULL on error (with |error|, if not NULL, set to the error code).
+ *
+ * The mapping is private: the pixels can be written to without touching the
+ * file. Only the header is checked, so loading doesn't read the pixels.
+ *
+ * Responsibility for unmapMMBitmapFile()'ing it is left up to the caller. */
+MMMappedBitmapRef mapMMBitmapFile(const char *path, MMMappedBitmapReadError *error);
+
+void unmapMMBitmapFile(MMMappedBitmapRef mapped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAPPED_BITMAP_H */
@@ -385,6 +385,9 @@ bool smoothlyMoveMouse(MMSignedPoint endPoint,double speed)
 	MMSignedSize screenSize = getMainDisplaySize();
 	double velo_x = 0.0, velo_y = 0.0;
 	double distance;
+	MMPacer pacer;
+
+	MMPacerStart(&pacer);
 
 	while ((distance = crude_hypot((double)pos.x - endPoint.x,
 	                               (double)pos.y - endPoint.y)) > 1.0) {
@@ -410,7 +413,7 @@ bool smoothlyMoveMouse(MMSignedPoint endPoint,double speed)
 		moveMouse(MMSignedPointMake((int32_t)pos.x, (int32_t)pos.y));
 
 		/* Wait 1 - (speed) milliseconds. */
-		microsleep(DEADBEEF_UNIFORM(0.7, speed));
+		MMPacerWait(&pacer, DEADBEEF_UNIFORM(0.7, speed));
 	}
 
 	return true;
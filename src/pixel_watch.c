@@ -0,0 +1,106 @@
+#include "pixel_watch.h"
+#include "MMBitmap.h"
+#include "screen_reader.h"
+#include <stdlib.h> /* calloc() */
+
+struct _MMPixelWatch {
+	MMPixelCondition *conditions;
+	size_t count;
+	uint64_t *hashes; /* Of each condition's pixels at the last poll. */
+	bool polled;
+	MMScreenReaderRef reader;
+};
+
+MMPixelWatchRef createMMPixelWatch(MMPixelCondition *conditions, size_t count)
+{
+	MMSignedRect *rects;
+	size_t i;
+	MMPixelWatchRef watch = calloc(1, sizeof(MMPixelWatch));
+	if (watch == NULL) return NULL;
+
+	watch->conditions = conditions;
+	watch->count = count;
+	watch->hashes = calloc(count > 0 ? count : 1, sizeof(uint64_t));
+	rects = malloc((count > 0 ? count : 1) * sizeof(MMSignedRect));
+	if (watch->hashes == NULL || rects == NULL) {
+		free(rects);
+		destroyMMPixelWatch(watch);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) rects[i] = conditions[i].rect;
+	watch->reader = createMMScreenReader(rects, count);
+	free(rects);
+	if (watch->reader == NULL) {
+		destroyMMPixelWatch(watch);
+		return NULL;
+	}
+
+	return watch;
+}
+
+/* Checks |condition| against |bitmap|, a capture of its rect (larger than the
+ * rect on HiDPI displays), and returns a hash of the pixels in it. */
+static uint64_t scanCondition(MMPixelCondition *condition, MMBitmapRef bitmap)
+{
+	const MMSignedRect rect = condition->rect;
+	uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
+	int32_t x, y;
+
+	condition->met = false;
+	for (y = 0; y < bitmap->height; y++) {
+		for (x = 0; x < bitmap->width; x++) {
+			const MMRGBHex color = MMRGBHexAtPoint(bitmap, x, y);
+			hash = (hash ^ color) * 1099511628211ULL;
+
+			if (!condition->met &&
+			    MMRGBHexSimilarToColor(color, condition->color, condition->tolerance)) {
+				condition->met = true;
+				condition->match = MMSignedPointMake(
+					rect.origin.x + (int32_t)((int64_t)x * rect.size.width / bitmap->width),
+					rect.origin.y + (int32_t)((int64_t)y * rect.size.height / bitmap->height));
+				condition->matchColor = color;
+			}
+		}
+	}
+
+	return hash;
+}
+
+int pollMMPixelWatch(MMPixelWatchRef watch, bool *changed)
+{
+	size_t i;
+	int met = 0;
+
+	*changed = !watch->polled;
+
+	for (i = 0; i < watch->count; i++) {
+		MMPixelCondition *condition = &watch->conditions[i];
+		MMBitmap bitmap;
+		uint8_t *owned;
+		uint64_t hash;
+
+		if (!readMMScreenReader(watch->reader, i, &bitmap, &owned)) {
+			free(owned);
+			return -1;
+		}
+		hash = scanCondition(condition, &bitmap);
+		free(owned);
+
+		if (watch->hashes[i] != hash) *changed = true;
+		watch->hashes[i] = hash;
+		if (condition->met) met++;
+	}
+
+	watch->polled = true;
+	return met;
+}
+
+void destroyMMPixelWatch(MMPixelWatchRef watch)
+{
+	if (watch == NULL) return;
+
+	destroyMMScreenReader(watch->reader);
+	free(watch->hashes);
+	free(watch);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef PIXEL_WATCH_H
+#define PIXEL_WATCH_H
+
+#include "types.h"
+#include "rgb.h"
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Something to wait for: a pixel, or any pixel of a rect, within |tolerance|
+ * of |color| (see MMRGBHexSimilarToColor()). */
+struct _MMPixelCondition {
+	MMSignedRect rect; /* 1x1 for a single pixel. */
+	MMRGBHex color;
+	float tolerance;
+
+	/* Set by pollMMPixelWatch(). */
+	bool met;
+	MMSignedPoint match;  /* The first pixel that matched, row by row. */
+	MMRGBHex matchColor;  /* And its color. */
+};
+
+typedef struct _MMPixelCondition MMPixelCondition;
+
+typedef struct _MMPixelWatch MMPixelWatch;
+typedef MMPixelWatch *MMPixelWatchRef;
+
+/* Sets up to read the rects of |count| |conditions| over and over, through
+ * an MMScreenReader, so it can be polled from a thread other than the one
+ * that made it (but only one at a time).
+ *
+ * |conditions| must outlive the watch. Returns NULL if the display could not
+ * be opened. */
+MMPixelWatchRef createMMPixelWatch(MMPixelCondition *conditions, size_t count);
+
+/* Reads every condition's rect once and updates its |met|, |match| and
+ * |matchColor|. |changed| is set to whether any pixel read differs from the
+ * previous poll (always true on the first).
+ *
+ * Returns the number of conditions met, or -1 if the display could not be
+ * read. */
+int pollMMPixelWatch(MMPixelWatchRef watch, bool *changed);
+
+void destroyMMPixelWatch(MMPixelWatchRef watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIXEL_WATCH_H */
@@ -0,0 +1,162 @@
+#include "png_filter.h"
+#include "png_io.h" /* For the _PNGFilter values. */
+#include <zlib.h> /* crc32() */
+#include <stdlib.h> /* abs() */
+#include <string.h> /* memcpy() */
+#include <limits.h> /* ULONG_MAX */
+
+static const uint8_t pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+int resolvePNGFilters(int filters)
+{
+	if (filters == kPNGFilterDefault) return kPNGFilterAll;
+	return filters & kPNGFilterAll;
+}
+
+void convertPNGRow(MMBitmapRef bitmap, int32_t y, uint8_t *rgb)
+{
+	const uint8_t *pixel = bitmap->imageBuffer + (size_t)bitmap->bytewidth * y;
+	const uint8_t bytesPerPixel = bitmap->bytesPerPixel;
+	int32_t x;
+
+	for (x = 0; x < bitmap->width; ++x, pixel += bytesPerPixel) {
+		const MMRGBColor *color = (const MMRGBColor *)pixel;
+		*rgb++ = color->red;
+		*rgb++ = color->green;
+		*rgb++ = color->blue;
+	}
+}
+
+static uint8_t paethPredictor(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc) return (uint8_t)a;
+	return (uint8_t)(pb <= pc ? b : c);
+}
+
+/* Applies filter |type| to |row|, given the row above it in |prior|, and
+ * writes the result to |out|. */
+static void filterRow(int type, const uint8_t *row, const uint8_t *prior,
+                      size_t length, uint8_t *out)
+{
+	const size_t bpp = 3;
+	size_t i;
+
+	switch (type) {
+		case kPNGFilterTypeSub:
+			for (i = 0; i < bpp; ++i) out[i] = row[i];
+			for (; i < length; ++i) out[i] = (uint8_t)(row[i] - row[i - bpp]);
+			break;
+		case kPNGFilterTypeUp:
+			for (i = 0; i < length; ++i) out[i] = (uint8_t)(row[i] - prior[i]);
+			break;
+		case kPNGFilterTypeAverage:
+			for (i = 0; i < bpp; ++i) out[i] = (uint8_t)(row[i] - (prior[i] >> 1));
+			for (; i < length; ++i) {
+				out[i] = (uint8_t)(row[i] - ((row[i - bpp] + prior[i]) >> 1));
+			}
+			break;
+		case kPNGFilterTypePaeth:
+			for (i = 0; i < bpp; ++i) out[i] = (uint8_t)(row[i] - prior[i]);
+			for (; i < length; ++i) {
+				out[i] = (uint8_t)(row[i] - paethPredictor(row[i - bpp], prior[i],
+				                                             prior[i - bpp]));
+			}
+			break;
+		default:
+			memcpy(out, row, length);
+			break;
+	}
+}
+
+/* Sum of the filtered bytes taken as signed values; the smaller it is, the
+ * better the row tends to compress. Gives up once it passes |limit|. */
+static unsigned long filteredRowCost(const uint8_t *out, size_t length,
+                                     unsigned long limit)
+{
+	unsigned long sum = 0;
+	size_t i;
+
+	for (i = 0; i < length && sum <= limit; ++i) {
+		sum += out[i] < 128 ? out[i] : 256 - out[i];
+	}
+
+	return sum;
+}
+
+void filterPNGRow(int filters, const uint8_t *row, const uint8_t *prior,
+                  size_t length, uint8_t *out, uint8_t *scratch)
+{
+	unsigned long bestCost = ULONG_MAX;
+	int type, best = -1;
+
+	if ((filters & (filters - 1)) == 0) {
+		/* Just the one; no need to weigh it up. */
+		type = kPNGFilterTypeNone;
+		while (type < kPNGFilterTypeCount - 1 && !(filters & (kPNGFilterNone << type))) {
+			++type;
+		}
+		out[0] = (uint8_t)type;
+		filterRow(type, row, prior, length, out + 1);
+		return;
+	}
+
+	for (type = kPNGFilterTypeNone; type < kPNGFilterTypeCount; ++type) {
+		uint8_t *candidate;
+		unsigned long cost;
+
+		if (!(filters & (kPNGFilterNone << type))) continue;
+
+		/* Filter straight into |out| until something beats it. */
+		candidate = best < 0 ? out + 1 : scratch;
+		filterRow(type, row, prior, length, candidate);
+		cost = filteredRowCost(candidate, length, bestCost);
+		if (cost < bestCost) {
+			best = type;
+			bestCost = cost;
+			if (candidate != out + 1) memcpy(out + 1, candidate, length);
+		}
+	}
+
+	out[0] = (uint8_t)best;
+}
+
+uint8_t *writePNGUInt32(uint8_t *out, uint32_t value)
+{
+	out[0] = (uint8_t)(value >> 24);
+	out[1] = (uint8_t)(value >> 16);
+	out[2] = (uint8_t)(value >> 8);
+	out[3] = (uint8_t)value;
+	return out + 4;
+}
+
+uint8_t *writePNGHeader(MMBitmapRef bitmap, uint8_t *out)
+{
+	uint8_t *ihdr;
+
+	memcpy(out, pngSignature, sizeof(pngSignature));
+
+	ihdr = out + sizeof(pngSignature) + 8;
+	writePNGUInt32(ihdr, (uint32_t)bitmap->width);
+	writePNGUInt32(ihdr + 4, (uint32_t)bitmap->height);
+	ihdr[8] = 8; /* Bit depth */
+	ihdr[9] = 2; /* RGB */
+	ihdr[10] = 0; /* Deflate */
+	ihdr[11] = 0; /* Adaptive filtering */
+	ihdr[12] = 0; /* No interlacing */
+
+	return finishPNGChunk(out + sizeof(pngSignature), "IHDR", 13);
+}
+
+uint8_t *finishPNGChunk(uint8_t *chunk, const char *type, size_t length)
+{
+	uint8_t *end = chunk + 8 + length;
+
+	writePNGUInt32(chunk, (uint32_t)length);
+	memcpy(chunk + 4, type, 4);
+	return writePNGUInt32(end, (uint32_t)crc32(0L, chunk + 4, (uInt)(length + 4)));
+}
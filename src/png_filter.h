@@ -0,0 +1,71 @@
+#pragma once
+#ifndef PNG_FILTER_H
+#define PNG_FILTER_H
+
+#include "MMBitmap.h"
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+	#include "ms_stdint.h"
+#else
+	#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Shared pieces of the encoders that write PNG without libpng (see
+ * png_parallel.h and image_stream.h). Images are always written as 8-bit
+ * RGB. */
+
+/* Filter type bytes, as written at the start of each row. */
+enum _PNGFilterType {
+	kPNGFilterTypeNone = 0,
+	kPNGFilterTypeSub,
+	kPNGFilterTypeUp,
+	kPNGFilterTypeAverage,
+	kPNGFilterTypePaeth,
+	kPNGFilterTypeCount
+};
+
+/* Size of the signature plus the IHDR chunk. */
+#define PNG_HEADER_SIZE 33
+
+/* Size of a chunk's length, type and CRC. */
+#define PNG_CHUNK_OVERHEAD 12
+
+/* Returns the _PNGFilter mask (see png_io.h) to use for |filters|, with
+ * kPNGFilterDefault meaning all of them, or 0 if it holds no valid filter. */
+int resolvePNGFilters(int filters);
+
+/* Writes row |y| of |bitmap| to |rgb| as packed RGB. */
+void convertPNGRow(MMBitmapRef bitmap, int32_t y, uint8_t *rgb);
+
+/* Filters the |length| bytes of |row| into |out| (the filter type byte
+ * followed by the data), given the row above it in |prior| (all zeros for the
+ * first row of the image). If |filters| holds more than one filter, the row
+ * uses whichever gives the smallest sum of absolute differences, as libpng
+ * does; |scratch| must then have room for one row. */
+void filterPNGRow(int filters, const uint8_t *row, const uint8_t *prior,
+                  size_t length, uint8_t *out, uint8_t *scratch);
+
+/* Writes |value| big-endian and returns the byte after it. */
+uint8_t *writePNGUInt32(uint8_t *out, uint32_t value);
+
+/* Writes the PNG signature and the IHDR chunk for |bitmap| to |out|, which
+ * must have room for PNG_HEADER_SIZE bytes, and returns the byte after
+ * them. */
+uint8_t *writePNGHeader(MMBitmapRef bitmap, uint8_t *out);
+
+/* Given a chunk whose |length| bytes of data already sit at |chunk| + 8,
+ * fills in its length and |type| in front and the CRC behind, and returns the
+ * byte after it. */
+uint8_t *finishPNGChunk(uint8_t *chunk, const char *type, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNG_FILTER_H */
@@ -1,8 +1,10 @@
 #include "png_io.h"
+#include "png_parallel.h"
 #include "os.h"
 #include <png.h>
 #include <stdio.h> /* fopen() */
 #include <stdlib.h> /* malloc/realloc */
+#include <string.h> /* memcpy() */
 #include <assert.h>
 
 #if defined(_MSC_VER)
@@ -293,46 +295,123 @@ struct io_data
 };
 
 /* Called each time libpng attempts to write data in createPNGData(). */
-void png_append_data(png_struct *png_ptr,
-                     png_byte *new_data,
-                     png_size_t length)
+static void png_append_data(png_struct *png_ptr,
+                            png_byte *new_data,
+                            png_size_t length)
 {
 	struct io_data *data = png_get_io_ptr(png_ptr);
-	data->size += length;
+	const size_t size = data->size + length;
 
 	/* Allocate or grow buffer. */
-	if (data->buffer == NULL) {
-		data->allocedSize = data->size;
-		data->buffer = png_malloc(png_ptr, data->allocedSize);
-		assert(data->buffer != NULL);
-	} else if (data->allocedSize < data->size) {
-		do {
-			/* Double size each time to avoid calls to realloc. */
-			data->allocedSize <<= 1;
-		} while (data->allocedSize < data->size);
-
-		data->buffer = realloc(data->buffer, data->allocedSize);
+	if (data->allocedSize < size) {
+		uint8_t *buffer;
+		size_t allocedSize = data->allocedSize > 0 ? data->allocedSize : size;
+
+		/* Double size each time to avoid calls to realloc. */
+		while (allocedSize < size) allocedSize <<= 1;
+
+		buffer = realloc(data->buffer, allocedSize);
+		if (buffer == NULL) png_error(png_ptr, "Out of memory");
+
+		data->buffer = buffer;
+		data->allocedSize = allocedSize;
 	}
 
 	/* Copy new bytes to end of buffer. */
-	memcpy(data->buffer + data->size - length, new_data, length);
+	memcpy(data->buffer + data->size, new_data, length);
+	data->size = size;
 }
 
 uint8_t *createPNGData(MMBitmapRef bitmap, size_t *len)
 {
-	PNGWriteInfoRef info = NULL;
-	struct io_data data = {NULL, 0, 0};
+	return createPNGDataWithOptions(bitmap, NULL, len);
+}
+
+uint8_t *createPNGDataWithOptions(MMBitmapRef bitmap,
+                                  const MMPNGOptions *options,
+                                  size_t *len)
+{
+	png_struct *png_ptr;
+	png_info *info_ptr;
+	/* On the heap, since libpng changes it between setjmp() and longjmp(). */
+	struct io_data *data;
+	uint8_t *buffer;
+	int32_t y;
 
 	assert(bitmap != NULL);
 	assert(len != NULL);
 
-	if ((info = createPNGWriteInfo(bitmap)) == NULL) return NULL;
+	if (bitmap->bytesPerPixel != 3 && bitmap->bytesPerPixel != 4) return NULL;
 
-	png_set_write_fn(info->png_ptr, &data, &png_append_data, NULL);
-	png_write_png(info->png_ptr, info->info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+	if (options != NULL && options->threads != 1) {
+		return createPNGDataParallel(bitmap, options->level, options->filters,
+		                             options->threads, len);
+	}
 
-	destroyPNGWriteInfo(info);
+	data = calloc(1, sizeof(struct io_data));
+	if (data == NULL) return NULL;
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png_ptr == NULL) {
+		free(data);
+		return NULL;
+	}
+
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL) {
+		png_destroy_write_struct(&png_ptr, NULL);
+		free(data);
+		return NULL;
+	}
+
+	/* Set up error handling. */
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		free(data->buffer);
+		free(data);
+		return NULL;
+	}
+
+	png_set_write_fn(png_ptr, data, &png_append_data, NULL);
+
+	png_set_IHDR(png_ptr,
+	             info_ptr,
+	             (png_uint_32)bitmap->width,
+	             (png_uint_32)bitmap->height,
+	             8,
+	             PNG_COLOR_TYPE_RGB,
+	             PNG_INTERLACE_NONE,
+	             PNG_COMPRESSION_TYPE_DEFAULT,
+	             PNG_FILTER_TYPE_DEFAULT);
+
+	if (options != NULL) {
+		if (options->level >= 0) {
+			png_set_compression_level(png_ptr, options->level);
+		}
+		if (options->filters != kPNGFilterDefault) {
+			png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, options->filters);
+		}
+	}
+
+	png_write_info(png_ptr, info_ptr);
+
+	/* Let libpng convert the pixels as it goes instead of copying them. */
+	if (bitmap->bytesPerPixel == 4) {
+		png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+	}
+	if (MMRGB_IS_BGR) {
+		png_set_bgr(png_ptr);
+	}
+
+	for (y = 0; y < bitmap->height; ++y) {
+		png_write_row(png_ptr, bitmap->imageBuffer + (size_t)bitmap->bytewidth * y);
+	}
+
+	png_write_end(png_ptr, NULL);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 
-	*len = data.size;
-	return data.buffer;
+	*len = data->size;
+	buffer = data->buffer;
+	free(data);
+	return buffer;
 }
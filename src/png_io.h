@@ -5,6 +5,11 @@
 #include "MMBitmap.h"
 #include "io.h"
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 enum _PNGReadError {
 	kPNGGenericError = 0,
 	kPNGReadError,
@@ -34,4 +39,41 @@ int saveMMBitmapAsPNG(MMBitmapRef bitmap, const char *path);
  * Responsibility for free()'ing data is left up to the caller. */
 uint8_t *createPNGData(MMBitmapRef bitmap, size_t *len);
 
+/* Row filters to try when encoding; these are the same bits as libpng's
+ * PNG_FILTER_* masks. With kPNGFilterDefault libpng chooses. */
+enum _PNGFilter {
+	kPNGFilterDefault = 0,
+	kPNGFilterNone = 0x08,
+	kPNGFilterSub = 0x10,
+	kPNGFilterUp = 0x20,
+	kPNGFilterAverage = 0x40,
+	kPNGFilterPaeth = 0x80,
+	kPNGFilterAll = 0xF8
+};
+
+struct _MMPNGOptions {
+	int level;   /* zlib compression level (0-9), or -1 for the default. */
+	int filters; /* Mask of _PNGFilter values. */
+	unsigned int threads; /* 1 to encode with libpng on the calling thread;
+	                       * otherwise the number of strips to encode in
+	                       * parallel (see png_parallel.h), or 0 for one per
+	                       * CPU. */
+};
+
+typedef struct _MMPNGOptions MMPNGOptions;
+
+/* Same as createPNGData(), but with the given compression settings (or the
+ * defaults, on a single thread, if |options| is NULL). Rows are handed to libpng straight from
+ * the bitmap's buffer, honouring its bytewidth; 32-bit pixels have their
+ * padding byte stripped by libpng rather than being copied first.
+ *
+ * Returns NULL on error. Safe to call from any thread. */
+uint8_t *createPNGDataWithOptions(MMBitmapRef bitmap,
+                                  const MMPNGOptions *options,
+                                  size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* PNG_IO_H */
@@ -0,0 +1,341 @@
+#include "png_parallel.h"
+#include "png_io.h" /* For the _PNGFilter values. */
+#include "png_filter.h"
+#include "os.h"
+#include <zlib.h>
+#include <stdlib.h> /* malloc() */
+#include <string.h> /* memcpy() */
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#if !defined(IS_WINDOWS)
+	#include <pthread.h>
+	#include <unistd.h> /* For sysconf() */
+#endif
+
+/* Deflate can refer back this far, so this is how much of the preceding
+ * strip is worth priming each compressor with. */
+#define PNG_WINDOW_SIZE 32768
+
+#define PNG_MAX_THREADS 64
+
+/* Strips shorter than this aren't worth a thread of their own. */
+#define PNG_MIN_STRIP_ROWS 32
+
+struct PNGStrip {
+	MMBitmapRef bitmap;
+	int level;
+	int filters;
+	int32_t firstRow;
+	int32_t rowCount;
+	bool last;
+	bool threaded; /* Whether it is being encoded on a thread of its own. */
+
+	/* Set by encodeStrip(). */
+	uint8_t *output;
+	size_t outputLength;
+	uLong adler;
+	bool failed;
+};
+
+/* Filters and deflates the rows of |strip|. */
+static void encodeStrip(struct PNGStrip *strip)
+{
+	MMBitmapRef bitmap = strip->bitmap;
+	const size_t rowLength = (size_t)bitmap->width * 3;
+	const size_t filteredLength = rowLength + 1;
+	int32_t dictionaryRows = 0;
+	int32_t start, y;
+	uint8_t *filtered = NULL;
+	uint8_t *rows = NULL;
+	uint8_t *row, *prior;
+	size_t inputLength, dictionaryLength;
+	z_stream zst;
+	int err;
+
+	strip->failed = true;
+
+	/* Filter enough of the preceding strip to prime the dictionary with;
+	 * filtering is deterministic, so this reproduces its output exactly. */
+	if (strip->firstRow > 0) {
+		dictionaryRows = (int32_t)((PNG_WINDOW_SIZE + filteredLength - 1) / filteredLength);
+		if (dictionaryRows > strip->firstRow) dictionaryRows = strip->firstRow;
+	}
+	start = strip->firstRow - dictionaryRows;
+
+	inputLength = (size_t)strip->rowCount * filteredLength;
+	if (inputLength > UINT32_MAX) return;
+
+	filtered = malloc((size_t)(dictionaryRows + strip->rowCount) * filteredLength);
+	rows = calloc(3, rowLength);
+	if (filtered == NULL || rows == NULL) goto bail;
+
+	row = rows;
+	prior = rows + rowLength;
+	if (start > 0) convertPNGRow(bitmap, start - 1, prior);
+
+	for (y = start; y < strip->firstRow + strip->rowCount; ++y) {
+		uint8_t *out = filtered + (size_t)(y - start) * filteredLength;
+		uint8_t *swap;
+
+		convertPNGRow(bitmap, y, row);
+		filterPNGRow(strip->filters, row, prior, rowLength, out,
+		             rows + 2 * rowLength);
+
+		swap = prior;
+		prior = row;
+		row = swap;
+	}
+
+	strip->adler = adler32(adler32(0L, Z_NULL, 0),
+	                       filtered + (size_t)dictionaryRows * filteredLength,
+	                       (uInt)inputLength);
+
+	zst.zalloc = Z_NULL;
+	zst.zfree = Z_NULL;
+	zst.opaque = Z_NULL;
+
+	/* Raw deflate; the zlib header and trailer are written around the
+	 * joined strips. */
+	if (deflateInit2(&zst, strip->level, Z_DEFLATED, -MAX_WBITS, 8,
+	                 Z_DEFAULT_STRATEGY) != Z_OK) {
+		goto bail;
+	}
+
+	dictionaryLength = (size_t)dictionaryRows * filteredLength;
+	if (dictionaryLength > PNG_WINDOW_SIZE) dictionaryLength = PNG_WINDOW_SIZE;
+	if (dictionaryLength > 0) {
+		deflateSetDictionary(&zst,
+		                     filtered + (size_t)dictionaryRows * filteredLength - dictionaryLength,
+		                     (uInt)dictionaryLength);
+	}
+
+	/* Room for the worst case plus the empty block a sync flush ends on. */
+	strip->outputLength = deflateBound(&zst, (uLong)inputLength) + 16;
+	strip->output = malloc(strip->outputLength);
+	if (strip->output == NULL) {
+		deflateEnd(&zst);
+		goto bail;
+	}
+
+	zst.next_in = filtered + (size_t)dictionaryRows * filteredLength;
+	zst.avail_in = (uInt)inputLength;
+	zst.next_out = strip->output;
+	zst.avail_out = (uInt)strip->outputLength;
+
+	/* A sync flush ends the strip on a byte boundary without marking the
+	 * last block, so the next strip's data can follow straight on. */
+	err = deflate(&zst, strip->last ? Z_FINISH : Z_SYNC_FLUSH);
+	strip->outputLength -= zst.avail_out;
+	deflateEnd(&zst);
+
+	if (zst.avail_in != 0 || err != (strip->last ? Z_STREAM_END : Z_OK)) {
+		free(strip->output);
+		strip->output = NULL;
+		goto bail;
+	}
+
+	strip->failed = false;
+
+bail:
+	free(rows);
+	free(filtered);
+}
+
+#if defined(IS_WINDOWS)
+static DWORD WINAPI stripThread(LPVOID strip)
+{
+	encodeStrip(strip);
+	return 0;
+}
+#else
+static void *stripThread(void *strip)
+{
+	encodeStrip(strip);
+	return NULL;
+}
+#endif
+
+unsigned int getCPUCount(void)
+{
+#if defined(IS_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+/* Writes a chunk of the given type, made up of the given pieces of data. */
+static uint8_t *writeChunk(uint8_t *out, const char *type,
+                           const uint8_t **pieces, const size_t *lengths,
+                           size_t count)
+{
+	uint8_t *data = out + 8;
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		memcpy(data, pieces[i], lengths[i]);
+		data += lengths[i];
+	}
+
+	return finishPNGChunk(out, type, (size_t)(data - out - 8));
+}
+
+/* Returns the two byte zlib header deflate would have written at |level|. */
+static void zlibHeader(int level, uint8_t header[2])
+{
+	int flevel;
+
+	if (level < 0) level = 6; /* Z_DEFAULT_COMPRESSION */
+	if (level < 2) flevel = 0;
+	else if (level < 6) flevel = 1;
+	else if (level == 6) flevel = 2;
+	else flevel = 3;
+
+	header[0] = 0x78; /* Deflate with a 32 KB window. */
+	header[1] = (uint8_t)(flevel << 6);
+	header[1] += (uint8_t)(31 - ((header[0] << 8) + header[1]) % 31);
+}
+
+uint8_t *createPNGDataParallel(MMBitmapRef bitmap, int level, int filters,
+                               unsigned int threads, size_t *len)
+{
+	struct PNGStrip *strips;
+	const size_t filteredLength = (size_t)bitmap->width * 3 + 1;
+	unsigned int count, i;
+	int32_t row = 0;
+	uint8_t *data, *out;
+	uint8_t header[2], trailer[4];
+	size_t length;
+	uLong adler;
+	bool failed = false;
+
+#if defined(IS_WINDOWS)
+	HANDLE *handles;
+#else
+	pthread_t *handles;
+#endif
+
+	if (bitmap == NULL || bitmap->width <= 0 || bitmap->height <= 0 ||
+	    (bitmap->bytesPerPixel != 3 && bitmap->bytesPerPixel != 4)) {
+		return NULL;
+	}
+
+	filters = resolvePNGFilters(filters);
+	if (filters == 0) return NULL;
+
+	count = threads > 0 ? threads : getCPUCount();
+	if (count > PNG_MAX_THREADS) count = PNG_MAX_THREADS;
+	if (count > (unsigned int)bitmap->height / PNG_MIN_STRIP_ROWS) {
+		count = (unsigned int)bitmap->height / PNG_MIN_STRIP_ROWS;
+	}
+	if (count == 0) count = 1;
+
+	strips = calloc(count, sizeof(struct PNGStrip));
+	handles = calloc(count, sizeof(*handles));
+	if (strips == NULL || handles == NULL) {
+		free(strips);
+		free(handles);
+		return NULL;
+	}
+
+	for (i = 0; i < count; ++i) {
+		strips[i].bitmap = bitmap;
+		strips[i].level = level;
+		strips[i].filters = filters;
+		strips[i].firstRow = row;
+		strips[i].rowCount = bitmap->height / (int32_t)count +
+		                     ((int32_t)i < bitmap->height % (int32_t)count ? 1 : 0);
+		strips[i].last = i == count - 1;
+		row += strips[i].rowCount;
+	}
+
+	/* The calling thread takes the first strip. */
+	for (i = 1; i < count; ++i) {
+#if defined(IS_WINDOWS)
+		handles[i] = CreateThread(NULL, 0, stripThread, &strips[i], 0, NULL);
+		strips[i].threaded = handles[i] != NULL;
+#else
+		strips[i].threaded =
+			pthread_create(&handles[i], NULL, stripThread, &strips[i]) == 0;
+#endif
+	}
+
+	encodeStrip(&strips[0]);
+
+	for (i = 1; i < count; ++i) {
+		if (!strips[i].threaded) {
+			/* Couldn't start a thread; do it here instead. */
+			encodeStrip(&strips[i]);
+			continue;
+		}
+
+#if defined(IS_WINDOWS)
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+#else
+		pthread_join(handles[i], NULL);
+#endif
+	}
+
+	free(handles);
+
+	length = PNG_HEADER_SIZE + PNG_CHUNK_OVERHEAD;
+	adler = strips[0].adler;
+	for (i = 0; i < count; ++i) {
+		if (strips[i].failed) failed = true;
+		length += PNG_CHUNK_OVERHEAD + strips[i].outputLength;
+		if (i > 0) {
+			adler = adler32_combine(adler, strips[i].adler,
+			                        (z_off_t)(strips[i].rowCount * filteredLength));
+		}
+	}
+	length += sizeof(header) + sizeof(trailer);
+
+	data = failed ? NULL : malloc(length);
+	if (data == NULL) {
+		for (i = 0; i < count; ++i) free(strips[i].output);
+		free(strips);
+		return NULL;
+	}
+
+	zlibHeader(level, header);
+	writePNGUInt32(trailer, (uint32_t)adler);
+
+	out = writePNGHeader(bitmap, data);
+
+	/* One IDAT per strip; the zlib header goes in front of the first and the
+	 * checksum after the last. */
+	for (i = 0; i < count; ++i) {
+		const uint8_t *pieces[3];
+		size_t lengths[3];
+		size_t n = 0;
+
+		if (i == 0) {
+			pieces[n] = header;
+			lengths[n++] = sizeof(header);
+		}
+		pieces[n] = strips[i].output;
+		lengths[n++] = strips[i].outputLength;
+		if (strips[i].last) {
+			pieces[n] = trailer;
+			lengths[n++] = sizeof(trailer);
+		}
+
+		out = writeChunk(out, "IDAT", pieces, lengths, n);
+		free(strips[i].output);
+	}
+
+	writeChunk(out, "IEND", NULL, NULL, 0);
+
+	free(strips);
+	*len = length;
+	return data;
+}
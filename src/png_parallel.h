@@ -0,0 +1,45 @@
+#pragma once
+#ifndef PNG_PARALLEL_H
+#define PNG_PARALLEL_H
+
+#include "MMBitmap.h"
+#include <stddef.h>
+
+#if defined(_MSC_VER)
+	#include "ms_stdint.h"
+#else
+	#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Encodes |bitmap| as a PNG using |threads| worker threads (or one per CPU
+ * if 0), without libpng.
+ *
+ * The image is cut into horizontal strips that are filtered and deflated
+ * independently, pigz-style: each strip's compressor is primed with the 32 KB
+ * of filtered data preceding it, and ends on a sync flush so the strips join
+ * into a single valid zlib stream. The Adler-32 checksums of the strips are
+ * combined, and each strip is written as its own IDAT chunk.
+ *
+ * |level| is the zlib level (0-9, or -1 for the default). |filters| is a mask
+ * of _PNGFilter values (see png_io.h); if it holds more than one filter, each
+ * row uses whichever gives the smallest sum of absolute differences, as
+ * libpng does. 0 means all filters.
+ *
+ * Returns the PNG data, to be free()'d by the caller, and sets |len| to its
+ * size; or returns NULL on error. */
+uint8_t *createPNGDataParallel(MMBitmapRef bitmap, int level, int filters,
+                               unsigned int threads, size_t *len);
+
+/* Returns the number of online CPUs (at least 1). */
+unsigned int getCPUCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNG_PARALLEL_H */
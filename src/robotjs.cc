@@ -2,14 +2,31 @@
 #include <vector>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include "mouse.h"
 #include "deadbeef_rand.h"
 #include "keypress.h"
 #include "screen.h"
 #include "screengrab.h"
 #include "MMBitmap.h"
+#if defined(USE_LIBPNG)
+	#include "png_io.h"
+	#include "image_stream.h"
+	#include "io.h"
+	#include "str_io.h"
+#endif
 #include "snprintf.h"
 #include "microsleep.h"
+#include "macro.h"
+#include "mapped_bitmap.h"
+#include "stats.h"
+#include "arena.h"
+#include "screen_cache.h"
+#include "pixel_watch.h"
+#include "bitmap_watch.h"
+#include "bitmap_find.h"
+#include "screen_stitch.h"
+#include "display_watch.h"
 #if defined(USE_X11)
 	#include "xdisplay.h"
 #endif
@@ -23,6 +40,10 @@
 
 // Thread safety: atomic operations for resource validity
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #if !defined(IS_WINDOWS)
 #include <unistd.h> // for usleep
 #endif
@@ -43,6 +64,45 @@ static std::atomic<int> active_operations{0};
 // Display initialization flag
 static bool display_initialized = false;
 
+// Records how long the enclosing scope took under |operation| when it ends,
+// along with |bytes|, for getStats().
+class ScopedStat
+{
+	public:
+		explicit ScopedStat(MMStatOperation operation)
+			: bytes(0), operation(operation), start(MMTimestampNow()) {}
+		~ScopedStat() { MMStatsRecord(operation, MMTimestampNow() - start, bytes); }
+
+		uint64_t bytes;
+
+	private:
+		MMStatOperation operation;
+		MMTimestamp start;
+};
+
+// Rewinds the arena when the enclosing scope ends, giving back whatever the
+// call allocated from it. Rewinding to a mark, rather than resetting, keeps
+// this safe when a call ends up re-entering the binding through JS.
+class ArenaScope
+{
+	public:
+		ArenaScope() : mark(MMArenaGetMark()) {}
+		~ArenaScope() { MMArenaRewind(mark); }
+
+	private:
+		MMArenaMark mark;
+};
+
+// copyMMBitmapFromDisplayInRect(), or the screen cache when it is on, counted
+// under "capture".
+static MMBitmapRef CaptureRect(MMSignedRect rect)
+{
+	ScopedStat stat(kMMStatCapture);
+	MMBitmapRef bitmap = MMScreenCacheCopyRect(rect);
+	if (bitmap != NULL) stat.bytes = (uint64_t)bitmap->bytewidth * bitmap->height;
+	return bitmap;
+}
+
 // Forward declarations for enhanced resource management functions
 void beginOperation();
 void endOperation();
@@ -128,7 +188,11 @@ napi_value DragMouse(napi_env env, napi_callback_info info)
 	}
 
 	MMSignedPoint point = MMSignedPointMake(x, y);
-	dragMouse(point, button);
+	{
+		ScopedStat stat(kMMStatMouse);
+		dragMouse(point, button);
+	}
+	MMScreenCacheInvalidate();
 	microsleep(mouseDelay);
 
 	napi_value result;
@@ -139,6 +203,7 @@ napi_value DragMouse(napi_env env, napi_callback_info info)
 napi_value UpdateScreenMetrics(napi_env env, napi_callback_info info)
 {
 	updateScreenMetrics();
+	invalidateScreenGeometry();
 
 	napi_value result;
 	napi_get_boolean(env, true, &result);
@@ -161,7 +226,10 @@ napi_value MoveMouse(napi_env env, napi_callback_info info)
 	napi_get_value_int32(env, args[1], &y);
 
 	MMSignedPoint point = MMSignedPointMake(x, y);
-	moveMouse(point);
+	{
+		ScopedStat stat(kMMStatMouse);
+		moveMouse(point);
+	}
 	microsleep(mouseDelay);
 
 	napi_value result;
@@ -203,6 +271,7 @@ napi_value GetMousePos(napi_env env, napi_callback_info info)
 {
 	MMSignedPoint pos = getMousePos();
 
+	ScopedStat stat(kMMStatObject);
 	napi_value obj;
 	napi_create_object(env, &obj);
 	napi_value x, y;
@@ -248,11 +317,15 @@ napi_value MouseClick(napi_env env, napi_callback_info info)
 		return NULL;
 	}
 
-	if (!doubleC) {
-		clickMouse(button);
-	} else {
-		doubleClick(button);
+	{
+		ScopedStat stat(kMMStatMouse);
+		if (!doubleC) {
+			clickMouse(button);
+		} else {
+			doubleClick(button);
+		}
 	}
+	MMScreenCacheInvalidate();
 
 	microsleep(mouseDelay);
 
@@ -309,7 +382,11 @@ napi_value MouseToggle(napi_env env, napi_callback_info info)
 		return NULL;
 	}
 
-	toggleMouse(down, button);
+	{
+		ScopedStat stat(kMMStatMouse);
+		toggleMouse(down, button);
+	}
+	MMScreenCacheInvalidate();
 	microsleep(mouseDelay);
 
 	napi_value result;
@@ -350,7 +427,11 @@ napi_value ScrollMouse(napi_env env, napi_callback_info info)
 	napi_get_value_int32(env, args[0], &x);
 	napi_get_value_int32(env, args[1], &y);
 
-	scrollMouse(x, y);
+	{
+		ScopedStat stat(kMMStatMouse);
+		scrollMouse(x, y);
+	}
+	MMScreenCacheInvalidate();
 	microsleep(mouseDelay);
 
 	napi_value result;
@@ -358,6 +439,29 @@ napi_value ScrollMouse(napi_env env, napi_callback_info info)
 	return result;
 }
 
+napi_value SetSpinWindow(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 1) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	double ms = 0;
+	if (napi_get_value_double(env, args[0], &ms) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected a spin window in milliseconds.");
+		return NULL;
+	}
+	setSleepSpinWindow(ms);
+
+	napi_value result;
+	napi_get_boolean(env, true, &result);
+	return result;
+}
+
 /*
  _  __          _                         _
 | |/ /___ _   _| |__   ___   __ _ _ __ __| |
@@ -372,104 +476,117 @@ struct KeyNames
 	MMKeyCode   key;
 };
 
-static KeyNames key_names[] =
-{
-	{ "backspace",      K_BACKSPACE },
-	{ "delete",         K_DELETE },
-	{ "enter",          K_RETURN },
-	{ "tab",            K_TAB },
-	{ "escape",         K_ESCAPE },
-	{ "up",             K_UP },
-	{ "down",           K_DOWN },
-	{ "right",          K_RIGHT },
-	{ "left",           K_LEFT },
-	{ "home",           K_HOME },
-	{ "end",            K_END },
-	{ "pageup",         K_PAGEUP },
-	{ "pagedown",       K_PAGEDOWN },
-	{ "f1",             K_F1 },
-	{ "f2",             K_F2 },
-	{ "f3",             K_F3 },
-	{ "f4",             K_F4 },
-	{ "f5",             K_F5 },
-	{ "f6",             K_F6 },
-	{ "f7",             K_F7 },
-	{ "f8",             K_F8 },
-	{ "f9",             K_F9 },
-	{ "f10",            K_F10 },
-	{ "f11",            K_F11 },
-	{ "f12",            K_F12 },
-	{ "f13",            K_F13 },
-	{ "f14",            K_F14 },
-	{ "f15",            K_F15 },
-	{ "f16",            K_F16 },
-	{ "f17",            K_F17 },
-	{ "f18",            K_F18 },
-	{ "f19",            K_F19 },
-	{ "f20",            K_F20 },
-	{ "f21",            K_F21 },
-	{ "f22",            K_F22 },
-	{ "f23",            K_F23 },
-	{ "f24",            K_F24 },
-	{ "capslock",       K_CAPSLOCK },
-	{ "command",        K_META },
-	{ "alt",            K_ALT },
-	{ "right_alt",      K_RIGHT_ALT },
-	{ "control",        K_CONTROL },
-	{ "left_control",   K_LEFT_CONTROL },
-	{ "right_control",  K_RIGHT_CONTROL },
-	{ "shift",          K_SHIFT },
-	{ "right_shift",    K_RIGHTSHIFT },
-	{ "space",          K_SPACE },
-	{ "printscreen",    K_PRINTSCREEN },
-	{ "insert",         K_INSERT },
-	{ "menu",           K_MENU },
-
-	{ "audio_mute",     K_AUDIO_VOLUME_MUTE },
-	{ "audio_vol_down", K_AUDIO_VOLUME_DOWN },
-	{ "audio_vol_up",   K_AUDIO_VOLUME_UP },
-	{ "audio_play",     K_AUDIO_PLAY },
-	{ "audio_stop",     K_AUDIO_STOP },
-	{ "audio_pause",    K_AUDIO_PAUSE },
-	{ "audio_prev",     K_AUDIO_PREV },
-	{ "audio_next",     K_AUDIO_NEXT },
-	{ "audio_rewind",   K_AUDIO_REWIND },
-	{ "audio_forward",  K_AUDIO_FORWARD },
-	{ "audio_repeat",   K_AUDIO_REPEAT },
-	{ "audio_random",   K_AUDIO_RANDOM },
-
-	{ "numpad_lock",	K_NUMPAD_LOCK },
-	{ "numpad_0",		K_NUMPAD_0 },
-	{ "numpad_0",		K_NUMPAD_0 },
-	{ "numpad_1",		K_NUMPAD_1 },
-	{ "numpad_2",		K_NUMPAD_2 },
-	{ "numpad_3",		K_NUMPAD_3 },
-	{ "numpad_4",		K_NUMPAD_4 },
-	{ "numpad_5",		K_NUMPAD_5 },
-	{ "numpad_6",		K_NUMPAD_6 },
-	{ "numpad_7",		K_NUMPAD_7 },
-	{ "numpad_8",		K_NUMPAD_8 },
-	{ "numpad_9",		K_NUMPAD_9 },
-	{ "numpad_+",		K_NUMPAD_PLUS },
-	{ "numpad_-",		K_NUMPAD_MINUS },
-	{ "numpad_*",		K_NUMPAD_MULTIPLY },
-	{ "numpad_/",		K_NUMPAD_DIVIDE },
-	{ "numpad_.",		K_NUMPAD_DECIMAL },
-
-	{ "lights_mon_up",    K_LIGHTS_MON_UP },
-	{ "lights_mon_down",  K_LIGHTS_MON_DOWN },
-	{ "lights_kbd_toggle",K_LIGHTS_KBD_TOGGLE },
-	{ "lights_kbd_up",    K_LIGHTS_KBD_UP },
-	{ "lights_kbd_down",  K_LIGHTS_KBD_DOWN },
-
-	{ NULL,               K_NOT_A_KEY } /* end marker */
+/* Sorted by strcmp() order so CheckKeyCodes() can binary search it; the
+ * static_assert below keeps it that way. */
+static constexpr KeyNames key_names[] =
+{
+	{ "alt",                K_ALT },
+	{ "audio_forward",      K_AUDIO_FORWARD },
+	{ "audio_mute",         K_AUDIO_VOLUME_MUTE },
+	{ "audio_next",         K_AUDIO_NEXT },
+	{ "audio_pause",        K_AUDIO_PAUSE },
+	{ "audio_play",         K_AUDIO_PLAY },
+	{ "audio_prev",         K_AUDIO_PREV },
+	{ "audio_random",       K_AUDIO_RANDOM },
+	{ "audio_repeat",       K_AUDIO_REPEAT },
+	{ "audio_rewind",       K_AUDIO_REWIND },
+	{ "audio_stop",         K_AUDIO_STOP },
+	{ "audio_vol_down",     K_AUDIO_VOLUME_DOWN },
+	{ "audio_vol_up",       K_AUDIO_VOLUME_UP },
+	{ "backspace",          K_BACKSPACE },
+	{ "capslock",           K_CAPSLOCK },
+	{ "command",            K_META },
+	{ "control",            K_CONTROL },
+	{ "delete",             K_DELETE },
+	{ "down",               K_DOWN },
+	{ "end",                K_END },
+	{ "enter",              K_RETURN },
+	{ "escape",             K_ESCAPE },
+	{ "f1",                 K_F1 },
+	{ "f10",                K_F10 },
+	{ "f11",                K_F11 },
+	{ "f12",                K_F12 },
+	{ "f13",                K_F13 },
+	{ "f14",                K_F14 },
+	{ "f15",                K_F15 },
+	{ "f16",                K_F16 },
+	{ "f17",                K_F17 },
+	{ "f18",                K_F18 },
+	{ "f19",                K_F19 },
+	{ "f2",                 K_F2 },
+	{ "f20",                K_F20 },
+	{ "f21",                K_F21 },
+	{ "f22",                K_F22 },
+	{ "f23",                K_F23 },
+	{ "f24",                K_F24 },
+	{ "f3",                 K_F3 },
+	{ "f4",                 K_F4 },
+	{ "f5",                 K_F5 },
+	{ "f6",                 K_F6 },
+	{ "f7",                 K_F7 },
+	{ "f8",                 K_F8 },
+	{ "f9",                 K_F9 },
+	{ "home",               K_HOME },
+	{ "insert",             K_INSERT },
+	{ "left",               K_LEFT },
+	{ "left_control",       K_LEFT_CONTROL },
+	{ "lights_kbd_down",    K_LIGHTS_KBD_DOWN },
+	{ "lights_kbd_toggle",  K_LIGHTS_KBD_TOGGLE },
+	{ "lights_kbd_up",      K_LIGHTS_KBD_UP },
+	{ "lights_mon_down",    K_LIGHTS_MON_DOWN },
+	{ "lights_mon_up",      K_LIGHTS_MON_UP },
+	{ "menu",               K_MENU },
+	{ "numpad_*",           K_NUMPAD_MULTIPLY },
+	{ "numpad_+",           K_NUMPAD_PLUS },
+	{ "numpad_-",           K_NUMPAD_MINUS },
+	{ "numpad_.",           K_NUMPAD_DECIMAL },
+	{ "numpad_/",           K_NUMPAD_DIVIDE },
+	{ "numpad_0",           K_NUMPAD_0 },
+	{ "numpad_1",           K_NUMPAD_1 },
+	{ "numpad_2",           K_NUMPAD_2 },
+	{ "numpad_3",           K_NUMPAD_3 },
+	{ "numpad_4",           K_NUMPAD_4 },
+	{ "numpad_5",           K_NUMPAD_5 },
+	{ "numpad_6",           K_NUMPAD_6 },
+	{ "numpad_7",           K_NUMPAD_7 },
+	{ "numpad_8",           K_NUMPAD_8 },
+	{ "numpad_9",           K_NUMPAD_9 },
+	{ "numpad_lock",        K_NUMPAD_LOCK },
+	{ "pagedown",           K_PAGEDOWN },
+	{ "pageup",             K_PAGEUP },
+	{ "printscreen",        K_PRINTSCREEN },
+	{ "right",              K_RIGHT },
+	{ "right_alt",          K_RIGHT_ALT },
+	{ "right_control",      K_RIGHT_CONTROL },
+	{ "right_shift",        K_RIGHTSHIFT },
+	{ "shift",              K_SHIFT },
+	{ "space",              K_SPACE },
+	{ "tab",                K_TAB },
+	{ "up",                 K_UP },
 };
 
+static constexpr size_t key_names_count = sizeof(key_names) / sizeof(key_names[0]);
+
+static constexpr int ConstStrcmp(const char* a, const char* b)
+{
+	return (*a != *b || *a == '\0')
+		? (unsigned char)*a - (unsigned char)*b
+		: ConstStrcmp(a + 1, b + 1);
+}
+
+static constexpr bool KeyNamesSorted(size_t i)
+{
+	return i + 1 >= key_names_count ||
+		(ConstStrcmp(key_names[i].name, key_names[i + 1].name) < 0 && KeyNamesSorted(i + 1));
+}
+
+static_assert(KeyNamesSorted(0), "key_names must be sorted and free of duplicates");
+
 int CheckKeyCodes(const char* k, MMKeyCode *key)
 {
 	if (!key) return -1;
 
-	if (strlen(k) == 1)
+	if (k[0] != '\0' && k[1] == '\0')
 	{
 		*key = keyCodeForChar(*k);
 		return 0;
@@ -477,15 +594,18 @@ int CheckKeyCodes(const char* k, MMKeyCode *key)
 
 	*key = K_NOT_A_KEY;
 
-	KeyNames* kn = key_names;
-	while (kn->name)
+	size_t lo = 0, hi = key_names_count;
+	while (lo < hi)
 	{
-		if (strcmp(k, kn->name) == 0)
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(k, key_names[mid].name);
+		if (cmp == 0)
 		{
-			*key = kn->key;
+			*key = key_names[mid].key;
 			break;
 		}
-		kn++;
+		if (cmp < 0) hi = mid;
+		else lo = mid + 1;
 	}
 
 	if (*key == K_NOT_A_KEY)
@@ -617,9 +737,16 @@ napi_value KeyTap(napi_env env, napi_callback_info info)
 			napi_throw_error(env, NULL, "Invalid key code specified.");
 			return NULL;
 		default:
-			toggleKeyCode(key, true, flags);
+			{
+				ScopedStat stat(kMMStatKeyboard);
+				toggleKeyCode(key, true, flags);
+			}
 			microsleep(keyboardDelay);
-			toggleKeyCode(key, false, flags);
+			{
+				ScopedStat stat(kMMStatKeyboard);
+				toggleKeyCode(key, false, flags);
+			}
+			MMScreenCacheInvalidate();
 			microsleep(keyboardDelay);
 			break;
 	}
@@ -694,7 +821,11 @@ napi_value KeyToggle(napi_env env, napi_callback_info info)
 			napi_throw_error(env, NULL, "Invalid key code specified.");
 			return NULL;
 		default:
-			toggleKeyCode(key, down, flags);
+			{
+				ScopedStat stat(kMMStatKeyboard);
+				toggleKeyCode(key, down, flags);
+			}
+			MMScreenCacheInvalidate();
 			microsleep(keyboardDelay);
 	}
 
@@ -716,14 +847,24 @@ napi_value TypeString(napi_env env, napi_callback_info info)
 		return NULL;
 	}
 
+	ArenaScope arena;
 	size_t str_size;
 	napi_get_value_string_utf8(env, args[0], NULL, 0, &str_size);
-	char* str = (char*)malloc(str_size + 1);
+	char* str = (char*)MMArenaAlloc(str_size + 1);
+	if (str == NULL) {
+		napi_throw_error(env, NULL, "Out of memory.");
+		return NULL;
+	}
 	napi_get_value_string_utf8(env, args[0], str, str_size + 1, &str_size);
 
-	typeStringDelayed(str, 0);
-
-	free(str);
+	// typeStringDelayed() with a rate is mostly the pacing it was asked for,
+	// so only the unpaced kind counts towards the stats.
+	{
+		ScopedStat stat(kMMStatKeyboard);
+		stat.bytes = str_size;
+		typeStringDelayed(str, 0);
+	}
+	MMScreenCacheInvalidate();
 
 	napi_value result;
 	napi_get_boolean(env, true, &result);
@@ -741,23 +882,70 @@ napi_value TypeStringDelayed(napi_env env, napi_callback_info info)
 		return NULL;
 	}
 
+	ArenaScope arena;
 	size_t str_size;
 	napi_get_value_string_utf8(env, args[0], NULL, 0, &str_size);
-	char* str = (char*)malloc(str_size + 1);
+	char* str = (char*)MMArenaAlloc(str_size + 1);
+	if (str == NULL) {
+		napi_throw_error(env, NULL, "Out of memory.");
+		return NULL;
+	}
 	napi_get_value_string_utf8(env, args[0], str, str_size + 1, &str_size);
 
 	int32_t cpm;
 	napi_get_value_int32(env, args[1], &cpm);
 
 	typeStringDelayed(str, cpm);
-
-	free(str);
+	MMScreenCacheInvalidate();
 
 	napi_value result;
 	napi_get_boolean(env, true, &result);
 	return result;
 }
 
+// decodeUTF8(buffer) returns the code points typeString() would type for the
+// UTF-8 in |buffer|, up to its first NUL. It is there so the decoder can be
+// tested with malformed input, which a JS string can't carry, without typing.
+napi_value DecodeUTF8(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	bool isBuffer = false;
+	if (argc == 1) napi_is_buffer(env, args[0], &isBuffer);
+	if (!isBuffer) {
+		napi_throw_type_error(env, NULL, "Expected a Buffer.");
+		return NULL;
+	}
+
+	void* data;
+	size_t length;
+	napi_get_buffer_info(env, args[0], &data, &length);
+
+	ArenaScope arena;
+	char* str = (char*)MMArenaAlloc(length + 1);
+	if (str == NULL) {
+		napi_throw_error(env, NULL, "Out of memory.");
+		return NULL;
+	}
+	memcpy(str, data, length);
+	str[length] = '\0';
+
+	napi_value result;
+	napi_create_array(env, &result);
+	uint32_t count = 0;
+	for (const char* p = str; *p != '\0'; count++) {
+		unsigned long ch;
+		p += decodeUTF8(p, &ch);
+
+		napi_value value;
+		napi_create_uint32(env, (uint32_t)ch, &value);
+		napi_set_element(env, result, count, value);
+	}
+	return result;
+}
+
 napi_value SetKeyboardDelay(napi_env env, napi_callback_info info)
 {
 	size_t argc = 1;
@@ -776,6 +964,311 @@ napi_value SetKeyboardDelay(napi_env env, napi_callback_info info)
 	return result;
 }
 
+/*
+ __  __
+|  \/  | __ _  ___ _ __ ___  ___
+| |\/| |/ _` |/ __| '__/ _ \/ __|
+| |  | | (_| | (__| | | (_) \__ \
+|_|  |_|\__,_|\___|_|  \___/|___/
+
+*/
+
+// Reads string property |name| of |obj| into |buf|. Returns false if the
+// property is missing or not a string.
+static bool GetStringProperty(napi_env env, napi_value obj, const char* name, char* buf, size_t len)
+{
+	bool has = false;
+	napi_has_named_property(env, obj, name, &has);
+	if (!has) return false;
+
+	napi_value value;
+	napi_valuetype type;
+	napi_get_named_property(env, obj, name, &value);
+	napi_typeof(env, value, &type);
+	if (type != napi_string) return false;
+
+	size_t copied;
+	napi_get_value_string_utf8(env, value, buf, len, &copied);
+	return true;
+}
+
+// Reads number property |name| of |obj|. Returns false if the property is
+// missing or not a number.
+static bool GetNumberProperty(napi_env env, napi_value obj, const char* name, double* out)
+{
+	bool has = false;
+	napi_has_named_property(env, obj, name, &has);
+	if (!has) return false;
+
+	napi_value value;
+	napi_valuetype type;
+	napi_get_named_property(env, obj, name, &value);
+	napi_typeof(env, value, &type);
+	if (type != napi_number) return false;
+
+	napi_get_value_double(env, value, out);
+	return true;
+}
+
+static napi_value ThrowMacroError(napi_env env, uint32_t index, const char* message,
+                                  bool range = false)
+{
+	char error[128];
+	snprintf(error, sizeof(error), "%s (event %u)", message, index);
+	if (range) {
+		napi_throw_range_error(env, NULL, error);
+	} else {
+		napi_throw_error(env, NULL, error);
+	}
+	return NULL;
+}
+
+// The longest delay an event can carry, as its microseconds fit in 32 bits
+// (about 71 minutes).
+static const double kMacroMaxDelayMs = UINT32_MAX / 1000.0;
+
+// Adds number property |name| of |obj|, in milliseconds, to |delay|, in
+// microseconds, if it is there. Returns false if it is not from 0 to
+// kMacroMaxDelayMs, or the sum is more than |delay| can hold.
+static bool AddMacroDelay(napi_env env, napi_value obj, const char* name, uint32_t* delay)
+{
+	double ms;
+	if (!GetNumberProperty(env, obj, name, &ms)) return true;
+	if (!(ms >= 0 && ms <= kMacroMaxDelayMs)) return false; // Catches NaN too.
+
+	const uint64_t total = (uint64_t)*delay + (uint64_t)(ms * 1000.0);
+	if (total > UINT32_MAX) return false;
+	*delay = (uint32_t)total;
+	return true;
+}
+
+// Resolves one script event into its compiled form. Returns NULL on success,
+// or an error message, with |rangeError| set if it is about a delay.
+static const char* CompileMacroEvent(napi_env env, napi_value obj, MMMacroEvent* event,
+                                     bool* rangeError)
+{
+	static const char* const kDelayError = "Delays must be from 0 to 4294967 ms.";
+	char type[32];
+	char str[64];
+
+	memset(event, 0, sizeof(*event));
+	*rangeError = false;
+
+	if (!GetStringProperty(env, obj, "type", type, sizeof(type))) {
+		return "Missing event type.";
+	}
+
+	if (!AddMacroDelay(env, obj, "delay", &event->delay)) {
+		*rangeError = true;
+		return kDelayError;
+	}
+
+	if (strcmp(type, "keyTap") == 0 || strcmp(type, "keyToggle") == 0) {
+		MMKeyCode key;
+		MMKeyFlags flags = MOD_NONE;
+		bool has = false;
+
+		event->type = strcmp(type, "keyTap") == 0 ? MMMACRO_KEY_TAP : MMMACRO_KEY_TOGGLE;
+
+		if (!GetStringProperty(env, obj, "key", str, sizeof(str)) ||
+		    CheckKeyCodes(str, &key) != 0) {
+			return "Invalid key code specified.";
+		}
+		event->code = (uint32_t)key;
+
+		napi_has_named_property(env, obj, "modifier", &has);
+		if (has) {
+			napi_value modifier;
+			napi_get_named_property(env, obj, "modifier", &modifier);
+			if (GetFlagsFromValue(env, modifier, &flags) != 0) {
+				return "Invalid key flag specified.";
+			}
+		}
+		event->flags = (uint32_t)flags;
+
+		if (event->type == MMMACRO_KEY_TOGGLE && GetStringProperty(env, obj, "down", str, sizeof(str))) {
+			if (strcmp(str, "down") == 0) {
+				event->down = 1;
+			} else if (strcmp(str, "up") != 0) {
+				return "Invalid key state specified.";
+			}
+		}
+	} else if (strcmp(type, "moveMouse") == 0 || strcmp(type, "dragMouse") == 0 ||
+	           strcmp(type, "scrollMouse") == 0) {
+		double x, y;
+		if (!GetNumberProperty(env, obj, "x", &x) || !GetNumberProperty(env, obj, "y", &y)) {
+			return "Missing x or y.";
+		}
+		event->x = (int32_t)x;
+		event->y = (int32_t)y;
+
+		if (strcmp(type, "moveMouse") == 0) {
+			event->type = MMMACRO_MOUSE_MOVE;
+		} else if (strcmp(type, "scrollMouse") == 0) {
+			event->type = MMMACRO_MOUSE_SCROLL;
+		} else {
+			MMMouseButton button = LEFT_BUTTON;
+			event->type = MMMACRO_MOUSE_DRAG;
+			if (GetStringProperty(env, obj, "button", str, sizeof(str)) &&
+			    CheckMouseButton(str, &button) != 0) {
+				return "Invalid mouse button specified.";
+			}
+			event->code = (uint32_t)button;
+		}
+	} else if (strcmp(type, "mouseClick") == 0 || strcmp(type, "mouseToggle") == 0) {
+		MMMouseButton button = LEFT_BUTTON;
+		if (GetStringProperty(env, obj, "button", str, sizeof(str)) &&
+		    CheckMouseButton(str, &button) != 0) {
+			return "Invalid mouse button specified.";
+		}
+		event->code = (uint32_t)button;
+
+		if (strcmp(type, "mouseClick") == 0) {
+			bool has = false;
+			event->type = MMMACRO_MOUSE_CLICK;
+			napi_has_named_property(env, obj, "double", &has);
+			if (has) {
+				napi_value value;
+				bool doubleC = false;
+				napi_get_named_property(env, obj, "double", &value);
+				napi_get_value_bool(env, value, &doubleC);
+				event->down = doubleC ? 1 : 0;
+			}
+		} else {
+			event->type = MMMACRO_MOUSE_TOGGLE;
+			if (GetStringProperty(env, obj, "down", str, sizeof(str))) {
+				if (strcmp(str, "down") == 0) {
+					event->down = 1;
+				} else if (strcmp(str, "up") != 0) {
+					return "Invalid mouse button state specified.";
+				}
+			}
+		}
+	} else if (strcmp(type, "delay") == 0) {
+		event->type = MMMACRO_DELAY;
+		if (!AddMacroDelay(env, obj, "ms", &event->delay)) {
+			*rangeError = true;
+			return kDelayError;
+		}
+	} else {
+		return "Invalid event type specified.";
+	}
+
+	return NULL;
+}
+
+napi_value CompileMacro(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	bool isArray = false;
+	if (argc == 1) napi_is_array(env, args[0], &isArray);
+	if (!isArray) {
+		napi_throw_error(env, NULL, "Expected an array of events.");
+		return NULL;
+	}
+
+	uint32_t count;
+	napi_get_array_length(env, args[0], &count);
+
+	void* data;
+	napi_value buffer;
+	if (napi_create_buffer(env, MMMacroSize(count), &data, &buffer) != napi_ok) {
+		napi_throw_error(env, NULL, "Failed to allocate macro");
+		return NULL;
+	}
+
+	initMMMacroHeader((MMMacroHeader*)data, count);
+	MMMacroEvent* events = (MMMacroEvent*)((uint8_t*)data + sizeof(MMMacroHeader));
+
+	for (uint32_t i = 0; i < count; i++) {
+		napi_value obj;
+		napi_valuetype type;
+		napi_get_element(env, args[0], i, &obj);
+		napi_typeof(env, obj, &type);
+		if (type != napi_object) {
+			return ThrowMacroError(env, i, "Expected an event object.");
+		}
+
+		bool rangeError;
+		const char* error = CompileMacroEvent(env, obj, &events[i], &rangeError);
+		if (error) {
+			return ThrowMacroError(env, i, error, rangeError);
+		}
+	}
+
+	return buffer;
+}
+
+static napi_value CreateFloat64Array(napi_env env, size_t length, double** data)
+{
+	napi_value arrayBuffer, array;
+	napi_create_arraybuffer(env, length * sizeof(double), (void**)data, &arrayBuffer);
+	napi_create_typedarray(env, napi_float64_array, length, arrayBuffer, 0, &array);
+	return array;
+}
+
+napi_value PlayMacro(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	bool isBuffer = false;
+	if (argc == 1) napi_is_buffer(env, args[0], &isBuffer);
+	if (!isBuffer) {
+		napi_throw_error(env, NULL, "Expected a compiled macro.");
+		return NULL;
+	}
+
+	void* data;
+	size_t length, count;
+	napi_get_buffer_info(env, args[0], &data, &length);
+	const MMMacroEvent* events = MMMacroEvents((const uint8_t*)data, length, &count);
+	if (!events) {
+		napi_throw_error(env, NULL, "Invalid compiled macro.");
+		return NULL;
+	}
+
+	std::vector<MMMacroTiming> timings(count);
+	playMMMacro(events, count, timings.data());
+	MMScreenCacheInvalidate();
+
+	double *scheduled, *actual, *durations;
+	napi_value scheduledArray = CreateFloat64Array(env, count, &scheduled);
+	napi_value actualArray = CreateFloat64Array(env, count, &actual);
+	napi_value durationArray = CreateFloat64Array(env, count, &durations);
+
+	double totalLateness = 0.0, maxLateness = 0.0, elapsed = 0.0;
+	for (size_t i = 0; i < count; i++) {
+		const double lateness = timings[i].actual - timings[i].scheduled;
+		scheduled[i] = timings[i].scheduled;
+		actual[i] = timings[i].actual;
+		durations[i] = timings[i].duration;
+		totalLateness += lateness;
+		if (lateness > maxLateness) maxLateness = lateness;
+		elapsed = timings[i].actual + timings[i].duration;
+	}
+
+	napi_value result, value;
+	napi_create_object(env, &result);
+	napi_create_uint32(env, (uint32_t)count, &value);
+	napi_set_named_property(env, result, "count", value);
+	napi_create_double(env, elapsed, &value);
+	napi_set_named_property(env, result, "elapsed", value);
+	napi_create_double(env, count ? totalLateness / count : 0.0, &value);
+	napi_set_named_property(env, result, "meanLateness", value);
+	napi_create_double(env, maxLateness, &value);
+	napi_set_named_property(env, result, "maxLateness", value);
+	napi_set_named_property(env, result, "scheduled", scheduledArray);
+	napi_set_named_property(env, result, "actual", actualArray);
+	napi_set_named_property(env, result, "durations", durationArray);
+
+	return result;
+}
+
 /*
   ____
  / ___|  ___ _ __ ___  ___ _ __
@@ -884,7 +1377,7 @@ napi_value GetMouseColor(napi_env env, napi_callback_info info) {
     // This helps with coordinate misalignment on Windows with DPI scaling
     int captureSize = 3; // Capture 3x3 pixel area
     int offset = captureSize / 2; // Center offset
-    MMBitmapRef bitmap = copyMMBitmapFromDisplayInRect(MMSignedRectMake(pos.x - offset, pos.y - offset, captureSize, captureSize));
+    MMBitmapRef bitmap = CaptureRect(MMSignedRectMake(pos.x - offset, pos.y - offset, captureSize, captureSize));
     
     if (!isBitmapValid(bitmap)) {
         if (bitmap) destroyMMBitmap(bitmap);
@@ -893,11 +1386,17 @@ napi_value GetMouseColor(napi_env env, napi_callback_info info) {
     }
     
     // Use safe pixel access - get the center pixel of our captured area
-    MMRGBColor rgb = safeGetPixelColor(bitmap, offset, offset);
+    MMRGBColor rgb;
+    {
+        ScopedStat stat(kMMStatConvert);
+        stat.bytes = bitmap->bytesPerPixel;
+        rgb = safeGetPixelColor(bitmap, offset, offset);
+    }
     
     destroyMMBitmap(bitmap);
     endOperation();
 
+    ScopedStat stat(kMMStatObject);
     napi_value result;
     napi_create_object(env, &result);
 
@@ -990,16 +1489,22 @@ napi_value GetPixelColor(napi_env env, napi_callback_info info) {
 		return createDummyMouseColorResult(env, x, y, ERROR_SUSPEND_WAKEUP);
 	}
 
-	MMBitmapRef bitmap = copyMMBitmapFromDisplayInRect(MMSignedRectMake(x, y, 1, 1));
+	MMBitmapRef bitmap = CaptureRect(MMSignedRectMake(x, y, 1, 1));
     if (!isBitmapValid(bitmap)) {
         if (bitmap) destroyMMBitmap(bitmap);
         return createDummyMouseColorResult(env, x, y, ERROR_BITMAP_INVALID);
     }
 
+	MMRGBColor rgbColor;
+	{
+		ScopedStat stat(kMMStatConvert);
+		stat.bytes = bitmap->bytesPerPixel;
+		rgbColor = safeGetPixelColor(bitmap, 0, 0);
+	}
+	destroyMMBitmap(bitmap);
+
+	ScopedStat stat(kMMStatObject);
 	if (returnRGB) {
-		// Use safe pixel access
-		MMRGBColor rgbColor = safeGetPixelColor(bitmap, 0, 0);
-		destroyMMBitmap(bitmap);
 		napi_value obj;
 		napi_create_object(env, &obj);
 		napi_value red, green, blue;
@@ -1011,9 +1516,6 @@ napi_value GetPixelColor(napi_env env, napi_callback_info info) {
 		napi_set_named_property(env, obj, "b", blue);
 		return obj;
 	} else {
-		// Use safe pixel access for hex color
-		MMRGBColor rgbColor = safeGetPixelColor(bitmap, 0, 0);
-		destroyMMBitmap(bitmap);
 		MMRGBHex color = hexFromMMRGB(rgbColor);
 		char hex[8];
 		hex[0] = '#';
@@ -1024,7 +1526,178 @@ napi_value GetPixelColor(napi_env env, napi_callback_info info) {
 	}
 }
 
+// Reads the {x, y} object at |index| of the array |points|.
+static bool GetPoint(napi_env env, napi_value points, uint32_t index, MMSignedPoint* point)
+{
+	napi_value element, x, y;
+	int32_t px, py;
+
+	if (napi_get_element(env, points, index, &element) != napi_ok ||
+	    napi_get_named_property(env, element, "x", &x) != napi_ok ||
+	    napi_get_named_property(env, element, "y", &y) != napi_ok ||
+	    napi_get_value_int32(env, x, &px) != napi_ok ||
+	    napi_get_value_int32(env, y, &py) != napi_ok) {
+		return false;
+	}
+
+	*point = MMSignedPointMake(px, py);
+	return true;
+}
+
+// The colors of many pixels in one call, as a Uint32Array of 0xRRGGBB values
+// in the order of the points.
+napi_value GetPixelColors(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 1) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	bool isArray = false, isTypedArray = false;
+	uint32_t count = 0;
+	const int32_t* pairs = NULL;
+	napi_is_array(env, args[0], &isArray);
+	napi_is_typedarray(env, args[0], &isTypedArray);
+
+	if (isTypedArray) {
+		napi_typedarray_type type;
+		size_t length;
+		void* pairData;
+		napi_get_typedarray_info(env, args[0], &type, &length, &pairData, NULL, NULL);
+		pairs = (const int32_t*)pairData;
+		if (type != napi_int32_array || length % 2 != 0) {
+			napi_throw_type_error(env, NULL, "Expected an Int32Array of x, y pairs.");
+			return NULL;
+		}
+		count = (uint32_t)(length / 2);
+	} else if (isArray) {
+		napi_get_array_length(env, args[0], &count);
+	} else {
+		napi_throw_type_error(env, NULL, "Expected an array of points or an Int32Array of x, y pairs.");
+		return NULL;
+	}
+
+	if (!resources_valid) {
+		napi_throw_error(env, NULL, "Screen capture resources are invalid");
+		return NULL;
+	}
+
+	// Most probing loops ask for a few dozen points; those stay on the stack.
+	MMSignedPoint stackPoints[64];
+	std::vector<MMSignedPoint> heapPoints;
+	MMSignedPoint* points = stackPoints;
+	if (count > sizeof(stackPoints) / sizeof(stackPoints[0])) {
+		heapPoints.resize(count);
+		points = heapPoints.data();
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (pairs != NULL) {
+			points[i] = MMSignedPointMake(pairs[i * 2], pairs[i * 2 + 1]);
+		} else if (!GetPoint(env, args[0], i, &points[i])) {
+			char message[64];
+			snprintf(message, sizeof(message), "Invalid point at index %u.", i);
+			napi_throw_type_error(env, NULL, message);
+			return NULL;
+		}
+	}
+
+	const MMSignedSize displaySize = count > 0 ? getMainDisplaySize() : MMSignedSizeMake(0, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		if (points[i].x < 0 || points[i].y < 0 ||
+		    points[i].x >= displaySize.width || points[i].y >= displaySize.height) {
+			char message[64];
+			snprintf(message, sizeof(message), "Point at index %u is outside the main screen.", i);
+			napi_throw_range_error(env, NULL, message);
+			return NULL;
+		}
+	}
+
+	// The colors are written straight into the array handed back.
+	napi_value buffer, result;
+	void* data = NULL;
+	if (napi_create_arraybuffer(env, (size_t)count * sizeof(uint32_t), &data, &buffer) != napi_ok) {
+		napi_throw_error(env, NULL, "Could not allocate the result.");
+		return NULL;
+	}
+
+	{
+		ScopedStat stat(kMMStatCapture);
+		stat.bytes = (uint64_t)count * sizeof(uint32_t);
+		if (MMScreenCacheReadPixels(points, count, (uint32_t*)data) != 0) {
+			napi_throw_error(env, NULL, "Failed to capture screen");
+			return NULL;
+		}
+	}
+
+	ScopedStat stat(kMMStatObject);
+	napi_create_typedarray(env, napi_uint32_array, count, buffer, 0, &result);
+	return result;
+}
+
+// Turns the screen cache on or off: a TTL in milliseconds, an object with a
+// ttl and optionally the x, y, width and height of the region to cache, or
+// false (or 0) to turn it off.
+napi_value SetScreenCache(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 1) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	napi_valuetype type;
+	napi_typeof(env, args[0], &type);
+
+	double ttl = 0;
+	double x = 0, y = 0, width = 0, height = 0;
+	if (type == napi_number) {
+		napi_get_value_double(env, args[0], &ttl);
+	} else if (type == napi_object) {
+		if (!GetNumberProperty(env, args[0], "ttl", &ttl)) {
+			napi_throw_type_error(env, NULL, "Missing ttl.");
+			return NULL;
+		}
+		const bool hasX = GetNumberProperty(env, args[0], "x", &x);
+		const bool hasY = GetNumberProperty(env, args[0], "y", &y);
+		const bool hasWidth = GetNumberProperty(env, args[0], "width", &width);
+		const bool hasHeight = GetNumberProperty(env, args[0], "height", &height);
+		if ((hasX || hasY || hasWidth || hasHeight) &&
+		    (!hasX || !hasY || !hasWidth || !hasHeight || width < 1 || height < 1)) {
+			napi_throw_type_error(env, NULL, "A region needs x, y and a positive width and height.");
+			return NULL;
+		}
+	} else if (type != napi_boolean && type != napi_undefined && type != napi_null) {
+		napi_throw_type_error(env, NULL, "Expected a TTL in milliseconds, options or false.");
+		return NULL;
+	}
+
+	MMScreenCacheConfigure(ttl, MMSignedRectMake((int32_t)x, (int32_t)y,
+	                                             (int32_t)width, (int32_t)height));
+
+	napi_value result;
+	napi_get_boolean(env, MMScreenCacheEnabled(), &result);
+	return result;
+}
+
+napi_value InvalidateScreenCache(napi_env env, napi_callback_info info)
+{
+	MMScreenCacheInvalidate();
+
+	napi_value result;
+	napi_get_boolean(env, true, &result);
+	return result;
+}
+
 napi_value GetScreenSize(napi_env env, napi_callback_info info) {
+	ArenaScope arena;
 	size_t argc = 1;
 	napi_value args[1];
 	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
@@ -1044,7 +1717,7 @@ napi_value GetScreenSize(napi_env env, napi_callback_info info) {
 			return null_value;
 		}
 
-		MMSignedRect* screens = (MMSignedRect*)malloc(count * sizeof(MMSignedRect));
+		MMSignedRect* screens = (MMSignedRect*)MMArenaAlloc(count * sizeof(MMSignedRect));
 		if (!screens) {
 			napi_value null_value;
 			napi_get_null(env, &null_value);
@@ -1081,7 +1754,6 @@ napi_value GetScreenSize(napi_env env, napi_callback_info info) {
 		napi_set_named_property(env, obj, "maxX", maxX_val);
 		napi_set_named_property(env, obj, "maxY", maxY_val);
 
-		free(screens);
 		return obj;
 	}
 	// If screenIndex > 0, return specific monitor size
@@ -1095,7 +1767,7 @@ napi_value GetScreenSize(napi_env env, napi_callback_info info) {
 			return null_value;
 		}
 
-		MMSignedRect* screens = (MMSignedRect*)malloc(count * sizeof(MMSignedRect));
+		MMSignedRect* screens = (MMSignedRect*)MMArenaAlloc(count * sizeof(MMSignedRect));
 		if (!screens) {
 			napi_value null_value;
 			napi_get_null(env, &null_value);
@@ -1118,7 +1790,6 @@ napi_value GetScreenSize(napi_env env, napi_callback_info info) {
 		napi_set_named_property(env, obj, "x", x);
 		napi_set_named_property(env, obj, "y", y);
 
-		free(screens);
 		return obj;
 	}
 	// If screenIndex < 0, return NULL
@@ -1141,6 +1812,8 @@ napi_value GetXDisplayName(napi_env env, napi_callback_info info) {
 #endif
 }
 
+static void RestartDisplayWatch();
+
 napi_value SetXDisplayName(napi_env env, napi_callback_info info) {
 #if defined(USE_X11)
 	size_t argc = 1;
@@ -1155,6 +1828,10 @@ napi_value SetXDisplayName(napi_env env, napi_callback_info info) {
 	setXDisplay(display);
 	free(display);
 
+	// Watch the new display for changes instead, and forget the old one's.
+	RestartDisplayWatch();
+	invalidateScreenGeometry();
+
 	napi_value result;
 	napi_get_boolean(env, true, &result);
 	return result;
@@ -1164,6 +1841,8 @@ napi_value SetXDisplayName(napi_env env, napi_callback_info info) {
 #endif
 }
 
+static napi_value NewBitmap(napi_env env, MMBitmapRef bitmap);
+
 napi_value CaptureScreen(napi_env env, napi_callback_info info) {
 	size_t argc = 4;
 	napi_value args[4];
@@ -1196,133 +1875,1883 @@ napi_value CaptureScreen(napi_env env, napi_callback_info info) {
 		return NULL;
 	}
 
-	MMBitmapRef bitmap = copyMMBitmapFromDisplayInRect(MMSignedRectMake(x, y, w, h));
+	MMBitmapRef bitmap = CaptureRect(MMSignedRectMake(x, y, w, h));
     if (!bitmap) {
         napi_throw_error(env, NULL, "Failed to capture screen");
         return NULL;
     }
-	uint32_t bufferSize = bitmap->bytewidth * bitmap->height;
-	napi_value buffer;
+	// The pixels stay native until someone asks for bitmap.image.
+	ScopedStat stat(kMMStatObject);
+	return NewBitmap(env, bitmap);
+}
+
+/*
+ ____  _ _
+| __ )(_) |_ _ __ ___   __ _ _ __
+|  _ \| | __| '_ ` _ \ / _` | '_ \
+| |_) | | |_| | | | | | (_| | |_) |
+|____/|_|\__|_| |_| |_|\__,_| .__/
+                            |_|
+ */
+
+// The native side of a Bitmap (see the class further down). Its pixels are
+// its own, straight from a capture; those of a JS buffer it holds; or, for a
+// view made by crop(), part of another handle's, which it keeps alive.
+struct BitmapHandle
+{
+	MMBitmap bitmap;       // What the methods read.
+	MMBitmapRef owned;     // Our own pixels, or NULL.
+	BitmapHandle* parent;  // Whose pixels a view reads, or NULL.
+	napi_ref imageRef;     // The image buffer, once there is one.
+	bool lent;             // |imageRef| is an external buffer over |owned|.
+	int users;             // The Bitmap, an external buffer over |owned|, and views.
+};
+
+static const napi_type_tag kBitmapTypeTag = {
+	0x6d0e3c5a4f1b42a7ULL, 0x9c8b2e71d35a6f04ULL
+};
+
+// Tags the external WrapBitmapHandle() passes to the constructor, so that no
+// other external can pass for a BitmapHandle.
+static const napi_type_tag kBitmapHandleTypeTag = {
+	0x2b71f0c48e9d4a63ULL, 0xa4e05d19c7b83f52ULL
+};
+
+static BitmapHandle* UnwrapBitmap(napi_env env, napi_value obj)
+{
+	bool isBitmap = false;
+	void* handle = NULL;
+	if (napi_check_object_type_tag(env, obj, &kBitmapTypeTag, &isBitmap) != napi_ok || !isBitmap ||
+	    napi_unwrap(env, obj, &handle) != napi_ok) {
+		return NULL;
+	}
+	return (BitmapHandle*)handle;
+}
+
+// Points |bitmap| at the pixels of buffer |image|, after checking that the
+// layout given fits them. Returns an error message, or NULL on success.
+static const char* SetBitmapView(napi_env env, MMBitmap* bitmap, uint32_t width, uint32_t height,
+                                 uint32_t byteWidth, uint32_t bitsPerPixel, uint32_t bytesPerPixel,
+                                 napi_value image)
+{
+	bool isBuffer = false;
+	napi_is_buffer(env, image, &isBuffer);
+	if (!isBuffer) return "Invalid bitmap.";
+
+	void* data;
+	size_t length;
+	napi_get_buffer_info(env, image, &data, &length);
+
+	// The last row's padding needn't be there, as in the image of a view.
+	if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX ||
+	    (bytesPerPixel != 3 && bytesPerPixel != 4) ||
+	    byteWidth > INT32_MAX || byteWidth < (uint64_t)width * bytesPerPixel ||
+	    length < (uint64_t)byteWidth * (height - 1) + (uint64_t)width * bytesPerPixel) {
+		return "Invalid bitmap.";
+	}
+
+	bitmap->imageBuffer = (uint8_t*)data;
+	bitmap->width = (int32_t)width;
+	bitmap->height = (int32_t)height;
+	bitmap->bytewidth = (int32_t)byteWidth;
+	bitmap->bitsPerPixel = (uint8_t)bitsPerPixel;
+	bitmap->bytesPerPixel = (uint8_t)bytesPerPixel;
+	return NULL;
+}
+
+// Describes the bitmap object |obj| (a Bitmap, or any object with the same
+// fields) without copying its pixels. |image| is set to whatever keeps the
+// pixels alive, for the caller to hold on to: the Bitmap itself, so that its
+// buffer is never made just to be read, or the object's image buffer.
+// Returns an error message, or NULL on success.
+static const char* GetBitmapView(napi_env env, napi_value obj, MMBitmap* bitmap, napi_value* image)
+{
+	napi_valuetype type;
+	napi_typeof(env, obj, &type);
+	if (type != napi_object) return "Expected a bitmap.";
+
+	BitmapHandle* handle = UnwrapBitmap(env, obj);
+	if (handle != NULL) {
+		*bitmap = handle->bitmap;
+		*image = obj;
+		return NULL;
+	}
+
+	uint32_t width, height, byteWidth, bitsPerPixel, bytesPerPixel;
+	napi_value value;
+	if (napi_get_named_property(env, obj, "width", &value) != napi_ok ||
+	    napi_get_value_uint32(env, value, &width) != napi_ok ||
+	    napi_get_named_property(env, obj, "height", &value) != napi_ok ||
+	    napi_get_value_uint32(env, value, &height) != napi_ok ||
+	    napi_get_named_property(env, obj, "byteWidth", &value) != napi_ok ||
+	    napi_get_value_uint32(env, value, &byteWidth) != napi_ok ||
+	    napi_get_named_property(env, obj, "bitsPerPixel", &value) != napi_ok ||
+	    napi_get_value_uint32(env, value, &bitsPerPixel) != napi_ok ||
+	    napi_get_named_property(env, obj, "bytesPerPixel", &value) != napi_ok ||
+	    napi_get_value_uint32(env, value, &bytesPerPixel) != napi_ok) {
+		return "Invalid bitmap.";
+	}
+
+	napi_get_named_property(env, obj, "image", image);
+	return SetBitmapView(env, bitmap, width, height, byteWidth, bitsPerPixel, bytesPerPixel, *image);
+}
+
+// The pixel of |needle|, read from |obj|, to compare first when searching for
+// it: the anchor of the signature a mapped bitmap carries, or else the one
+// findNeedleAnchor() works out.
+static MMPoint GetNeedleAnchor(napi_env env, napi_value obj, MMBitmapRef needle)
+{
+	napi_value signature;
+	napi_valuetype type = napi_undefined;
+	double x, y;
+	if (napi_get_named_property(env, obj, "signature", &signature) == napi_ok) {
+		napi_typeof(env, signature, &type);
+	}
+	if (type == napi_object &&
+	    GetNumberProperty(env, signature, "anchorX", &x) &&
+	    GetNumberProperty(env, signature, "anchorY", &y) &&
+	    x >= 0 && y >= 0 && x < needle->width && y < needle->height &&
+	    x == (int32_t)x && y == (int32_t)y) {
+		return MMPointMake((size_t)x, (size_t)y);
+	}
+	return findNeedleAnchor(needle, NULL);
+}
+
+static napi_value CreateColorString(napi_env env, MMRGBHex color);
+
+// Reads pixel (|x|, |y|) of |bitmap| as a "#rrggbb" string, or throws if it
+// is outside.
+static napi_value GetBitmapColor(napi_env env, MMBitmapRef bitmap, napi_value x, napi_value y)
+{
+	double px, py;
+	if (napi_get_value_double(env, x, &px) != napi_ok ||
+	    napi_get_value_double(env, y, &py) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Invalid coordinates.");
+		return NULL;
+	}
+
+	// Make sure the requested pixel is inside the bitmap.
+	if (!(px >= 0 && px < bitmap->width && py >= 0 && py < bitmap->height)) {
+		napi_throw_error(env, NULL, "Requested coordinates are outside the bitmap's dimensions.");
+		return NULL;
+	}
+
+	return CreateColorString(env, MMRGBHexAtPoint(bitmap, (size_t)px, (size_t)py));
+}
+
+napi_value GetColor(napi_env env, napi_callback_info info)
+{
+	size_t argc = 3;
+	napi_value args[3];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 3) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	MMBitmap bitmap;
+	napi_value image;
+	const char* error = GetBitmapView(env, args[0], &bitmap, &image);
+	if (error != NULL) {
+		napi_throw_error(env, NULL, error);
+		return NULL;
+	}
+
+	return GetBitmapColor(env, &bitmap, args[1], args[2]);
+}
+
+#if defined(USE_LIBPNG)
+
+struct EncodePNGData
+{
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref imageRef; // Keeps the pixels alive while encoding.
+	MMBitmap bitmap;
+	MMPNGOptions options;
+	uint8_t* png;
+	size_t length;
+};
+
+static void ExecuteEncodePNG(napi_env env, void* data)
+{
+	EncodePNGData* encode = (EncodePNGData*)data;
+	encode->png = createPNGDataWithOptions(&encode->bitmap, &encode->options, &encode->length);
+}
+
+static void FreePNGData(napi_env env, void* data, void* hint)
+{
+	free(data);
+}
+
+static void CompleteEncodePNG(napi_env env, napi_status status, void* data)
+{
+	EncodePNGData* encode = (EncodePNGData*)data;
+	napi_value result;
+
+	if (status == napi_ok && encode->png != NULL &&
+	    napi_create_external_buffer(env, encode->length, encode->png, FreePNGData, NULL, &result) == napi_ok) {
+		napi_resolve_deferred(env, encode->deferred, result);
+	} else {
+		napi_value message;
+		free(encode->png);
+		napi_create_string_utf8(env, "Failed to encode PNG", NAPI_AUTO_LENGTH, &message);
+		napi_create_error(env, NULL, message, &result);
+		napi_reject_deferred(env, encode->deferred, result);
+	}
+
+	napi_delete_reference(env, encode->imageRef);
+	napi_delete_async_work(env, encode->work);
+	delete encode;
+}
+
+struct PNGFilterName
+{
+	const char* name;
+	int filters;
+};
+
+static const PNGFilterName png_filter_names[] =
+{
+	{ "default", kPNGFilterDefault },
+	{ "none",    kPNGFilterNone },
+	{ "sub",     kPNGFilterSub },
+	{ "up",      kPNGFilterUp },
+	{ "average", kPNGFilterAverage },
+	{ "paeth",   kPNGFilterPaeth },
+	{ "all",     kPNGFilterAll }
+};
+
+// Reads {level, filter, threads} from |value| into |options|. Returns an error
+// message, or NULL on success.
+static const char* GetPNGOptions(napi_env env, napi_value value, MMPNGOptions* options)
+{
+	napi_valuetype type;
+	char filter[16];
+	double level, threads;
+
+	options->level = -1;
+	options->filters = kPNGFilterDefault;
+	options->threads = 1;
+
+	if (value == NULL) return NULL;
+
+	napi_typeof(env, value, &type);
+	if (type == napi_undefined || type == napi_null) return NULL;
+	if (type != napi_object) return "Invalid PNG options.";
+
+	if (GetNumberProperty(env, value, "level", &level)) {
+		if (level < 0 || level > 9 || level != (int)level) {
+			return "Invalid compression level; expected an integer from 0 to 9.";
+		}
+		options->level = (int)level;
+	}
+
+	if (GetStringProperty(env, value, "filter", filter, sizeof(filter))) {
+		size_t i;
+		const size_t count = sizeof(png_filter_names) / sizeof(png_filter_names[0]);
+		for (i = 0; i < count; i++) {
+			if (strcmp(filter, png_filter_names[i].name) == 0) break;
+		}
+		if (i == count) return "Invalid PNG filter specified.";
+		options->filters = png_filter_names[i].filters;
+	}
+
+	if (GetNumberProperty(env, value, "threads", &threads)) {
+		if (threads < 0 || threads > 64 || threads != (int)threads) {
+			return "Invalid thread count; expected an integer from 0 to 64.";
+		}
+		options->threads = (unsigned int)threads;
+	}
+
+	return NULL;
+}
+
+// Encodes |bitmap| off the main thread; |options| may be NULL. Returns a
+// promise of the PNG, or throws if either argument is invalid.
+static napi_value StartEncodePNG(napi_env env, napi_value bitmap, napi_value options)
+{
+	EncodePNGData* encode = new EncodePNGData();
+	napi_value image;
+	const char* error = GetBitmapView(env, bitmap, &encode->bitmap, &image);
+	if (error == NULL) {
+		error = GetPNGOptions(env, options, &encode->options);
+	}
+
+	if (error != NULL) {
+		delete encode;
+		napi_throw_error(env, NULL, error);
+		return NULL;
+	}
+
+	napi_value promise, name;
+	napi_create_promise(env, &encode->deferred, &promise);
+	napi_create_reference(env, image, 1, &encode->imageRef);
+	napi_create_string_utf8(env, "robotjs.encodePNG", NAPI_AUTO_LENGTH, &name);
+	napi_create_async_work(env, NULL, name, ExecuteEncodePNG, CompleteEncodePNG, encode, &encode->work);
+	napi_queue_async_work(env, encode->work);
+
+	return promise;
+}
+
+#endif
+
+napi_value EncodePNG(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc < 1 || argc > 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	return StartEncodePNG(env, args[0], argc == 2 ? args[1] : NULL);
+#else
+	napi_throw_error(env, NULL, "encodePNG is only supported on Linux");
+	return NULL;
+#endif
+}
+
+#if defined(USE_LIBPNG)
+
+// An encoder handed to JS as an external; it reads from the bitmap's pixels,
+// so holds on to them for as long as it lives.
+struct ImageEncoderHandle
+{
+	MMImageEncoderRef encoder;
+	MMBitmap bitmap;
+	napi_ref imageRef;
+	size_t chunkSize;
+	bool busy; // A read is in flight.
+};
+
+static const napi_type_tag kImageEncoderTypeTag = {
+	0x51c9e2a07d3b4f8eULL, 0xb63a0f4d92e1c785ULL
+};
+
+static void FreeImageEncoder(napi_env env, void* data, void* hint)
+{
+	ImageEncoderHandle* handle = (ImageEncoderHandle*)data;
+	destroyMMImageEncoder(handle->encoder);
+	napi_delete_reference(env, handle->imageRef);
+	delete handle;
+}
+
+// Reads {format, level, filter, chunkSize} from |value|. Returns an error
+// message, or NULL on success.
+static const char* GetImageOptions(napi_env env, napi_value value, MMImageType* type,
+                                   MMPNGOptions* options, size_t* chunkSize)
+{
+	char format[8];
+	double size;
+
+	*type = kPNGImageType;
+	*chunkSize = 65536;
+
+	const char* error = GetPNGOptions(env, value, options);
+	if (error != NULL || value == NULL) return error;
+
+	napi_valuetype valueType;
+	napi_typeof(env, value, &valueType);
+	if (valueType != napi_object) return NULL;
+
+	if (GetStringProperty(env, value, "format", format, sizeof(format))) {
+		if (strcmp(format, "png") == 0) {
+			*type = kPNGImageType;
+		} else if (strcmp(format, "bmp") == 0) {
+			*type = kBMPImageType;
+		} else {
+			return "Invalid image format; expected \"png\" or \"bmp\".";
+		}
+	}
+
+	if (GetNumberProperty(env, value, "chunkSize", &size)) {
+		if (size < MM_IMAGE_MIN_CHUNK_SIZE || size > 0x40000000 || size != (double)(size_t)size) {
+			return "Invalid chunk size; expected an integer from 64 to 2^30.";
+		}
+		*chunkSize = (size_t)size;
+	}
+
+	return NULL;
+}
+
+struct ReadImageData
+{
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref handleRef; // Keeps the encoder alive while reading.
+	ImageEncoderHandle* handle;
+	uint8_t* chunk;
+	size_t length;
+	int error;
+};
+
+static void ExecuteReadImage(napi_env env, void* data)
+{
+	ReadImageData* read = (ReadImageData*)data;
+	read->error = readMMImageEncoder(read->handle->encoder, read->chunk, read->handle->chunkSize, &read->length);
+}
+
+static void CompleteReadImage(napi_env env, napi_status status, void* data)
+{
+	ReadImageData* read = (ReadImageData*)data;
+	napi_value result;
+
+	read->handle->busy = false;
+
+	if (status == napi_ok && read->error == 0 && read->length == 0) {
+		// The end of the file.
+		free(read->chunk);
+		napi_get_null(env, &result);
+		napi_resolve_deferred(env, read->deferred, result);
+	} else if (status == napi_ok && read->error == 0 &&
+	           napi_create_external_buffer(env, read->length, read->chunk, FreePNGData, NULL, &result) == napi_ok) {
+		napi_resolve_deferred(env, read->deferred, result);
+	} else {
+		napi_value message;
+		free(read->chunk);
+		napi_create_string_utf8(env, "Failed to encode image", NAPI_AUTO_LENGTH, &message);
+		napi_create_error(env, NULL, message, &result);
+		napi_reject_deferred(env, read->deferred, result);
+	}
+
+	napi_delete_reference(env, read->handleRef);
+	napi_delete_async_work(env, read->work);
+	delete read;
+}
+
+struct WriteImageData
+{
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref imageRef;
+	MMBitmap bitmap;
+	MMImageType type;
+	MMPNGOptions options;
+	int fd;
+	size_t chunkSize;
+	size_t written;
+	int error;
+	int errorNumber;
+};
+
+static void ExecuteWriteImage(napi_env env, void* data)
+{
+	WriteImageData* write = (WriteImageData*)data;
+	errno = 0;
+	write->error = writeMMBitmapToFD(&write->bitmap, write->fd, write->type,
+	                                 write->options.level, write->options.filters,
+	                                 write->chunkSize, &write->written);
+	write->errorNumber = errno;
+}
+
+static void CompleteWriteImage(napi_env env, napi_status status, void* data)
+{
+	WriteImageData* write = (WriteImageData*)data;
+	napi_value result;
+
+	if (status == napi_ok && write->error == 0) {
+		napi_create_double(env, (double)write->written, &result);
+		napi_resolve_deferred(env, write->deferred, result);
+	} else {
+		char buffer[128];
+		napi_value message;
+		if (write->errorNumber != 0) {
+			snprintf(buffer, sizeof(buffer), "Failed to write image: %s", strerror(write->errorNumber));
+		} else {
+			snprintf(buffer, sizeof(buffer), "Failed to encode image");
+		}
+		napi_create_string_utf8(env, buffer, NAPI_AUTO_LENGTH, &message);
+		napi_create_error(env, NULL, message, &result);
+		napi_reject_deferred(env, write->deferred, result);
+	}
+
+	napi_delete_reference(env, write->imageRef);
+	napi_delete_async_work(env, write->work);
+	delete write;
+}
+
+#endif
+
+napi_value CreateImageEncoder(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc < 1 || argc > 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	ImageEncoderHandle* handle = new ImageEncoderHandle();
+	napi_value image;
+	MMImageType type;
+	MMPNGOptions options;
+	const char* error = GetBitmapView(env, args[0], &handle->bitmap, &image);
+	if (error == NULL) {
+		error = GetImageOptions(env, argc == 2 ? args[1] : NULL, &type, &options, &handle->chunkSize);
+	}
+	if (error == NULL) {
+		handle->encoder = createMMImageEncoder(&handle->bitmap, type, options.level, options.filters);
+		if (handle->encoder == NULL) error = "Failed to create image encoder.";
+	}
+
+	if (error != NULL) {
+		delete handle;
+		napi_throw_error(env, NULL, error);
+		return NULL;
+	}
+
+	napi_value result;
+	napi_create_reference(env, image, 1, &handle->imageRef);
+	napi_create_external(env, handle, FreeImageEncoder, NULL, &result);
+	napi_type_tag_object(env, result, &kImageEncoderTypeTag);
+	return result;
+#else
+	napi_throw_error(env, NULL, "createImageEncoder is only supported on Linux");
+	return NULL;
+#endif
+}
+
+napi_value ReadImageEncoder(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 1) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	napi_valuetype type;
+	ImageEncoderHandle* handle = NULL;
+	bool isEncoder = false;
+	napi_typeof(env, args[0], &type);
+	if (type != napi_external ||
+	    napi_check_object_type_tag(env, args[0], &kImageEncoderTypeTag, &isEncoder) != napi_ok || !isEncoder ||
+	    napi_get_value_external(env, args[0], (void**)&handle) != napi_ok) {
+		napi_throw_error(env, NULL, "Expected an image encoder.");
+		return NULL;
+	}
+	if (handle->busy) {
+		napi_throw_error(env, NULL, "The image encoder is already being read from.");
+		return NULL;
+	}
+
+	ReadImageData* read = new ReadImageData();
+	read->handle = handle;
+	read->chunk = (uint8_t*)malloc(handle->chunkSize);
+	if (read->chunk == NULL) {
+		delete read;
+		napi_throw_error(env, NULL, "Out of memory.");
+		return NULL;
+	}
+
+	handle->busy = true;
+
+	napi_value promise, name;
+	napi_create_promise(env, &read->deferred, &promise);
+	napi_create_reference(env, args[0], 1, &read->handleRef);
+	napi_create_string_utf8(env, "robotjs.readImageEncoder", NAPI_AUTO_LENGTH, &name);
+	napi_create_async_work(env, NULL, name, ExecuteReadImage, CompleteReadImage, read, &read->work);
+	napi_queue_async_work(env, read->work);
+
+	return promise;
+#else
+	napi_throw_error(env, NULL, "readImageEncoder is only supported on Linux");
+	return NULL;
+#endif
+}
+
+napi_value WriteImageToFD(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 3;
+	napi_value args[3];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc < 2 || argc > 3) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	WriteImageData* write = new WriteImageData();
+	napi_value image;
+	int32_t fd;
+	const char* error = GetBitmapView(env, args[0], &write->bitmap, &image);
+	if (error == NULL && (napi_get_value_int32(env, args[1], &fd) != napi_ok || fd < 0)) {
+		error = "Invalid file descriptor.";
+	}
+	if (error == NULL) {
+		error = GetImageOptions(env, argc == 3 ? args[2] : NULL, &write->type, &write->options, &write->chunkSize);
+	}
+
+	if (error != NULL) {
+		delete write;
+		napi_throw_error(env, NULL, error);
+		return NULL;
+	}
+
+	write->fd = fd;
+
+	napi_value promise, name;
+	napi_create_promise(env, &write->deferred, &promise);
+	napi_create_reference(env, image, 1, &write->imageRef);
+	napi_create_string_utf8(env, "robotjs.writeImageToFD", NAPI_AUTO_LENGTH, &name);
+	napi_create_async_work(env, NULL, name, ExecuteWriteImage, CompleteWriteImage, write, &write->work);
+	napi_queue_async_work(env, write->work);
+
+	return promise;
+#else
+	napi_throw_error(env, NULL, "writeImageToFD is only supported on Linux");
+	return NULL;
+#endif
+}
+
+static void FreeMappedBitmap(napi_env env, void* data, void* hint)
+{
+	unmapMMBitmapFile((MMMappedBitmapRef)hint);
+}
+
+static napi_value CreateColorString(napi_env env, MMRGBHex color)
+{
+	char hex[8];
+	hex[0] = '#';
+	padHex(color, hex + 1);
+
+	napi_value result;
+	napi_create_string_utf8(env, hex, NAPI_AUTO_LENGTH, &result);
+	return result;
+}
+
+// Reads string argument |value| into |buf|. Returns false if it isn't a
+// string or doesn't fit.
+static bool GetPathArgument(napi_env env, napi_value value, char* buf, size_t len)
+{
+	size_t copied;
+	return napi_get_value_string_utf8(env, value, buf, len, &copied) == napi_ok &&
+	       copied < len - 1;
+}
+
+static void SetNumberProperty(napi_env env, napi_value obj, const char* name, double number)
+{
+	napi_value value;
+	napi_create_double(env, number, &value);
+	napi_set_named_property(env, obj, name, value);
+}
+
+napi_value MapBitmap(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	char path[4096];
+	if (argc != 1 || !GetPathArgument(env, args[0], path, sizeof(path))) {
+		napi_throw_error(env, NULL, "Expected a path.");
+		return NULL;
+	}
+
+	MMMappedBitmapReadError error;
+	MMMappedBitmapRef mapped = mapMMBitmapFile(path, &error);
+	if (mapped == NULL) {
+		const char* message = MMMappedBitmapReadErrorString(error);
+		napi_throw_error(env, NULL, message != NULL ? message : "Could not load mapped bitmap");
+		return NULL;
+	}
+
+	const MMBitmap bitmap = mapped->bitmap;
+	const MMNeedleSignature needle = mapped->signature;
+	const size_t length = (size_t)bitmap.bytewidth * bitmap.height;
+	napi_value image;
+
+	// The buffer's memory is the mapping itself. Where external buffers aren't
+	// allowed (e.g. Electron's memory cage) the pixels get copied instead.
+	if (napi_create_external_buffer(env, length, bitmap.imageBuffer, FreeMappedBitmap, mapped, &image) != napi_ok) {
+		void* data;
+		napi_status status = napi_create_buffer_copy(env, length, bitmap.imageBuffer, &data, &image);
+		unmapMMBitmapFile(mapped);
+		if (status != napi_ok) {
+			napi_throw_error(env, NULL, "Could not load mapped bitmap");
+			return NULL;
+		}
+	}
+
+	napi_value obj, signature, checksum;
+	napi_create_object(env, &obj);
+	SetNumberProperty(env, obj, "width", bitmap.width);
+	SetNumberProperty(env, obj, "height", bitmap.height);
+	SetNumberProperty(env, obj, "byteWidth", bitmap.bytewidth);
+	SetNumberProperty(env, obj, "bitsPerPixel", bitmap.bitsPerPixel);
+	SetNumberProperty(env, obj, "bytesPerPixel", bitmap.bytesPerPixel);
+	napi_set_named_property(env, obj, "image", image);
+
+	napi_create_object(env, &signature);
+	napi_create_bigint_uint64(env, needle.checksum, &checksum);
+	napi_set_named_property(env, signature, "checksum", checksum);
+	napi_set_named_property(env, signature, "firstColor", CreateColorString(env, needle.firstColor));
+	napi_set_named_property(env, signature, "anchorColor", CreateColorString(env, needle.anchorColor));
+	SetNumberProperty(env, signature, "anchorX", needle.anchorX);
+	SetNumberProperty(env, signature, "anchorY", needle.anchorY);
+	SetNumberProperty(env, signature, "colorCount", needle.colorCount);
+	napi_set_named_property(env, obj, "signature", signature);
+
+	return obj;
+}
+
+napi_value SaveMappedBitmap(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	MMBitmap bitmap;
+	napi_value image;
+	char path[4096];
+	const char* error = GetBitmapView(env, args[0], &bitmap, &image);
+	if (error == NULL && !GetPathArgument(env, args[1], path, sizeof(path))) {
+		error = "Expected a path.";
+	}
+	if (error == NULL && saveMMBitmapAsMapped(&bitmap, path) != 0) {
+		error = "Could not save mapped bitmap";
+	}
+
+	if (error != NULL) {
+		napi_throw_error(env, NULL, error);
+	}
+	return NULL;
+}
+
+napi_value ConvertToMappedBitmap(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	char input[4096], output[4096];
+	if (argc != 2 || !GetPathArgument(env, args[0], input, sizeof(input)) ||
+	    !GetPathArgument(env, args[1], output, sizeof(output))) {
+		napi_throw_error(env, NULL, "Expected input and output paths.");
+		return NULL;
+	}
+
+	const MMImageType type = imageTypeFromExtension(getExtension(input, strlen(input)));
+	MMIOError error;
+	MMBitmapRef bitmap = newMMBitmapFromFile(input, type, &error);
+	if (bitmap == NULL) {
+		const char* message = MMIOErrorString(type, error);
+		char buffer[512];
+		snprintf(buffer, sizeof(buffer), "Could not read %s: %s", input,
+		         message != NULL ? message : "Unknown error");
+		napi_throw_error(env, NULL, buffer);
+		return NULL;
+	}
+
+	const int status = saveMMBitmapAsMapped(bitmap, output);
+	destroyMMBitmap(bitmap);
+	if (status != 0) {
+		napi_throw_error(env, NULL, "Could not save mapped bitmap");
+	}
+	return NULL;
+#else
+	napi_throw_error(env, NULL, "convertToMappedBitmap is only supported on Linux");
+	return NULL;
+#endif
+}
+
+static void FreeBitmapBuffer(napi_env env, void* data, void* hint)
+{
+	free(data);
+}
+
+napi_value ReadBitmapFile(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	char path[4096];
+	if (argc != 1 || !GetPathArgument(env, args[0], path, sizeof(path))) {
+		napi_throw_error(env, NULL, "Expected a path.");
+		return NULL;
+	}
+
+	const MMImageType type = imageTypeFromExtension(getExtension(path, strlen(path)));
+	MMIOError error;
+	MMBitmapRef bitmap = newMMBitmapFromFile(path, type, &error);
+	if (bitmap == NULL) {
+		const char* message = MMIOErrorString(type, error);
+		char buffer[512];
+		snprintf(buffer, sizeof(buffer), "Could not read %s: %s", path,
+		         message != NULL ? message : "Unknown error");
+		napi_throw_error(env, NULL, buffer);
+		return NULL;
+	}
+
+	// The decoded pixels become the buffer's memory, unless external buffers
+	// aren't allowed, in which case they are copied.
+	const size_t length = (size_t)bitmap->bytewidth * bitmap->height;
+	napi_value image;
+	if (napi_create_external_buffer(env, length, bitmap->imageBuffer, FreeBitmapBuffer, NULL, &image) == napi_ok) {
+		bitmap->imageBuffer = NULL;
+	} else {
+		void* data;
+		if (napi_create_buffer_copy(env, length, bitmap->imageBuffer, &data, &image) != napi_ok) {
+			destroyMMBitmap(bitmap);
+			napi_throw_error(env, NULL, "Out of memory.");
+			return NULL;
+		}
+	}
+
+	napi_value obj;
+	napi_create_object(env, &obj);
+	SetNumberProperty(env, obj, "width", bitmap->width);
+	SetNumberProperty(env, obj, "height", bitmap->height);
+	SetNumberProperty(env, obj, "byteWidth", bitmap->bytewidth);
+	SetNumberProperty(env, obj, "bitsPerPixel", bitmap->bitsPerPixel);
+	SetNumberProperty(env, obj, "bytesPerPixel", bitmap->bytesPerPixel);
+	napi_set_named_property(env, obj, "image", image);
+
+	destroyMMBitmap(bitmap);
+	return obj;
+#else
+	napi_throw_error(env, NULL, "readBitmapFile is only supported on Linux");
+	return NULL;
+#endif
+}
+
+napi_value SaveBitmapFile(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	MMBitmap bitmap;
+	napi_value image;
+	char path[4096];
+	const char* error = GetBitmapView(env, args[0], &bitmap, &image);
+	if (error == NULL && !GetPathArgument(env, args[1], path, sizeof(path))) {
+		error = "Expected a path.";
+	}
+	if (error == NULL &&
+	    saveMMBitmapToFile(&bitmap, path, imageTypeFromExtension(getExtension(path, strlen(path)))) != 0) {
+		error = "Could not save bitmap";
+	}
+
+	if (error != NULL) {
+		napi_throw_error(env, NULL, error);
+	}
+	return NULL;
+#else
+	napi_throw_error(env, NULL, "saveBitmapFile is only supported on Linux");
+	return NULL;
+#endif
+}
+
+napi_value EncodeBitmapString(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc != 1) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	MMBitmap bitmap;
+	napi_value image;
+	const char* error = GetBitmapView(env, args[0], &bitmap, &image);
+	if (error != NULL) {
+		napi_throw_error(env, NULL, error);
+		return NULL;
+	}
+
+	MMBMPStringError err = kMMBMPStringGenericError;
+	size_t length;
+	uint8_t* string = createStringFromMMBitmap(&bitmap, &err, &length);
+	if (string == NULL) {
+		const char* message = MMBitmapStringErrorString(err);
+		napi_throw_error(env, NULL, message != NULL ? message : "Could not encode bitmap");
+		return NULL;
+	}
+
+	napi_value result;
+	napi_create_string_latin1(env, (const char*)string, length, &result);
+	free(string);
+	return result;
+#else
+	napi_throw_error(env, NULL, "Bitmap strings are only supported on Linux");
+	return NULL;
+#endif
+}
+
+napi_value DecodeBitmapString(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	size_t length;
+	if (argc != 1 || napi_get_value_string_latin1(env, args[0], NULL, 0, &length) != napi_ok) {
+		napi_throw_error(env, NULL, "Expected a bitmap string.");
+		return NULL;
+	}
+
+	std::vector<char> string(length + 1);
+	napi_get_value_string_latin1(env, args[0], string.data(), string.size(), &length);
+
+	size_t width, height;
+	if (MMBitmapStringSize((const uint8_t*)string.data(), length, &width, &height) != 0) {
+		napi_throw_error(env, NULL, MMBitmapStringErrorString(kMMBMPStringInvalidHeaderError));
+		return NULL;
+	}
+
+	// Decode straight into the buffer handed back to JS.
+	const size_t byteWidth = width * 3;
+	napi_value image;
+	void* data;
+	if (napi_create_buffer(env, byteWidth * height, &data, &image) != napi_ok) {
+		napi_throw_error(env, NULL, "Out of memory.");
+		return NULL;
+	}
+
+	MMBMPStringError err = kMMBMPStringGenericError;
+	if (readMMBitmapString((const uint8_t*)string.data(), length, (uint8_t*)data,
+	                       byteWidth * height, &err) != 0) {
+		const char* message = MMBitmapStringErrorString(err);
+		napi_throw_error(env, NULL, message != NULL ? message : "Could not decode bitmap string");
+		return NULL;
+	}
+
+	napi_value obj;
+	napi_create_object(env, &obj);
+	SetNumberProperty(env, obj, "width", (double)width);
+	SetNumberProperty(env, obj, "height", (double)height);
+	SetNumberProperty(env, obj, "byteWidth", (double)byteWidth);
+	SetNumberProperty(env, obj, "bitsPerPixel", 24);
+	SetNumberProperty(env, obj, "bytesPerPixel", 3);
+	napi_set_named_property(env, obj, "image", image);
+	return obj;
+#else
+	napi_throw_error(env, NULL, "Bitmap strings are only supported on Linux");
+	return NULL;
+#endif
+}
+
+// A Bitmap, as JS sees it, is an object wrapping a BitmapHandle. Captures
+// hand their pixels straight to one, and colorAt(), crop(), find() and toPNG()
+// read them where they are; the image buffer is only made the first time
+// .image is read, so a capture that is only searched or encoded is never
+// converted. crop() copies nothing either: it makes a view into the same
+// pixels, which holds on to the handle they belong to.
+
+static void ReleaseBitmapHandle(napi_env env, BitmapHandle* handle)
+{
+	if (--handle->users > 0) return;
+	if (handle->imageRef != NULL) napi_delete_reference(env, handle->imageRef);
+	if (handle->owned != NULL) {
+		int64_t change;
+		napi_adjust_external_memory(env, -(int64_t)MMBitmapBufferSize(handle->owned), &change);
+		destroyMMBitmap(handle->owned);
+	}
+	if (handle->parent != NULL) ReleaseBitmapHandle(env, handle->parent);
+	delete handle;
+}
+
+static void FinalizeBitmap(napi_env env, void* data, void* hint)
+{
+	BitmapHandle* handle = (BitmapHandle*)data;
+
+	// A lent buffer holds the handle in turn, so is let go of here; any other
+	// stays until the last view is done with the pixels.
+	if (handle->lent) {
+		napi_delete_reference(env, handle->imageRef);
+		handle->imageRef = NULL;
+	}
+	ReleaseBitmapHandle(env, handle);
+}
+
+static void FreeBitmapPixels(napi_env env, void* data, void* hint)
+{
+	ReleaseBitmapHandle(env, (BitmapHandle*)hint);
+}
+
+static void DeleteBitmapConstructor(napi_env env, void* data, void* hint)
+{
+	napi_delete_reference(env, (napi_ref)data);
+}
+
+// new Bitmap(width, height, byteWidth, bitsPerPixel, bytesPerPixel, image)
+// views the pixels of buffer |image|. WrapBitmapHandle() passes a single
+// external instead, tagged with kBitmapHandleTypeTag, the BitmapHandle to
+// take over.
+static napi_value BitmapConstructor(napi_env env, napi_callback_info info)
+{
+	size_t argc = 6;
+	napi_value args[6], self, target;
+	napi_get_cb_info(env, info, &argc, args, &self, NULL);
+
+	napi_get_new_target(env, info, &target);
+	if (target == NULL) {
+		napi_throw_type_error(env, NULL, "Bitmap must be called with new.");
+		return NULL;
+	}
+
+	BitmapHandle* handle;
+	napi_valuetype type = napi_undefined;
+	bool isHandle = false;
+	if (argc >= 1) napi_typeof(env, args[0], &type);
+	if (argc == 1 && type == napi_external &&
+	    napi_check_object_type_tag(env, args[0], &kBitmapHandleTypeTag, &isHandle) != napi_ok) {
+		isHandle = false;
+	}
+
+	if (isHandle) {
+		void* data;
+		napi_get_value_external(env, args[0], &data);
+		handle = (BitmapHandle*)data;
+	} else {
+		handle = new BitmapHandle();
+		handle->users = 1;
+
+		uint32_t values[5];
+		const char* error = argc == 6 ? NULL : "Invalid number of arguments.";
+		for (size_t i = 0; error == NULL && i < 5; i++) {
+			if (napi_get_value_uint32(env, args[i], &values[i]) != napi_ok) error = "Invalid bitmap.";
+		}
+		if (error == NULL) {
+			error = SetBitmapView(env, &handle->bitmap, values[0], values[1], values[2],
+			                      values[3], values[4], args[5]);
+		}
+		if (error != NULL) {
+			delete handle;
+			napi_throw_type_error(env, NULL, error);
+			return NULL;
+		}
+		napi_create_reference(env, args[5], 1, &handle->imageRef);
+	}
+
+	napi_type_tag_object(env, self, &kBitmapTypeTag);
+	napi_wrap(env, self, handle, FinalizeBitmap, NULL, NULL);
+	return self;
+}
+
+// Hands |handle|, with its one user, over to a new Bitmap. It is released if
+// that fails, in which case an exception is pending and NULL is returned.
+static napi_value WrapBitmapHandle(napi_env env, BitmapHandle* handle)
+{
+	void* data = NULL;
+	napi_value constructor, external, result;
+	napi_get_instance_data(env, &data);
+	if (data == NULL ||
+	    napi_get_reference_value(env, (napi_ref)data, &constructor) != napi_ok ||
+	    napi_create_external(env, handle, NULL, NULL, &external) != napi_ok ||
+	    napi_type_tag_object(env, external, &kBitmapHandleTypeTag) != napi_ok ||
+	    napi_new_instance(env, constructor, 1, &external, &result) != napi_ok) {
+		bool pending = false;
+		ReleaseBitmapHandle(env, handle);
+		napi_is_exception_pending(env, &pending);
+		if (!pending) napi_throw_error(env, NULL, "Failed to create bitmap");
+		return NULL;
+	}
+	return result;
+}
+
+// Hands |bitmap| over to a new Bitmap; see WrapBitmapHandle().
+static napi_value NewBitmap(napi_env env, MMBitmapRef bitmap)
+{
+	// Tell the GC what the pixels cost, now that no buffer holds them.
+	int64_t change;
+	napi_adjust_external_memory(env, (int64_t)MMBitmapBufferSize(bitmap), &change);
+
+	BitmapHandle* handle = new BitmapHandle();
+	handle->bitmap = *bitmap;
+	handle->owned = bitmap;
+	handle->users = 1;
+	return WrapBitmapHandle(env, handle);
+}
+
+// A Bitmap that is a view of |rect| of |handle|'s pixels, which must lie
+// inside them. Views of views hold on to the handle that has the pixels, not
+// a chain.
+static napi_value NewBitmapView(napi_env env, BitmapHandle* handle, MMSignedRect rect)
+{
+	BitmapHandle* view = new BitmapHandle();
+	MMBitmapViewOfPortion(&handle->bitmap, rect, &view->bitmap);
+	view->parent = handle->parent != NULL ? handle->parent : handle;
+	view->parent->users++;
+	view->users = 1;
+	return WrapBitmapHandle(env, view);
+}
+
+// The Bitmap a method was called on, with up to |*argc| of its arguments.
+// Throws and returns NULL if |this| isn't one.
+static BitmapHandle* GetThisBitmap(napi_env env, napi_callback_info info, size_t* argc,
+                                   napi_value* args, napi_value* self, void** data = NULL)
+{
+	napi_get_cb_info(env, info, argc, args, self, data);
+	BitmapHandle* handle = UnwrapBitmap(env, *self);
+	if (handle == NULL) napi_throw_type_error(env, NULL, "Expected a bitmap.");
+	return handle;
+}
+
+enum BitmapField
+{
+	kBitmapWidth,
+	kBitmapHeight,
+	kBitmapByteWidth,
+	kBitmapBitsPerPixel,
+	kBitmapBytesPerPixel
+};
+
+static napi_value GetBitmapField(napi_env env, napi_callback_info info)
+{
+	size_t argc = 0;
+	napi_value self;
 	void* data;
-	napi_create_buffer_copy(env, bufferSize, bitmap->imageBuffer, &data, &buffer);
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, NULL, &self, &data);
+	if (handle == NULL) return NULL;
+
+	int32_t value = 0;
+	switch ((BitmapField)(intptr_t)data) {
+		case kBitmapWidth: value = handle->bitmap.width; break;
+		case kBitmapHeight: value = handle->bitmap.height; break;
+		case kBitmapByteWidth: value = handle->bitmap.bytewidth; break;
+		case kBitmapBitsPerPixel: value = handle->bitmap.bitsPerPixel; break;
+		case kBitmapBytesPerPixel: value = handle->bitmap.bytesPerPixel; break;
+	}
+
+	napi_value result;
+	napi_create_int32(env, value, &result);
+	return result;
+}
+
+static napi_value GetBitmapImage(napi_env env, napi_callback_info info)
+{
+	size_t argc = 0;
+	napi_value self, image;
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, NULL, &self);
+	if (handle == NULL) return NULL;
+
+	if (handle->imageRef != NULL) {
+		napi_get_reference_value(env, handle->imageRef, &image);
+		return image;
+	}
+
+	// Lend our own pixels to the buffer, which keeps the handle alive in
+	// turn. A view's are copied, since V8 won't wrap memory that is already
+	// wrapped, as are our own where external buffers aren't allowed at all;
+	// such an image is a snapshot, and writes to it aren't seen here.
+	const MMBitmap* bitmap = &handle->bitmap;
+	const size_t length = MMBitmapBufferSize(bitmap);
+	ScopedStat stat(kMMStatConvert);
+	stat.bytes = length;
+	if (handle->owned != NULL &&
+	    napi_create_external_buffer(env, length, bitmap->imageBuffer, FreeBitmapPixels, handle, &image) == napi_ok) {
+		handle->users++;
+		handle->lent = true;
+	} else {
+		void* data;
+		if (napi_create_buffer_copy(env, length, bitmap->imageBuffer, &data, &image) != napi_ok) {
+			napi_throw_error(env, NULL, "Out of memory.");
+			return NULL;
+		}
+	}
+
+	napi_create_reference(env, image, 1, &handle->imageRef);
+	return image;
+}
+
+static napi_value BitmapColorAt(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value args[2], self;
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, args, &self);
+	if (handle == NULL) return NULL;
+
+	if (argc != 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	return GetBitmapColor(env, &handle->bitmap, args[0], args[1]);
+}
+
+// crop(x, y, width, height) returns a view of part of the bitmap, which reads
+// the same pixels.
+static napi_value BitmapCrop(napi_env env, napi_callback_info info)
+{
+	size_t argc = 4;
+	napi_value args[4], self;
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, args, &self);
+	if (handle == NULL) return NULL;
+
+	double rect[4];
+	if (argc != 4) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+	for (size_t i = 0; i < 4; i++) {
+		if (napi_get_value_double(env, args[i], &rect[i]) != napi_ok || rect[i] != (int32_t)rect[i]) {
+			napi_throw_type_error(env, NULL, "Expected integer coordinates.");
+			return NULL;
+		}
+	}
+
+	const MMBitmap* bitmap = &handle->bitmap;
+	if (rect[0] < 0 || rect[1] < 0 || rect[2] < 1 || rect[3] < 1 ||
+	    rect[0] + rect[2] > bitmap->width || rect[1] + rect[3] > bitmap->height) {
+		napi_throw_range_error(env, NULL, "Requested coordinates are outside the bitmap's dimensions.");
+		return NULL;
+	}
+
+	ScopedStat stat(kMMStatObject);
+	return NewBitmapView(env, handle,
+		MMSignedRectMake((int32_t)rect[0], (int32_t)rect[1], (int32_t)rect[2], (int32_t)rect[3]));
+}
+
+// find(needle, {x, y, width, height, tolerance}) looks for |needle| in the
+// bitmap, or the region of it given, and returns the top left corner of the
+// first match, row by row, or null.
+static napi_value BitmapFind(napi_env env, napi_callback_info info)
+{
+	ArenaScope arena;
+	size_t argc = 2;
+	napi_value args[2], self;
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, args, &self);
+	if (handle == NULL) return NULL;
+
+	if (argc < 1 || argc > 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	MMBitmap needle;
+	napi_value image;
+	const char* error = GetBitmapView(env, args[0], &needle, &image);
+	if (error != NULL) {
+		napi_throw_type_error(env, NULL, error);
+		return NULL;
+	}
+
+	MMBitmap* haystack = &handle->bitmap;
+	double tolerance = 0;
+	double x = 0, y = 0, width = haystack->width, height = haystack->height;
+	if (argc == 2) {
+		napi_valuetype type;
+		napi_typeof(env, args[1], &type);
+		if (type == napi_object) {
+			GetNumberProperty(env, args[1], "tolerance", &tolerance);
+			const bool hasX = GetNumberProperty(env, args[1], "x", &x);
+			const bool hasY = GetNumberProperty(env, args[1], "y", &y);
+			const bool hasWidth = GetNumberProperty(env, args[1], "width", &width);
+			const bool hasHeight = GetNumberProperty(env, args[1], "height", &height);
+			if ((hasX || hasY || hasWidth || hasHeight) &&
+			    (!hasX || !hasY || !hasWidth || !hasHeight || width < 1 || height < 1)) {
+				napi_throw_type_error(env, NULL, "A region needs x, y and a positive width and height.");
+				return NULL;
+			}
+		} else if (type != napi_undefined) {
+			napi_throw_type_error(env, NULL, "Invalid options.");
+			return NULL;
+		}
+	}
+	if (tolerance < 0 || tolerance > 1) {
+		napi_throw_type_error(env, NULL, "Invalid tolerance; expected 0 to 1.");
+		return NULL;
+	}
+	if (x < 0 || y < 0 || x + width > haystack->width || y + height > haystack->height) {
+		napi_throw_range_error(env, NULL, "Requested coordinates are outside the bitmap's dimensions.");
+		return NULL;
+	}
+
+	MMPoint point;
+	napi_value result;
+	if (findBitmapInRectFromAnchor(&needle, haystack, &point,
+	                               MMRectMake((size_t)x, (size_t)y, (size_t)width, (size_t)height),
+	                               (float)tolerance, GetNeedleAnchor(env, args[0], &needle)) != 0) {
+		napi_get_null(env, &result);
+		return result;
+	}
+
+	napi_create_object(env, &result);
+	SetNumberProperty(env, result, "x", (double)point.x);
+	SetNumberProperty(env, result, "y", (double)point.y);
+	return result;
+}
+
+static napi_value BitmapToPNG(napi_env env, napi_callback_info info)
+{
+#if defined(USE_LIBPNG)
+	size_t argc = 1;
+	napi_value args[1], self;
+	BitmapHandle* handle = GetThisBitmap(env, info, &argc, args, &self);
+	if (handle == NULL) return NULL;
+
+	return StartEncodePNG(env, self, argc == 1 ? args[0] : NULL);
+#else
+	napi_throw_error(env, NULL, "encodePNG is only supported on Linux");
+	return NULL;
+#endif
+}
 
-	napi_value obj;
-	napi_create_object(env, &obj);
-	napi_value width, height, byteWidth, bitsPerPixel, bytesPerPixel;
-	napi_create_int32(env, bitmap->width, &width);
-	napi_create_int32(env, bitmap->height, &height);
-	napi_create_int32(env, bitmap->bytewidth, &byteWidth);
-	napi_create_int32(env, bitmap->bitsPerPixel, &bitsPerPixel);
-	napi_create_int32(env, bitmap->bytesPerPixel, &bytesPerPixel);
-	napi_set_named_property(env, obj, "width", width);
-	napi_set_named_property(env, obj, "height", height);
-	napi_set_named_property(env, obj, "byteWidth", byteWidth);
-	napi_set_named_property(env, obj, "bitsPerPixel", bitsPerPixel);
-	napi_set_named_property(env, obj, "bytesPerPixel", bytesPerPixel);
-	napi_set_named_property(env, obj, "image", buffer);
+// Defines the Bitmap class on |exports|, and keeps its constructor for
+// NewBitmap().
+static bool DefineBitmapClass(napi_env env, napi_value exports)
+{
+	#define BITMAP_FIELD(name, field) \
+		{ name, NULL, NULL, GetBitmapField, NULL, NULL, napi_enumerable, (void*)(intptr_t)field }
+	#define BITMAP_METHOD(name, func) \
+		{ name, NULL, func, NULL, NULL, NULL, napi_default, NULL }
+
+	const napi_property_descriptor properties[] = {
+		BITMAP_FIELD("width", kBitmapWidth),
+		BITMAP_FIELD("height", kBitmapHeight),
+		BITMAP_FIELD("byteWidth", kBitmapByteWidth),
+		BITMAP_FIELD("bitsPerPixel", kBitmapBitsPerPixel),
+		BITMAP_FIELD("bytesPerPixel", kBitmapBytesPerPixel),
+		{ "image", NULL, NULL, GetBitmapImage, NULL, NULL, napi_enumerable, NULL },
+		BITMAP_METHOD("colorAt", BitmapColorAt),
+		BITMAP_METHOD("crop", BitmapCrop),
+		BITMAP_METHOD("find", BitmapFind),
+		BITMAP_METHOD("toPNG", BitmapToPNG)
+	};
+
+	#undef BITMAP_FIELD
+	#undef BITMAP_METHOD
+
+	napi_value constructor;
+	napi_ref ref;
+	if (napi_define_class(env, "Bitmap", NAPI_AUTO_LENGTH, BitmapConstructor, NULL,
+	                      sizeof(properties) / sizeof(properties[0]), properties,
+	                      &constructor) != napi_ok ||
+	    napi_create_reference(env, constructor, 1, &ref) != napi_ok) {
+		return false;
+	}
+	if (napi_set_instance_data(env, ref, DeleteBitmapConstructor, NULL) != napi_ok) {
+		napi_delete_reference(env, ref);
+		return false;
+	}
+	return napi_set_named_property(env, exports, "Bitmap", constructor) == napi_ok;
+}
 
-	destroyMMBitmap(bitmap);
+// A waitForPixel(), waitForPixels() or waitForBitmap() in flight. It polls on
+// a thread of its own rather than the libuv pool, since a wait can last as
+// long as its timeout, and hands the outcome back through |done|.
+struct ScreenWait
+{
+	// For pixel waits.
+	std::vector<MMPixelCondition> conditions;
+	bool all;            // Every condition has to be met, not just one.
+	bool single;         // Resolve with the one match rather than an array.
+
+	// For bitmap waits, which have a needle.
+	bool isBitmap;
+	MMBitmap needle;
+	MMPoint anchor;      // See GetNeedleAnchor().
+	napi_ref needleRef;  // Keeps the needle's pixels alive.
+	MMSignedRect rect;
+	float tolerance;
+	MMSignedPoint found;
+
+	MMTimestamp timeout;
+	MMTimestamp maxInterval;
+
+	napi_deferred deferred;
+	napi_threadsafe_function done;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool cancelled;
+
+	int outcome;         // Set by the thread: 1 met, 0 timed out, -1 failed.
+};
 
-	return obj;
+// Polls fast while the watched pixels are changing, and backs off, up to
+// maxInterval, while they hold still.
+static const MMTimestamp kScreenWaitMinInterval = MMTimestampFromMilliseconds(1);
+
+// The longest timeoutMs or maxIntervalMs a wait accepts: setTimeout's limit,
+// about 24.8 days.
+static const double kScreenWaitMaxMilliseconds = 2147483647.0;
+
+// Reads the screen once for |wait|. Returns 1 if what it waits for is there,
+// 0 if not, or -1 if the screen could not be read.
+static int PollScreenWait(ScreenWait* wait, MMPixelWatchRef pixelWatch,
+                          MMBitmapWatchRef bitmapWatch, bool* changed)
+{
+	if (wait->isBitmap) return pollMMBitmapWatch(bitmapWatch, &wait->found, changed);
+
+	const int met = pollMMPixelWatch(pixelWatch, changed);
+	if (met < 0) return -1;
+	return (wait->all ? (size_t)met == wait->conditions.size() : met > 0) ? 1 : 0;
 }
 
-/*
- ____  _ _
-| __ )(_) |_ _ __ ___   __ _ _ __
-|  _ \| | __| '_ ` _ \ / _` | '_ \
-| |_) | | |_| | | | | | (_| | |_) |
-|____/|_|\__|_| |_| |_|\__,_| .__/
-                            |_|
- */
+static void RunScreenWait(ScreenWait* wait)
+{
+	const MMTimestamp start = MMTimestampNow();
+	MMTimestamp interval = kScreenWaitMinInterval;
+	MMPixelWatchRef pixelWatch = NULL;
+	MMBitmapWatchRef bitmapWatch = NULL;
+
+	if (wait->isBitmap) {
+		bitmapWatch = createMMBitmapWatch(&wait->needle, wait->anchor, wait->rect, wait->tolerance);
+	} else {
+		pixelWatch = createMMPixelWatch(wait->conditions.data(), wait->conditions.size());
+	}
+
+	wait->outcome = -1;
+	while (pixelWatch != NULL || bitmapWatch != NULL) {
+		bool changed;
+		const int found = PollScreenWait(wait, pixelWatch, bitmapWatch, &changed);
+		if (found != 0) {
+			wait->outcome = found;
+			break;
+		}
 
-class BMP
+		const MMTimestamp elapsed = MMTimestampNow() - start;
+		if (elapsed >= wait->timeout) {
+			wait->outcome = 0;
+			break;
+		}
+
+		interval = changed ? kScreenWaitMinInterval : interval * 2;
+		if (interval > wait->maxInterval) interval = wait->maxInterval;
+		const MMTimestamp pause = interval < wait->timeout - elapsed ? interval : wait->timeout - elapsed;
+
+		std::unique_lock<std::mutex> lock(wait->mutex);
+		if (wait->wake.wait_for(lock, std::chrono::nanoseconds(pause),
+		                        [wait] { return wait->cancelled; })) {
+			break;
+		}
+	}
+	destroyMMPixelWatch(pixelWatch);
+	destroyMMBitmapWatch(bitmapWatch);
+	MMArenaRelease(); // The searches' arena dies with the thread.
+
+	napi_call_threadsafe_function(wait->done, wait, napi_tsfn_blocking);
+	napi_release_threadsafe_function(wait->done, napi_tsfn_release);
+}
+
+static napi_value CreatePixelMatch(napi_env env, const MMPixelCondition& condition)
 {
-	public:
-		uint32_t width;
-		uint32_t height;
-		uint32_t byteWidth;
-		uint32_t bitsPerPixel;
-		uint32_t bytesPerPixel;
-		uint8_t *image;
-};
+	napi_value match;
+	if (!condition.met) {
+		napi_get_null(env, &match);
+		return match;
+	}
+
+	napi_create_object(env, &match);
+	SetNumberProperty(env, match, "x", condition.match.x);
+	SetNumberProperty(env, match, "y", condition.match.y);
+	napi_set_named_property(env, match, "color", CreateColorString(env, condition.matchColor));
+	return match;
+}
+
+static void StopScreenWait(void* data);
 
-//Convert object from Javascript to a C++ class (BMP).
-BMP buildBMP(napi_env env, napi_value info)
+// Settles the wait's promise on the JS thread. |env| is NULL if the
+// environment is going away, in which case StopScreenWait() has cleaned up.
+static void CompleteScreenWait(napi_env env, napi_value callback, void* context, void* data)
 {
-	BMP img;
+	ScreenWait* wait = (ScreenWait*)data;
+	if (env == NULL) return;
 
-	napi_value width, height, byteWidth, bitsPerPixel, bytesPerPixel, image;
-	napi_get_named_property(env, info, "width", &width);
-	napi_get_named_property(env, info, "height", &height);
-	napi_get_named_property(env, info, "byteWidth", &byteWidth);
-	napi_get_named_property(env, info, "bitsPerPixel", &bitsPerPixel);
-	napi_get_named_property(env, info, "bytesPerPixel", &bytesPerPixel);
-	napi_get_named_property(env, info, "image", &image);
+	wait->thread.join();
+	napi_remove_env_cleanup_hook(env, StopScreenWait, wait);
+	if (wait->isBitmap) napi_delete_reference(env, wait->needleRef);
 
-	napi_get_value_uint32(env, width, &img.width);
-	napi_get_value_uint32(env, height, &img.height);
-	napi_get_value_uint32(env, byteWidth, &img.byteWidth);
-	napi_get_value_uint32(env, bitsPerPixel, &img.bitsPerPixel);
-	napi_get_value_uint32(env, bytesPerPixel, &img.bytesPerPixel);
+	napi_value result;
+	if (wait->outcome < 0) {
+		napi_value message;
+		napi_create_string_utf8(env, "Failed to read the screen.", NAPI_AUTO_LENGTH, &message);
+		napi_create_error(env, NULL, message, &result);
+		napi_reject_deferred(env, wait->deferred, result);
+	} else {
+		if (wait->outcome == 0) {
+			napi_get_null(env, &result);
+		} else if (wait->isBitmap) {
+			napi_create_object(env, &result);
+			SetNumberProperty(env, result, "x", wait->found.x);
+			SetNumberProperty(env, result, "y", wait->found.y);
+		} else if (wait->single) {
+			result = CreatePixelMatch(env, wait->conditions[0]);
+		} else {
+			napi_create_array_with_length(env, wait->conditions.size(), &result);
+			for (size_t i = 0; i < wait->conditions.size(); i++) {
+				napi_set_element(env, result, (uint32_t)i, CreatePixelMatch(env, wait->conditions[i]));
+			}
+		}
+		napi_resolve_deferred(env, wait->deferred, result);
+	}
+
+	delete wait;
+}
 
-	void* buf;
-	size_t buf_len;
-	napi_get_buffer_info(env, image, &buf, &buf_len);
+// Cancels a wait that is still running when the environment goes away and
+// waits for its thread, leaving the promise unsettled. Registered after the
+// wait's threadsafe function, so it runs before that is torn down.
+static void StopScreenWait(void* data)
+{
+	ScreenWait* wait = (ScreenWait*)data;
+	{
+		std::lock_guard<std::mutex> lock(wait->mutex);
+		wait->cancelled = true;
+	}
+	wait->wake.notify_one();
+	wait->thread.join();
+	delete wait;
+}
 
-	// Convert the buffer to a uint8_t which createMMBitmap requires.
-	img.image = (uint8_t *)malloc(img.byteWidth * img.height);
-	memcpy(img.image, buf, img.byteWidth * img.height);
+// Reads a color given as a number (0xRRGGBB) or a "#rrggbb" or "rrggbb"
+// string.
+static bool GetColorValue(napi_env env, napi_value value, MMRGBHex* color)
+{
+	napi_valuetype type;
+	napi_typeof(env, value, &type);
+
+	if (type == napi_number) {
+		double number;
+		napi_get_value_double(env, value, &number);
+		if (number < 0 || number > 0xFFFFFF || number != (uint32_t)number) return false;
+		*color = (MMRGBHex)number;
+		return true;
+	}
 
-	return img;
+	char hex[9];
+	size_t length;
+	if (type != napi_string ||
+	    napi_get_value_string_utf8(env, value, hex, sizeof(hex), &length) != napi_ok) {
+		return false;
+	}
+	const char* digits = hex[0] == '#' ? hex + 1 : hex;
+	char* end;
+	if (strlen(digits) != 6) return false;
+	*color = (MMRGBHex)strtoul(digits, &end, 16);
+	return *end == '\0';
 }
 
-napi_value GetColor(napi_env env, napi_callback_info info)
+// Reads {x, y, color, tolerance, width, height} into |condition|, with the
+// tolerance defaulting to |tolerance|. Returns an error message, or NULL on
+// success.
+static const char* GetPixelCondition(napi_env env, napi_value obj, double tolerance,
+                                     MMPixelCondition* condition)
 {
-	size_t argc = 3;
-	napi_value args[3];
+	napi_valuetype type;
+	napi_typeof(env, obj, &type);
+	if (type != napi_object) return "Expected {x, y, color}.";
+
+	double x, y, width = 1, height = 1;
+	if (!GetNumberProperty(env, obj, "x", &x) || !GetNumberProperty(env, obj, "y", &y)) {
+		return "Expected {x, y, color}.";
+	}
+	const bool hasWidth = GetNumberProperty(env, obj, "width", &width);
+	const bool hasHeight = GetNumberProperty(env, obj, "height", &height);
+	if (hasWidth != hasHeight || width < 1 || height < 1) {
+		return "A region needs a positive width and height.";
+	}
+
+	napi_value color;
+	bool hasColor = false;
+	napi_has_named_property(env, obj, "color", &hasColor);
+	if (!hasColor || napi_get_named_property(env, obj, "color", &color) != napi_ok ||
+	    !GetColorValue(env, color, &condition->color)) {
+		return "Invalid color; expected 0xRRGGBB or \"#rrggbb\".";
+	}
+
+	GetNumberProperty(env, obj, "tolerance", &tolerance);
+	if (tolerance < 0 || tolerance > 1) return "Invalid tolerance; expected 0 to 1.";
+
+	condition->rect = MMSignedRectMake((int32_t)x, (int32_t)y, (int32_t)width, (int32_t)height);
+	condition->tolerance = (float)tolerance;
+	condition->met = false;
+	return NULL;
+}
+
+// Whether |rect| is on the main screen. The X server answers reads outside it
+// with an error that would take the process down, so none may get through.
+static bool RectOnMainScreen(MMSignedRect rect, MMSignedSize size)
+{
+	return rect.origin.x >= 0 && rect.origin.y >= 0 &&
+	       (int64_t)rect.origin.x + rect.size.width <= size.width &&
+	       (int64_t)rect.origin.y + rect.size.height <= size.height;
+}
+
+// Starts |wait|, whose conditions or needle are filled in, and returns its
+// promise. |options| may carry timeoutMs and maxIntervalMs. |image| is the
+// Buffer holding the needle's pixels, if there is one.
+static napi_value StartScreenWait(napi_env env, ScreenWait* wait, napi_value options,
+                                  napi_value image)
+{
+	double timeout = 10000, maxInterval = 10;
+	if (options != NULL) {
+		GetNumberProperty(env, options, "timeoutMs", &timeout);
+		GetNumberProperty(env, options, "maxIntervalMs", &maxInterval);
+	}
+	// Written so that NaN fails too.
+	if (!(timeout >= 0 && timeout <= kScreenWaitMaxMilliseconds) ||
+	    !(maxInterval >= 1 && maxInterval <= kScreenWaitMaxMilliseconds)) {
+		delete wait;
+		napi_throw_range_error(env, NULL, "Invalid timeoutMs or maxIntervalMs.");
+		return NULL;
+	}
+
+	const MMSignedSize size = getMainDisplaySize();
+	bool onScreen = !wait->isBitmap || RectOnMainScreen(wait->rect, size);
+	for (const MMPixelCondition& condition : wait->conditions) {
+		onScreen = onScreen && RectOnMainScreen(condition.rect, size);
+	}
+	if (!onScreen) {
+		delete wait;
+		napi_throw_range_error(env, NULL, "Requested coordinates are outside the main screen's dimensions.");
+		return NULL;
+	}
+
+	wait->timeout = MMTimestampFromMilliseconds(timeout);
+	wait->maxInterval = MMTimestampFromMilliseconds(maxInterval);
+	wait->cancelled = false;
+
+	napi_value promise, name;
+	napi_create_promise(env, &wait->deferred, &promise);
+	napi_create_string_utf8(env, wait->isBitmap ? "robotjs.waitForBitmap" : "robotjs.waitForPixel",
+	                        NAPI_AUTO_LENGTH, &name);
+	napi_create_threadsafe_function(env, NULL, NULL, name, 0, 1, NULL, NULL, NULL,
+	                                CompleteScreenWait, &wait->done);
+
+	if (wait->isBitmap) napi_create_reference(env, image, 1, &wait->needleRef);
+	napi_add_env_cleanup_hook(env, StopScreenWait, wait);
+	wait->thread = std::thread(RunScreenWait, wait);
+
+	return promise;
+}
+
+// waitForPixel({x, y, color, tolerance, width, height, timeoutMs,
+// maxIntervalMs}) resolves with {x, y, color} once the pixel (or, given a
+// width and height, any pixel of that region) is within tolerance of color,
+// or with null once timeoutMs (10 seconds by default) has passed.
+napi_value WaitForPixel(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
 	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
 
-	if (argc != 3) {
+	if (argc != 1) {
 		napi_throw_error(env, NULL, "Invalid number of arguments.");
 		return NULL;
 	}
 
-	BMP img = buildBMP(env, args[0]);
+	ScreenWait* wait = new ScreenWait();
+	wait->conditions.resize(1);
+	const char* error = GetPixelCondition(env, args[0], 0, &wait->conditions[0]);
+	if (error != NULL) {
+		delete wait;
+		napi_throw_type_error(env, NULL, error);
+		return NULL;
+	}
+	wait->all = true;
+	wait->single = true;
 
-	int32_t x, y;
-	napi_get_value_int32(env, args[1], &x);
-	napi_get_value_int32(env, args[2], &y);
+	return StartScreenWait(env, wait, args[0], NULL);
+}
 
-	MMBitmapRef bitmap = createMMBitmap(img.image, img.width, img.height, img.byteWidth, img.bitsPerPixel, img.bytesPerPixel);
+// waitForPixels(conditions, {all, tolerance, timeoutMs, maxIntervalMs}) waits
+// on several waitForPixel() conditions at once, until any (or, with all, every)
+// one is met. Resolves with an array of each condition's match, null where it
+// isn't met, or with null on timeout.
+napi_value WaitForPixels(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
 
-    if (!bitmap) {
-        napi_throw_error(env, NULL, "Failed to create bitmap");
-        return NULL;
-    }
+	bool isArray = false;
+	if (argc >= 1) napi_is_array(env, args[0], &isArray);
+	if (argc < 1 || argc > 2 || !isArray) {
+		napi_throw_type_error(env, NULL, "Expected an array of {x, y, color}.");
+		return NULL;
+	}
 
-	// Make sure the requested pixel is inside the bitmap.
-	if (!MMBitmapPointInBounds(bitmap, MMPointMake(x, y))) {
-		destroyMMBitmap(bitmap);
-		napi_throw_error(env, NULL, "Requested coordinates are outside the bitmap's dimensions.");
+	napi_value options = NULL;
+	if (argc == 2) {
+		napi_valuetype type;
+		napi_typeof(env, args[1], &type);
+		if (type == napi_object) {
+			options = args[1];
+		} else if (type != napi_undefined) {
+			napi_throw_type_error(env, NULL, "Invalid options.");
+			return NULL;
+		}
+	}
+
+	double tolerance = 0;
+	bool all = false;
+	if (options != NULL) {
+		GetNumberProperty(env, options, "tolerance", &tolerance);
+		napi_value value;
+		napi_valuetype type;
+		if (napi_get_named_property(env, options, "all", &value) == napi_ok &&
+		    napi_typeof(env, value, &type) == napi_ok && type == napi_boolean) {
+			napi_get_value_bool(env, value, &all);
+		}
+	}
+
+	uint32_t count;
+	napi_get_array_length(env, args[0], &count);
+	if (count == 0) {
+		napi_throw_type_error(env, NULL, "Expected at least one condition.");
 		return NULL;
-	}   
+	}
 
-	MMRGBHex color = MMRGBHexAtPoint(bitmap, x, y);
+	ScreenWait* wait = new ScreenWait();
+	wait->conditions.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		napi_value element;
+		napi_get_element(env, args[0], i, &element);
+		const char* error = GetPixelCondition(env, element, tolerance, &wait->conditions[i]);
+		if (error != NULL) {
+			char message[128];
+			snprintf(message, sizeof(message), "Condition %u: %s", i, error);
+			delete wait;
+			napi_throw_type_error(env, NULL, message);
+			return NULL;
+		}
+	}
+	wait->all = all;
+	wait->single = false;
 
-	char hex[8]; // Increased size to accommodate # prefix
-	hex[0] = '#';
-	padHex(color, hex + 1); // Start after the # character
-	
-	destroyMMBitmap(bitmap);
+	return StartScreenWait(env, wait, options, NULL);
+}
 
-	napi_value result;
-	napi_create_string_utf8(env, hex, NAPI_AUTO_LENGTH, &result);
-	return result;
+// waitForBitmap(needle, {x, y, width, height, tolerance, timeoutMs,
+// maxIntervalMs}) resolves with {x, y}, where the needle's top left corner is
+// on the screen, once it shows up inside the rect (the whole main screen by
+// default), or with null once timeoutMs (10 seconds by default) has passed.
+// Only the parts of the screen that changed since the last look are searched
+// again.
+napi_value WaitForBitmap(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value args[2];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	if (argc < 1 || argc > 2) {
+		napi_throw_error(env, NULL, "Invalid number of arguments.");
+		return NULL;
+	}
+
+	ScreenWait* wait = new ScreenWait();
+	napi_value image;
+	const char* error = GetBitmapView(env, args[0], &wait->needle, &image);
+	if (error != NULL) {
+		delete wait;
+		napi_throw_type_error(env, NULL, error);
+		return NULL;
+	}
+
+	napi_value options = NULL;
+	if (argc == 2) {
+		napi_valuetype type;
+		napi_typeof(env, args[1], &type);
+		if (type == napi_object) {
+			options = args[1];
+		} else if (type != napi_undefined) {
+			delete wait;
+			napi_throw_type_error(env, NULL, "Invalid options.");
+			return NULL;
+		}
+	}
+
+	double tolerance = 0;
+	double x = 0, y = 0, width = 0, height = 0;
+	bool hasRect = false;
+	if (options != NULL) {
+		GetNumberProperty(env, options, "tolerance", &tolerance);
+		const bool hasX = GetNumberProperty(env, options, "x", &x);
+		const bool hasY = GetNumberProperty(env, options, "y", &y);
+		const bool hasWidth = GetNumberProperty(env, options, "width", &width);
+		const bool hasHeight = GetNumberProperty(env, options, "height", &height);
+		hasRect = hasX || hasY || hasWidth || hasHeight;
+		if (hasRect && (!hasX || !hasY || !hasWidth || !hasHeight || width < 1 || height < 1)) {
+			delete wait;
+			napi_throw_type_error(env, NULL, "A region needs x, y and a positive width and height.");
+			return NULL;
+		}
+	}
+	if (tolerance < 0 || tolerance > 1) {
+		delete wait;
+		napi_throw_type_error(env, NULL, "Invalid tolerance; expected 0 to 1.");
+		return NULL;
+	}
+
+	if (hasRect) {
+		wait->rect = MMSignedRectMake((int32_t)x, (int32_t)y, (int32_t)width, (int32_t)height);
+	} else {
+		const MMSignedSize size = getMainDisplaySize();
+		wait->rect = MMSignedRectMake(0, 0, size.width, size.height);
+	}
+	if (wait->needle.width > wait->rect.size.width || wait->needle.height > wait->rect.size.height) {
+		delete wait;
+		napi_throw_range_error(env, NULL, "The bitmap is larger than the region searched.");
+		return NULL;
+	}
+	wait->isBitmap = true;
+	wait->anchor = GetNeedleAnchor(env, args[0], &wait->needle);
+	wait->tolerance = (float)tolerance;
+
+	return StartScreenWait(env, wait, options, image);
+}
+
+// {x, y, width, height, isMain, displayId} for getScreens(); the first screen
+// is the main one.
+static napi_value NewScreenInfo(napi_env env, MMSignedRect screen, int index)
+{
+	napi_value obj, x, y, width, height, isMain, displayId;
+	napi_create_object(env, &obj);
+	napi_create_int32(env, screen.origin.x, &x);
+	napi_create_int32(env, screen.origin.y, &y);
+	napi_create_int32(env, screen.size.width, &width);
+	napi_create_int32(env, screen.size.height, &height);
+	napi_get_boolean(env, index == 0, &isMain);
+	napi_create_int32(env, index, &displayId);
+
+	napi_set_named_property(env, obj, "x", x);
+	napi_set_named_property(env, obj, "y", y);
+	napi_set_named_property(env, obj, "width", width);
+	napi_set_named_property(env, obj, "height", height);
+	napi_set_named_property(env, obj, "isMain", isMain);
+	napi_set_named_property(env, obj, "displayId", displayId);
+	return obj;
 }
 
 napi_value GetScreens(napi_env env, napi_callback_info info) {
+    ArenaScope arena;
     int count = getScreensCount();
-    MMSignedRect* screens = (MMSignedRect*)malloc(count * sizeof(MMSignedRect));
+    MMSignedRect* screens = (MMSignedRect*)MMArenaAlloc(count * sizeof(MMSignedRect));
     if (!screens) {
         napi_value null_value;
         napi_get_null(env, &null_value);
@@ -1334,34 +3763,257 @@ napi_value GetScreens(napi_env env, napi_callback_info info) {
     napi_create_array_with_length(env, count, &array);
 
     for (int i = 0; i < count; i++) {
-        napi_value obj;
-        napi_create_object(env, &obj);
-
-        napi_value x, y, width, height, isMain, displayId;
-        napi_create_int32(env, screens[i].origin.x, &x);
-        napi_create_int32(env, screens[i].origin.y, &y);
-        napi_create_int32(env, screens[i].size.width, &width);
-        napi_create_int32(env, screens[i].size.height, &height);
-        
-        // For Windows, we'll use a simple approach - first screen is main
-        bool isMainScreen = (i == 0);
-        napi_get_boolean(env, isMainScreen, &isMain);
-        napi_create_int32(env, i, &displayId);
-
-        napi_set_named_property(env, obj, "x", x);
-        napi_set_named_property(env, obj, "y", y);
-        napi_set_named_property(env, obj, "width", width);
-        napi_set_named_property(env, obj, "height", height);
-        napi_set_named_property(env, obj, "isMain", isMain);
-        napi_set_named_property(env, obj, "displayId", displayId);
-
-        napi_set_element(env, array, i, obj);
+        napi_set_element(env, array, i, NewScreenInfo(env, screens[i], i));
     }
-    
-    free(screens);
+
     return array;
 }
 
+// captureAllScreens() captures every screen at once, each on a thread of its
+// own, into one bitmap of the virtual desktop. Returns {x, y, bitmap,
+// screens}: where the desktop's top left corner is, its bitmap, and the
+// screens as from getScreens(), each with a bitmap of its own that is a view
+// of its part of the desktop's.
+napi_value CaptureAllScreens(napi_env env, napi_callback_info info)
+{
+	ArenaScope arena;
+
+	if (!resources_valid) {
+		napi_throw_error(env, NULL, "Screen capture resources are invalid");
+		return NULL;
+	}
+
+	int count = getScreensCount();
+#if defined(IS_MACOSX)
+	// Captures there only read the main display.
+	if (count > 1) count = 1;
+#endif
+	MMSignedRect* screens = (MMSignedRect*)MMArenaAlloc(count * 2 * sizeof(MMSignedRect));
+	if (count < 1 || screens == NULL) {
+		napi_throw_error(env, NULL, "Failed to capture screens");
+		return NULL;
+	}
+	MMSignedRect* placed = screens + count;
+	getScreensInfo(screens, count);
+
+	MMBitmapRef bitmap;
+	{
+		ScopedStat stat(kMMStatCapture);
+		bitmap = copyMMBitmapFromScreens(screens, (size_t)count, placed);
+		if (bitmap != NULL) stat.bytes = (uint64_t)bitmap->bytewidth * bitmap->height;
+	}
+	if (bitmap == NULL) {
+		napi_throw_error(env, NULL, "Failed to capture screens");
+		return NULL;
+	}
+
+	ScopedStat stat(kMMStatObject);
+	napi_value desktop = NewBitmap(env, bitmap);
+	if (desktop == NULL) return NULL;
+	BitmapHandle* handle = UnwrapBitmap(env, desktop);
+
+	int32_t left = screens[0].origin.x, top = screens[0].origin.y;
+	napi_value array;
+	napi_create_array_with_length(env, count, &array);
+	for (int i = 0; i < count; i++) {
+		if (screens[i].origin.x < left) left = screens[i].origin.x;
+		if (screens[i].origin.y < top) top = screens[i].origin.y;
+
+		napi_value screen = NewScreenInfo(env, screens[i], i);
+		napi_value view = NewBitmapView(env, handle, placed[i]);
+		if (view == NULL) return NULL;
+		napi_set_named_property(env, screen, "bitmap", view);
+		napi_set_element(env, array, i, screen);
+	}
+
+	napi_value result, x, y;
+	napi_create_object(env, &result);
+	napi_create_int32(env, left, &x);
+	napi_create_int32(env, top, &y);
+	napi_set_named_property(env, result, "x", x);
+	napi_set_named_property(env, result, "y", y);
+	napi_set_named_property(env, result, "bitmap", desktop);
+	napi_set_named_property(env, result, "screens", array);
+	return result;
+}
+
+// getScreens() and the like are answered from memory while the display
+// watch (display_watch.h) runs. It is started with the first environment to
+// load the module and stopped with the last; each environment that listens
+// for 'screenschange' (see index.js) is told of changes through a
+// thread-safe function, called from the watch's thread.
+static std::mutex display_watch_mutex; // Starting and stopping the watch.
+static int display_watch_users = 0;
+static std::mutex screens_listeners_mutex;
+static std::vector<std::pair<napi_env, napi_threadsafe_function>> screens_listeners;
+
+static void NotifyScreensChange(void* context)
+{
+	std::lock_guard<std::mutex> lock(screens_listeners_mutex);
+	for (const auto& listener : screens_listeners) {
+		napi_call_threadsafe_function(listener.second, NULL, napi_tsfn_nonblocking);
+	}
+}
+
+static void CallScreensListener(napi_env env, napi_value callback, void* context, void* data)
+{
+	if (env == NULL) return;
+
+	napi_value undefined;
+	napi_get_undefined(env, &undefined);
+	napi_call_function(env, undefined, callback, 0, NULL, NULL);
+}
+
+// Drops |env|'s listener, if it has one. Also a cleanup hook, run before the
+// thread-safe function's own (hooks run last in, first out).
+static void RemoveScreensListener(void* data)
+{
+	napi_env env = (napi_env)data;
+	std::lock_guard<std::mutex> lock(screens_listeners_mutex);
+	for (auto it = screens_listeners.begin(); it != screens_listeners.end(); ++it) {
+		if (it->first == env) {
+			napi_release_threadsafe_function(it->second, napi_tsfn_release);
+			screens_listeners.erase(it);
+			return;
+		}
+	}
+}
+
+static void StartDisplayWatch()
+{
+	std::lock_guard<std::mutex> lock(display_watch_mutex);
+	if (display_watch_users++ == 0) MMDisplayWatchStart(NotifyScreensChange, NULL);
+}
+
+static void StopDisplayWatch(void* data)
+{
+	std::lock_guard<std::mutex> lock(display_watch_mutex);
+	if (--display_watch_users == 0) MMDisplayWatchStop();
+}
+
+// After setXDisplayName(), so the display watched is the one read.
+static void RestartDisplayWatch()
+{
+	std::lock_guard<std::mutex> lock(display_watch_mutex);
+	if (display_watch_users > 0) {
+		MMDisplayWatchStop();
+		MMDisplayWatchStart(NotifyScreensChange, NULL);
+	}
+}
+
+// setScreensChangeListener(fn) has fn called, with no arguments, soon after
+// displays are added, removed, resized or moved; null stops that. Returns
+// whether such changes are watched for here (X11 with RandR, for now).
+napi_value SetScreensChangeListener(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value args[1];
+	napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+
+	napi_valuetype type = napi_undefined;
+	if (argc > 0) napi_typeof(env, args[0], &type);
+	if (type != napi_function && type != napi_null && type != napi_undefined) {
+		napi_throw_type_error(env, NULL, "Expected a function or null.");
+		return NULL;
+	}
+
+	bool hadListener = false;
+	{
+		std::lock_guard<std::mutex> lock(screens_listeners_mutex);
+		for (const auto& listener : screens_listeners) {
+			if (listener.first == env) hadListener = true;
+		}
+	}
+	if (hadListener) {
+		napi_remove_env_cleanup_hook(env, RemoveScreensListener, env);
+		RemoveScreensListener(env);
+	}
+
+	if (type == napi_function) {
+		napi_value name;
+		napi_threadsafe_function listener;
+		napi_create_string_utf8(env, "robotjs.screenschange", NAPI_AUTO_LENGTH, &name);
+		if (napi_create_threadsafe_function(env, args[0], NULL, name, 0, 1, NULL, NULL, NULL,
+		                                    CallScreensListener, &listener) != napi_ok) {
+			napi_throw_error(env, NULL, "Failed to listen for screen changes");
+			return NULL;
+		}
+		// Listening mustn't keep the process alive.
+		napi_unref_threadsafe_function(env, listener);
+
+		std::lock_guard<std::mutex> lock(screens_listeners_mutex);
+		screens_listeners.push_back(std::make_pair(env, listener));
+		napi_add_env_cleanup_hook(env, RemoveScreensListener, env);
+	}
+
+	napi_value result;
+	napi_get_boolean(env, MMDisplayWatchGeneration() != 0, &result);
+	return result;
+}
+
+// Per-operation counts, bytes and latencies (in milliseconds) recorded since
+// the module was loaded or resetStats() was last called.
+napi_value GetStats(napi_env env, napi_callback_info info)
+{
+	napi_value stats;
+	napi_create_object(env, &stats);
+
+	for (int i = 0; i < kMMStatOperationCount; i++) {
+		const MMStatOperation operation = (MMStatOperation)i;
+		MMStatSummary summary;
+		MMStatsSummarize(operation, &summary);
+
+		napi_value entry;
+		napi_create_object(env, &entry);
+		SetNumberProperty(env, entry, "count", (double)summary.count);
+		SetNumberProperty(env, entry, "bytes", (double)summary.bytes);
+		SetNumberProperty(env, entry, "totalMs", MMTimestampToMilliseconds(summary.totalNs));
+		SetNumberProperty(env, entry, "meanMs", summary.count > 0 ?
+			MMTimestampToMilliseconds(summary.totalNs) / summary.count : 0);
+		SetNumberProperty(env, entry, "maxMs", MMTimestampToMilliseconds(summary.maxNs));
+		SetNumberProperty(env, entry, "p50Ms", MMTimestampToMilliseconds(summary.p50Ns));
+		SetNumberProperty(env, entry, "p90Ms", MMTimestampToMilliseconds(summary.p90Ns));
+		SetNumberProperty(env, entry, "p99Ms", MMTimestampToMilliseconds(summary.p99Ns));
+		SetNumberProperty(env, entry, "p999Ms", MMTimestampToMilliseconds(summary.p999Ns));
+		napi_set_named_property(env, stats, MMStatOperationName(operation), entry);
+	}
+
+	MMScreenCacheStats cache;
+	MMScreenCacheGetStats(&cache);
+	napi_value entry;
+	napi_create_object(env, &entry);
+	SetNumberProperty(env, entry, "hits", (double)cache.hits);
+	SetNumberProperty(env, entry, "misses", (double)cache.misses);
+	SetNumberProperty(env, entry, "bypasses", (double)cache.bypasses);
+	SetNumberProperty(env, entry, "ttlMs", cache.ttl);
+	SetNumberProperty(env, entry, "ageMs", cache.age);
+	napi_set_named_property(env, stats, "screenCache", entry);
+
+	// What the per-call arenas handed out, and how often they needed the heap
+	// to do it; a search that has run before should need it no more.
+	MMArenaStats arena;
+	MMArenaGetStats(&arena);
+	napi_create_object(env, &entry);
+	SetNumberProperty(env, entry, "allocations", (double)arena.allocations);
+	SetNumberProperty(env, entry, "bytes", (double)arena.bytes);
+	SetNumberProperty(env, entry, "heapAllocations", (double)arena.heapAllocations);
+	SetNumberProperty(env, entry, "reservedBytes", (double)arena.reservedBytes);
+	napi_set_named_property(env, stats, "arena", entry);
+
+	return stats;
+}
+
+napi_value ResetStats(napi_env env, napi_callback_info info)
+{
+	MMStatsReset();
+	MMScreenCacheResetStats();
+	MMArenaResetStats();
+
+	napi_value result;
+	napi_get_boolean(env, true, &result);
+	return result;
+}
+
 napi_value GetVersion(napi_env env, napi_callback_info info) {
     // Return the version string from package.json
     const char* version = "0.8.3"; // This should match package.json version
@@ -1488,6 +4140,12 @@ napi_value InitAll(napi_env env, napi_value exports) {
 		DEBUG_LOG("Failed to register cleanup hook");
 	}
 
+	StartDisplayWatch();
+	status = napi_add_env_cleanup_hook(env, StopDisplayWatch, nullptr);
+	if (status != napi_ok) {
+		DEBUG_LOG("Failed to register display watch cleanup hook");
+	}
+
 	// Safe function registration with error handling
 	#define SAFE_REGISTER_FUNCTION(name, func) \
 		status = napi_create_function(env, NULL, 0, func, NULL, &fn); \
@@ -1498,6 +4156,10 @@ napi_value InitAll(napi_env env, napi_value exports) {
 			DEBUG_LOG("Failed to register function: " name); \
 		}
 
+	if (!DefineBitmapClass(env, exports)) {
+		DEBUG_LOG("Failed to register class: Bitmap");
+	}
+
 	SAFE_REGISTER_FUNCTION("dragMouse", DragMouse);
 	SAFE_REGISTER_FUNCTION("updateScreenMetrics", UpdateScreenMetrics);
 	SAFE_REGISTER_FUNCTION("moveMouse", MoveMouse);
@@ -1507,19 +4169,44 @@ napi_value InitAll(napi_env env, napi_value exports) {
 	SAFE_REGISTER_FUNCTION("mouseToggle", MouseToggle);
 	SAFE_REGISTER_FUNCTION("setMouseDelay", SetMouseDelay);
 	SAFE_REGISTER_FUNCTION("scrollMouse", ScrollMouse);
+	SAFE_REGISTER_FUNCTION("setSpinWindow", SetSpinWindow);
 	SAFE_REGISTER_FUNCTION("keyTap", KeyTap);
 	SAFE_REGISTER_FUNCTION("keyToggle", KeyToggle);
 	SAFE_REGISTER_FUNCTION("typeString", TypeString);
 	SAFE_REGISTER_FUNCTION("typeStringDelayed", TypeStringDelayed);
+	SAFE_REGISTER_FUNCTION("decodeUTF8", DecodeUTF8);
 	SAFE_REGISTER_FUNCTION("setKeyboardDelay", SetKeyboardDelay);
+	SAFE_REGISTER_FUNCTION("compileMacro", CompileMacro);
+	SAFE_REGISTER_FUNCTION("playMacro", PlayMacro);
 	SAFE_REGISTER_FUNCTION("getPixelColor", GetPixelColor);
+	SAFE_REGISTER_FUNCTION("getPixelColors", GetPixelColors);
+	SAFE_REGISTER_FUNCTION("setScreenCache", SetScreenCache);
+	SAFE_REGISTER_FUNCTION("invalidateScreenCache", InvalidateScreenCache);
+	SAFE_REGISTER_FUNCTION("waitForPixel", WaitForPixel);
+	SAFE_REGISTER_FUNCTION("waitForPixels", WaitForPixels);
+	SAFE_REGISTER_FUNCTION("waitForBitmap", WaitForBitmap);
 	SAFE_REGISTER_FUNCTION("getScreenSize", GetScreenSize);
 	SAFE_REGISTER_FUNCTION("getXDisplayName", GetXDisplayName);
 	SAFE_REGISTER_FUNCTION("setXDisplayName", SetXDisplayName);
 	SAFE_REGISTER_FUNCTION("captureScreen", CaptureScreen);
 	SAFE_REGISTER_FUNCTION("getColor", GetColor);
+	SAFE_REGISTER_FUNCTION("encodePNG", EncodePNG);
+	SAFE_REGISTER_FUNCTION("createImageEncoder", CreateImageEncoder);
+	SAFE_REGISTER_FUNCTION("readImageEncoder", ReadImageEncoder);
+	SAFE_REGISTER_FUNCTION("writeImageToFD", WriteImageToFD);
+	SAFE_REGISTER_FUNCTION("mapBitmapFile", MapBitmap);
+	SAFE_REGISTER_FUNCTION("saveMappedBitmap", SaveMappedBitmap);
+	SAFE_REGISTER_FUNCTION("convertToMappedBitmap", ConvertToMappedBitmap);
+	SAFE_REGISTER_FUNCTION("readBitmapFile", ReadBitmapFile);
+	SAFE_REGISTER_FUNCTION("saveBitmapFile", SaveBitmapFile);
+	SAFE_REGISTER_FUNCTION("encodeBitmapString", EncodeBitmapString);
+	SAFE_REGISTER_FUNCTION("decodeBitmapString", DecodeBitmapString);
 	SAFE_REGISTER_FUNCTION("getScreens", GetScreens);
+	SAFE_REGISTER_FUNCTION("captureAllScreens", CaptureAllScreens);
+	SAFE_REGISTER_FUNCTION("setScreensChangeListener", SetScreensChangeListener);
 	SAFE_REGISTER_FUNCTION("getMouseColor", GetMouseColor);
+	SAFE_REGISTER_FUNCTION("getStats", GetStats);
+	SAFE_REGISTER_FUNCTION("resetStats", ResetStats);
 	SAFE_REGISTER_FUNCTION("getVersion", GetVersion);
 	SAFE_REGISTER_FUNCTION("isResourcesValid", IsResourcesValid);
 
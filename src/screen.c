@@ -1,11 +1,17 @@
 #include "screen.h"
 #include "os.h"
+#include "display_watch.h"
 #include <stdlib.h>
+#include <string.h> /* memcpy(), memmove() */
+#if !defined(IS_WINDOWS)
+	#include <pthread.h>
+#endif
 
 #if defined(IS_MACOSX)
 	#include <ApplicationServices/ApplicationServices.h>
 #elif defined(USE_X11)
 	#include <X11/Xlib.h>
+	#include <X11/extensions/Xrandr.h>
 	#include "xdisplay.h"
 #elif defined(IS_WINDOWS)
 	#include <windows.h>
@@ -30,7 +36,131 @@
 	}
 #endif
 
-MMSignedSize getMainDisplaySize(void)
+#if defined(USE_X11)
+
+/* The size of the default screen's root window, from the server: Xlib's own
+ * idea of it (DisplayWidth() and the like) is only brought up to date by
+ * the RandR events this connection never reads. */
+static MMSignedSize getX11RootSize(Display *display)
+{
+	Window root;
+	int x, y;
+	unsigned int width, height, border, depth;
+
+	if (!XGetGeometry(display, DefaultRootWindow(display), &root, &x, &y,
+	                  &width, &height, &border, &depth)) {
+		const int screen = DefaultScreen(display);
+		return MMSignedSizeMake((int32_t)DisplayWidth(display, screen),
+		                        (int32_t)DisplayHeight(display, screen));
+	}
+	return MMSignedSizeMake((int32_t)width, (int32_t)height);
+}
+
+/* Adds |rect| to the |*count| monitors in |monitors|, first if it is the
+ * primary one, unless it is already there (as clones are). */
+static void addX11Monitor(MMSignedRect *monitors, int *count,
+                          MMSignedRect rect, bool primary)
+{
+	int i;
+
+	for (i = 0; i < *count; i++) {
+		if (monitors[i].origin.x == rect.origin.x &&
+		    monitors[i].origin.y == rect.origin.y &&
+		    monitors[i].size.width == rect.size.width &&
+		    monitors[i].size.height == rect.size.height) {
+			return;
+		}
+	}
+
+	if (primary) {
+		memmove(monitors + 1, monitors, (size_t)*count * sizeof(MMSignedRect));
+		monitors[0] = rect;
+	} else {
+		monitors[*count] = rect;
+	}
+	++*count;
+}
+
+/* Returns the monitors of the default screen where RandR lays them out on
+ * its root window, primary first, to be free()'d by the caller; |count| is
+ * set to how many there are. They come from RandR 1.5's monitor list, or
+ * from the CRTCs that are lit under RandR 1.2 to 1.4. Without RandR (as
+ * under older servers' Xinerama) or any monitor, the root window is the one
+ * monitor.
+ *
+ * Returns NULL, with |count| 0, if the display could not be opened. */
+static MMSignedRect *copyX11Monitors(int *count)
+{
+	Display *display = XGetMainDisplay();
+	MMSignedRect *monitors = NULL;
+	int eventBase, errorBase, major = 0, minor = 0;
+	Window root;
+	int i;
+
+	*count = 0;
+	if (display == NULL) return NULL;
+	root = DefaultRootWindow(display);
+
+	if (XRRQueryExtension(display, &eventBase, &errorBase) &&
+	    XRRQueryVersion(display, &major, &minor) &&
+	    (major > 1 || (major == 1 && minor >= 5))) {
+		int monitorCount = 0;
+		XRRMonitorInfo *info = XRRGetMonitors(display, root, True, &monitorCount);
+		if (info != NULL) {
+			monitors = malloc(((size_t)monitorCount + 1) * sizeof(MMSignedRect));
+			for (i = 0; monitors != NULL && i < monitorCount; i++) {
+				addX11Monitor(monitors, count,
+				              MMSignedRectMake(info[i].x, info[i].y,
+				                               info[i].width, info[i].height),
+				              info[i].primary);
+			}
+			XRRFreeMonitors(info);
+		}
+	} else if (major == 1 && minor >= 2) {
+		/* ...Current() and the primary output are 1.3. */
+		XRRScreenResources *resources = minor >= 3 ?
+			XRRGetScreenResourcesCurrent(display, root) :
+			XRRGetScreenResources(display, root);
+		const RROutput primary = minor >= 3 ? XRRGetOutputPrimary(display, root) : None;
+		if (resources != NULL) {
+			monitors = malloc(((size_t)resources->ncrtc + 1) * sizeof(MMSignedRect));
+			for (i = 0; monitors != NULL && i < resources->ncrtc; i++) {
+				XRRCrtcInfo *crtc = XRRGetCrtcInfo(display, resources, resources->crtcs[i]);
+				bool isPrimary = false;
+				int j;
+
+				if (crtc == NULL) continue;
+				if (crtc->mode != None && crtc->noutput > 0) {
+					for (j = 0; j < crtc->noutput; j++) {
+						if (crtc->outputs[j] == primary) isPrimary = true;
+					}
+					addX11Monitor(monitors, count,
+					              MMSignedRectMake(crtc->x, crtc->y,
+					                               (int32_t)crtc->width,
+					                               (int32_t)crtc->height),
+					              isPrimary);
+				}
+				XRRFreeCrtcInfo(crtc);
+			}
+			XRRFreeScreenResources(resources);
+		}
+	}
+
+	if (*count == 0) {
+		const MMSignedSize size = getX11RootSize(display);
+		free(monitors);
+		monitors = malloc(sizeof(MMSignedRect));
+		if (monitors == NULL) return NULL;
+		monitors[0] = MMSignedRectMake(0, 0, size.width, size.height);
+		*count = 1;
+	}
+
+	return monitors;
+}
+
+#endif
+
+static MMSignedSize queryMainDisplaySize(void)
 {
 #if defined(IS_MACOSX)
 	CGDirectDisplayID displayID = CGMainDisplayID();
@@ -39,11 +169,8 @@ MMSignedSize getMainDisplaySize(void)
 	return size;
 #elif defined(USE_X11)
 	Display *display = XGetMainDisplay();
-	const int screen = DefaultScreen(display);
-
-	MMSignedSize size = MMSignedSizeMake((int32_t)DisplayWidth(display, screen),
-	                  (int32_t)DisplayHeight(display, screen));
-	return size;
+	if (display == NULL) return MMSignedSizeMake(0, 0);
+	return getX11RootSize(display);
 #elif defined(IS_WINDOWS)
 	MMSignedSize size = MMSignedSizeMake((int32_t)GetSystemMetrics(SM_CXSCREEN),
 	                  (int32_t)GetSystemMetrics(SM_CYSCREEN));
@@ -51,78 +178,22 @@ MMSignedSize getMainDisplaySize(void)
 #endif
 }
 
-bool pointVisibleOnMainDisplay(MMSignedPoint point)
-{
-	MMSignedSize displaySize = getMainDisplaySize();
-	return point.x < displaySize.width && point.y < displaySize.height;
-}
-
-int getScreensCount(void)
+static int queryScreensCount(void)
 {
 #if defined(IS_MACOSX)
 	uint32_t displayCount = 0;
 	CGGetActiveDisplayList(0, NULL, &displayCount);
 	return (int)displayCount;
 #elif defined(USE_X11)
-	Display *display = XGetMainDisplay();
-	return ScreenCount(display);
+	int count;
+	free(copyX11Monitors(&count));
+	return count;
 #elif defined(IS_WINDOWS)
 	return GetSystemMetrics(SM_CMONITORS);
 #endif
 }
 
-void getScreensInfo(MMSignedRect *screens, int count)
-{
-#if defined(IS_MACOSX)
-	uint32_t displayCount = (uint32_t)count;
-	CGDirectDisplayID *displayIDs = malloc(displayCount * sizeof(CGDirectDisplayID));
-	
-	if (CGGetActiveDisplayList(displayCount, displayIDs, &displayCount) == kCGErrorSuccess) {
-		for (int i = 0; i < count && i < (int)displayCount; i++) {
-			CGRect bounds = CGDisplayBounds(displayIDs[i]);
-			screens[i] = MMSignedRectMake(
-				(int32_t)bounds.origin.x,
-				(int32_t)bounds.origin.y,
-				(int32_t)bounds.size.width,
-				(int32_t)bounds.size.height
-			);
-		}
-	}
-	
-	free(displayIDs);
-#elif defined(USE_X11)
-	Display *display = XGetMainDisplay();
-	for (int i = 0; i < count && i < ScreenCount(display); i++) {
-		screens[i] = MMSignedRectMake(
-			0, 0,
-			(int32_t)DisplayWidth(display, i),
-			(int32_t)DisplayHeight(display, i)
-		);
-	}
-#elif defined(IS_WINDOWS)
-	// Reset global variables for new enumeration
-	g_monitorIndex = 0;
-	if (g_monitorRects) {
-		free(g_monitorRects);
-	}
-	g_monitorRects = malloc(count * sizeof(MMSignedRect));
-	g_monitorCount = count;
-	
-	// Enumerate monitors
-	EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, 0);
-	
-	// Copy results to output array
-	for (int i = 0; i < count && i < g_monitorIndex; i++) {
-		screens[i] = g_monitorRects[i];
-	}
-	
-	// Clean up
-	free(g_monitorRects);
-	g_monitorRects = NULL;
-#endif
-}
-
-void getScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count)
+static void queryScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count)
 {
 #if defined(IS_MACOSX)
 	uint32_t displayCount = (uint32_t)count;
@@ -143,15 +214,13 @@ void getScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count)
 	
 	free(cgDisplayIDs);
 #elif defined(USE_X11)
-	Display *display = XGetMainDisplay();
-	for (int i = 0; i < count && i < ScreenCount(display); i++) {
-		screens[i] = MMSignedRectMake(
-			0, 0,
-			(int32_t)DisplayWidth(display, i),
-			(int32_t)DisplayHeight(display, i)
-		);
+	int monitorCount;
+	MMSignedRect *monitors = copyX11Monitors(&monitorCount);
+	for (int i = 0; i < count && i < monitorCount; i++) {
+		screens[i] = monitors[i];
 		displayIDs[i] = i;
 	}
+	free(monitors);
 #elif defined(IS_WINDOWS)
 	// Reset global variables for new enumeration
 	g_monitorIndex = 0;
@@ -175,3 +244,133 @@ void getScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count)
 	g_monitorRects = NULL;
 #endif
 }
+
+/* What the functions above report, kept while the display watch runs and
+ * refilled after it sees a change, so that they cost a read of memory. Any
+ * thread may ask, so it's only touched with |geometryLock| held. */
+static struct {
+	uint64_t generation; /* Of the display watch when filled; 0 if empty. */
+	MMSignedSize mainSize;
+	MMSignedRect *screens;
+	int *displayIDs;
+	int count;
+} geometry;
+
+#if defined(IS_WINDOWS)
+	static SRWLOCK geometryLock = SRWLOCK_INIT;
+	#define LOCK_GEOMETRY() AcquireSRWLockExclusive(&geometryLock)
+	#define UNLOCK_GEOMETRY() ReleaseSRWLockExclusive(&geometryLock)
+#else
+	static pthread_mutex_t geometryLock = PTHREAD_MUTEX_INITIALIZER;
+	#define LOCK_GEOMETRY() pthread_mutex_lock(&geometryLock)
+	#define UNLOCK_GEOMETRY() pthread_mutex_unlock(&geometryLock)
+#endif
+
+/* Brings |geometry| up to date if need be, with |geometryLock| held. Returns
+ * false if it can't be kept, as nothing is watching for changes. */
+static bool updateGeometry(void)
+{
+	const uint64_t generation = MMDisplayWatchGeneration();
+	MMSignedRect *screens;
+	int *displayIDs;
+	int count;
+
+	if (generation == 0) return false;
+	if (generation == geometry.generation) return true;
+
+	count = queryScreensCount();
+	screens = malloc((count > 0 ? count : 1) * sizeof(MMSignedRect));
+	displayIDs = malloc((count > 0 ? count : 1) * sizeof(int));
+	if (screens == NULL || displayIDs == NULL) {
+		free(screens);
+		free(displayIDs);
+		return false;
+	}
+	queryScreensInfoWithIDs(screens, displayIDs, count);
+
+	free(geometry.screens);
+	free(geometry.displayIDs);
+	geometry.screens = screens;
+	geometry.displayIDs = displayIDs;
+	geometry.count = count;
+	geometry.mainSize = queryMainDisplaySize();
+	/* Read before the queries, so a change during them is caught next time. */
+	geometry.generation = generation;
+	return true;
+}
+
+void invalidateScreenGeometry(void)
+{
+	LOCK_GEOMETRY();
+	geometry.generation = 0;
+	UNLOCK_GEOMETRY();
+}
+
+MMSignedSize getMainDisplaySize(void)
+{
+	MMSignedSize size;
+	bool cached;
+
+	LOCK_GEOMETRY();
+	cached = updateGeometry();
+	if (cached) size = geometry.mainSize;
+	UNLOCK_GEOMETRY();
+
+	return cached ? size : queryMainDisplaySize();
+}
+
+bool pointVisibleOnMainDisplay(MMSignedPoint point)
+{
+	MMSignedSize displaySize = getMainDisplaySize();
+	return point.x < displaySize.width && point.y < displaySize.height;
+}
+
+int getScreensCount(void)
+{
+	int count;
+	bool cached;
+
+	LOCK_GEOMETRY();
+	cached = updateGeometry();
+	if (cached) count = geometry.count;
+	UNLOCK_GEOMETRY();
+
+	return cached ? count : queryScreensCount();
+}
+
+void getScreensInfo(MMSignedRect *screens, int count)
+{
+	int *displayIDs;
+	bool cached;
+
+	LOCK_GEOMETRY();
+	cached = updateGeometry();
+	if (cached) {
+		memcpy(screens, geometry.screens,
+		       (size_t)(count < geometry.count ? count : geometry.count) * sizeof(MMSignedRect));
+	}
+	UNLOCK_GEOMETRY();
+	if (cached) return;
+
+	displayIDs = malloc((count > 0 ? count : 1) * sizeof(int));
+	if (displayIDs == NULL) return;
+	queryScreensInfoWithIDs(screens, displayIDs, count);
+	free(displayIDs);
+}
+
+void getScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count)
+{
+	bool cached;
+
+	LOCK_GEOMETRY();
+	cached = updateGeometry();
+	if (cached) {
+		const size_t copied = (size_t)(count < geometry.count ? count : geometry.count);
+		memcpy(screens, geometry.screens, copied * sizeof(MMSignedRect));
+		memcpy(displayIDs, geometry.displayIDs, copied * sizeof(int));
+	}
+	UNLOCK_GEOMETRY();
+	if (cached) return;
+
+	queryScreensInfoWithIDs(screens, displayIDs, count);
+}
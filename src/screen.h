@@ -37,6 +37,11 @@ void getScreensInfo(MMSignedRect *screens, int count);
  * displayIDs will contain the display IDs for each screen. */
 void getScreensInfoWithIDs(MMSignedRect *screens, int *displayIDs, int count);
 
+/* The functions above answer from memory while the display watch runs (see
+ * display_watch.h), asking the system again only after it sees a change.
+ * This makes the next of them ask again regardless. */
+void invalidateScreenGeometry(void);
+
 #ifdef __cplusplus
 }
 #endif
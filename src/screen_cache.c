@@ -0,0 +1,161 @@
+#include "screen_cache.h"
+#include "screengrab.h"
+#include "screen.h"
+#include "timing.h"
+
+static MMTimestamp ttl = 0; /* 0 when the cache is off. */
+static MMSignedRect configuredRegion;
+
+/* The cached frame and the part of the screen it shows. */
+static MMBitmapRef frame = NULL;
+static MMSignedRect frameRegion;
+static MMTimestamp frameTime = 0;
+
+static MMScreenCacheStats counts;
+
+void MMScreenCacheConfigure(double milliseconds, MMSignedRect region)
+{
+	ttl = milliseconds > 0 ? MMTimestampFromMilliseconds(milliseconds) : 0;
+	configuredRegion = region;
+	MMScreenCacheInvalidate();
+}
+
+void MMScreenCacheInvalidate(void)
+{
+	if (frame != NULL) destroyMMBitmap(frame);
+	frame = NULL;
+}
+
+bool MMScreenCacheEnabled(void)
+{
+	return ttl > 0;
+}
+
+/* The region the next frame should cover. */
+static MMSignedRect regionToCapture(void)
+{
+	if (configuredRegion.size.width > 0 && configuredRegion.size.height > 0) {
+		return configuredRegion;
+	} else {
+		const MMSignedSize size = getMainDisplaySize();
+		return MMSignedRectMake(0, 0, size.width, size.height);
+	}
+}
+
+static bool regionContains(MMSignedRect region, MMSignedRect rect)
+{
+	return rect.origin.x >= region.origin.x && rect.origin.y >= region.origin.y &&
+	       (int64_t)rect.origin.x + rect.size.width <= (int64_t)region.origin.x + region.size.width &&
+	       (int64_t)rect.origin.y + rect.size.height <= (int64_t)region.origin.y + region.size.height;
+}
+
+/* Makes sure a live frame is cached, counting a hit or a miss. Returns false
+ * if a new one was needed but could not be captured. */
+static bool refreshFrame(void)
+{
+	const MMTimestamp now = MMTimestampNow();
+
+	if (frame != NULL && now - frameTime < ttl) {
+		counts.hits++;
+		return true;
+	}
+
+	counts.misses++;
+	MMScreenCacheInvalidate();
+	frameRegion = regionToCapture();
+	frame = copyMMBitmapFromDisplayInRect(frameRegion);
+	if (frame == NULL || frame->imageBuffer == NULL) {
+		MMScreenCacheInvalidate();
+		return false;
+	}
+	/* Aged from when the capture started, to err on the side of fresh. */
+	frameTime = now;
+	return true;
+}
+
+/* Whether |rect| can be answered from the cache, in terms of the region the
+ * current frame shows or, without one, the region the next would. */
+static bool cacheCovers(MMSignedRect rect)
+{
+	if (ttl == 0) return false;
+	return regionContains(frame != NULL ? frameRegion : regionToCapture(), rect);
+}
+
+/* Map screen coordinates into the frame, which is larger than its region on
+ * HiDPI displays. */
+static int32_t frameX(int64_t x)
+{
+	return (int32_t)((x - frameRegion.origin.x) * frame->width / frameRegion.size.width);
+}
+
+static int32_t frameY(int64_t y)
+{
+	return (int32_t)((y - frameRegion.origin.y) * frame->height / frameRegion.size.height);
+}
+
+MMBitmapRef MMScreenCacheCopyRect(MMSignedRect rect)
+{
+	if (rect.size.width <= 0 || rect.size.height <= 0 || !cacheCovers(rect)) {
+		if (ttl > 0) counts.bypasses++;
+		return copyMMBitmapFromDisplayInRect(rect);
+	}
+
+	if (!refreshFrame()) return NULL;
+
+	/* The new frame may cover less if the screen shrank since. */
+	if (!regionContains(frameRegion, rect)) {
+		return copyMMBitmapFromDisplayInRect(rect);
+	}
+
+	{
+		const int32_t left = frameX(rect.origin.x);
+		const int32_t top = frameY(rect.origin.y);
+		const int32_t right = frameX((int64_t)rect.origin.x + rect.size.width);
+		const int32_t bottom = frameY((int64_t)rect.origin.y + rect.size.height);
+		return copyMMBitmapFromPortion(frame, MMSignedRectMake(left, top, right - left,
+		                                                       bottom - top));
+	}
+}
+
+int MMScreenCacheReadPixels(const MMSignedPoint *points, size_t count,
+                            uint32_t *colors)
+{
+	size_t i;
+	bool covered = ttl > 0 && count > 0;
+
+	for (i = 0; i < count && covered; i++) {
+		covered = cacheCovers(MMSignedRectMake(points[i].x, points[i].y, 1, 1));
+	}
+
+	if (!covered) {
+		if (ttl > 0 && count > 0) counts.bypasses++;
+		return copyPixelColorsFromDisplay(points, count, colors);
+	}
+
+	if (!refreshFrame()) return -1;
+
+	for (i = 0; i < count; i++) {
+		if (!regionContains(frameRegion, MMSignedRectMake(points[i].x, points[i].y, 1, 1))) {
+			return copyPixelColorsFromDisplay(points, count, colors);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		colors[i] = (uint32_t)MMRGBHexAtPoint(frame, frameX(points[i].x), frameY(points[i].y));
+	}
+	return 0;
+}
+
+void MMScreenCacheGetStats(MMScreenCacheStats *stats)
+{
+	*stats = counts;
+	stats->ttl = MMTimestampToMilliseconds(ttl);
+	stats->age = frame != NULL ? MMTimestampToMilliseconds(MMTimestampNow() - frameTime) : -1;
+}
+
+void MMScreenCacheResetStats(void)
+{
+	counts.hits = 0;
+	counts.misses = 0;
+	counts.bypasses = 0;
+}
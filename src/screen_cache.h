@@ -0,0 +1,66 @@
+#pragma once
+#ifndef SCREEN_CACHE_H
+#define SCREEN_CACHE_H
+
+#include "types.h"
+#include "MMBitmap.h"
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* An opt-in cache of the screen: one capture of the main display (or of a
+ * region of it) that pixel and capture queries are answered from until it is
+ * older than a TTL or is invalidated, so that a burst of queries costs a
+ * single capture. Off until MMScreenCacheConfigure() is called with a TTL.
+ *
+ * Like the rest of the binding's state, it is only meant to be used from one
+ * thread. */
+
+/* Turns the cache on with frames that live for |ttl| milliseconds, or off if
+ * |ttl| is 0 or less. |region| is the part of the screen to cache; an empty
+ * one means the whole main display, whatever its size at capture time. Drops
+ * the current frame. */
+void MMScreenCacheConfigure(double ttl, MMSignedRect region);
+
+/* Drops the current frame, so the next query captures a new one. */
+void MMScreenCacheInvalidate(void);
+
+bool MMScreenCacheEnabled(void);
+
+/* Like copyMMBitmapFromDisplayInRect(), but copied from the cached frame when
+ * the cache is on and |rect| lies inside its region. */
+MMBitmapRef MMScreenCacheCopyRect(MMSignedRect rect);
+
+/* Like copyPixelColorsFromDisplay(), but read from the cached frame when the
+ * cache is on and every point lies inside its region. */
+int MMScreenCacheReadPixels(const MMSignedPoint *points, size_t count,
+                            uint32_t *colors);
+
+struct _MMScreenCacheStats {
+	uint64_t hits;     /* Queries answered from a live frame. */
+	uint64_t misses;   /* Queries that had to capture a new frame. */
+	uint64_t bypasses; /* Queries outside the region, read from the display. */
+	double ttl;        /* Milliseconds, 0 when the cache is off. */
+	double age;        /* Milliseconds since the frame was captured, or -1. */
+};
+
+typedef struct _MMScreenCacheStats MMScreenCacheStats;
+
+void MMScreenCacheGetStats(MMScreenCacheStats *stats);
+
+/* Zeroes the hit, miss and bypass counts. */
+void MMScreenCacheResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCREEN_CACHE_H */
@@ -0,0 +1,250 @@
+#include "screen_reader.h"
+#include "screengrab.h"
+#include <stdlib.h> /* calloc() */
+#include <string.h> /* memcpy() */
+
+#if defined(USE_X11)
+	#include <X11/Xlib.h>
+	#include <X11/Xutil.h>
+	#include <X11/extensions/XShm.h>
+	#include <pthread.h>
+	#include <sys/ipc.h>
+	#include <sys/shm.h>
+	#include "xdisplay.h"
+#endif
+
+struct _MMScreenReader {
+	MMSignedRect *rects;
+	size_t count;
+#if defined(USE_X11)
+	Display *display;
+	XShmSegmentInfo shm;
+	XImage **images; /* One per rect, all over |shm|; NULL without it. */
+#endif
+};
+
+#if defined(USE_X11)
+
+static void wrapImage(MMBitmapRef bitmap, XImage *image)
+{
+	bitmap->imageBuffer = (uint8_t *)image->data;
+	bitmap->width = image->width;
+	bitmap->height = image->height;
+	bitmap->bytewidth = (int32_t)image->bytes_per_line;
+	bitmap->bitsPerPixel = (uint8_t)image->bits_per_pixel;
+	bitmap->bytesPerPixel = (uint8_t)(image->bits_per_pixel / 8);
+}
+
+/* Protocol errors are reported through a handler, and Xlib's default one
+ * takes the process down. Readers can't swap handlers around each request,
+ * as the handler is process-wide and they run on threads of their own, so
+ * one handler is installed for good. It swallows errors on whichever display
+ * the calling thread has asked it to trap, which is the thread Xlib reports
+ * that display's errors on, and hands anything else to the handler it
+ * replaced. */
+static __thread Display *trappedDisplay = NULL;
+static __thread bool trappedError = false;
+static int (*untrappedHandler)(Display *, XErrorEvent *) = NULL;
+static pthread_once_t trapOnce = PTHREAD_ONCE_INIT;
+
+static int trapError(Display *display, XErrorEvent *event)
+{
+	if (display == trappedDisplay) {
+		trappedError = true;
+		return 0;
+	}
+	return untrappedHandler != NULL ? untrappedHandler(display, event) : 0;
+}
+
+static void installErrorTrap(void)
+{
+	untrappedHandler = XSetErrorHandler(trapError);
+}
+
+static void beginTrap(Display *display)
+{
+	trappedDisplay = display;
+	trappedError = false;
+}
+
+/* Returns true if an error was trapped since beginTrap(). Errors for requests
+ * without a reply only show up once the display has been synced. */
+static bool endTrap(void)
+{
+	trappedDisplay = NULL;
+	return trappedError;
+}
+
+static void detachSharedMemory(MMScreenReaderRef reader)
+{
+	size_t i;
+
+	if (reader->images == NULL) return;
+
+	for (i = 0; i < reader->count; i++) {
+		if (reader->images[i] == NULL) continue;
+		reader->images[i]->data = NULL;
+		XDestroyImage(reader->images[i]);
+	}
+	free(reader->images);
+	reader->images = NULL;
+
+	if (reader->shm.shmaddr != NULL && reader->shm.shmaddr != (char *)-1) {
+		shmdt(reader->shm.shmaddr);
+	}
+}
+
+/* Sets up one shared segment, as big as the largest rect, for every rect to
+ * be read into in turn. Leaves |images| NULL if the server can't share memory
+ * with us (say, over the network). */
+static void attachSharedMemory(MMScreenReaderRef reader)
+{
+	const int screen = DefaultScreen(reader->display);
+	size_t i, size = 0;
+	bool attachFailed;
+
+	if (!XShmQueryExtension(reader->display)) return;
+
+	reader->images = calloc(reader->count, sizeof(XImage *));
+	if (reader->images == NULL) return;
+	reader->shm.shmaddr = NULL;
+
+	for (i = 0; i < reader->count; i++) {
+		const MMSignedRect rect = reader->rects[i];
+		XImage *image = XShmCreateImage(reader->display,
+		                                DefaultVisual(reader->display, screen),
+		                                (unsigned int)DefaultDepth(reader->display, screen),
+		                                ZPixmap, NULL, &reader->shm,
+		                                (unsigned int)rect.size.width,
+		                                (unsigned int)rect.size.height);
+		if (image == NULL) {
+			detachSharedMemory(reader);
+			return;
+		}
+		reader->images[i] = image;
+		if ((size_t)image->bytes_per_line * image->height > size) {
+			size = (size_t)image->bytes_per_line * image->height;
+		}
+	}
+
+	reader->shm.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (reader->shm.shmid == -1) {
+		detachSharedMemory(reader);
+		return;
+	}
+	reader->shm.shmaddr = shmat(reader->shm.shmid, NULL, 0);
+	reader->shm.readOnly = False;
+
+	attachFailed = true;
+	if (reader->shm.shmaddr != (char *)-1) {
+		/* A failed attach is only reported as a protocol error. */
+		beginTrap(reader->display);
+		attachFailed = !XShmAttach(reader->display, &reader->shm);
+		XSync(reader->display, False);
+		attachFailed = endTrap() || attachFailed;
+	}
+
+	/* Freed once both sides have let go of it. */
+	shmctl(reader->shm.shmid, IPC_RMID, NULL);
+
+	if (reader->shm.shmaddr == (char *)-1 || attachFailed) {
+		detachSharedMemory(reader);
+		return;
+	}
+
+	for (i = 0; i < reader->count; i++) reader->images[i]->data = reader->shm.shmaddr;
+}
+
+#endif
+
+MMScreenReaderRef createMMScreenReader(const MMSignedRect *rects, size_t count)
+{
+	MMScreenReaderRef reader = calloc(1, sizeof(MMScreenReader));
+	if (reader == NULL) return NULL;
+
+	reader->count = count;
+	reader->rects = malloc((count > 0 ? count : 1) * sizeof(MMSignedRect));
+	if (reader->rects == NULL) {
+		free(reader);
+		return NULL;
+	}
+	memcpy(reader->rects, rects, count * sizeof(MMSignedRect));
+
+#if defined(USE_X11)
+	reader->display = XOpenDisplay(getXDisplay());
+	if (reader->display == NULL) reader->display = XOpenDisplay(NULL);
+	if (reader->display == NULL) {
+		destroyMMScreenReader(reader);
+		return NULL;
+	}
+	pthread_once(&trapOnce, installErrorTrap);
+	attachSharedMemory(reader);
+#endif
+
+	return reader;
+}
+
+bool readMMScreenReader(MMScreenReaderRef reader, size_t index,
+                        MMBitmapRef bitmap, uint8_t **owned)
+{
+	const MMSignedRect rect = reader->rects[index];
+#if defined(USE_X11)
+	XImage *image;
+	bool read;
+
+	/* The rect may have left the screen since the reader was made, if the
+	 * screen shrank, which the server answers with BadMatch. */
+	*owned = NULL;
+	if (reader->images != NULL) {
+		image = reader->images[index];
+		beginTrap(reader->display);
+		read = XShmGetImage(reader->display, XDefaultRootWindow(reader->display), image,
+		                    (int)rect.origin.x, (int)rect.origin.y, AllPlanes);
+		if (endTrap() || !read) return false;
+		wrapImage(bitmap, image);
+		return true;
+	}
+
+	beginTrap(reader->display);
+	image = XGetImage(reader->display, XDefaultRootWindow(reader->display),
+	                  (int)rect.origin.x, (int)rect.origin.y,
+	                  (unsigned int)rect.size.width, (unsigned int)rect.size.height,
+	                  AllPlanes, ZPixmap);
+	if (endTrap() && image != NULL) {
+		XDestroyImage(image);
+		image = NULL;
+	}
+	if (image == NULL) return false;
+	wrapImage(bitmap, image);
+	*owned = (uint8_t *)image->data;
+	image->data = NULL; /* Ours now. */
+	XDestroyImage(image);
+	return true;
+#else
+	MMBitmapRef capture = copyMMBitmapFromDisplayInRect(rect);
+
+	*owned = NULL;
+	if (capture == NULL) return false;
+	*bitmap = *capture;
+	*owned = capture->imageBuffer;
+	capture->imageBuffer = NULL;
+	destroyMMBitmap(capture);
+	return *owned != NULL;
+#endif
+}
+
+void destroyMMScreenReader(MMScreenReaderRef reader)
+{
+	if (reader == NULL) return;
+
+#if defined(USE_X11)
+	if (reader->display != NULL) {
+		if (reader->images != NULL) XShmDetach(reader->display, &reader->shm);
+		detachSharedMemory(reader);
+		XCloseDisplay(reader->display);
+	}
+#endif
+
+	free(reader->rects);
+	free(reader);
+}
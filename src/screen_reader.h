@@ -0,0 +1,46 @@
+#pragma once
+#ifndef SCREEN_READER_H
+#define SCREEN_READER_H
+
+#include "types.h"
+#include "MMBitmap.h"
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Reads the same few rects of the display over and over, for the watchers
+ * that poll it. On X11 the reader keeps a display connection of its own, and
+ * reads through shared memory when the server offers it, so it can be used
+ * from a thread other than the one that made it (but only one at a time).
+ * Elsewhere it is a thin layer over copyMMBitmapFromDisplayInRect(). */
+typedef struct _MMScreenReader MMScreenReader;
+typedef MMScreenReader *MMScreenReaderRef;
+
+/* Sets up to read the |count| |rects|, which must lie on the main display.
+ * Returns NULL if the display could not be opened. */
+MMScreenReaderRef createMMScreenReader(const MMSignedRect *rects, size_t count);
+
+/* Reads rect |index| into |bitmap| (larger than the rect on HiDPI displays).
+ * Its pixels either belong to the reader, and stay valid until the next read,
+ * or are handed back in |owned| for the caller to free().
+ *
+ * Returns false if the display could not be read, as when the rect no longer
+ * lies on it after the screen shrank. */
+bool readMMScreenReader(MMScreenReaderRef reader, size_t index,
+                        MMBitmapRef bitmap, uint8_t **owned);
+
+void destroyMMScreenReader(MMScreenReaderRef reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCREEN_READER_H */
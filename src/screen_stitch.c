@@ -0,0 +1,200 @@
+#include "screen_stitch.h"
+#include "screen_reader.h"
+#include "os.h"
+#include <stdlib.h> /* calloc() */
+#include <string.h> /* memcpy() */
+
+#if defined(_MSC_VER)
+	#include "ms_stdbool.h"
+#else
+	#include <stdbool.h>
+#endif
+
+#if !defined(IS_WINDOWS)
+	#include <pthread.h>
+#endif
+
+struct ScreenGrab {
+	MMScreenReaderRef reader;
+	MMBitmap frame;
+	uint8_t *owned;
+	bool read;
+	bool threaded; /* Whether it is being read on a thread of its own. */
+};
+
+static void readScreen(struct ScreenGrab *grab)
+{
+	grab->read = readMMScreenReader(grab->reader, 0, &grab->frame, &grab->owned);
+}
+
+#if defined(IS_WINDOWS)
+static DWORD WINAPI screenThread(LPVOID grab)
+{
+	readScreen(grab);
+	return 0;
+}
+#else
+static void *screenThread(void *grab)
+{
+	readScreen(grab);
+	return NULL;
+}
+#endif
+
+/* Copies |frame| into |rect| of |bitmap|, a row at a time where the two
+ * match, or a pixel at a time (nearest neighbour) where they don't. */
+static void placeFrame(MMBitmapRef bitmap, MMSignedRect rect, MMBitmapRef frame)
+{
+	int32_t x, y;
+
+	if (frame->width == rect.size.width && frame->height == rect.size.height &&
+	    frame->bytesPerPixel == bitmap->bytesPerPixel) {
+		for (y = 0; y < rect.size.height; y++) {
+			memcpy(bitmap->imageBuffer + (size_t)(rect.origin.y + y) * bitmap->bytewidth +
+			       (size_t)rect.origin.x * bitmap->bytesPerPixel,
+			       frame->imageBuffer + (size_t)y * frame->bytewidth,
+			       (size_t)rect.size.width * bitmap->bytesPerPixel);
+		}
+		return;
+	}
+
+	for (y = 0; y < rect.size.height; y++) {
+		const size_t frameY = (size_t)y * frame->height / rect.size.height;
+		uint8_t *row = bitmap->imageBuffer + (size_t)(rect.origin.y + y) * bitmap->bytewidth;
+		for (x = 0; x < rect.size.width; x++) {
+			const size_t frameX = (size_t)x * frame->width / rect.size.width;
+			const MMRGBHex color = MMRGBHexAtPoint(frame, frameX, frameY);
+			uint8_t *pixel = row + (size_t)(rect.origin.x + x) * bitmap->bytesPerPixel;
+			pixel[0] = color & 0xFF;
+			pixel[1] = (color >> 8) & 0xFF;
+			pixel[2] = (color >> 16) & 0xFF;
+		}
+	}
+}
+
+MMBitmapRef copyMMBitmapFromScreens(const MMSignedRect *screens, size_t count,
+                                    MMSignedRect *placed)
+{
+	struct ScreenGrab *grabs;
+	MMBitmapRef bitmap = NULL;
+	int32_t left, top, right, bottom;
+	double scaleX, scaleY;
+	bool failed = false;
+	size_t i;
+
+#if defined(IS_WINDOWS)
+	HANDLE *handles;
+#else
+	pthread_t *handles;
+#endif
+
+	if (count == 0) return NULL;
+
+	grabs = calloc(count, sizeof(struct ScreenGrab));
+	handles = calloc(count, sizeof(*handles));
+	if (grabs == NULL || handles == NULL) {
+		free(grabs);
+		free(handles);
+		return NULL;
+	}
+
+	/* Connections are opened here, one after the other, as Xlib can't be
+	 * trusted to open them from several threads at once; only the reads,
+	 * each on its own connection, run side by side. */
+	for (i = 0; i < count; i++) {
+		grabs[i].reader = createMMScreenReader(&screens[i], 1);
+		if (grabs[i].reader == NULL) failed = true;
+	}
+
+	if (!failed) {
+		/* The calling thread takes the first screen. */
+		for (i = 1; i < count; i++) {
+#if defined(IS_WINDOWS)
+			handles[i] = CreateThread(NULL, 0, screenThread, &grabs[i], 0, NULL);
+			grabs[i].threaded = handles[i] != NULL;
+#else
+			grabs[i].threaded =
+				pthread_create(&handles[i], NULL, screenThread, &grabs[i]) == 0;
+#endif
+		}
+
+		readScreen(&grabs[0]);
+
+		for (i = 1; i < count; i++) {
+			if (!grabs[i].threaded) {
+				/* Couldn't start a thread; do it here instead. */
+				readScreen(&grabs[i]);
+				continue;
+			}
+
+#if defined(IS_WINDOWS)
+			WaitForSingleObject(handles[i], INFINITE);
+			CloseHandle(handles[i]);
+#else
+			pthread_join(handles[i], NULL);
+#endif
+		}
+
+		for (i = 0; i < count; i++) {
+			if (!grabs[i].read ||
+			    (grabs[i].frame.bytesPerPixel != 3 && grabs[i].frame.bytesPerPixel != 4)) {
+				failed = true;
+			}
+		}
+	}
+
+	free(handles);
+
+	if (!failed) {
+		left = screens[0].origin.x;
+		top = screens[0].origin.y;
+		right = screens[0].origin.x + screens[0].size.width;
+		bottom = screens[0].origin.y + screens[0].size.height;
+		for (i = 1; i < count; i++) {
+			if (screens[i].origin.x < left) left = screens[i].origin.x;
+			if (screens[i].origin.y < top) top = screens[i].origin.y;
+			if (screens[i].origin.x + screens[i].size.width > right) {
+				right = screens[i].origin.x + screens[i].size.width;
+			}
+			if (screens[i].origin.y + screens[i].size.height > bottom) {
+				bottom = screens[i].origin.y + screens[i].size.height;
+			}
+		}
+
+		/* Pixels per point, more than 1 on HiDPI displays. */
+		scaleX = (double)grabs[0].frame.width / screens[0].size.width;
+		scaleY = (double)grabs[0].frame.height / screens[0].size.height;
+
+		for (i = 0; i < count; i++) {
+			const int32_t x = (int32_t)((screens[i].origin.x - left) * scaleX + 0.5);
+			const int32_t y = (int32_t)((screens[i].origin.y - top) * scaleY + 0.5);
+			placed[i] = MMSignedRectMake(
+				x, y,
+				(int32_t)((screens[i].origin.x + screens[i].size.width - left) * scaleX + 0.5) - x,
+				(int32_t)((screens[i].origin.y + screens[i].size.height - top) * scaleY + 0.5) - y);
+		}
+
+		{
+			const int32_t width = (int32_t)((right - left) * scaleX + 0.5);
+			const int32_t height = (int32_t)((bottom - top) * scaleY + 0.5);
+			const size_t bytewidth = (size_t)width * 4;
+			uint8_t *buffer = calloc(bytewidth * height, 1);
+			if (buffer != NULL) {
+				bitmap = createMMBitmap(buffer, width, height, (int32_t)bytewidth, 32, 4);
+				if (bitmap == NULL) free(buffer);
+			}
+		}
+
+		for (i = 0; bitmap != NULL && i < count; i++) {
+			placeFrame(bitmap, placed[i], &grabs[i].frame);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		free(grabs[i].owned);
+		destroyMMScreenReader(grabs[i].reader);
+	}
+	free(grabs);
+
+	return bitmap;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef SCREEN_STITCH_H
+#define SCREEN_STITCH_H
+
+#include "types.h"
+#include "MMBitmap.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Captures the |count| |screens| (as from getScreensInfo()) at once, each
+ * on a thread and, on X11, a display connection of its own, and stitches
+ * them into one bitmap of their bounding box: the virtual desktop. Parts of
+ * it no screen covers are left black. The bitmap is at the scale of the first
+ * screen's capture, and other screens are resized to match if theirs differ.
+ *
+ * Sets |placed| (|count| rects) to where each screen ended up in the bitmap,
+ * in its pixels. Returns the bitmap, to be destroyMMBitmap()'d by the caller,
+ * or NULL if any screen could not be read. */
+MMBitmapRef copyMMBitmapFromScreens(const MMSignedRect *screens, size_t count,
+                                    MMSignedRect *placed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCREEN_STITCH_H */
@@ -166,3 +166,110 @@ MMBitmapRef copyMMBitmapFromDisplayInRect(MMSignedRect rect)
 	return bitmap;
 #endif
 }
+
+/* A group of points is read with one capture of their bounding box while it
+ * stays under this many pixels (or this many per point, for large groups);
+ * past that, it is split in two. */
+#define PIXEL_CLUSTER_MIN_AREA (256 * 256)
+#define PIXEL_CLUSTER_AREA_PER_POINT 1024
+
+struct _PixelProbe {
+	int32_t x;
+	int32_t y;
+	size_t index; /* Where its color goes. */
+};
+
+typedef struct _PixelProbe PixelProbe;
+
+static int compareProbesByX(const void *a, const void *b)
+{
+	const PixelProbe *p = (const PixelProbe *)a;
+	const PixelProbe *q = (const PixelProbe *)b;
+	return (p->x > q->x) - (p->x < q->x);
+}
+
+static int compareProbesByY(const void *a, const void *b)
+{
+	const PixelProbe *p = (const PixelProbe *)a;
+	const PixelProbe *q = (const PixelProbe *)b;
+	return (p->y > q->y) - (p->y < q->y);
+}
+
+static int readProbeCluster(PixelProbe *probes, size_t count, uint32_t *colors)
+{
+	int32_t left = probes[0].x, right = probes[0].x;
+	int32_t top = probes[0].y, bottom = probes[0].y;
+	int64_t width, height;
+	MMBitmapRef bitmap;
+	size_t i;
+
+	for (i = 1; i < count; i++) {
+		if (probes[i].x < left) left = probes[i].x;
+		if (probes[i].x > right) right = probes[i].x;
+		if (probes[i].y < top) top = probes[i].y;
+		if (probes[i].y > bottom) bottom = probes[i].y;
+	}
+
+	width = (int64_t)right - left + 1;
+	height = (int64_t)bottom - top + 1;
+
+	if (count > 1 && width * height > PIXEL_CLUSTER_MIN_AREA &&
+	    width * height > (int64_t)count * PIXEL_CLUSTER_AREA_PER_POINT) {
+		/* Split across the longer side, at the median point. */
+		const size_t half = count / 2;
+		qsort(probes, count, sizeof(PixelProbe),
+		      width >= height ? compareProbesByX : compareProbesByY);
+		if (readProbeCluster(probes, half, colors) != 0) return -1;
+		return readProbeCluster(probes + half, count - half, colors);
+	}
+
+	bitmap = copyMMBitmapFromDisplayInRect(MMSignedRectMake(left, top,
+	                                                        (int32_t)width,
+	                                                        (int32_t)height));
+	if (bitmap == NULL || bitmap->imageBuffer == NULL ||
+	    bitmap->width == 0 || bitmap->height == 0) {
+		if (bitmap != NULL) destroyMMBitmap(bitmap);
+		return -1;
+	}
+
+	/* Scale into the capture, which is larger than asked for on HiDPI
+	 * displays. */
+	for (i = 0; i < count; i++) {
+		const size_t x = (size_t)((probes[i].x - left) * (int64_t)bitmap->width / width);
+		const size_t y = (size_t)((probes[i].y - top) * (int64_t)bitmap->height / height);
+		colors[probes[i].index] = (uint32_t)MMRGBHexAtPoint(bitmap, x, y);
+	}
+
+	destroyMMBitmap(bitmap);
+	return 0;
+}
+
+/* Enough for the usual handful of probes without going to the heap. */
+#define PIXEL_PROBES_ON_STACK 64
+
+int copyPixelColorsFromDisplay(const MMSignedPoint *points, size_t count,
+                               uint32_t *colors)
+{
+	PixelProbe stackProbes[PIXEL_PROBES_ON_STACK];
+	PixelProbe *probes = stackProbes;
+	size_t i;
+	int result;
+
+	if (count == 0) return 0;
+
+	if (count > PIXEL_PROBES_ON_STACK) {
+		probes = malloc(count * sizeof(PixelProbe));
+		if (probes == NULL) return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		probes[i].x = points[i].x;
+		probes[i].y = points[i].y;
+		probes[i].index = i;
+	}
+
+	result = readProbeCluster(probes, count, colors);
+
+	if (probes != stackProbes) free(probes);
+	return result;
+}
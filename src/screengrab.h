@@ -14,6 +14,16 @@ extern "C"
  * caller), or NULL on error. */
 MMBitmapRef copyMMBitmapFromDisplayInRect(MMSignedRect rect);
 
+/* Reads the colors of the |count| display pixels at |points| into |colors|,
+ * as 0xRRGGBB. Points close together are read with one capture of their
+ * bounding box, and far-flung ones in separate, smaller captures, so the
+ * number of captures stays small without ever reading much more of the
+ * screen than needed. The points must be on the display.
+ *
+ * Returns 0 on success, or -1 if the display could not be read. */
+int copyPixelColorsFromDisplay(const MMSignedPoint *points, size_t count,
+                               uint32_t *colors);
+
 #ifdef __cplusplus
 }
 #endif
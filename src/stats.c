@@ -0,0 +1,176 @@
+#include "stats.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+/* Relaxed atomics on 64-bit counters. Nothing is ordered against anything
+ * else; each counter only has to add up. */
+#if defined(_MSC_VER)
+	#define ATOMIC_ADD(ptr, value) \
+		((void)_InterlockedExchangeAdd64((volatile __int64 *)(ptr), (__int64)(value)))
+	#define ATOMIC_LOAD(ptr) \
+		((uint64_t)_InterlockedOr64((volatile __int64 *)(ptr), 0))
+	#define ATOMIC_STORE(ptr, value) \
+		((void)_InterlockedExchange64((volatile __int64 *)(ptr), (__int64)(value)))
+	#define ATOMIC_CAS(ptr, expected, desired) \
+		(_InterlockedCompareExchange64((volatile __int64 *)(ptr), (__int64)(desired), \
+		                               (__int64)(expected)) == (__int64)(expected))
+#else
+	#define ATOMIC_ADD(ptr, value) \
+		((void)__atomic_fetch_add((ptr), (uint64_t)(value), __ATOMIC_RELAXED))
+	#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+	#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (uint64_t)(value), __ATOMIC_RELAXED)
+	#define ATOMIC_CAS(ptr, expected, desired) compareExchange((ptr), (expected), (desired))
+
+static int compareExchange(uint64_t *ptr, uint64_t expected, uint64_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0,
+	                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#endif
+
+/* HDR-style histogram: values below 16 ns get a bucket each, and every power
+ * of two above that is split into 16 equal buckets, so a bucket is never
+ * wider than 1/16 of the values in it. Anything from 2^44 ns (almost five
+ * hours) up shares the last bucket. */
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_EXPONENT 44
+#define BUCKET_COUNT (SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS) * SUB_BUCKETS)
+
+struct _MMStatCounters {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t totalNs;
+	uint64_t maxNs;
+	uint64_t buckets[BUCKET_COUNT];
+};
+
+static struct _MMStatCounters counters[kMMStatOperationCount];
+
+static const char *operationNames[kMMStatOperationCount] = {
+	"capture",
+	"convert",
+	"object",
+	"mouse",
+	"keyboard"
+};
+
+/* Index of the highest set bit of |value|, which must not be 0. */
+static unsigned int highestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (unsigned int)index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(value >> 32))) return (unsigned int)index + 32;
+	_BitScanReverse(&index, (unsigned long)value);
+	return (unsigned int)index;
+#else
+	return 63 - (unsigned int)__builtin_clzll(value);
+#endif
+}
+
+static size_t bucketForValue(uint64_t value)
+{
+	unsigned int exponent;
+	size_t index;
+
+	if (value < SUB_BUCKETS) return (size_t)value;
+
+	exponent = highestBit(value);
+	index = SUB_BUCKETS + (size_t)(exponent - SUB_BUCKET_BITS) * SUB_BUCKETS +
+	        (size_t)((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+	return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+}
+
+/* The middle of the range of values that land in bucket |index|. */
+static uint64_t valueForBucket(size_t index)
+{
+	size_t exponent;
+	uint64_t low, width;
+
+	if (index < SUB_BUCKETS) return (uint64_t)index;
+
+	exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+	width = (uint64_t)1 << (exponent - SUB_BUCKET_BITS);
+	low = (uint64_t)(SUB_BUCKETS + (index - SUB_BUCKETS) % SUB_BUCKETS) * width;
+	return low + width / 2;
+}
+
+void MMStatsRecord(MMStatOperation operation, MMTimestamp elapsed, uint64_t bytes)
+{
+	struct _MMStatCounters *stat = &counters[operation];
+	uint64_t max;
+
+	ATOMIC_ADD(&stat->count, 1);
+	ATOMIC_ADD(&stat->bytes, bytes);
+	ATOMIC_ADD(&stat->totalNs, elapsed);
+	ATOMIC_ADD(&stat->buckets[bucketForValue(elapsed)], 1);
+
+	max = ATOMIC_LOAD(&stat->maxNs);
+	while (elapsed > max && !ATOMIC_CAS(&stat->maxNs, max, elapsed)) {
+		max = ATOMIC_LOAD(&stat->maxNs);
+	}
+}
+
+void MMStatsSummarize(MMStatOperation operation, MMStatSummary *summary)
+{
+	struct _MMStatCounters *stat = &counters[operation];
+	uint64_t buckets[BUCKET_COUNT];
+	uint64_t total = 0;
+	uint64_t seen = 0;
+	const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t *results[4];
+	size_t i, next = 0;
+
+	summary->count = ATOMIC_LOAD(&stat->count);
+	summary->bytes = ATOMIC_LOAD(&stat->bytes);
+	summary->totalNs = ATOMIC_LOAD(&stat->totalNs);
+	summary->maxNs = ATOMIC_LOAD(&stat->maxNs);
+
+	/* Percentiles come from the buckets' own total, which may be a little off
+	 * |count| while other threads are recording. */
+	for (i = 0; i < BUCKET_COUNT; i++) {
+		buckets[i] = ATOMIC_LOAD(&stat->buckets[i]);
+		total += buckets[i];
+	}
+
+	results[0] = &summary->p50Ns;
+	results[1] = &summary->p90Ns;
+	results[2] = &summary->p99Ns;
+	results[3] = &summary->p999Ns;
+	for (i = 0; i < 4; i++) *results[i] = 0;
+	if (total == 0) return;
+
+	for (i = 0; i < BUCKET_COUNT && next < 4; i++) {
+		seen += buckets[i];
+		while (next < 4 && (double)seen >= quantiles[next] * (double)total) {
+			/* Never report more than was actually seen. */
+			const uint64_t value = valueForBucket(i);
+			*results[next++] = value < summary->maxNs ? value : summary->maxNs;
+		}
+	}
+}
+
+void MMStatsReset(void)
+{
+	size_t operation, i;
+
+	for (operation = 0; operation < kMMStatOperationCount; operation++) {
+		struct _MMStatCounters *stat = &counters[operation];
+		ATOMIC_STORE(&stat->count, 0);
+		ATOMIC_STORE(&stat->bytes, 0);
+		ATOMIC_STORE(&stat->totalNs, 0);
+		ATOMIC_STORE(&stat->maxNs, 0);
+		for (i = 0; i < BUCKET_COUNT; i++) ATOMIC_STORE(&stat->buckets[i], 0);
+	}
+}
+
+const char *MMStatOperationName(MMStatOperation operation)
+{
+	return operationNames[operation];
+}
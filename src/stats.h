@@ -0,0 +1,59 @@
+#pragma once
+#ifndef STATS_H
+#define STATS_H
+
+#include "timing.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* The operations the binding keeps latency statistics for. */
+enum _MMStatOperation {
+	kMMStatCapture = 0, /* Reading pixels from the display. */
+	kMMStatConvert,     /* Copying captured pixels out (to a Buffer or color). */
+	kMMStatObject,      /* Building the JS object handed back. */
+	kMMStatMouse,       /* Injecting mouse input, without the mouse delay. */
+	kMMStatKeyboard,    /* Injecting key input, without the keyboard delay. */
+	kMMStatOperationCount
+};
+
+typedef enum _MMStatOperation MMStatOperation;
+
+/* A point-in-time view of one operation's statistics. Latencies are in
+ * nanoseconds; percentiles are read off a log-linear histogram and are
+ * accurate to about 3%. */
+struct _MMStatSummary {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t totalNs;
+	uint64_t maxNs;
+	uint64_t p50Ns;
+	uint64_t p90Ns;
+	uint64_t p99Ns;
+	uint64_t p999Ns;
+};
+
+typedef struct _MMStatSummary MMStatSummary;
+
+/* Adds one call of |operation| that took |elapsed| and moved |bytes|.
+ * Lock-free and safe to call from any thread. */
+void MMStatsRecord(MMStatOperation operation, MMTimestamp elapsed, uint64_t bytes);
+
+/* Fills in |summary| for |operation|. Calls recorded while this runs may be
+ * only partly included. */
+void MMStatsSummarize(MMStatOperation operation, MMStatSummary *summary);
+
+/* Zeroes the statistics of every operation. */
+void MMStatsReset(void);
+
+/* Returns the name the operation is reported under, e.g. "capture". */
+const char *MMStatOperationName(MMStatOperation operation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATS_H */
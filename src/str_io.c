@@ -19,6 +19,7 @@
 
 #define MAX_DIMENSION_LEN 5 /* Maximum length for [width] or [height]
                              * in string. */
+#define MAX_DIMENSION 99999
 
 const char *MMBitmapStringErrorString(MMBMPStringError err)
 {
@@ -50,43 +51,92 @@ static bool getSizeFromString(const uint8_t *buf, size_t buflen,
                               size_t *width, size_t *height,
                               size_t *len);
 
-MMBitmapRef createMMBitmapFromString(const uint8_t *buffer, size_t buflen,
-                                     MMBMPStringError *err)
+/* Parses the "b[width],[height]," header, setting |width|, |height| and the
+ * length of the header, |len|. */
+static bool parseHeader(const uint8_t *buffer, size_t buflen,
+                        size_t *width, size_t *height, size_t *len)
+{
+	if (buffer == NULL || buflen < 1 || buffer[0] != 'b' ||
+	    !getSizeFromString(buffer + 1, buflen - 1, width, height, len)) {
+		return false;
+	}
+
+	++*len;
+	return true;
+}
+
+int MMBitmapStringSize(const uint8_t *buffer, size_t buflen,
+                       size_t *width, size_t *height)
+{
+	size_t len;
+	return parseHeader(buffer, buflen, width, height, &len) ? 0 : -1;
+}
+
+int readMMBitmapString(const uint8_t *buffer, size_t buflen,
+                       uint8_t *dest, size_t destlen, MMBMPStringError *err)
 {
-	uint8_t *decoded, *decompressed;
+	uint8_t *decoded;
 	size_t width, height;
-	size_t len, bytewidth;
+	size_t len;
+	int ret;
 
-	if (*buffer++ != 'b' || !getSizeFromString(buffer, --buflen,
-	                                           &width, &height, &len)) {
+	if (!parseHeader(buffer, buflen, &width, &height, &len)) {
 		if (err != NULL) *err = kMMBMPStringInvalidHeaderError;
-		return NULL;
+		return -1;
 	}
 	buffer += len;
 	buflen -= len;
 
-	decoded = base64decode(buffer, buflen, NULL);
+	if (width * height * STR_BYTES_PER_PIXEL != destlen) {
+		if (err != NULL) *err = kMMBMPStringSizeError;
+		return -1;
+	}
+
+	decoded = malloc(BASE64_DECODED_MAX_LENGTH(buflen) + 1);
 	if (decoded == NULL) {
 		if (err != NULL) *err = kMMBMPStringDecodeError;
-		return NULL;
+		return -1;
 	}
 
-	decompressed = zlib_decompress(decoded, &len);
+	/* Inflate straight into the pixels; the header says how big they are. */
+	len = base64decodeInto(buffer, buflen, decoded);
+	ret = zlib_decompress_into(decoded, len, dest, destlen);
 	free(decoded);
 
-	if (decompressed == NULL) {
+	if (ret != 0) {
 		if (err != NULL) *err = kMMBMPStringDecompressError;
+		return -1;
+	}
+
+	return 0;
+}
+
+MMBitmapRef createMMBitmapFromString(const uint8_t *buffer, size_t buflen,
+                                     MMBMPStringError *err)
+{
+	uint8_t *pixels;
+	size_t width, height;
+	size_t bytewidth;
+
+	if (MMBitmapStringSize(buffer, buflen, &width, &height) != 0) {
+		if (err != NULL) *err = kMMBMPStringInvalidHeaderError;
 		return NULL;
 	}
 
 	bytewidth = width * STR_BYTES_PER_PIXEL; /* Note that bytewidth is NOT
 	                                          * aligned to a padding. */
-	if (height * bytewidth != len) {
-		if (err != NULL) *err = kMMBMPStringSizeError;
+	pixels = malloc(bytewidth * height);
+	if (pixels == NULL) {
+		if (err != NULL) *err = kMMBMPStringGenericError;
 		return NULL;
 	}
 
-	return createMMBitmap(decompressed, width, height,
+	if (readMMBitmapString(buffer, buflen, pixels, bytewidth * height, err) != 0) {
+		free(pixels);
+		return NULL;
+	}
+
+	return createMMBitmap(pixels, width, height,
 	                      bytewidth, STR_BITS_PER_PIXEL, STR_BYTES_PER_PIXEL);
 }
 
@@ -96,14 +146,22 @@ MMBitmapRef createMMBitmapFromString(const uint8_t *buffer, size_t buflen,
  * Caller is responsible for free()'ing returned buffer. */
 static uint8_t *createRawBitmapData(MMBitmapRef bitmap);
 
-uint8_t *createStringFromMMBitmap(MMBitmapRef bitmap, MMBMPStringError *err)
+uint8_t *createStringFromMMBitmap(MMBitmapRef bitmap, MMBMPStringError *err,
+                                  size_t *len)
 {
 	uint8_t *raw, *compressed;
-	uint8_t *ret, *encoded;
-	size_t len, retlen;
+	uint8_t *ret;
+	char header[3 + (MAX_DIMENSION_LEN * 2) + 1];
+	size_t compressedLen, headerLen, retlen;
 
 	assert(bitmap != NULL);
 
+	if (bitmap->width <= 0 || bitmap->height <= 0 ||
+	    bitmap->width > MAX_DIMENSION || bitmap->height > MAX_DIMENSION) {
+		if (err != NULL) *err = kMMBMPStringGenericError;
+		return NULL;
+	}
+
 	raw = createRawBitmapData(bitmap);
 	if (raw == NULL) {
 		if (err != NULL) *err = kMMBMPStringGenericError;
@@ -113,27 +171,31 @@ uint8_t *createStringFromMMBitmap(MMBitmapRef bitmap, MMBMPStringError *err)
 	compressed = zlib_compress(raw,
 	                           bitmap->width * bitmap->height *
 	                           STR_BYTES_PER_PIXEL,
-	                           9, &len);
+	                           9, &compressedLen);
 	free(raw);
 	if (compressed == NULL) {
 		if (err != NULL) *err = kMMBMPStringCompressError;
 		return NULL;
 	}
 
-	encoded = base64encode(compressed, len - 1, &retlen);
-	free(compressed);
-	if (encoded == NULL) {
+	/* Size the string exactly, and encode straight into it. */
+	headerLen = (size_t)snprintf(header, sizeof(header), "b%lu,%lu,",
+	                             (unsigned long)bitmap->width,
+	                             (unsigned long)bitmap->height);
+	retlen = headerLen + BASE64_ENCODED_LENGTH(compressedLen);
+	ret = malloc(retlen + 1);
+	if (ret == NULL) {
+		free(compressed);
 		if (err != NULL) *err = MMMBMPStringEncodeError;
 		return NULL;
 	}
 
-	retlen += 3 + (MAX_DIMENSION_LEN * 2);
-	ret = calloc(sizeof(char), (retlen + 1));
-	snprintf((char *)ret, retlen, "b%lu,%lu,%s", (unsigned long)bitmap->width,
-	                                             (unsigned long)bitmap->height,
-												 encoded);
+	memcpy(ret, header, headerLen);
+	base64encodeInto(compressed, compressedLen, ret + headerLen);
 	ret[retlen] = '\0';
-	free(encoded);
+	free(compressed);
+
+	if (len != NULL) *len = retlen;
 	return ret;
 }
 
@@ -149,12 +211,14 @@ static bool getSizeFromString(const uint8_t *buf, size_t buflen,
 	assert(width != NULL);
 	assert(height != NULL);
 
-	if ((*width = parseDimension(buf, buflen, &numlen)) == 0) {
+	if ((*width = parseDimension(buf, buflen, &numlen)) == 0 ||
+	    numlen >= buflen || buf[numlen] != ',') {
 		return false;
 	}
 	*len = numlen + 1;
 
-	if ((*height = parseDimension(buf + *len, buflen, &numlen)) == 0) {
+	if ((*height = parseDimension(buf + *len, buflen - *len, &numlen)) == 0 ||
+	    *len + numlen >= buflen || buf[*len + numlen] != ',') {
 		return false;
 	}
 	*len += numlen + 1;
@@ -171,9 +235,9 @@ static uint32_t parseDimension(const uint8_t *buf, size_t buflen,
 	size_t i;
 
 	assert(buf != NULL);
-	assert(len != NULL);
+	assert(numlen != NULL);
 	for (i = 0; i < buflen && buf[i] != ',' && buf[i] != '\0'; ++i) {
-		if (!isdigit(buf[i]) || i > MAX_DIMENSION_LEN) return 0;
+		if (!isdigit(buf[i]) || i >= MAX_DIMENSION_LEN) return 0;
 		num[i] = buf[i];
 	}
 	num[i] = '\0';
@@ -184,21 +248,30 @@ static uint32_t parseDimension(const uint8_t *buf, size_t buflen,
 
 static uint8_t *createRawBitmapData(MMBitmapRef bitmap)
 {
-	uint8_t *raw = calloc(STR_BYTES_PER_PIXEL, bitmap->width * bitmap->height);
-	size_t y;
+	uint8_t *raw = malloc((size_t)bitmap->width * bitmap->height * STR_BYTES_PER_PIXEL);
+	uint8_t *dest = raw;
+	int32_t x, y;
+
+	if (raw == NULL) return NULL;
 
 	for (y = 0; y < bitmap->height; ++y) {
 		/* No padding is added to string bitmaps. */
-		const size_t rowOffset = y * bitmap->width * STR_BYTES_PER_PIXEL;
-		size_t x;
+		const uint8_t *src = bitmap->imageBuffer + (size_t)bitmap->bytewidth * y;
+
+		if (bitmap->bytesPerPixel == STR_BYTES_PER_PIXEL) {
+			memcpy(dest, src, (size_t)bitmap->width * STR_BYTES_PER_PIXEL);
+			dest += (size_t)bitmap->width * STR_BYTES_PER_PIXEL;
+			continue;
+		}
+
 		for (x = 0; x < bitmap->width; ++x) {
 			/* Copy in BGR format. */
-			const size_t colOffset = x * STR_BYTES_PER_PIXEL;
-			uint8_t *dest = raw + rowOffset + colOffset;
-			MMRGBColor *srcColor = MMRGBColorRefAtPoint(bitmap, x, y);
+			const MMRGBColor *srcColor = (const MMRGBColor *)src;
 			dest[0] = srcColor->blue;
 			dest[1] = srcColor->green;
 			dest[2] = srcColor->red;
+			dest += STR_BYTES_PER_PIXEL;
+			src += bitmap->bytesPerPixel;
 		}
 	}
 
@@ -6,6 +6,10 @@
 #include "io.h"
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
 
 enum _MMBMPStringError {
 	kMMBMPStringGenericError = 0,
@@ -19,6 +23,21 @@ enum _MMBMPStringError {
 
 typedef MMIOError MMBMPStringError;
 
+/* Parses the header of a bitmap string (see createMMBitmapFromString()),
+ * setting |width| and |height|. Returns 0 on success, or -1 if the header
+ * isn't valid. */
+int MMBitmapStringSize(const uint8_t *buffer, size_t buflen,
+                       size_t *width, size_t *height);
+
+/* Decodes the pixels of a bitmap string into |dest| as unpadded 24-bit BGR,
+ * with no intermediate copy of the pixels. |destlen| must be exactly
+ * width * height * 3, as given by MMBitmapStringSize().
+ *
+ * Returns 0 on success, or -1 on error (with |error|, if not NULL, set to
+ * the error code). */
+int readMMBitmapString(const uint8_t *buffer, size_t buflen,
+                       uint8_t *dest, size_t destlen, MMBMPStringError *error);
+
 /* Creates a 24-bit bitmap from a compressed, printable string.
  *
  * String should be in the format: "b[width],[height],[data]",
@@ -40,11 +59,17 @@ MMBitmapRef createMMBitmapFromString(const uint8_t *buffer, size_t buflen,
  *
  * Returns NULL on error, or new string on success (to be free'()d by caller).
  * If |error| is non-NULL, it will be set to the error code on return.
+ * If |len| is non-NULL, it will be set to the length of the string.
  */
-uint8_t *createStringFromMMBitmap(MMBitmapRef bitmap, MMBMPStringError *error);
+uint8_t *createStringFromMMBitmap(MMBitmapRef bitmap, MMBMPStringError *error,
+                                  size_t *len);
 
 /* Returns description of given error code.
  * Returned string is constant and hence should not be freed. */
 const char *MMBitmapStringErrorString(MMBMPStringError err);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* STR_IO_H */
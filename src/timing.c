@@ -0,0 +1,111 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* For clock_nanosleep() */
+#endif
+
+#include "timing.h"
+
+#if !defined(IS_WINDOWS)
+	#include <time.h>
+	#include <errno.h>
+#endif
+
+/* Use absolute sleeps where the platform has them (Linux and most other
+ * POSIX systems); macOS only has relative nanosleep(). */
+#if !defined(IS_WINDOWS) && !defined(IS_MACOSX) && defined(TIMER_ABSTIME)
+	#define HAS_ABSOLUTE_SLEEP 1
+#endif
+
+static MMTimestamp spinWindow = 0;
+
+MMTimestamp MMTimestampNow(void)
+{
+#if defined(IS_WINDOWS)
+	static LARGE_INTEGER frequency = {0};
+	LARGE_INTEGER counter;
+
+	if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	/* Split the conversion to avoid overflowing 64 bits. */
+	return (MMTimestamp)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+	       (MMTimestamp)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL /
+	       (MMTimestamp)frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (MMTimestamp)now.tv_sec * 1000000000ULL + (MMTimestamp)now.tv_nsec;
+#endif
+}
+
+/* Sleeps in the OS until roughly |deadline|. May return early (e.g. when
+ * interrupted by a signal); sleepUntil() takes care of that. */
+static void osSleepUntil(MMTimestamp deadline, MMTimestamp now)
+{
+#if defined(IS_WINDOWS)
+	/* Sleep() only has millisecond granularity (and usually worse), so round
+	 * down and let the caller loop for the remainder. */
+	Sleep((DWORD)((deadline - now) / 1000000ULL));
+#elif defined(HAS_ABSOLUTE_SLEEP)
+	struct timespec ts;
+	(void)now;
+	ts.tv_sec = (time_t)(deadline / 1000000000ULL);
+	ts.tv_nsec = (long)(deadline % 1000000000ULL);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#else
+	struct timespec ts;
+	const MMTimestamp remaining = deadline - now;
+	ts.tv_sec = (time_t)(remaining / 1000000000ULL);
+	ts.tv_nsec = (long)(remaining % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void sleepUntil(MMTimestamp deadline)
+{
+	for (;;) {
+		const MMTimestamp now = MMTimestampNow();
+		if (now >= deadline) return;
+
+		if (deadline - now <= spinWindow) {
+			/* Close enough; spin out the rest. */
+			while (MMTimestampNow() < deadline)
+				;
+			return;
+		}
+
+		osSleepUntil(deadline - spinWindow, now);
+	}
+}
+
+void setSleepSpinWindow(double milliseconds)
+{
+	spinWindow = milliseconds > 0.0 ? MMTimestampFromMilliseconds(milliseconds) : 0;
+}
+
+double getSleepSpinWindow(void)
+{
+	return MMTimestampToMilliseconds(spinWindow);
+}
+
+void MMPacerStart(MMPacer *pacer)
+{
+	pacer->next = MMTimestampNow();
+}
+
+void MMPacerWait(MMPacer *pacer, double milliseconds)
+{
+	const MMTimestamp now = MMTimestampNow();
+
+	if (milliseconds > 0.0) {
+		pacer->next += MMTimestampFromMilliseconds(milliseconds);
+	}
+
+	/* Don't try to make up for a long stall. */
+	if (now > pacer->next &&
+	    now - pacer->next > MMTimestampFromMilliseconds(MMPACER_MAX_LAG_MS)) {
+		pacer->next = now;
+		return;
+	}
+
+	sleepUntil(pacer->next);
+}
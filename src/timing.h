@@ -0,0 +1,64 @@
+#pragma once
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "os.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* A reading of the monotonic clock, in nanoseconds. Only the difference
+ * between two timestamps is meaningful. */
+typedef uint64_t MMTimestamp;
+
+#define MMTimestampFromMilliseconds(ms) ((MMTimestamp)((ms) * 1000000.0))
+#define MMTimestampToMilliseconds(ts) ((double)(ts) / 1000000.0)
+
+/* Returns the current time of the monotonic clock (CLOCK_MONOTONIC on POSIX,
+ * QueryPerformanceCounter() on Windows). */
+MMTimestamp MMTimestampNow(void);
+
+/* Blocks until the monotonic clock reaches |deadline|, or returns immediately
+ * if it already has.
+ *
+ * Because the deadline is absolute, time lost to oversleeping or to an
+ * interrupted sleep is not carried over to the next wait. The last part of
+ * the wait (see setSleepSpinWindow()) is busy-waited for accuracy. */
+void sleepUntil(MMTimestamp deadline);
+
+/* Sets how many milliseconds before a deadline sleepUntil() stops sleeping
+ * and starts spinning. 0 (the default) disables spinning. Around 0.2 ms is
+ * enough for sub-millisecond accuracy on most systems. */
+void setSleepSpinWindow(double milliseconds);
+
+/* Returns the current spin window in milliseconds. */
+double getSleepSpinWindow(void);
+
+/* Paces a sequence of events on an absolute schedule: each wait is measured
+ * from the previous deadline rather than from "now", so that the time spent
+ * sending events and any overshoot of the OS sleep do not accumulate over a
+ * long sequence. */
+struct _MMPacer {
+	MMTimestamp next; /* Deadline of the next event. */
+};
+
+typedef struct _MMPacer MMPacer;
+
+/* A pacer that falls further behind than this (e.g. after the machine was
+ * suspended) restarts its schedule instead of bursting to catch up. */
+#define MMPACER_MAX_LAG_MS 250.0
+
+/* Starts the schedule at the current time. */
+void MMPacerStart(MMPacer *pacer);
+
+/* Advances the schedule by |milliseconds| and waits for the new deadline. */
+void MMPacerWait(MMPacer *pacer, double milliseconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMING_H */
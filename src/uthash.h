@@ -41,8 +41,12 @@
 
 
 #define uthash_fatal(msg) exit(-1)        /* fatal error (out of memory,etc) */
+#ifndef uthash_malloc
 #define uthash_malloc(sz) malloc(sz)      /* malloc fcn                      */
+#endif
+#ifndef uthash_free
 #define uthash_free(ptr) free(ptr)        /* free fcn                        */
+#endif
 
 #define uthash_noexpand_fyi(tbl)          /* can be defined to log noexpand  */
 #define uthash_expand_fyi(tbl)            /* can be defined to log expands   */
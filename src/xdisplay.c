@@ -1,4 +1,5 @@
 #include "xdisplay.h"
+#include "xkeymap.h"
 #include <stdio.h> /* For fputs() */
 #include <stdlib.h> /* For atexit() */
 
@@ -38,6 +39,7 @@ Display *XGetMainDisplay(void)
 void XCloseMainDisplay(void)
 {
 	if (mainDisplay != NULL) {
+		XRestoreKeyMap(mainDisplay);
 		XCloseDisplay(mainDisplay);
 		mainDisplay = NULL;
 	}
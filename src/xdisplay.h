@@ -4,6 +4,11 @@
 
 #include <X11/Xlib.h>
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 /* Returns the main display, closed either on exit or when closeMainDisplay()
  * is invoked. This removes a bit of the overhead of calling XOpenDisplay() &
  * XCloseDisplay() everytime the main display needs to be used.
@@ -14,11 +19,6 @@ Display *XGetMainDisplay(void);
 /* Closes the main display if it is open, or does nothing if not. */
 void XCloseMainDisplay(void);
 
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-
 char *getXDisplay(void);
 void setXDisplay(char *name);
 
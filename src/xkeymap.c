@@ -0,0 +1,276 @@
+#include "xkeymap.h"
+#include <stdbool.h>
+#include <string.h> /* For memset() */
+
+/* Open addressing table from keysym to keycode. It has to hold two levels
+ * for each of at most 248 keycodes, plus whatever gets bound to empty
+ * keycodes; once it is three quarters full it is rebuilt from the server. */
+#define KEYMAP_TABLE_SIZE 1024
+#define KEYMAP_MAX_LOAD (KEYMAP_TABLE_SIZE * 3 / 4)
+
+/* The most keysyms per keycode we are prepared to write back. */
+#define KEYMAP_MAX_KEYSYMS 16
+
+struct XKeyMapEntry {
+	KeySym keysym;   /* NoSymbol if the slot is free. */
+	KeyCode keycode; /* 0 if the keysym has been unbound. */
+	unsigned char level;
+};
+
+static struct {
+	Display *display;
+	bool valid;
+	int keysymsPerKeyCode;
+	unsigned int used;
+
+	/* Number of MappingNotify events that were caused by our own
+	 * XChangeKeyboardMapping() calls, and so need not invalidate the cache. */
+	unsigned int pendingChanges;
+
+	struct XKeyMapEntry table[KEYMAP_TABLE_SIZE];
+
+	/* Keycodes the layout leaves empty, and what we have bound to them. */
+	KeyCode scratch[256];
+	unsigned int scratchCount;
+	unsigned int nextScratch;
+	KeySym bound[256];
+} keymap;
+
+static struct XKeyMapEntry *findEntry(KeySym keysym)
+{
+	size_t i = ((unsigned long)keysym * 2654435761UL) & (KEYMAP_TABLE_SIZE - 1);
+
+	while (keymap.table[i].keysym != NoSymbol &&
+	       keymap.table[i].keysym != keysym) {
+		i = (i + 1) & (KEYMAP_TABLE_SIZE - 1);
+	}
+
+	return &keymap.table[i];
+}
+
+static void insertEntry(KeySym keysym, KeyCode keycode, unsigned char level)
+{
+	struct XKeyMapEntry *entry = findEntry(keysym);
+
+	if (entry->keysym == NoSymbol) {
+		entry->keysym = keysym;
+		++keymap.used;
+	} else if (entry->keycode != 0) {
+		return; /* Keep the first (lowest level) binding. */
+	}
+
+	entry->keycode = keycode;
+	entry->level = level;
+}
+
+static bool buildKeyMap(Display *display)
+{
+	int minKeyCode, maxKeyCode, perKeyCode;
+	int keycode, level;
+	KeySym *keysyms;
+
+	if (keymap.display != display) {
+		/* Bindings made on another connection are not ours to track. */
+		memset(&keymap, 0, sizeof(keymap));
+		keymap.display = display;
+	}
+
+	XDisplayKeycodes(display, &minKeyCode, &maxKeyCode);
+	keysyms = XGetKeyboardMapping(display, (KeyCode)minKeyCode,
+	                              maxKeyCode - minKeyCode + 1, &perKeyCode);
+	if (keysyms == NULL) return false;
+
+	memset(keymap.table, 0, sizeof(keymap.table));
+	keymap.used = 0;
+	keymap.scratchCount = 0;
+	keymap.nextScratch = 0;
+	keymap.keysymsPerKeyCode = perKeyCode;
+
+	/* Only the unshifted and shifted levels are used; keysyms only reachable
+	 * through AltGr or Mode_switch get bound to an empty keycode instead. */
+	for (level = XKEY_LEVEL_BASE; level <= XKEY_LEVEL_SHIFT && level < perKeyCode; ++level) {
+		for (keycode = minKeyCode; keycode <= maxKeyCode; ++keycode) {
+			const KeySym keysym = keysyms[(keycode - minKeyCode) * perKeyCode + level];
+			if (keysym != NoSymbol) {
+				insertEntry(keysym, (KeyCode)keycode, (unsigned char)level);
+			}
+		}
+	}
+
+	for (keycode = minKeyCode; keycode <= maxKeyCode; ++keycode) {
+		const KeySym *row = &keysyms[(keycode - minKeyCode) * perKeyCode];
+		bool empty = true;
+		int i;
+
+		for (i = 0; i < perKeyCode && empty; ++i) {
+			empty = row[i] == NoSymbol;
+		}
+
+		if (empty || keymap.bound[keycode] != NoSymbol) {
+			keymap.scratch[keymap.scratchCount++] = (KeyCode)keycode;
+		}
+	}
+
+	XFree(keysyms);
+	keymap.valid = true;
+	return true;
+}
+
+/* Handles any MappingNotify events already read from the connection (every
+ * key event is followed by XSync(), so nothing extra is read here), then
+ * builds the cache if needed. */
+static bool syncKeyMap(Display *display)
+{
+	while (XEventsQueued(display, QueuedAlready) > 0) {
+		XEvent event;
+		XNextEvent(display, &event);
+
+		if (event.type != MappingNotify) continue;
+
+		XRefreshKeyboardMapping(&event.xmapping);
+		if (event.xmapping.request != MappingKeyboard) continue;
+
+		if (keymap.pendingChanges > 0) {
+			--keymap.pendingChanges;
+		} else {
+			XInvalidateKeyMap();
+		}
+	}
+
+	if (keymap.valid && keymap.display == display) return true;
+	return buildKeyMap(display);
+}
+
+KeyCode XKeyCodeForKeySym(Display *display, KeySym keysym, unsigned int *level)
+{
+	struct XKeyMapEntry *entry;
+
+	if (level != NULL) *level = XKEY_LEVEL_BASE;
+	if (display == NULL || keysym == NoSymbol) return 0;
+
+	if (!syncKeyMap(display)) return 0;
+
+	entry = findEntry(keysym);
+	if (entry->keysym == keysym && entry->keycode != 0) {
+		if (level != NULL) *level = entry->level;
+		return entry->keycode;
+	}
+
+	if (XBindKeySyms(display, &keysym, 1) == 0) return 0;
+	return findEntry(keysym)->keycode;
+}
+
+/* Writes the bindings of keycodes |first| through |last| to the server. */
+static void writeBindings(Display *display, int first, int last)
+{
+	static KeySym keysyms[256 * KEYMAP_MAX_KEYSYMS];
+	const int perKeyCode = keymap.keysymsPerKeyCode;
+	int keycode, i;
+
+	for (keycode = first; keycode <= last; ++keycode) {
+		KeySym *row = &keysyms[(keycode - first) * perKeyCode];
+
+		/* Bind both levels, so the keysym comes out whatever the Shift
+		 * state. */
+		for (i = 0; i < perKeyCode; ++i) {
+			row[i] = i <= XKEY_LEVEL_SHIFT ? keymap.bound[keycode] : NoSymbol;
+		}
+	}
+
+	XChangeKeyboardMapping(display, first, perKeyCode, keysyms, last - first + 1);
+	++keymap.pendingChanges;
+}
+
+size_t XBindKeySyms(Display *display, const KeySym *keysyms, size_t count)
+{
+	bool claimed[256] = {false};
+	bool dirty[256] = {false};
+	bool written = false;
+	unsigned int tries;
+	int keycode, first;
+	size_t i;
+
+	if (display == NULL) return 0;
+
+	if (!syncKeyMap(display)) return 0;
+
+	/* Make sure a whole batch fits; rebuilding drops unbound entries, and the
+	 * bindings themselves live on the server. */
+	if (keymap.used + keymap.scratchCount > KEYMAP_MAX_LOAD && !buildKeyMap(display)) {
+		return 0;
+	}
+
+	if (keymap.keysymsPerKeyCode > KEYMAP_MAX_KEYSYMS) return 0;
+
+	for (i = 0; i < count; ++i) {
+		struct XKeyMapEntry *entry;
+
+		if (keysyms[i] == NoSymbol) continue;
+
+		entry = findEntry(keysyms[i]);
+		if (entry->keysym == keysyms[i] && entry->keycode != 0) {
+			/* Don't rebind a keycode something earlier in the batch uses. */
+			claimed[entry->keycode] = true;
+			continue;
+		}
+
+		for (tries = 0; tries < keymap.scratchCount; ++tries) {
+			keycode = keymap.scratch[keymap.nextScratch];
+			keymap.nextScratch = (keymap.nextScratch + 1) % keymap.scratchCount;
+			if (!claimed[keycode]) break;
+		}
+
+		if (tries == keymap.scratchCount) break; /* Out of keycodes. */
+
+		if (keymap.bound[keycode] != NoSymbol) {
+			struct XKeyMapEntry *previous = findEntry(keymap.bound[keycode]);
+			if (previous->keycode == keycode) previous->keycode = 0;
+		}
+
+		keymap.bound[keycode] = keysyms[i];
+		insertEntry(keysyms[i], (KeyCode)keycode, XKEY_LEVEL_BASE);
+		claimed[keycode] = dirty[keycode] = true;
+	}
+
+	/* One request per run of adjacent keycodes, and a single round trip. */
+	first = -1;
+	for (keycode = 0; keycode <= 256; ++keycode) {
+		if (keycode < 256 && dirty[keycode]) {
+			if (first < 0) first = keycode;
+		} else if (first >= 0) {
+			writeBindings(display, first, keycode - 1);
+			written = true;
+			first = -1;
+		}
+	}
+
+	if (written) XSync(display, False);
+
+	return i;
+}
+
+void XInvalidateKeyMap(void)
+{
+	keymap.valid = false;
+}
+
+void XRestoreKeyMap(Display *display)
+{
+	KeySym keysyms[KEYMAP_MAX_KEYSYMS];
+	bool changed = false;
+	int keycode;
+
+	if (display == NULL || keymap.display != display) return;
+
+	for (keycode = 0; keycode < 256; ++keycode) {
+		if (keymap.bound[keycode] != NoSymbol) {
+			memset(keysyms, 0, sizeof(keysyms)); /* NoSymbol */
+			XChangeKeyboardMapping(display, keycode, keymap.keysymsPerKeyCode,
+			                       keysyms, 1);
+			changed = true;
+		}
+	}
+
+	if (changed) XSync(display, False);
+	memset(&keymap, 0, sizeof(keymap));
+}
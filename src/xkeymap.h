@@ -0,0 +1,53 @@
+#pragma once
+#ifndef XKEYMAP_H
+#define XKEYMAP_H
+
+#include <X11/Xlib.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Shift level a keysym was found at (see XKeyCodeForKeySym()). */
+enum _XKeyLevel {
+	XKEY_LEVEL_BASE = 0,
+	XKEY_LEVEL_SHIFT = 1
+};
+
+/* Returns the keycode that produces |keysym|, looked up in a cache built
+ * once from XGetKeyboardMapping() rather than by walking the mapping on every
+ * call like XKeysymToKeycode() does. The cache is rebuilt when the server
+ * reports a MappingNotify.
+ *
+ * If |level| is not NULL it is set to the shift level the keysym lives at, so
+ * the caller knows whether Shift has to be held to produce it.
+ *
+ * Keysyms missing from the current layout (or only reachable through
+ * AltGr/Mode_switch levels) are bound to one of the keycodes the layout
+ * leaves empty, which are cycled through in least-recently-assigned order and
+ * reset by XRestoreKeyMap(). Returns 0 if no keycode could be found or
+ * assigned. */
+KeyCode XKeyCodeForKeySym(Display *display, KeySym keysym, unsigned int *level);
+
+/* Makes sure the first keysyms of |keysyms| all have a keycode, binding the
+ * missing ones to empty keycodes with one XChangeKeyboardMapping() request per
+ * run of adjacent keycodes and a single round trip, rather than one per
+ * keysym. Stops when it runs out of keycodes that no earlier keysym in the
+ * batch needs, and returns how many keysyms can now be typed. NoSymbol
+ * entries are skipped over. */
+size_t XBindKeySyms(Display *display, const KeySym *keysyms, size_t count);
+
+/* Drops the cached mapping; the next lookup rebuilds it. */
+void XInvalidateKeyMap(void);
+
+/* Unbinds every keycode assigned by XKeyCodeForKeySym() and drops the cache.
+ * Must be called before |display| is closed. */
+void XRestoreKeyMap(Display *display);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XKEYMAP_H */
@@ -6,7 +6,7 @@
 
 #define ZLIB_CHUNK (16 * 1024)
 
-uint8_t *zlib_decompress(const uint8_t *buf, size_t *len)
+uint8_t *zlib_decompress(const uint8_t *buf, size_t buflen, size_t *len)
 {
 	size_t output_size = ZLIB_CHUNK;
 	uint8_t *output = malloc(output_size);
@@ -21,31 +21,39 @@ uint8_t *zlib_decompress(const uint8_t *buf, size_t *len)
 	zst.zalloc = Z_NULL;
 	zst.zfree = Z_NULL;
 	zst.opaque = Z_NULL;
-	zst.next_out = (Byte *)output;
 	zst.next_in = (Byte *)buf;
-	zst.avail_out = ZLIB_CHUNK;
+	zst.avail_in = (uInt)buflen;
+	zst.next_out = (Byte *)output;
+	zst.avail_out = (uInt)output_size;
 
 	if (inflateInit(&zst) != Z_OK) goto error;
 
 	/* Decompress input buffer */
-	do {
-		if ((err = inflate(&zst, Z_NO_FLUSH)) == Z_OK) { /* Need more memory */
-			zst.avail_out = (uInt)output_size;
+	while ((err = inflate(&zst, Z_NO_FLUSH)) != Z_STREAM_END) {
+		uint8_t *grown;
 
-			/* Double size each time to avoid calls to realloc() */
-			output_size <<= 1;
-			output = realloc(output, output_size + 1);
-			if (output == NULL) return NULL;
-
-			zst.next_out = (Byte *)(output + zst.avail_out);
-		} else if (err != Z_STREAM_END) { /* Error decompressing */
+		if (err != Z_OK || zst.avail_in == 0) { /* Error decompressing */
 			if (zst.msg != NULL) {
 				fprintf(stderr, "Could not decompress data: %s\n", zst.msg);
 			}
 			inflateEnd(&zst);
 			goto error;
 		}
-	} while (err != Z_STREAM_END);
+
+		if (zst.avail_out == 0) { /* Need more memory */
+			/* Double size each time to avoid calls to realloc() */
+			grown = realloc(output, output_size << 1);
+			if (grown == NULL) {
+				inflateEnd(&zst);
+				goto error;
+			}
+
+			output = grown;
+			zst.next_out = (Byte *)(output + output_size);
+			zst.avail_out = (uInt)output_size;
+			output_size <<= 1;
+		}
+	}
 
 	if (len != NULL) *len = zst.total_out;
 	if (inflateEnd(&zst) != Z_OK) goto error;
@@ -56,6 +64,47 @@ error:
 	return NULL;
 }
 
+int zlib_decompress_into(const uint8_t *buf, size_t buflen,
+                         uint8_t *dest, size_t destlen)
+{
+	z_stream zst;
+	int err;
+	uint8_t extra;
+
+	assert(buf != NULL);
+	assert(dest != NULL);
+
+	if (buflen > UINT32_MAX || destlen > UINT32_MAX) return -1;
+
+	zst.zalloc = Z_NULL;
+	zst.zfree = Z_NULL;
+	zst.opaque = Z_NULL;
+	zst.next_in = (Byte *)buf;
+	zst.avail_in = (uInt)buflen;
+
+	if (inflateInit(&zst) != Z_OK) return -1;
+
+	zst.next_out = (Byte *)dest;
+	zst.avail_out = (uInt)destlen;
+	err = inflate(&zst, Z_FINISH);
+
+	/* If the output is full, make sure nothing more was coming (and reach the
+	 * checksum, if there is one). */
+	if (err == Z_BUF_ERROR && zst.avail_out == 0) {
+		zst.next_out = &extra;
+		zst.avail_out = 1;
+		err = inflate(&zst, Z_FINISH);
+		if (err == Z_BUF_ERROR && zst.avail_out == 1 && zst.avail_in == 0) {
+			err = Z_STREAM_END; /* Truncated checksum. */
+		} else if (zst.avail_out == 0) {
+			err = Z_DATA_ERROR; /* Too much data. */
+		}
+	}
+
+	inflateEnd(&zst);
+	return err == Z_STREAM_END && zst.total_out == destlen ? 0 : -1;
+}
+
 uint8_t *zlib_compress(const uint8_t *buf, const size_t buflen, int level,
                        size_t *len)
 {
@@ -67,19 +116,25 @@ uint8_t *zlib_compress(const uint8_t *buf, const size_t buflen, int level,
 	assert(len != NULL);
 	assert(level <= 9 && level >= 0);
 
-	zst.avail_out = (uInt)((buflen + (buflen / 10)) + 12);
-	output = malloc(zst.avail_out);
-	if (output == NULL) return NULL;
-
 	/* Set deflate state */
 	zst.zalloc = Z_NULL;
 	zst.zfree = Z_NULL;
+	zst.opaque = Z_NULL;
+
+	if (buflen > UINT32_MAX || deflateInit(&zst, level) != Z_OK) return NULL;
+
+	/* Allocate the worst case up front, so it is done in one pass. */
+	zst.avail_out = (uInt)deflateBound(&zst, (uLong)buflen);
+	output = malloc(zst.avail_out);
+	if (output == NULL) {
+		deflateEnd(&zst);
+		return NULL;
+	}
+
 	zst.next_out = (Byte *)output;
 	zst.next_in = (Byte *)buf;
 	zst.avail_in = (uInt)buflen;
 
-	if (deflateInit(&zst, level) != Z_OK) goto error;
-
 	/* Compress input buffer */
 	if (deflate(&zst, Z_FINISH) != Z_STREAM_END) {
 		if (zst.msg != NULL) {
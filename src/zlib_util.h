@@ -10,12 +10,27 @@
 	#include <stdint.h>
 #endif
 
-/* Attempts to decompress given deflated NUL-terminated buffer.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Attempts to decompress the |buflen| bytes of deflated data in |buf|.
  *
  * If successful and |len| is not NULL, |len| will be set to the number of
  * bytes in the returned buffer.
  * Returns new string to be free()'d by caller, or NULL on error. */
-uint8_t *zlib_decompress(const uint8_t *buf, size_t *len);
+uint8_t *zlib_decompress(const uint8_t *buf, size_t buflen, size_t *len);
+
+/* Decompresses the |buflen| bytes of deflated data in |buf| straight into
+ * |dest|, when the size of the output is known up front. Returns 0 if
+ * exactly |destlen| bytes came out, or -1 on error.
+ *
+ * The checksum at the end of the stream isn't required, as strings written
+ * by older versions of createStringFromMMBitmap() lack its last byte; a
+ * checksum that is there has to match. */
+int zlib_decompress_into(const uint8_t *buf, size_t buflen,
+                         uint8_t *dest, size_t destlen);
 
 /* Attempt to compress given buffer.
  *
@@ -29,4 +44,8 @@ uint8_t *zlib_decompress(const uint8_t *buf, size_t *len);
 uint8_t *zlib_compress(const uint8_t *buf, const size_t buflen, int level,
                        size_t *len);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* ZLIB_UTIL_H */
@@ -53,4 +53,244 @@ describe('Bitmap', () => {
 		expect(() => img.colorAt(9999999999999, 0)).toThrowError(/are outside the bitmap/);
 		expect(() => img.colorAt(0, 9999999999999)).toThrowError(/are outside the bitmap/);
 	});
+
+	it('Crop a bitmap and find the crop in it.', function()
+	{
+		var img = robot.screen.capture(0, 0, 40, 40);
+		var crop = img.crop(10, 5, 8, 6);
+
+		expect(crop instanceof robot.Bitmap).toBeTruthy();
+		expect(crop.width).toEqual(8);
+		expect(crop.height).toEqual(6);
+		expect(crop.colorAt(2, 3)).toEqual(img.colorAt(12, 8));
+		expect(crop.crop(2, 3, 1, 1).colorAt(0, 0)).toEqual(img.colorAt(12, 8));
+
+		// A crop is a view of the same pixels, rows and all.
+		expect(crop.byteWidth).toEqual(img.byteWidth);
+		expect(crop.image.length).toEqual(img.byteWidth * 5 + 8 * img.bytesPerPixel);
+		expect(() => img.crop(35, 0, 10, 10)).toThrowError(/are outside the bitmap/);
+
+		var match = img.find(crop);
+		expect(match).not.toBeNull();
+		expect(crop.colorAt(0, 0)).toEqual(img.colorAt(match.x, match.y));
+		expect(img.find(crop, { x: 10, y: 5, width: 8, height: 6 })).toEqual({ x: 10, y: 5 });
+		expect(() => img.find(crop, { x: 0, y: 0, width: 41, height: 40 })).toThrowError(/are outside the bitmap/);
+	});
+
+	it('Search without the heap once warm.', function()
+	{
+		var img = robot.screen.capture(0, 0, 100, 100);
+		var needle = img.crop(40, 40, 16, 16);
+
+		img.find(needle);
+		robot.resetStats();
+		for (var i = 0; i < 5; i++)
+		{
+			img.find(needle);
+			img.find(needle, { tolerance: 0.2 });
+			robot.getScreenSize();
+		}
+
+		// Each search takes scratch from the arena for the needle's anchor, and
+		// once warm the arena has all it needs without going to the heap.
+		var arena = robot.getStats().arena;
+		expect(arena.allocations >= 10).toBeTruthy();
+		expect(arena.heapAllocations).toEqual(0);
+	});
+
+	it('Only make the image buffer when asked for.', function()
+	{
+		var img = robot.screen.capture(0, 0, 10, 10);
+
+		robot.resetStats();
+		img.colorAt(1, 1);
+		expect(robot.getStats().convert.count).toEqual(0);
+
+		var image = img.image;
+		expect(Buffer.isBuffer(image)).toBeTruthy();
+		expect(image.length).toEqual(img.byteWidth * img.height);
+		expect(img.image).toBe(image);
+		expect(robot.getStats().convert.count).toEqual(1);
+
+		var copy = new robot.Bitmap(img.width, img.height, img.byteWidth, img.bitsPerPixel, img.bytesPerPixel, Buffer.from(image));
+		expect(copy.colorAt(3, 4)).toEqual(img.colorAt(3, 4));
+		expect(() => new robot.Bitmap(10, 10, 40, 32, 4, Buffer.alloc(4))).toThrowError(/Invalid bitmap/);
+	});
+
+	it('Encode a bitmap as PNG.', function()
+	{
+		var img = robot.screen.capture(0, 0, 10, 10);
+
+		expect(() => img.toPNG({ level: 10 })).toThrowError(/Invalid compression level/);
+		expect(() => img.toPNG({ filter: 'median' })).toThrowError(/Invalid PNG filter/);
+
+		return img.toPNG({ level: 1, filter: 'up' }).then(function(png)
+		{
+			expect(png.slice(0, 8)).toEqual(Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]));
+			expect(png.readUInt32BE(16)).toEqual(img.width);
+			expect(png.readUInt32BE(20)).toEqual(img.height);
+		});
+	});
+
+	it('Encode a bitmap as PNG on several threads.', function()
+	{
+		var img = robot.screen.capture(0, 0, 100, 100);
+
+		expect(() => img.toPNG({ threads: -1 })).toThrowError(/Invalid thread count/);
+
+		return Promise.all([
+			img.toPNG({ level: 1 }),
+			img.toPNG({ level: 1, threads: 4 })
+		]).then(function(pngs)
+		{
+			// Same header, and both decode to the same size.
+			expect(pngs[1].slice(0, 24)).toEqual(pngs[0].slice(0, 24));
+		});
+	});
+
+	it('Stream a bitmap as PNG and BMP.', function()
+	{
+		var img = robot.screen.capture(0, 0, 100, 100);
+
+		expect(() => img.toStream({ format: 'gif' })).toThrowError(/Invalid image format/);
+		expect(() => img.toStream({ chunkSize: 10 })).toThrowError(/Invalid chunk size/);
+
+		// An encoder is no bitmap, and only encoders can be read from.
+		var encoder = robot.createImageEncoder(img);
+		expect(() => new robot.Bitmap(encoder)).toThrowError(/Invalid number of arguments/);
+		expect(() => robot.readImageEncoder({})).toThrowError(/Expected an image encoder/);
+
+		function collect(stream)
+		{
+			var chunks = [];
+			return new Promise(function(resolve, reject)
+			{
+				stream.on('data', function(chunk) { chunks.push(chunk); });
+				stream.on('end', function() { resolve(chunks); });
+				stream.on('error', reject);
+			});
+		}
+
+		return Promise.all([
+			collect(img.toStream({ chunkSize: 256 })),
+			collect(img.toStream({ format: 'bmp', chunkSize: 256 }))
+		]).then(function(results)
+		{
+			var png = Buffer.concat(results[0]);
+			expect(png.slice(0, 8)).toEqual(Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]));
+			expect(png.readUInt32BE(16)).toEqual(img.width);
+			expect(png.slice(-8, -4).toString()).toEqual('IEND');
+			expect(results[0][0].length).toEqual(256);
+
+			var bmp = Buffer.concat(results[1]);
+			expect(bmp.slice(0, 2).toString()).toEqual('BM');
+			expect(bmp.readUInt32LE(2)).toEqual(bmp.length);
+			expect(bmp.readInt32LE(22)).toEqual(-img.height);
+		});
+	});
+
+	it('Save and map a bitmap file.', function()
+	{
+		var path = require('path').join(require('os').tmpdir(), 'robotjs-test.mmb');
+		var img = robot.screen.capture(0, 0, 20, 10);
+
+		robot.saveMappedBitmap(img, path);
+		var mapped = robot.mapBitmap(path);
+
+		expect(mapped.width).toEqual(img.width);
+		expect(mapped.height).toEqual(img.height);
+		expect(mapped.bytesPerPixel).toEqual(4);
+		expect(mapped.byteWidth % 16).toEqual(0);
+		expect(mapped.colorAt(5, 5)).toEqual(img.colorAt(5, 5));
+		expect(mapped.colorAt(mapped.signature.anchorX, mapped.signature.anchorY)).toEqual(mapped.signature.anchorColor);
+
+		// Searches start from the signature's anchor, and ignore one that is off the bitmap.
+		expect(img.find(mapped)).toEqual({ x: 0, y: 0 });
+		mapped.signature = { anchorX: 20, anchorY: -1 };
+		expect(img.find(mapped)).toEqual({ x: 0, y: 0 });
+
+		expect(() => robot.mapBitmap(path + '.missing')).toThrowError(/Could not open file/);
+	});
+
+	it('Refuse to map truncated or bad-offset bitmap files.', function()
+	{
+		var fs = require('fs');
+		var path = require('path').join(require('os').tmpdir(), 'robotjs-test-bad.mmb');
+		var img = new robot.Bitmap(4, 4, 16, 32, 4, Buffer.alloc(64, 0x7f));
+
+		robot.saveMappedBitmap(img, path);
+		var file = fs.readFileSync(path);
+
+		fs.writeFileSync(path, file.slice(0, file.length - 1));
+		expect(() => robot.mapBitmap(path)).toThrowError(/truncated/);
+
+		// The pixels' offset, far past the end of the file.
+		var badOffset = Buffer.from(file);
+		badOffset.writeUInt16LE(0xFFF0, 6);
+		fs.writeFileSync(path, badOffset);
+		expect(() => robot.mapBitmap(path)).toThrowError(/truncated/);
+
+		fs.unlinkSync(path);
+	});
+
+	it('Save a bitmap as BMP and read BMP files back.', function()
+	{
+		var fs = require('fs');
+		var dir = require('os').tmpdir();
+		var img = robot.screen.capture(0, 0, 20, 10);
+
+		robot.saveBitmapFile(img, require('path').join(dir, 'robotjs-test.bmp'));
+		var read = robot.readBitmap(require('path').join(dir, 'robotjs-test.bmp'));
+		expect(read.width).toEqual(img.width);
+		expect(read.height).toEqual(img.height);
+		expect(read.colorAt(7, 3)).toEqual(img.colorAt(7, 3));
+
+		// A bottom-up 2x2 8-bit file: red and green on top, blue and white below.
+		var header = Buffer.alloc(54);
+		var palette = Buffer.from([0, 0, 255, 0, 0, 255, 0, 0, 255, 0, 0, 0, 255, 255, 255, 0]);
+		var pixels = Buffer.from([2, 3, 0, 0, 0, 1, 0, 0]);
+		header.write('BM', 0);
+		header.writeUInt32LE(54 + palette.length + pixels.length, 2);
+		header.writeUInt32LE(54 + palette.length, 10);
+		header.writeUInt32LE(40, 14);
+		header.writeInt32LE(2, 18);
+		header.writeInt32LE(2, 22);
+		header.writeUInt16LE(1, 26);
+		header.writeUInt16LE(8, 28);
+		header.writeUInt32LE(4, 46);
+		fs.writeFileSync(require('path').join(dir, 'robotjs-test-8.bmp'), Buffer.concat([header, palette, pixels]));
+
+		var indexed = robot.readBitmap(require('path').join(dir, 'robotjs-test-8.bmp'));
+		expect(indexed.bitsPerPixel).toEqual(32);
+		expect(indexed.colorAt(0, 0)).toEqual('#ff0000');
+		expect(indexed.colorAt(1, 0)).toEqual('#00ff00');
+		expect(indexed.colorAt(0, 1)).toEqual('#0000ff');
+		expect(indexed.colorAt(1, 1)).toEqual('#ffffff');
+
+		// RLE8 data that ends straight away (0, 1) can claim any size; a huge one is refused.
+		header.writeInt32LE(60000, 18);
+		header.writeInt32LE(60000, 22);
+		header.writeUInt32LE(1, 30);
+		fs.writeFileSync(require('path').join(dir, 'robotjs-test-rle.bmp'), Buffer.concat([header, palette, Buffer.from([0, 1])]));
+		expect(() => robot.readBitmap(require('path').join(dir, 'robotjs-test-rle.bmp'))).toThrowError(/Invalid dimensions/);
+
+		expect(() => robot.readBitmap(require('path').join(dir, 'robotjs-test.missing.bmp'))).toThrowError(/Could not open file/);
+	});
+
+	it('Convert a bitmap to a string and back.', function()
+	{
+		var img = robot.screen.capture(0, 0, 20, 10);
+		var string = img.toString();
+
+		expect(string).toMatch(/^b20,10,[A-Za-z0-9+\/]+=*$/);
+
+		var decoded = robot.bitmapFromString(string);
+		expect(decoded.width).toEqual(img.width);
+		expect(decoded.height).toEqual(img.height);
+		expect(decoded.bytesPerPixel).toEqual(3);
+		expect(decoded.colorAt(7, 3)).toEqual(img.colorAt(7, 3));
+
+		expect(() => robot.bitmapFromString('b20,10')).toThrowError(/Invalid header/);
+		expect(() => robot.bitmapFromString('b20,11,' + string.split(',')[2])).toThrowError(/Error decompressing/);
+	});
 });
@@ -38,4 +38,40 @@ describe('Keyboard', () => {
       }
     }
   });
+
+  // This it won't fail if there's an issue, but it will help you identify an issue if ran locally.
+  it('Type characters outside the keyboard layout.', function()
+  {
+    expect(() => robot.typeString('!?é€😀')).not.toThrow();
+  });
+
+  // JS strings always reach the addon as valid UTF-8 (a lone surrogate becomes
+  // U+FFFD), so malformed input can't be sent from here.
+  it('Type strings with Latin-1 characters and lone surrogates.', function()
+  {
+    expect(() => robot.typeString(Buffer.from([0x61, 0xc0, 0xaf, 0x62]).toString('latin1'))).not.toThrow();
+    expect(() => robot.typeString('a\ud800b\udc00')).not.toThrow();
+    expect(() => robot.typeStringDelayed('aé€', 6000)).not.toThrow();
+  });
+
+  it('Decode UTF-8 the way typeString does.', function()
+  {
+    // Valid two, three and four byte sequences.
+    expect(robot.decodeUTF8(Buffer.from('aé€😀'))).toEqual([0x61, 0xe9, 0x20ac, 0x1f600]);
+    // Truncated sequences: at the end of the input, and cut short by an ASCII byte.
+    expect(robot.decodeUTF8(Buffer.from([0x61, 0xe2, 0x82]))).toEqual([0x61, 0xfffd, 0xfffd]);
+    expect(robot.decodeUTF8(Buffer.from([0xf0, 0x9f, 0x98, 0x61]))).toEqual([0xfffd, 0xfffd, 0xfffd, 0x61]);
+    // Overlong forms of '/' and of NUL, a surrogate and a value past U+10FFFF.
+    expect(robot.decodeUTF8(Buffer.from([0xc0, 0xaf, 0xe0, 0x80, 0xaf]))).toEqual([0xfffd, 0xfffd, 0xfffd, 0xfffd, 0xfffd]);
+    expect(robot.decodeUTF8(Buffer.from([0xc0, 0x80, 0x62]))).toEqual([0xfffd, 0xfffd, 0x62]);
+    expect(robot.decodeUTF8(Buffer.from([0xed, 0xa0, 0x80]))).toEqual([0xfffd, 0xfffd, 0xfffd]);
+    expect(robot.decodeUTF8(Buffer.from([0xf4, 0x90, 0x80, 0x80]))).toEqual([0xfffd, 0xfffd, 0xfffd, 0xfffd]);
+    // Lone continuation bytes, and bytes that never start a sequence.
+    expect(robot.decodeUTF8(Buffer.from([0x80, 0x61, 0xbf, 0xff, 0xf8]))).toEqual([0xfffd, 0x61, 0xfffd, 0xfffd, 0xfffd]);
+    // Decoding stops at the first NUL.
+    expect(robot.decodeUTF8(Buffer.from([0x61, 0x00, 0x62]))).toEqual([0x61]);
+    expect(robot.decodeUTF8(Buffer.alloc(0))).toEqual([]);
+
+    expect(() => robot.decodeUTF8('a')).toThrowError(/Expected a Buffer/);
+  });
 });
@@ -0,0 +1,71 @@
+var robot = require('..');
+
+describe('Macro', () => {
+  it('Compile a macro.', function()
+  {
+    var macro = robot.compileMacro([
+      { type: 'moveMouse', x: 100, y: 100 },
+      { type: 'keyTap', key: 'a', modifier: 'shift', delay: 10 },
+      { type: 'keyToggle', key: 'shift', down: 'down' },
+      { type: 'keyToggle', key: 'shift', down: 'up', delay: 5 },
+      { type: 'delay', ms: 20 }
+    ]);
+
+    expect(Buffer.isBuffer(macro)).toBeTruthy();
+    expect(macro.toString('ascii', 0, 4)).toEqual('RJMC');
+  });
+
+  it('Reject invalid events.', function()
+  {
+    expect(function()
+    {
+      robot.compileMacro([{ type: 'keyTap', key: 'notakey' }]);
+    }).toThrowError(/Invalid key code specified\. \(event 0\)/);
+
+    expect(function()
+    {
+      robot.compileMacro([{ type: 'delay' }, { type: 'jump' }]);
+    }).toThrowError(/event 1/);
+
+    expect(function()
+    {
+      robot.compileMacro([{ type: 'moveMouse', x: 1 }]);
+    }).toThrowError(/Missing x or y/);
+
+    [-1, NaN, Infinity, 5e6].forEach(function(delay)
+    {
+      expect(function()
+      {
+        robot.compileMacro([{ type: 'keyTap', key: 'a', delay: delay }]);
+      }).toThrowError(RangeError);
+    });
+
+    expect(function()
+    {
+      robot.compileMacro([{ type: 'delay', delay: 3e6, ms: 3e6 }]);
+    }).toThrowError(/Delays must be from 0 to 4294967 ms\. \(event 0\)/);
+
+    expect(function()
+    {
+      robot.playMacro(Buffer.alloc(8));
+    }).toThrowError(/Invalid compiled macro/);
+  });
+
+  it('Play a macro on schedule.', function()
+  {
+    var macro = robot.compileMacro([
+      { type: 'moveMouse', x: 100, y: 100 },
+      { type: 'moveMouse', x: 110, y: 110, delay: 20 },
+      { type: 'delay', ms: 30 }
+    ]);
+    var stats = robot.playMacro(macro);
+
+    expect(stats.count).toEqual(3);
+    expect(stats.scheduled[2]).toEqual(50);
+    expect(stats.actual[2] >= 50).toBeTruthy();
+    expect(stats.elapsed >= 50).toBeTruthy();
+
+    var pos = robot.getMousePos();
+    expect(pos.x === 110 && pos.y === 110).toBeTruthy();
+  });
+});
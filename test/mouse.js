@@ -122,4 +122,20 @@ describe('Mouse', () => {
     expect(lastKnownPos = robot.getMousePos()).toBeTruthy();
     expect(robot.mouseToggle('up', 'right') === 1).toBeTruthy();
   });
+
+  it('Set the timer spin window.', function()
+  {
+    expect(robot.setSpinWindow(0.2)).toBeTruthy();
+    expect(robot.setSpinWindow(0)).toBeTruthy();
+
+    expect(function()
+    {
+      robot.setSpinWindow();
+    }).toThrowError(/Invalid number/);
+
+    expect(function()
+    {
+      robot.setSpinWindow('0.2');
+    }).toThrowError(/Expected a spin window/);
+  });
 });
@@ -30,6 +30,137 @@ describe('Screen', () => {
     }).toThrowError(/Invalid number/);
   });
 
+  it('Get many pixel colors at once.', function()
+  {
+    var size = robot.getScreenSize();
+    var points = [
+      { x: 5, y: 5 },
+      { x: size.width - 1, y: size.height - 1 },
+      { x: 6, y: 5 },
+      { x: size.width >> 1, y: size.height >> 1 }
+    ];
+
+    var colors = robot.getPixelColors(points);
+    expect(colors instanceof Uint32Array).toBeTruthy();
+    expect(colors.length).toEqual(points.length);
+
+    points.forEach(function(point, i)
+    {
+      var hex = robot.getPixelColor(point.x, point.y).replace('#', '');
+      expect(colors[i]).toEqual(parseInt(hex, 16));
+    });
+
+    var pairs = new Int32Array([6, 5, 5, 5]);
+    expect(Array.from(robot.getPixelColors(pairs))).toEqual([colors[2], colors[0]]);
+    expect(robot.getPixelColors([]).length).toEqual(0);
+
+    expect(function()
+    {
+      robot.getPixelColors([{ x: 0, y: 0 }, { x: -1, y: 0 }]);
+    }).toThrowError(/index 1 is outside the main screen/);
+
+    expect(function()
+    {
+      robot.getPixelColors([{ x: 0 }]);
+    }).toThrowError(/Invalid point at index 0/);
+
+    expect(function()
+    {
+      robot.getPixelColors(new Int32Array(3));
+    }).toThrowError(/Int32Array of x, y pairs/);
+  });
+
+  it('Answer repeated pixel reads from the screen cache.', function()
+  {
+    var expected = robot.getPixelColor(5, 5);
+    robot.resetStats();
+
+    expect(robot.setScreenCache(60000)).toBeTruthy();
+    expect(robot.getPixelColor(5, 5)).toEqual(expected);
+    expect(robot.getPixelColor(5, 5)).toEqual(expected);
+    expect(robot.getPixelColors([{ x: 5, y: 5 }])[0]).toEqual(parseInt(expected.slice(1), 16));
+
+    var stats = robot.getStats().screenCache;
+    expect(stats.misses).toEqual(1);
+    expect(stats.hits).toEqual(2);
+    expect(stats.ttlMs).toEqual(60000);
+    expect(stats.ageMs >= 0).toBeTruthy();
+
+    robot.invalidateScreenCache();
+    expect(robot.getStats().screenCache.ageMs).toEqual(-1);
+    robot.getPixelColor(5, 5);
+    expect(robot.getStats().screenCache.misses).toEqual(2);
+
+    robot.setScreenCache({ ttl: 60000, x: 0, y: 0, width: 4, height: 4 });
+    robot.getPixelColor(5, 5);
+    expect(robot.getStats().screenCache.bypasses).toEqual(1);
+
+    expect(robot.setScreenCache(false)).toEqual(false);
+    expect(robot.getStats().screenCache.ttlMs).toEqual(0);
+
+    expect(function()
+    {
+      robot.setScreenCache({ ttl: 100, x: 0 });
+    }).toThrowError(/needs x, y/);
+  });
+
+  it('Wait for a pixel color.', function()
+  {
+    var color = robot.getPixelColor(5, 5);
+
+    return robot.waitForPixel({ x: 5, y: 5, color: color, timeoutMs: 1000 }).then(function(match)
+    {
+      expect(match).toEqual({ x: 5, y: 5, color: color });
+    });
+  });
+
+  it('Time out waiting for pixels.', function()
+  {
+    var color = parseInt(robot.getPixelColor(5, 5).slice(1), 16);
+    var conditions = [
+      { x: 5, y: 5, color: color ^ 0xffffff },
+      { x: 0, y: 0, width: 4, height: 4, color: color ^ 0xffffff, tolerance: 0 }
+    ];
+
+    expect(function()
+    {
+      robot.waitForPixel({ x: -1, y: 0, color: 0 });
+    }).toThrowError(/outside the main screen/);
+
+    expect(function()
+    {
+      robot.waitForPixels([{ x: 0, y: 0, color: 'red' }]);
+    }).toThrowError(/Condition 0: Invalid color/);
+
+    [NaN, Infinity, -1, 1e20].forEach(function(timeoutMs)
+    {
+      expect(function()
+      {
+        robot.waitForPixel({ x: 5, y: 5, color: color, timeoutMs: timeoutMs });
+      }).toThrowError(/Invalid timeoutMs/);
+    });
+
+    return robot.waitForPixels(conditions, { all: true, timeoutMs: 50 }).then(function(matches)
+    {
+      expect(matches).toEqual(null);
+    });
+  });
+
+  it('Wait for a bitmap.', function()
+  {
+    var needle = robot.screen.capture(20, 20, 8, 8);
+
+    expect(function()
+    {
+      robot.waitForBitmap(needle, { x: 0, y: 0, width: 4, height: 4 });
+    }).toThrowError(/larger than the region/);
+
+    return robot.waitForBitmap(needle, { x: 20, y: 20, width: 8, height: 8, timeoutMs: 1000 }).then(function(match)
+    {
+      expect(match).toEqual({ x: 20, y: 20 });
+    });
+  });
+
   it('Get screen size.', function()
   {
     expect(screenSize = robot.getScreenSize()).toBeTruthy();
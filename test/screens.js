@@ -54,4 +54,67 @@ describe("Screen Detection", () => {
         
         expect(mainScreen).toBeDefined();
     });
-}); 
\ No newline at end of file
+    
+    test("captureAllScreens should stitch every screen into one bitmap", () => {
+        const screens = robot.getScreens();
+        const desktop = robot.captureAllScreens();
+
+        expect(desktop.bitmap).toBeInstanceOf(robot.Bitmap);
+        expect(desktop.screens.length).toBe(screens.length);
+        expect(desktop.x).toBe(Math.min(...screens.map(screen => screen.x)));
+        expect(desktop.y).toBe(Math.min(...screens.map(screen => screen.y)));
+
+        // Pixels per point, 1 but for HiDPI displays.
+        const scale = desktop.screens[0].bitmap.width / screens[0].width;
+        const right = Math.max(...screens.map(screen => screen.x + screen.width));
+        const bottom = Math.max(...screens.map(screen => screen.y + screen.height));
+        expect(desktop.bitmap.width).toBe(Math.round((right - desktop.x) * scale));
+        expect(desktop.bitmap.height).toBe(Math.round((bottom - desktop.y) * scale));
+
+        desktop.screens.forEach((screen, index) => {
+            const { bitmap, ...info } = screen;
+            expect(info).toEqual(screens[index]);
+            expect(bitmap.width).toBe(Math.round(screen.width * scale));
+            expect(bitmap.height).toBe(Math.round(screen.height * scale));
+            // A view into the desktop's pixels, so the same colors.
+            expect(bitmap.colorAt(0, 0)).toBe(desktop.bitmap.colorAt(
+                Math.round((screen.x - desktop.x) * scale),
+                Math.round((screen.y - desktop.y) * scale)));
+        });
+    });
+    
+    test("screenschange listeners can be added and removed", () => {
+        const listener = jest.fn();
+        const subscribe = jest.spyOn(robot, "setScreensChangeListener");
+
+        try {
+            // Only the first listener subscribes natively, and only the last unsubscribes.
+            expect(robot.on("screenschange", listener)).toBe(robot);
+            expect(robot.once("screenschange", listener)).toBe(robot);
+            expect(subscribe).toHaveBeenCalledTimes(1);
+            expect(subscribe).toHaveBeenLastCalledWith(expect.any(Function));
+            expect(typeof subscribe.mock.results[0].value).toBe("boolean");
+
+            expect(robot.off("screenschange", listener)).toBe(robot);
+            expect(subscribe).toHaveBeenCalledTimes(1);
+            expect(robot.removeAllListeners("screenschange")).toBe(robot);
+            expect(subscribe).toHaveBeenCalledTimes(2);
+            expect(subscribe).toHaveBeenLastCalledWith(null);
+
+            // Removing every listener of every event mustn't stop later ones subscribing.
+            robot.on("screenschange", listener);
+            expect(robot.removeAllListeners()).toBe(robot);
+            expect(subscribe).toHaveBeenLastCalledWith(null);
+            robot.on("screenschange", listener);
+            expect(subscribe).toHaveBeenCalledTimes(5);
+            expect(subscribe).toHaveBeenLastCalledWith(expect.any(Function));
+            robot.off("screenschange", listener);
+            expect(subscribe).toHaveBeenLastCalledWith(null);
+        } finally {
+            subscribe.mockRestore();
+        }
+
+        // Nothing has changed, so nothing was emitted.
+        expect(listener).not.toHaveBeenCalled();
+    });
+});
\ No newline at end of file
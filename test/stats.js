@@ -0,0 +1,41 @@
+var robot = require('..');
+
+describe('Stats', () => {
+  var operations = ['capture', 'convert', 'object', 'mouse', 'keyboard'];
+  var fields = ['count', 'bytes', 'totalMs', 'meanMs', 'maxMs', 'p50Ms', 'p90Ms', 'p99Ms', 'p999Ms'];
+
+  it('Report every operation, empty after a reset.', function()
+  {
+    robot.resetStats();
+    var stats = robot.getStats();
+
+    operations.forEach(function(operation)
+    {
+      fields.forEach(function(field)
+      {
+        expect(stats[operation][field]).toEqual(0);
+      });
+    });
+  });
+
+  it('Count captures and input.', function()
+  {
+    robot.resetStats();
+    // Captures stay native until their image is read.
+    robot.captureScreen(0, 0, 10, 10).image;
+    robot.getPixelColor(5, 5);
+    robot.moveMouse(5, 5);
+
+    var stats = robot.getStats();
+    expect(stats.capture.count).toEqual(2);
+    expect(stats.capture.bytes >= 10 * 10 * 3 + 3).toBeTruthy();
+    expect(stats.convert.count).toEqual(2);
+    expect(stats.object.count).toEqual(2);
+    expect(stats.mouse.count).toEqual(1);
+    expect(stats.keyboard.count).toEqual(0);
+
+    expect(stats.capture.totalMs > 0).toBeTruthy();
+    expect(stats.capture.p50Ms <= stats.capture.p99Ms).toBeTruthy();
+    expect(stats.capture.p99Ms <= stats.capture.maxMs).toBeTruthy();
+  });
+});